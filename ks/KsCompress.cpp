@@ -0,0 +1,459 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <ks/KsCompress.hpp>
+
+namespace ks
+{
+    namespace
+    {
+        size_t const k_min_match = 4;
+
+        // The format requires the last 5 bytes to be literals
+        // and the last match to start 12 bytes before the end
+        size_t const k_last_literals = 5;
+        size_t const k_match_find_limit = 12;
+
+        uint const k_hash_bits = 12;
+        size_t const k_max_offset = 65535;
+
+        inline u32 Read32(u8 const * p)
+        {
+            u32 val;
+            std::memcpy(&val,p,sizeof(val));
+            return val;
+        }
+
+        inline uint Hash(u32 seq)
+        {
+            return (seq*2654435761u) >> (32-k_hash_bits);
+        }
+
+        inline void WriteLength(u8 * &out, size_t length)
+        {
+            while(length >= 255) {
+                *out++ = 255;
+                length -= 255;
+            }
+            *out++ = static_cast<u8>(length);
+        }
+
+        void WriteSequence(u8 * &out,
+                           u8 const * literals,
+                           size_t literal_size,
+                           size_t offset,
+                           size_t match_size)
+        {
+            // match_size of zero means a final literal run
+            size_t const match_code =
+                    (match_size > 0) ? (match_size-k_min_match) : 0;
+
+            u8 * token = out++;
+            *token = static_cast<u8>(
+                        (std::min(literal_size,size_t(15)) << 4) |
+                        std::min(match_code,size_t(15)));
+
+            if(literal_size >= 15) {
+                WriteLength(out,literal_size-15);
+            }
+
+            if(literal_size > 0) {
+                // @literals can be null for empty input
+                std::memcpy(out,literals,literal_size);
+                out += literal_size;
+            }
+
+            if(match_size > 0) {
+                *out++ = static_cast<u8>(offset & 0xFF);
+                *out++ = static_cast<u8>(offset >> 8);
+
+                if(match_code >= 15) {
+                    WriteLength(out,match_code-15);
+                }
+            }
+        }
+
+        // * Reads a length extension; returns false if
+        //   it runs past @end
+        bool ReadLength(u8 const * &in, u8 const * end, size_t &length)
+        {
+            u8 byte;
+            do {
+                if(in == end) {
+                    return false;
+                }
+                byte = *in++;
+                length += byte;
+            }
+            while(byte == 255);
+
+            return true;
+        }
+
+        u32 Checksum(u8 const * data, size_t size)
+        {
+            // FNV-1a
+            u32 hash = 2166136261u;
+            for(size_t i=0; i < size; i++) {
+                hash ^= data[i];
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+
+        void WriteU32(u8 * p, u32 val)
+        {
+            p[0] = static_cast<u8>(val);
+            p[1] = static_cast<u8>(val >> 8);
+            p[2] = static_cast<u8>(val >> 16);
+            p[3] = static_cast<u8>(val >> 24);
+        }
+
+        u32 ReadU32(u8 const * p)
+        {
+            return static_cast<u32>(p[0]) |
+                    (static_cast<u32>(p[1]) << 8) |
+                    (static_cast<u32>(p[2]) << 16) |
+                    (static_cast<u32>(p[3]) << 24);
+        }
+    }
+
+    // ============================================================= //
+
+    size_t GetCompressBound(size_t size)
+    {
+        return size+(size/255)+16;
+    }
+
+    size_t CompressBlock(u8 const * src, size_t size, u8 * dst)
+    {
+        u8 * out = dst;
+        u8 const * anchor = src;
+
+        if(size > k_match_find_limit) {
+            u32 list_positions[1 << k_hash_bits];
+            std::memset(list_positions,0,sizeof(list_positions));
+
+            u8 const * const end = src+size;
+            u8 const * const match_find_end = end-k_match_find_limit;
+            u8 const * const match_end = end-k_last_literals;
+
+            u8 const * ip = src+1;
+            while(ip < match_find_end) {
+                u32 const seq = Read32(ip);
+                uint const hash = Hash(seq);
+                u8 const * match = src+list_positions[hash];
+                list_positions[hash] = static_cast<u32>(ip-src);
+
+                if(match >= ip ||
+                   static_cast<size_t>(ip-match) > k_max_offset ||
+                   Read32(match) != seq)
+                {
+                    // Step faster through data that
+                    // doesn't compress
+                    ip += 1+((ip-anchor) >> 6);
+                    continue;
+                }
+
+                // Extend backwards over literals
+                while(ip > anchor && match > src && ip[-1] == match[-1]) {
+                    ip--;
+                    match--;
+                }
+
+                u8 const * ip_end = ip+k_min_match;
+                u8 const * match_it = match+k_min_match;
+                while(ip_end < match_end && *ip_end == *match_it) {
+                    ip_end++;
+                    match_it++;
+                }
+
+                WriteSequence(out,
+                              anchor,
+                              static_cast<size_t>(ip-anchor),
+                              static_cast<size_t>(ip-match),
+                              static_cast<size_t>(ip_end-ip));
+
+                ip = ip_end;
+                anchor = ip;
+
+                if(ip < match_find_end) {
+                    // Index a position inside the match
+                    list_positions[Hash(Read32(ip-2))] =
+                            static_cast<u32>(ip-2-src);
+                }
+            }
+        }
+
+        WriteSequence(out,anchor,static_cast<size_t>((src+size)-anchor),0,0);
+        return static_cast<size_t>(out-dst);
+    }
+
+    bool DecompressBlock(u8 const * src, size_t src_size,
+                         u8 * dst, size_t dst_size)
+    {
+        u8 const * in = src;
+        u8 const * const in_end = src+src_size;
+        u8 * out = dst;
+        u8 * const out_end = dst+dst_size;
+
+        while(in < in_end) {
+            u8 const token = *in++;
+
+            size_t literal_size = token >> 4;
+            if(literal_size == 15 && !ReadLength(in,in_end,literal_size)) {
+                return false;
+            }
+
+            if(literal_size > static_cast<size_t>(in_end-in) ||
+               literal_size > static_cast<size_t>(out_end-out))
+            {
+                return false;
+            }
+
+            if(literal_size > 0) {
+                std::memcpy(out,in,literal_size);
+                in += literal_size;
+                out += literal_size;
+            }
+
+            if(in == in_end) {
+                break; // final literal run
+            }
+
+            if(in_end-in < 2) {
+                return false;
+            }
+
+            size_t const offset = static_cast<size_t>(in[0]) |
+                    (static_cast<size_t>(in[1]) << 8);
+            in += 2;
+
+            size_t match_size = token & 15;
+            if(match_size == 15 && !ReadLength(in,in_end,match_size)) {
+                return false;
+            }
+            match_size += k_min_match;
+
+            if(offset == 0 ||
+               offset > static_cast<size_t>(out-dst) ||
+               match_size > static_cast<size_t>(out_end-out))
+            {
+                return false;
+            }
+
+            // Matches can overlap their own output (ie runs),
+            // so copy forward a byte at a time in that case
+            u8 const * match = out-offset;
+            if(offset >= match_size) {
+                std::memcpy(out,match,match_size);
+                out += match_size;
+            }
+            else {
+                for(size_t i=0; i < match_size; i++) {
+                    *out++ = *match++;
+                }
+            }
+        }
+
+        return (out == out_end);
+    }
+
+    // ============================================================= //
+
+    void AppendFrameHeader(std::vector<u8> &out)
+    {
+        out.insert(out.end(),
+                   frame_detail::k_magic,
+                   frame_detail::k_magic+4);
+
+        out.push_back(frame_detail::k_version);
+        out.push_back(0);
+        out.push_back(0);
+        out.push_back(0);
+    }
+
+    void AppendFrameBlock(u8 const * data, size_t size,
+                          std::vector<u8> &out)
+    {
+        size_t const header_offset = out.size();
+        out.resize(header_offset+
+                   frame_detail::k_block_header_size+
+                   GetCompressBound(size));
+
+        u8 * const block = &(out[header_offset+frame_detail::k_block_header_size]);
+        size_t stored_size = CompressBlock(data,size,block);
+        u32 stored_flag = 0;
+
+        if(stored_size >= size) {
+            // Incompressible; store as is
+            if(size > 0) {
+                std::memcpy(block,data,size);
+            }
+            stored_size = size;
+            stored_flag = frame_detail::k_stored_flag;
+        }
+
+        u8 * const header = &(out[header_offset]);
+        WriteU32(header,static_cast<u32>(stored_size) | stored_flag);
+        WriteU32(header+4,static_cast<u32>(size));
+        WriteU32(header+8,Checksum(data,size));
+        out.resize(header_offset+frame_detail::k_block_header_size+stored_size);
+    }
+
+    bool CompressFile(std::string const &src_path,
+                      std::string const &dst_path,
+                      size_t block_size)
+    {
+        block_size = std::min(block_size,frame_detail::k_max_block_size);
+
+        std::FILE * src = std::fopen(src_path.c_str(),"rb");
+        if(src == nullptr) {
+            return false;
+        }
+
+        std::FILE * dst = std::fopen(dst_path.c_str(),"wb");
+        if(dst == nullptr) {
+            std::fclose(src);
+            return false;
+        }
+
+        std::vector<u8> buffer(block_size);
+        std::vector<u8> frame;
+        frame.reserve(GetCompressBound(block_size)+frame_detail::k_header_size+
+                      frame_detail::k_block_header_size);
+
+        AppendFrameHeader(frame);
+
+        bool ok = true;
+        while(ok) {
+            size_t const read_size =
+                    std::fread(&(buffer[0]),1,buffer.size(),src);
+
+            if(read_size == 0) {
+                ok = (std::ferror(src) == 0);
+                break;
+            }
+
+            AppendFrameBlock(&(buffer[0]),read_size,frame);
+
+            // Each block is written whole, so a reader of a
+            // partially written file sees complete blocks
+            ok = (std::fwrite(&(frame[0]),1,frame.size(),dst) == frame.size());
+            frame.clear();
+        }
+
+        std::fclose(src);
+        ok = (std::fclose(dst) == 0) && ok;
+
+        return ok;
+    }
+
+    // ============================================================= //
+
+    FrameDecoder::FrameDecoder() :
+        m_valid(true),
+        m_header_read(false)
+    {
+        // empty
+    }
+
+    bool FrameDecoder::Feed(u8 const * data, size_t size, std::string &out)
+    {
+        if(!m_valid) {
+            return false;
+        }
+
+        m_pending.insert(m_pending.end(),data,data+size);
+
+        size_t offset = 0;
+        std::vector<u8> block;
+
+        if(!m_header_read) {
+            if(m_pending.size() < frame_detail::k_header_size) {
+                return true;
+            }
+
+            if(std::memcmp(&(m_pending[0]),frame_detail::k_magic,4) != 0 ||
+               m_pending[4] != frame_detail::k_version)
+            {
+                m_valid = false;
+                return false;
+            }
+
+            m_header_read = true;
+            offset = frame_detail::k_header_size;
+        }
+
+        while(m_pending.size()-offset >= frame_detail::k_block_header_size) {
+            u8 const * header = &(m_pending[offset]);
+            u32 const stored_word = ReadU32(header);
+            size_t const stored_size = stored_word & ~frame_detail::k_stored_flag;
+            size_t const raw_size = ReadU32(header+4);
+            u32 const checksum = ReadU32(header+8);
+
+            if(raw_size > frame_detail::k_max_block_size ||
+               stored_size > GetCompressBound(raw_size))
+            {
+                m_valid = false;
+                return false;
+            }
+
+            size_t const block_size = frame_detail::k_block_header_size+stored_size;
+            if(m_pending.size()-offset < block_size) {
+                break; // wait for the rest of the block
+            }
+
+            u8 const * stored = header+frame_detail::k_block_header_size;
+            block.resize(raw_size);
+
+            bool ok;
+            if(stored_word & frame_detail::k_stored_flag) {
+                ok = (stored_size == raw_size);
+                if(ok && raw_size > 0) {
+                    std::memcpy(&(block[0]),stored,raw_size);
+                }
+            }
+            else {
+                ok = DecompressBlock(stored,stored_size,
+                                     block.data(),raw_size);
+            }
+
+            if(!ok || Checksum(block.data(),raw_size) != checksum) {
+                m_valid = false;
+                return false;
+            }
+
+            out.append(reinterpret_cast<char const*>(block.data()),raw_size);
+            offset += block_size;
+        }
+
+        m_pending.erase(m_pending.begin(),m_pending.begin()+offset);
+        return true;
+    }
+
+    size_t FrameDecoder::GetPendingSize() const
+    {
+        return m_pending.size();
+    }
+
+    // ============================================================= //
+
+} // ks
@@ -0,0 +1,120 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_COMPRESS_HPP
+#define KS_COMPRESS_HPP
+
+#include <string>
+#include <vector>
+
+#include <ks/KsGlobal.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // Block compression
+    // * a fast LZ77 compressor in the LZ4 block format: a
+    //   sequence is a token (literal and match length nibbles),
+    //   the literals, a 16 bit offset and the match length
+    // * favours speed over ratio; text logs typically shrink
+    //   to between a quarter and a tenth of their size
+
+    // * Returns the largest compressed size of @size bytes
+    size_t GetCompressBound(size_t size);
+
+    // * Compresses @size bytes from @src into @dst, which must
+    //   have room for GetCompressBound(@size) bytes; @size
+    //   must be less than 4GB
+    // * Returns the compressed size
+    size_t CompressBlock(u8 const * src, size_t size, u8 * dst);
+
+    // * Decompresses a block that expands to exactly @dst_size
+    //   bytes into @dst
+    // * Returns false if the block is malformed
+    bool DecompressBlock(u8 const * src, size_t src_size,
+                         u8 * dst, size_t dst_size);
+
+    // ============================================================= //
+
+    // Compressed frames
+    // * a stream of independently compressed blocks so that a
+    //   partially written file can be read up to its last
+    //   complete block:
+    //
+    //   header: "KSLZ", u8 version, u8 reserved[3]
+    //   block:  u32 stored size (the high bit is set if the
+    //           block is stored uncompressed), u32 raw size,
+    //           u32 checksum (FNV-1a of the raw data), data
+    //
+    // * integers are little endian
+
+    namespace frame_detail
+    {
+        char const * const k_magic = "KSLZ";
+        u8 const k_version = 1;
+        size_t const k_header_size = 8;
+        size_t const k_block_header_size = 12;
+        u32 const k_stored_flag = 0x80000000;
+
+        // blocks larger than this are rejected
+        size_t const k_max_block_size = 4*1024*1024;
+    }
+
+    // * Appends the frame header to @out
+    void AppendFrameHeader(std::vector<u8> &out);
+
+    // * Compresses @size bytes of @data as one block
+    //   and appends it to @out
+    void AppendFrameBlock(u8 const * data, size_t size,
+                          std::vector<u8> &out);
+
+    // * Compresses the file at @src_path into a frame at
+    //   @dst_path, in blocks of @block_size
+    // * Returns false if either file couldn't be
+    //   accessed; @src_path is left as is
+    bool CompressFile(std::string const &src_path,
+                      std::string const &dst_path,
+                      size_t block_size=256*1024);
+
+    // FrameDecoder
+    // * decompresses a frame that's fed in arbitrarily
+    //   sized pieces
+    class FrameDecoder
+    {
+    public:
+        FrameDecoder();
+
+        // * Appends the data of each complete block to @out
+        // * Returns false if the frame is malformed, after
+        //   which all further input is ignored
+        bool Feed(u8 const * data, size_t size, std::string &out);
+
+        // * Returns the number of bytes received but not yet
+        //   decoded (ie a block that was cut short)
+        size_t GetPendingSize() const;
+
+    private:
+        bool m_valid;
+        bool m_header_read;
+        std::vector<u8> m_pending;
+    };
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_COMPRESS_HPP
@@ -31,6 +31,11 @@
     #endif
 #endif
 
+#if defined(KS_ENV_ANDROID) || defined(KS_ENV_LINUX) || \
+    defined(KS_ENV_APPLE_IOS) || defined(KS_ENV_APPLE_OSX)
+    #define KS_ENV_POSIX 1
+#endif
+
 // thirdparty
 // builds without boost deps using c++11 instead
 #define ASIO_STANDALONE 1
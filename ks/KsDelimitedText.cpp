@@ -0,0 +1,306 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include <ks/KsDelimitedText.hpp>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define KS_DELIMITED_SIMD 1
+    #include <immintrin.h>
+#endif
+
+namespace ks
+{
+    namespace
+    {
+        // Text is indexed in windows of this size, which
+        // also keeps offsets within a u32
+        size_t const k_window_size = 256*1024;
+
+        size_t const k_block_size = 64;
+
+        // * Returns a mask with bit i set if @block[i] is
+        //   @delimiter, '\n' or '"'; @block is k_block_size
+        //   chars
+        using BlockMaskFn = u64(*)(char const * block, char delimiter);
+
+        inline bool IsStructural(char c, char delimiter)
+        {
+            return (c == delimiter || c == '\n' || c == '"');
+        }
+
+        #ifndef KS_DELIMITED_SIMD
+        u64 GetBlockMaskScalar(char const * block, char delimiter)
+        {
+            u64 mask = 0;
+            for(size_t i=0; i < k_block_size; i++) {
+                if(IsStructural(block[i],delimiter)) {
+                    mask |= (u64(1) << i);
+                }
+            }
+            return mask;
+        }
+        #else
+        u64 GetBlockMaskSSE2(char const * block, char delimiter)
+        {
+            __m128i const delim_v = _mm_set1_epi8(delimiter);
+            __m128i const newline_v = _mm_set1_epi8('\n');
+            __m128i const quote_v = _mm_set1_epi8('"');
+
+            u64 mask = 0;
+            for(size_t i=0; i < k_block_size; i += 16) {
+                __m128i const chars = _mm_loadu_si128(
+                            reinterpret_cast<__m128i const*>(block+i));
+
+                __m128i const matches = _mm_or_si128(
+                            _mm_or_si128(_mm_cmpeq_epi8(chars,delim_v),
+                                         _mm_cmpeq_epi8(chars,newline_v)),
+                            _mm_cmpeq_epi8(chars,quote_v));
+
+                mask |= static_cast<u64>(
+                            static_cast<u16>(_mm_movemask_epi8(matches))) << i;
+            }
+            return mask;
+        }
+
+        __attribute__((target("avx2")))
+        u64 GetBlockMaskAVX2(char const * block, char delimiter)
+        {
+            __m256i const delim_v = _mm256_set1_epi8(delimiter);
+            __m256i const newline_v = _mm256_set1_epi8('\n');
+            __m256i const quote_v = _mm256_set1_epi8('"');
+
+            u64 mask = 0;
+            for(size_t i=0; i < k_block_size; i += 32) {
+                __m256i const chars = _mm256_loadu_si256(
+                            reinterpret_cast<__m256i const*>(block+i));
+
+                __m256i const matches = _mm256_or_si256(
+                            _mm256_or_si256(_mm256_cmpeq_epi8(chars,delim_v),
+                                            _mm256_cmpeq_epi8(chars,newline_v)),
+                            _mm256_cmpeq_epi8(chars,quote_v));
+
+                mask |= static_cast<u64>(
+                            static_cast<u32>(_mm256_movemask_epi8(matches))) << i;
+            }
+            return mask;
+        }
+        #endif
+
+        BlockMaskFn GetBlockMaskFn()
+        {
+            #ifdef KS_DELIMITED_SIMD
+            // Chosen once; x86_64 always has SSE2
+            static BlockMaskFn const fn =
+                    __builtin_cpu_supports("avx2") ?
+                        GetBlockMaskAVX2 : GetBlockMaskSSE2;
+            return fn;
+            #else
+            return GetBlockMaskScalar;
+            #endif
+        }
+
+        inline uint CountTrailingZeros(u64 mask)
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+            return static_cast<uint>(__builtin_ctzll(mask));
+            #else
+            uint count = 0;
+            while((mask & 1) == 0) {
+                mask >>= 1;
+                count++;
+            }
+            return count;
+            #endif
+        }
+
+        // * Writes the offsets of the structural chars in
+        //   @data to @positions, which must have room for
+        //   @size entries
+        // * Returns the number of offsets written
+        size_t IndexText(char const * data,
+                         size_t size,
+                         char delimiter,
+                         u32 * positions)
+        {
+            BlockMaskFn const get_block_mask = GetBlockMaskFn();
+            u32 * out = positions;
+
+            size_t offset = 0;
+            for(; offset+k_block_size <= size; offset += k_block_size) {
+                u64 mask = get_block_mask(data+offset,delimiter);
+                while(mask != 0) {
+                    *out++ = static_cast<u32>(offset+CountTrailingZeros(mask));
+                    mask &= mask-1;
+                }
+            }
+
+            // The last partial block
+            for(; offset < size; offset++) {
+                if(IsStructural(data[offset],delimiter)) {
+                    *out++ = static_cast<u32>(offset);
+                }
+            }
+
+            return static_cast<size_t>(out-positions);
+        }
+    }
+
+    // ============================================================= //
+
+    void AppendUnquoted(TextField const &field, std::string &str)
+    {
+        if(!field.quoted) {
+            str.append(field.data,field.size);
+            return;
+        }
+
+        char const * it = field.data;
+        char const * const last = field.data+field.size;
+        while(it != last) {
+            char const * quote = static_cast<char const*>(
+                        std::memchr(it,'"',static_cast<size_t>(last-it)));
+
+            if(quote == nullptr) {
+                str.append(it,last);
+                break;
+            }
+
+            // Keep one of each pair of quotes
+            str.append(it,quote+1);
+            it = quote+1;
+            if(it != last && *it == '"') {
+                ++it;
+            }
+        }
+    }
+
+    // ============================================================= //
+
+    DelimitedReader::DelimitedReader(char const * data,
+                                     size_t size,
+                                     char delimiter) :
+        m_data(data),
+        m_size(size),
+        m_delimiter(delimiter),
+        m_row_begin(0),
+        m_window_begin(0),
+        m_window_end(0),
+        m_position_count(0),
+        m_position_index(0)
+    {
+        // empty
+    }
+
+    bool DelimitedReader::NextRow(std::vector<TextField> &list_fields)
+    {
+        list_fields.clear();
+        if(m_row_begin >= m_size) {
+            return false;
+        }
+
+        size_t field_begin = m_row_begin;
+        bool field_quoted = (m_data[field_begin] == '"');
+        bool in_quotes = false;
+
+        while(true) {
+            if(m_position_index == m_position_count) {
+                if(m_window_end == m_size) {
+                    // The last row has no newline
+                    addField(field_begin,m_size,list_fields);
+                    m_row_begin = m_size;
+                    return true;
+                }
+                indexNextWindow();
+                continue;
+            }
+
+            size_t const pos = m_window_begin+m_list_positions[m_position_index++];
+            char const c = m_data[pos];
+
+            if(c == '"') {
+                // Quotes only mean something in quoted fields,
+                // and an escaped quote toggles twice
+                in_quotes = (field_quoted && !in_quotes);
+                continue;
+            }
+
+            if(in_quotes) {
+                continue;
+            }
+
+            addField(field_begin,pos,list_fields);
+            field_begin = pos+1;
+            field_quoted = (field_begin < m_size && m_data[field_begin] == '"');
+
+            if(c == '\n') {
+                m_row_begin = pos+1;
+                return true;
+            }
+        }
+    }
+
+    size_t DelimitedReader::GetOffset() const
+    {
+        return m_row_begin;
+    }
+
+    void DelimitedReader::indexNextWindow()
+    {
+        m_window_begin = m_window_end;
+        m_window_end = std::min(m_size,m_window_begin+k_window_size);
+
+        size_t const window_size = m_window_end-m_window_begin;
+        if(m_list_positions.size() < window_size) {
+            m_list_positions.resize(window_size);
+        }
+
+        m_position_count = IndexText(m_data+m_window_begin,
+                                     window_size,
+                                     m_delimiter,
+                                     m_list_positions.data());
+        m_position_index = 0;
+    }
+
+    void DelimitedReader::addField(size_t first,
+                                   size_t last,
+                                   std::vector<TextField> &list_fields) const
+    {
+        if(last > first && m_data[last-1] == '\r' &&
+           (last == m_size || m_data[last] == '\n'))
+        {
+            last--;
+        }
+
+        TextField field;
+        field.quoted = (last > first && m_data[first] == '"');
+        if(field.quoted) {
+            first++;
+            if(last > first && m_data[last-1] == '"') {
+                last--;
+            }
+        }
+
+        field.data = m_data+first;
+        field.size = last-first;
+        list_fields.push_back(field);
+    }
+
+    // ============================================================= //
+
+} // ks
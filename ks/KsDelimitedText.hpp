@@ -0,0 +1,145 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_DELIMITED_TEXT_HPP
+#define KS_DELIMITED_TEXT_HPP
+
+#include <string>
+#include <vector>
+
+#include <ks/KsGlobal.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // TextField
+    // * a view of one field in delimited text
+    // * quoted fields exclude the surrounding quotes; escaped
+    //   quotes ("") are left as is, see AppendUnquoted
+    struct TextField
+    {
+        char const * data;
+        size_t size;
+        bool quoted;
+    };
+
+    // * Appends @field to @str with escaped quotes replaced
+    void AppendUnquoted(TextField const &field, std::string &str);
+
+    // * Parses the whole of @field as a number (see ParseNumber)
+    // * Returns false if the field is empty or contains
+    //   anything else
+    template<typename T>
+    bool ParseField(TextField const &field, T &val)
+    {
+        char const * last = field.data+field.size;
+        return (field.size > 0) && (ParseNumber(field.data,last,val) == last);
+    }
+
+    // ============================================================= //
+
+    // DelimitedReader
+    // * splits CSV/TSV style text into rows of fields
+    // * delimiters, newlines and quotes are found in bulk with
+    //   SIMD compares (AVX2 or SSE2 on x86_64, chosen at run
+    //   time, with a scalar fallback elsewhere), a window of
+    //   text at a time so the index stays in cache
+    // * rows end at '\n'; a trailing '\r' is dropped. Fields that
+    //   start with a quote may contain delimiters and newlines
+    // * the text isn't copied and must outlive the reader and
+    //   the fields it returns. To read a file:
+    //
+    //   MappedFile file(path);
+    //   DelimitedReader reader(file.data(),file.size(),',');
+    //   std::vector<TextField> list_fields;
+    //   while(reader.NextRow(list_fields)) { ... }
+    //
+    class DelimitedReader
+    {
+    public:
+        DelimitedReader(char const * data, size_t size, char delimiter);
+
+        // * Replaces the contents of @list_fields with the
+        //   next row
+        // * Returns false once there are no more rows
+        bool NextRow(std::vector<TextField> &list_fields);
+
+        // * Returns the offset of the next row
+        size_t GetOffset() const;
+
+    private:
+        void indexNextWindow();
+        void addField(size_t first, size_t last,
+                      std::vector<TextField> &list_fields) const;
+
+        char const * const m_data;
+        size_t const m_size;
+        char const m_delimiter;
+
+        size_t m_row_begin;
+
+        // offsets of delimiters, newlines and quotes in
+        // [m_window_begin,m_window_end), relative to
+        // m_window_begin
+        size_t m_window_begin;
+        size_t m_window_end;
+        std::vector<u32> m_list_positions;
+        size_t m_position_count;
+        size_t m_position_index;
+    };
+
+    // * Reads every remaining row of @reader as numbers, with
+    //   each column appended to the vector in @list_columns
+    //   at its index
+    // * Returns false at the first field that isn't a number or
+    //   row with a different number of fields from the first
+    template<typename T>
+    bool ReadNumberColumns(DelimitedReader &reader,
+                           std::vector<std::vector<T>> &list_columns)
+    {
+        std::vector<TextField> list_fields;
+        size_t column_count = 0;
+        bool first_row = true;
+
+        while(reader.NextRow(list_fields)) {
+            if(first_row) {
+                column_count = list_fields.size();
+                if(list_columns.size() < column_count) {
+                    list_columns.resize(column_count);
+                }
+                first_row = false;
+            }
+            else if(list_fields.size() != column_count) {
+                return false;
+            }
+
+            for(size_t i=0; i < column_count; i++) {
+                T val;
+                if(!ParseField(list_fields[i],val)) {
+                    return false;
+                }
+                list_columns[i].push_back(val);
+            }
+        }
+        return true;
+    }
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_DELIMITED_TEXT_HPP
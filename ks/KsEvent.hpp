@@ -157,12 +157,21 @@ namespace ks
     };
 
     // SlotEvent
+    // * @tag identifies where the slot came from (the receiving
+    //   Object's Id for a signal connection, 0 if unknown) so a
+    //   long running slot can be traced back to it
+    // * @signal is the Signal the slot was emitted from, or
+    //   null, to tell apart signals with the same receiver
     class SlotEvent : public Event
     {
     public:
-        SlotEvent(std::function<void()> &&slot) :
+        SlotEvent(std::function<void()> &&slot,
+                  Id tag=0,
+                  void const * signal=nullptr) :
             Event(Event::Type::Slot),
-            m_slot(std::move(slot))
+            m_slot(std::move(slot)),
+            m_tag(tag),
+            m_signal(signal)
         {
             // empty
         }
@@ -177,8 +186,20 @@ namespace ks
             m_slot();
         }
 
+        Id GetTag() const
+        {
+            return m_tag;
+        }
+
+        void const * GetSignal() const
+        {
+            return m_signal;
+        }
+
     private:
         std::function<void()> m_slot;
+        Id m_tag;
+        void const * m_signal;
     };
 
     class BlockingSlotEvent : public Event
@@ -187,12 +208,16 @@ namespace ks
         BlockingSlotEvent(std::function<void()> &&slot,
                           bool * invoked,
                           std::mutex * invoked_mutex,
-                          std::condition_variable * invoked_cv) :
+                          std::condition_variable * invoked_cv,
+                          Id tag=0,
+                          void const * signal=nullptr) :
             Event(Event::Type::BlockingSlot),
             m_slot(std::move(slot)),
             m_invoked(invoked),
             m_invoked_mutex(invoked_mutex),
-            m_invoked_cv(invoked_cv)
+            m_invoked_cv(invoked_cv),
+            m_tag(tag),
+            m_signal(signal)
         {
             // empty
         }
@@ -213,12 +238,24 @@ namespace ks
             m_invoked_mutex->unlock();
         }
 
+        Id GetTag() const
+        {
+            return m_tag;
+        }
+
+        void const * GetSignal() const
+        {
+            return m_signal;
+        }
+
     private:
         std::function<void()> m_slot;
 
         bool * m_invoked;
         std::mutex * m_invoked_mutex;
         std::condition_variable * m_invoked_cv;
+        Id m_tag;
+        void const * m_signal;
     };
 
 } // ks
@@ -15,6 +15,8 @@
 */
 
 // stl
+#include <algorithm>
+#include <cmath>
 #include <map>
 
 // asio
@@ -27,6 +29,18 @@
 #include <ks/KsTimer.hpp>
 #include <ks/KsEventLoop.hpp>
 #include <ks/KsException.hpp>
+#include <ks/KsFastClock.hpp>
+#include <ks/KsIntrospect.hpp>
+#include <ks/KsTrace.hpp>
+
+#ifdef KS_ENV_LINUX
+#include <sys/resource.h>
+#endif
+
+#if defined(KS_ENV_LINUX) || defined(KS_ENV_ANDROID)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace ks
 {
@@ -42,7 +56,7 @@ namespace ks
 
     // ============================================================= //
 
-    std::mutex EventLoop::s_id_mutex;
+    Mutex EventLoop::s_id_mutex("EventLoop::genId");
 
     // Start at one so that an Id of 0
     // can be considered invalid / unset
@@ -50,23 +64,359 @@ namespace ks
 
     Id EventLoop::genId()
     {
-        std::lock_guard<std::mutex> lock(s_id_mutex);
+        std::lock_guard<Mutex> lock(s_id_mutex);
         Id id = s_id_counter;
         s_id_counter++;
         return id;
     }
 
+    namespace
+    {
+        // LoopRegistry
+        // * every EventLoop that exists, for ForEachEventLoop
+        struct LoopRegistry
+        {
+            LoopRegistry() :
+                mutex("EventLoop::registry")
+            {
+                // empty
+            }
+
+            Mutex mutex;
+            std::vector<EventLoop*> list_loops;
+        };
+
+        LoopRegistry & GetLoopRegistry()
+        {
+            // Leaked so loops can be destroyed during
+            // static destruction
+            static LoopRegistry * registry = new LoopRegistry();
+            return *registry;
+        }
+    }
+
+    // ============================================================= //
+
+    namespace
+    {
+        // * For counters that only the loop's thread writes,
+        //   which don't need an atomic read-modify-write
+        inline void AddRelaxed(std::atomic<u64> &counter, u64 val)
+        {
+            counter.store(counter.load(std::memory_order_relaxed)+val,
+                          std::memory_order_relaxed);
+        }
+
+        inline uint GetLatencyBucket(u64 ns)
+        {
+            uint bucket = 0;
+            #if defined(__GNUC__) || defined(__clang__)
+            if(ns != 0) {
+                bucket = 63-static_cast<uint>(__builtin_clzll(ns));
+            }
+            #else
+            while(ns > 1) {
+                ns >>= 1;
+                bucket++;
+            }
+            #endif
+            return std::min(bucket,k_latency_bucket_count-1);
+        }
+
+        s64 GetThreadCpuNs()
+        {
+            #ifdef KS_ENV_LINUX
+            struct rusage usage;
+            if(getrusage(RUSAGE_THREAD,&usage) != 0) {
+                return -1;
+            }
+
+            return (static_cast<s64>(usage.ru_utime.tv_sec)+usage.ru_stime.tv_sec)*1000000000+
+                    (static_cast<s64>(usage.ru_utime.tv_usec)+usage.ru_stime.tv_usec)*1000;
+            #else
+            return -1;
+            #endif
+        }
+    }
+
+    // ============================================================= //
+
+    LatencyHistogram::LatencyHistogram() :
+        count(0),
+        total_ns(0),
+        max_ns(0)
+    {
+        list_buckets.fill(0);
+    }
+
+    double LatencyHistogram::GetMeanNs() const
+    {
+        return (count == 0) ? 0.0 : static_cast<double>(total_ns)/count;
+    }
+
+    u64 LatencyHistogram::GetPercentileNs(double percentile) const
+    {
+        if(count == 0) {
+            return 0;
+        }
+
+        percentile = std::max(0.0,std::min(percentile,100.0));
+        u64 const target = std::max(
+                    u64(1),
+                    static_cast<u64>(std::ceil(count*percentile/100.0)));
+
+        u64 seen = 0;
+        for(uint i=0; i < k_latency_bucket_count-1; i++) {
+            seen += list_buckets[i];
+            if(seen >= target) {
+                return std::min(u64(1) << (i+1),max_ns);
+            }
+        }
+        return max_ns;
+    }
+
+    char const * GetLoopHandlerTypeName(LoopHandlerType type)
+    {
+        switch(type) {
+            case LoopHandlerType::Event: return "Event";
+            case LoopHandlerType::Task: return "Task";
+            case LoopHandlerType::Timer: return "Timer";
+            case LoopHandlerType::Descriptor: return "Descriptor";
+            case LoopHandlerType::Io: return "Io";
+            default: return "None";
+        }
+    }
+
+    // ============================================================= //
+
+    // * A LatencyHistogram that the loop's thread writes
+    //   while other threads read it
+    struct AtomicHistogram
+    {
+        AtomicHistogram()
+        {
+            for(auto &bucket : list_buckets) {
+                bucket.store(0,std::memory_order_relaxed);
+            }
+            count.store(0,std::memory_order_relaxed);
+            total_ns.store(0,std::memory_order_relaxed);
+            max_ns.store(0,std::memory_order_relaxed);
+        }
+
+        void Add(u64 ns)
+        {
+            AddRelaxed(list_buckets[GetLatencyBucket(ns)],1);
+            AddRelaxed(count,1);
+            AddRelaxed(total_ns,ns);
+            if(ns > max_ns.load(std::memory_order_relaxed)) {
+                max_ns.store(ns,std::memory_order_relaxed);
+            }
+        }
+
+        void Read(LatencyHistogram &histogram) const
+        {
+            for(uint i=0; i < k_latency_bucket_count; i++) {
+                histogram.list_buckets[i] =
+                        list_buckets[i].load(std::memory_order_relaxed);
+            }
+            histogram.count = count.load(std::memory_order_relaxed);
+            histogram.total_ns = total_ns.load(std::memory_order_relaxed);
+            histogram.max_ns = max_ns.load(std::memory_order_relaxed);
+        }
+
+        std::array<std::atomic<u64>,k_latency_bucket_count> list_buckets;
+        std::atomic<u64> count;
+        std::atomic<u64> total_ns;
+        std::atomic<u64> max_ns;
+    };
+
+    // LoopCounters
+    // * the counters behind EventLoopStats and the current
+    //   handler. Posting can happen on any thread; everything
+    //   else is written on the loop's thread
+    struct LoopCounters
+    {
+        LoopCounters() :
+            queue_depth(0),
+            peak_queue_depth(0),
+            queue_bytes(0),
+            events_handled(0),
+            timers_started(0),
+            timers_fired(0),
+            thread_cpu_ns(-1),
+            handler_seq(0),
+            handler_type(static_cast<u8>(LoopHandlerType::None)),
+            handler_tag(0),
+            handler_start_ns(0)
+        {
+            // empty
+        }
+
+        // * Returns the time the handler started
+        s64 onStart(LoopHandlerType type, Id tag)
+        {
+            s64 const now_ns = FastClock::GetPreciseNs();
+            setHandler(type,tag,now_ns);
+            return now_ns;
+        }
+
+        void onPost(s64 bytes)
+        {
+            queue_bytes.fetch_add(bytes,std::memory_order_relaxed);
+
+            s64 const depth = queue_depth.fetch_add(1,std::memory_order_relaxed)+1;
+            s64 peak = peak_queue_depth.load(std::memory_order_relaxed);
+            while(depth > peak &&
+                  !peak_queue_depth.compare_exchange_weak(
+                      peak,depth,std::memory_order_relaxed))
+            {
+                // retry
+            }
+        }
+
+        // * Returns the time the handler started
+        s64 onDispatch(s64 post_ns, s64 bytes, LoopHandlerType type, Id tag)
+        {
+            queue_depth.fetch_sub(1,std::memory_order_relaxed);
+            queue_bytes.fetch_sub(bytes,std::memory_order_relaxed);
+
+            s64 const now_ns = onStart(type,tag);
+            wait_ns.Add(static_cast<u64>(std::max(now_ns-post_ns,s64(0))));
+            return now_ns;
+        }
+
+        void onHandled(s64 start_ns)
+        {
+            setHandler(LoopHandlerType::None,0,0);
+
+            s64 const now_ns = FastClock::GetPreciseNs();
+            handler_ns.Add(static_cast<u64>(std::max(now_ns-start_ns,s64(0))));
+
+            u64 const handled = events_handled.load(std::memory_order_relaxed)+1;
+            events_handled.store(handled,std::memory_order_relaxed);
+
+            if((handled & 255) == 1) {
+                thread_cpu_ns.store(GetThreadCpuNs(),std::memory_order_relaxed);
+            }
+        }
+
+        // * Returns false if no handler is running
+        bool readHandler(LoopHandler &handler) const
+        {
+            // Retry if the loop's thread was writing
+            // while the handler was being read
+            for(uint i=0; i < 16; i++) {
+                u64 const seq = handler_seq.load(std::memory_order_acquire);
+                if(seq & 1) {
+                    continue;
+                }
+
+                handler.type = static_cast<LoopHandlerType>(
+                            handler_type.load(std::memory_order_relaxed));
+                handler.tag = handler_tag.load(std::memory_order_relaxed);
+                handler.start_ns = handler_start_ns.load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(handler_seq.load(std::memory_order_relaxed) == seq) {
+                    return (handler.start_ns != 0);
+                }
+            }
+            return false;
+        }
+
+        std::atomic<s64> queue_depth;
+        std::atomic<s64> peak_queue_depth;
+        std::atomic<s64> queue_bytes;
+        std::atomic<u64> events_handled;
+        std::atomic<u64> timers_started;
+        std::atomic<u64> timers_fired;
+        std::atomic<s64> thread_cpu_ns;
+        AtomicHistogram wait_ns;
+        AtomicHistogram handler_ns;
+
+        // The current handler, written as a seqlock: the
+        // sequence is odd while the fields are being written
+        std::atomic<u64> handler_seq;
+        std::atomic<u8> handler_type;
+        std::atomic<Id> handler_tag;
+        std::atomic<s64> handler_start_ns;
+
+    private:
+        void setHandler(LoopHandlerType type, Id tag, s64 start_ns)
+        {
+            u64 const seq = handler_seq.load(std::memory_order_relaxed);
+            handler_seq.store(seq+1,std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            handler_type.store(static_cast<u8>(type),std::memory_order_relaxed);
+            handler_tag.store(tag,std::memory_order_relaxed);
+            handler_start_ns.store(start_ns,std::memory_order_relaxed);
+
+            handler_seq.store(seq+2,std::memory_order_release);
+        }
+    };
+
+    // HandlerScope
+    // * ends a handler started with LoopCounters::onStart or
+    //   onDispatch when it goes out of scope, along with its
+    //   trace slice if @traced, so a handler that throws
+    //   isn't left running
+    class HandlerScope
+    {
+    public:
+        HandlerScope(LoopCounters * counters,
+                     s64 start_ns,
+                     Id loop_id,
+                     LoopHandlerType type,
+                     Id tag,
+                     u64 flow_id,
+                     bool traced) :
+            m_counters(counters),
+            m_start_ns(start_ns),
+            m_loop_id(loop_id),
+            m_type(type),
+            m_tag(tag),
+            m_flow_id(flow_id),
+            m_traced(traced)
+        {
+            // empty
+        }
+
+        ~HandlerScope()
+        {
+            m_counters->onHandled(m_start_ns);
+
+            if(m_traced) {
+                trace_detail::Record(trace_detail::Kind::End,
+                                     m_loop_id,m_type,m_tag,m_flow_id);
+            }
+        }
+
+    private:
+        LoopCounters * const m_counters;
+        s64 const m_start_ns;
+        Id const m_loop_id;
+        LoopHandlerType const m_type;
+        Id const m_tag;
+        u64 const m_flow_id;
+        bool const m_traced;
+    };
+
     // ============================================================= //
 
     struct TimerInfo
     {
         TimerInfo(Id id,
+                  Id loop_id,
                   weak_ptr<Timer> timer,
                   asio::io_service & service,
+                  LoopCounters * counters,
                   Milliseconds interval_ms,
                   bool repeat) :
             id(id),
+            loop_id(loop_id),
             timer(timer),
+            counters(counters),
             interval_ms(interval_ms),
             asio_timer(service,interval_ms),
             repeat(repeat),
@@ -76,7 +426,9 @@ namespace ks
         }
 
         Id id;
+        Id loop_id;
         weak_ptr<Timer> timer;
+        LoopCounters * counters;
         Milliseconds interval_ms;
         asio::steady_timer asio_timer;
         bool repeat;
@@ -88,7 +440,10 @@ namespace ks
     class TimeoutHandler
     {
     public:
-        TimeoutHandler(shared_ptr<TimerInfo> &timerinfo, bool move)
+        TimeoutHandler(shared_ptr<TimerInfo> &timerinfo,
+                       bool move,
+                       u64 wait_id) :
+            m_wait_id(wait_id)
         {
             if(move) {
                 m_timerinfo = std::move(timerinfo);
@@ -101,15 +456,26 @@ namespace ks
         TimeoutHandler(TimeoutHandler const &other)
         {
             m_timerinfo = other.m_timerinfo;
+            m_wait_id = other.m_wait_id;
         }
 
         TimeoutHandler(TimeoutHandler && other)
         {
             m_timerinfo = std::move(other.m_timerinfo);
+            m_wait_id = other.m_wait_id;
         }
 
         void operator()(asio::error_code const &ec)
         {
+            if(m_wait_id != 0) {
+                trace_detail::Record(trace_detail::Kind::AsyncEnd,
+                                     m_timerinfo->loop_id,
+                                     LoopHandlerType::Timer,
+                                     m_timerinfo->id,
+                                     m_wait_id,
+                                     ec || m_timerinfo->canceled);
+            }
+
             if((ec == asio::error::operation_aborted) ||
                m_timerinfo->canceled) {
                 // The timer was canceled
@@ -122,6 +488,11 @@ namespace ks
                 return;
             }
 
+            // Read before m_timerinfo is moved below
+            LoopCounters * counters = m_timerinfo->counters;
+            Id const timer_id = m_timerinfo->id;
+            Id const loop_id = m_timerinfo->loop_id;
+
             // If this is a repeating timer, post another timeout
             if(m_timerinfo->repeat) {
                 TimerInfo * timerinfo = m_timerinfo.get();
@@ -130,7 +501,10 @@ namespace ks
                             timerinfo->interval_ms);
 
                 timerinfo->asio_timer.async_wait(
-                            TimeoutHandler(m_timerinfo,true));
+                            TimeoutHandler(
+                                m_timerinfo,true,
+                                trace_detail::TraceAsyncBegin(
+                                    loop_id,LoopHandlerType::Timer,timer_id)));
             }
             else {
                 // mark inactive
@@ -138,11 +512,24 @@ namespace ks
             }
 
             // Emit the timeout signal
+            s64 const start_ns = counters->onStart(LoopHandlerType::Timer,timer_id);
+            AddRelaxed(counters->timers_fired,1);
+
+            bool const traced = trace_detail::TraceSample();
+            if(traced) {
+                trace_detail::Record(trace_detail::Kind::Begin,loop_id,
+                                     LoopHandlerType::Timer,timer_id,0);
+            }
+
+            HandlerScope scope(counters,start_ns,loop_id,
+                               LoopHandlerType::Timer,timer_id,0,traced);
+
             timer->signal_timeout.Emit();
         }
 
     private:
         shared_ptr<TimerInfo> m_timerinfo;
+        u64 m_wait_id; // 0 if not traced
     };
 
     // ============================================================= //
@@ -151,9 +538,16 @@ namespace ks
     {
     public:
         TaskHandler(shared_ptr<Task> task,
-                    asio::io_service* service) :
+                    asio::io_service* service,
+                    LoopCounters * counters,
+                    Id loop_id,
+                    u64 flow_id) :
             m_task(task),
-            m_service(service)
+            m_service(service),
+            m_counters(counters),
+            m_post_ns(FastClock::GetPreciseNs()),
+            m_loop_id(loop_id),
+            m_flow_id(flow_id)
         {
             // empty
         }
@@ -169,16 +563,42 @@ namespace ks
         {
             m_task = std::move(other.m_task);
             m_service = other.m_service;
+            m_counters = other.m_counters;
+            m_post_ns = other.m_post_ns;
+            m_loop_id = other.m_loop_id;
+            m_flow_id = other.m_flow_id;
         }
 
         void operator()()
         {
+            if(m_flow_id != 0) {
+                trace_detail::Record(trace_detail::Kind::Begin,m_loop_id,
+                                     LoopHandlerType::Task,0,m_flow_id);
+            }
+
+            s64 const start_ns = m_counters->onDispatch(
+                        m_post_ns,GetQueuedSize(),LoopHandlerType::Task,0);
+
+            HandlerScope scope(m_counters,start_ns,m_loop_id,
+                               LoopHandlerType::Task,0,m_flow_id,
+                               m_flow_id != 0);
+
             m_task->Invoke();
         }
 
+        // * Returns the memory a queued task is counted as using
+        static s64 GetQueuedSize()
+        {
+            return sizeof(TaskHandler)+sizeof(Task);
+        }
+
     private:
         shared_ptr<Task> m_task;
         asio::io_service* m_service;
+        LoopCounters * m_counters;
+        s64 m_post_ns;
+        Id m_loop_id;
+        u64 m_flow_id; // 0 if not traced
     };
 
     // ============================================================= //
@@ -187,9 +607,16 @@ namespace ks
     {
     public:
         EventHandler(unique_ptr<Event> &event,
-                     asio::io_service * service) :
+                     asio::io_service * service,
+                     LoopCounters * counters,
+                     Id loop_id,
+                     u64 flow_id) :
             m_event(std::move(event)),
-            m_service(service)
+            m_service(service),
+            m_counters(counters),
+            m_post_ns(FastClock::GetPreciseNs()),
+            m_loop_id(loop_id),
+            m_flow_id(flow_id)
         {
             // empty
         }
@@ -212,43 +639,232 @@ namespace ks
         {
             m_event = std::move(other.m_event);
             m_service = other.m_service;
+            m_counters = other.m_counters;
+            m_post_ns = other.m_post_ns;
+            m_loop_id = other.m_loop_id;
+            m_flow_id = other.m_flow_id;
         }
 
         void operator()()
         {
+            Id const tag = GetEventTag(m_event.get());
+            if(m_flow_id != 0) {
+                trace_detail::Record(trace_detail::Kind::Begin,m_loop_id,
+                                     LoopHandlerType::Event,tag,m_flow_id,
+                                     false,GetEventSignal(m_event.get()));
+            }
+
             auto const ev_type = m_event->GetType();
+            s64 const bytes = GetQueuedSize(m_event.get());
+
+            // tag is 0 for anything that isn't a slot
+            s64 const start_ns = m_counters->onDispatch(
+                        m_post_ns,bytes,LoopHandlerType::Event,tag);
+
+            HandlerScope scope(m_counters,start_ns,m_loop_id,
+                               LoopHandlerType::Event,tag,m_flow_id,
+                               m_flow_id != 0);
 
             if(ev_type == Event::Type::Slot) {
                 SlotEvent * ev =
                         static_cast<SlotEvent*>(
                             m_event.get());
+
                 ev->Invoke();
             }
             else if(ev_type == Event::Type::BlockingSlot) {
                 BlockingSlotEvent * ev =
                         static_cast<BlockingSlotEvent*>(
                             m_event.get());
+
                 ev->Invoke();
             }
         }
 
+        // * Returns the tag of a slot event, or 0
+        static Id GetEventTag(Event * event)
+        {
+            if(event->GetType() == Event::Type::Slot) {
+                return static_cast<SlotEvent*>(event)->GetTag();
+            }
+            else if(event->GetType() == Event::Type::BlockingSlot) {
+                return static_cast<BlockingSlotEvent*>(event)->GetTag();
+            }
+            return 0;
+        }
+
+        // * Returns the Signal a slot event was emitted
+        //   from, or null
+        static void const * GetEventSignal(Event * event)
+        {
+            if(event->GetType() == Event::Type::Slot) {
+                return static_cast<SlotEvent*>(event)->GetSignal();
+            }
+            else if(event->GetType() == Event::Type::BlockingSlot) {
+                return static_cast<BlockingSlotEvent*>(event)->GetSignal();
+            }
+            return nullptr;
+        }
+
+        // * Returns the memory a queued @event is counted as using
+        static s64 GetQueuedSize(Event * event)
+        {
+            s64 event_size = sizeof(Event);
+            if(event->GetType() == Event::Type::Slot) {
+                event_size = sizeof(SlotEvent);
+            }
+            else if(event->GetType() == Event::Type::BlockingSlot) {
+                event_size = sizeof(BlockingSlotEvent);
+            }
+            return sizeof(EventHandler)+event_size;
+        }
+
     private:
         unique_ptr<Event> m_event;
         asio::io_service * m_service;
+        LoopCounters * m_counters;
+        s64 m_post_ns;
+        Id m_loop_id;
+        u64 m_flow_id; // 0 if not traced
+    };
+
+    // ============================================================= //
+
+    #ifdef KS_ENV_POSIX
+    struct DescriptorInfo
+    {
+        DescriptorInfo(asio::io_service & service,
+                       LoopCounters * counters,
+                       Id loop_id,
+                       Id id,
+                       int fd,
+                       std::function<void()> callback) :
+            descriptor(service,fd),
+            counters(counters),
+            loop_id(loop_id),
+            id(id),
+            callback(std::move(callback)),
+            removed(false)
+        {
+            // empty
+        }
+
+        asio::posix::stream_descriptor descriptor;
+        LoopCounters * counters;
+        Id loop_id;
+        Id id;
+        std::function<void()> callback;
+        bool removed;
+    };
+
+    class ReadableHandler
+    {
+    public:
+        ReadableHandler(shared_ptr<DescriptorInfo> info, u64 wait_id) :
+            m_info(std::move(info)),
+            m_wait_id(wait_id)
+        {
+            // empty
+        }
+
+        void operator()(asio::error_code const &ec, size_t)
+        {
+            if(m_wait_id != 0) {
+                trace_detail::Record(trace_detail::Kind::AsyncEnd,
+                                     m_info->loop_id,
+                                     LoopHandlerType::Descriptor,
+                                     m_info->id,
+                                     m_wait_id,
+                                     ec || m_info->removed);
+            }
+
+            if(ec || m_info->removed) {
+                // Canceled, or the descriptor failed
+                return;
+            }
+
+            if(m_wait_id != 0) {
+                trace_detail::Record(trace_detail::Kind::Begin,
+                                     m_info->loop_id,
+                                     LoopHandlerType::Descriptor,
+                                     m_info->id,0);
+            }
+
+            {
+                s64 const start_ns = m_info->counters->onStart(
+                            LoopHandlerType::Descriptor,m_info->id);
+
+                HandlerScope scope(m_info->counters,start_ns,
+                                   m_info->loop_id,
+                                   LoopHandlerType::Descriptor,
+                                   m_info->id,0,m_wait_id != 0);
+
+                m_info->callback();
+            }
+
+            if(!m_info->removed) {
+                Wait(m_info);
+            }
+        }
+
+        static void Wait(shared_ptr<DescriptorInfo> const &info)
+        {
+            // null_buffers waits for readiness without
+            // reading anything
+            info->descriptor.async_read_some(
+                        asio::null_buffers(),
+                        ReadableHandler(
+                            info,
+                            trace_detail::TraceAsyncBegin(
+                                info->loop_id,
+                                LoopHandlerType::Descriptor,
+                                info->id)));
+        }
+
+    private:
+        shared_ptr<DescriptorInfo> m_info;
+        u64 m_wait_id; // 0 if not traced
     };
+    #endif
 
     // ============================================================= //
 
     // EventLoop implementation
     struct EventLoop::Impl
     {
-        Impl()
+        Impl() :
+            m_stats_mutex("EventLoop::stats"),
+            m_stats_prev_ns(FastClock::GetSteadyNs()),
+            m_stats_prev_handled(0),
+            m_os_thread_id(-1),
+            m_descriptor_mutex("EventLoop::descriptors"),
+            m_descriptor_id_counter(1)
         {
             // empty
         }
 
+        LoopCounters m_counters;
+
+        // for events_per_sec
+        Mutex m_stats_mutex;
+        s64 m_stats_prev_ns;
+        u64 m_stats_prev_handled;
+
+        // see LoopHandler::os_thread_id
+        std::atomic<s64> m_os_thread_id;
+
+        introspect_detail::ObjectRegistry m_object_registry;
+
         asio::io_service m_asio_service;
         unique_ptr<asio::io_service::work> m_asio_work;
+
+        #ifdef KS_ENV_POSIX
+        // Declared after the service so descriptors are
+        // closed before it's destroyed
+        Mutex m_descriptor_mutex;
+        Id m_descriptor_id_counter;
+        std::map<Id,shared_ptr<DescriptorInfo>> m_list_descriptors;
+        #endif
     };
 
     // ============================================================= //
@@ -258,13 +874,25 @@ namespace ks
         m_id(genId()),
         m_started(false),
         m_running(false),
+        m_mutex("EventLoop"),
         m_impl(new Impl())
     {
-        // empty
+        LoopRegistry &registry = GetLoopRegistry();
+        std::lock_guard<Mutex> lock(registry.mutex);
+        registry.list_loops.push_back(this);
     }
 
     EventLoop::~EventLoop()
     {
+        {
+            LoopRegistry &registry = GetLoopRegistry();
+            std::lock_guard<Mutex> lock(registry.mutex);
+            registry.list_loops.erase(
+                        std::find(registry.list_loops.begin(),
+                                  registry.list_loops.end(),
+                                  this));
+        }
+
         this->Stop();
     }
 
@@ -275,19 +903,19 @@ namespace ks
 
     std::thread::id EventLoop::GetThreadId()
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<Mutex> lock(m_mutex);
         return m_thread_id;
     }
 
     bool EventLoop::GetStarted()
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<Mutex> lock(m_mutex);
         return m_started;
     }
 
     bool EventLoop::GetRunning()
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<Mutex> lock(m_mutex);
         return m_running;
     }
 
@@ -295,7 +923,7 @@ namespace ks
                              bool& started,
                              bool& running)
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<Mutex> lock(m_mutex);
         thread_id = m_thread_id;
         started = m_started;
         running = m_running;
@@ -303,7 +931,7 @@ namespace ks
 
     void EventLoop::Start()
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<Mutex> lock(m_mutex);
 
         if(m_started || m_impl->m_asio_work) {
             return;
@@ -324,7 +952,7 @@ namespace ks
     void EventLoop::Run()
     {
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
+            std::lock_guard<Mutex> lock(m_mutex);
 
             ensureActiveLoop();
             ensureActiveThread();
@@ -335,13 +963,16 @@ namespace ks
 
         m_impl->m_asio_service.run(); // blocks!
 
-        std::lock_guard<std::mutex> lock(m_mutex);
+        m_impl->m_counters.thread_cpu_ns.store(
+                    GetThreadCpuNs(),std::memory_order_relaxed);
+
+        std::lock_guard<Mutex> lock(m_mutex);
         m_running = false;
     }
 
     void EventLoop::Stop()
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<Mutex> lock(m_mutex);
 
         m_impl->m_asio_work.reset(nullptr);
         m_impl->m_asio_service.stop();
@@ -359,7 +990,7 @@ namespace ks
     void EventLoop::ProcessEvents()
     {
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
+            std::lock_guard<Mutex> lock(m_mutex);
             ensureActiveLoop();
             ensureActiveThread();
         }
@@ -383,10 +1014,19 @@ namespace ks
                                     event.release())));
         }
         else {
+            u64 const flow_id = trace_detail::TracePost(
+                        m_id,LoopHandlerType::Event,
+                        EventHandler::GetEventTag(event.get()),
+                        EventHandler::GetEventSignal(event.get()));
+
+            m_impl->m_counters.onPost(EventHandler::GetQueuedSize(event.get()));
             m_impl->m_asio_service.post(
                         EventHandler(
                             event,
-                            &(m_impl->m_asio_service)));
+                            &(m_impl->m_asio_service),
+                            &(m_impl->m_counters),
+                            m_id,
+                            flow_id));
         }
     }
 
@@ -399,20 +1039,33 @@ namespace ks
             return;
         }
 
+        u64 const flow_id = trace_detail::TracePost(
+                    m_id,LoopHandlerType::Task,0);
+
+        m_impl->m_counters.onPost(TaskHandler::GetQueuedSize());
         m_impl->m_asio_service.post(
                     TaskHandler(
                         task,
-                        &(m_impl->m_asio_service)));
+                        &(m_impl->m_asio_service),
+                        &(m_impl->m_counters),
+                        m_id,
+                        flow_id));
     }
 
     void EventLoop::PostCallback(std::function<void()> callback)
     {
         unique_ptr<Event> event = make_unique<SlotEvent>(std::move(callback));
+        u64 const flow_id = trace_detail::TracePost(
+                    m_id,LoopHandlerType::Event,0);
 
+        m_impl->m_counters.onPost(EventHandler::GetQueuedSize(event.get()));
         m_impl->m_asio_service.post(
                     EventHandler(
                         event,
-                        &(m_impl->m_asio_service)));
+                        &(m_impl->m_asio_service),
+                        &(m_impl->m_counters),
+                        m_id,
+                        flow_id));
     }
 
     void EventLoop::PostStopEvent()
@@ -420,6 +1073,120 @@ namespace ks
         m_impl->m_asio_service.post(std::bind(&EventLoop::Stop,this));
     }
 
+    EventLoopStats EventLoop::GetStats(bool update_rate)
+    {
+        LoopCounters const &counters = m_impl->m_counters;
+
+        EventLoopStats stats;
+        stats.queue_depth = static_cast<u64>(std::max(
+                    counters.queue_depth.load(std::memory_order_relaxed),s64(0)));
+        stats.peak_queue_depth = static_cast<u64>(
+                    counters.peak_queue_depth.load(std::memory_order_relaxed));
+        stats.queue_bytes = static_cast<u64>(std::max(
+                    counters.queue_bytes.load(std::memory_order_relaxed),s64(0)));
+        stats.events_handled = counters.events_handled.load(std::memory_order_relaxed);
+        stats.timers_started = counters.timers_started.load(std::memory_order_relaxed);
+        stats.timers_fired = counters.timers_fired.load(std::memory_order_relaxed);
+        stats.thread_cpu_ns = counters.thread_cpu_ns.load(std::memory_order_relaxed);
+        counters.wait_ns.Read(stats.wait_ns);
+        counters.handler_ns.Read(stats.handler_ns);
+        stats.events_per_sec = 0.0;
+
+        if(update_rate) {
+            std::lock_guard<Mutex> lock(m_impl->m_stats_mutex);
+            s64 const now_ns = FastClock::GetSteadyNs();
+            s64 const elapsed_ns = now_ns-m_impl->m_stats_prev_ns;
+
+            stats.events_per_sec = (elapsed_ns > 0) ?
+                        (stats.events_handled-m_impl->m_stats_prev_handled)*1e9/elapsed_ns :
+                        0.0;
+
+            m_impl->m_stats_prev_ns = now_ns;
+            m_impl->m_stats_prev_handled = stats.events_handled;
+        }
+
+        return stats;
+    }
+
+    u64 EventLoop::GetQueueSize(u64 * bytes) const
+    {
+        LoopCounters const &counters = m_impl->m_counters;
+        if(bytes) {
+            *bytes = static_cast<u64>(std::max(
+                        counters.queue_bytes.load(std::memory_order_relaxed),s64(0)));
+        }
+        return static_cast<u64>(std::max(
+                    counters.queue_depth.load(std::memory_order_relaxed),s64(0)));
+    }
+
+    introspect_detail::ObjectRegistry & EventLoop::GetObjectRegistry()
+    {
+        return m_impl->m_object_registry;
+    }
+
+    bool EventLoop::GetCurrentHandler(LoopHandler &handler)
+    {
+        if(!m_impl->m_counters.readHandler(handler)) {
+            return false;
+        }
+
+        handler.thread_id = this->GetThreadId();
+        handler.os_thread_id = m_impl->m_os_thread_id.load(std::memory_order_relaxed);
+        return true;
+    }
+
+    #ifdef KS_ENV_POSIX
+    Id EventLoop::AddDescriptor(int fd, std::function<void()> callback)
+    {
+        std::lock_guard<Mutex> lock(m_impl->m_descriptor_mutex);
+
+        Id const id = m_impl->m_descriptor_id_counter++;
+        shared_ptr<DescriptorInfo> info =
+                make_shared<DescriptorInfo>(
+                    m_impl->m_asio_service,
+                    &(m_impl->m_counters),
+                    m_id,
+                    id,
+                    fd,
+                    std::move(callback));
+
+        m_impl->m_list_descriptors.emplace(id,info);
+        ReadableHandler::Wait(info);
+
+        return id;
+    }
+
+    void EventLoop::RemoveDescriptor(Id descriptor_id)
+    {
+        // Removed on the loop's thread so it can't race
+        // with the callback. The handler can only run while
+        // the service, and so the Impl, exists
+        Impl * impl = m_impl.get();
+        impl->m_asio_service.post(
+                    [impl,descriptor_id]() {
+                        std::lock_guard<Mutex> lock(impl->m_descriptor_mutex);
+
+                        auto it = impl->m_list_descriptors.find(descriptor_id);
+                        if(it == impl->m_list_descriptors.end()) {
+                            return;
+                        }
+
+                        it->second->removed = true;
+                        it->second->descriptor.cancel();
+                        impl->m_list_descriptors.erase(it);
+                    });
+    }
+    #endif
+
+    void EventLoop::ForEachEventLoop(std::function<void(EventLoop&)> const &fn)
+    {
+        LoopRegistry &registry = GetLoopRegistry();
+        std::lock_guard<Mutex> lock(registry.mutex);
+        for(EventLoop * event_loop : registry.list_loops) {
+            fn(*event_loop);
+        }
+    }
+
     std::thread EventLoop::LaunchInThread(shared_ptr<EventLoop> event_loop)
     {
         std::thread thread(
@@ -449,7 +1216,7 @@ namespace ks
 
     void EventLoop::waitUntilStarted()
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
+        MutexLock lock(m_mutex);
 
         while(!m_started) {
             m_cv_started.wait(lock);
@@ -458,7 +1225,7 @@ namespace ks
 
     void EventLoop::waitUntilRunning()
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
+        MutexLock lock(m_mutex);
 
         while(!m_running) {
             m_cv_running.wait(lock);
@@ -467,7 +1234,7 @@ namespace ks
 
     void EventLoop::waitUntilStopped()
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
+        MutexLock lock(m_mutex);
 
         while(m_started) {
             m_cv_stopped.wait(lock);
@@ -478,6 +1245,12 @@ namespace ks
     {
         auto const calling_thread_id = std::this_thread::get_id();
         m_thread_id = calling_thread_id;
+
+        #if defined(KS_ENV_LINUX) || defined(KS_ENV_ANDROID)
+        m_impl->m_os_thread_id.store(
+                    static_cast<s64>(syscall(SYS_gettid)),
+                    std::memory_order_relaxed);
+        #endif
     }
 
     void EventLoop::ensureActiveThread()
@@ -505,12 +1278,13 @@ namespace ks
     void EventLoop::unsetActiveThread()
     {
         m_thread_id = m_thread_id_null;
+        m_impl->m_os_thread_id.store(-1,std::memory_order_relaxed);
     }
 
     void EventLoop::startTimer(unique_ptr<StartTimerEvent> ev)
     {
         // lock because we modify m_list_timers
-        std::unique_lock<std::mutex> lock(m_mutex);
+        MutexLock lock(m_mutex);
 
         auto timer = ev->GetTimer().lock();
         if(!timer) {
@@ -531,20 +1305,26 @@ namespace ks
                     ev->GetTimerId(),
                     make_shared<TimerInfo>(
                         ev->GetTimerId(),
+                        m_id,
                         ev->GetTimer(),
                         m_impl->m_asio_service,
+                        &(m_impl->m_counters),
                         ev->GetInterval(),
                         ev->GetRepeating())).first;
 
         timer->m_active = true;
+        m_impl->m_counters.timers_started.fetch_add(1,std::memory_order_relaxed);
         timerinfo_it->second->asio_timer.async_wait(
-                    TimeoutHandler(timerinfo_it->second,false));
+                    TimeoutHandler(
+                        timerinfo_it->second,false,
+                        trace_detail::TraceAsyncBegin(
+                            m_id,LoopHandlerType::Timer,ev->GetTimerId())));
     }
 
     void EventLoop::stopTimer(unique_ptr<StopTimerEvent> ev)
     {
         // lock because we modify m_list_timers
-        std::unique_lock<std::mutex> lock(m_mutex);
+        MutexLock lock(m_mutex);
 
         // Cancel and remove the timer for the given id
         auto timerinfo_it = m_list_timers.find(ev->GetTimerId());
@@ -562,4 +1342,42 @@ namespace ks
         m_list_timers.erase(timerinfo_it);
     }
 
+    // ============================================================= //
+
+    namespace asio_detail
+    {
+        asio::io_service & LoopAccess::GetService(EventLoop &event_loop)
+        {
+            return event_loop.m_impl->m_asio_service;
+        }
+
+        LoopAccess::HandlerStart LoopAccess::BeginHandler(EventLoop &event_loop,
+                                                          LoopHandlerType type,
+                                                          Id tag)
+        {
+            HandlerStart start;
+            start.traced = trace_detail::TraceSample();
+            if(start.traced) {
+                trace_detail::Record(trace_detail::Kind::Begin,
+                                     event_loop.m_id,type,tag,0);
+            }
+
+            start.start_ns = event_loop.m_impl->m_counters.onStart(type,tag);
+            return start;
+        }
+
+        void LoopAccess::EndHandler(EventLoop &event_loop,
+                                    HandlerStart const &start,
+                                    LoopHandlerType type,
+                                    Id tag)
+        {
+            event_loop.m_impl->m_counters.onHandled(start.start_ns);
+
+            if(start.traced) {
+                trace_detail::Record(trace_detail::Kind::End,
+                                     event_loop.m_id,type,tag,0);
+            }
+        }
+    }
+
 } // ks
@@ -17,15 +17,21 @@
 #ifndef KS_EVENT_LOOP_HPP
 #define KS_EVENT_LOOP_HPP
 
+#include <array>
 #include <atomic>
 #include <thread>
-#include <mutex>
 #include <map>
 #include <vector>
-#include <condition_variable>
 
+#include <ks/KsConfig.hpp>
 #include <ks/KsTask.hpp>
 #include <ks/KsException.hpp>
+#include <ks/KsMutex.hpp>
+
+namespace asio
+{
+    class io_service;
+}
 
 namespace ks
 {
@@ -47,11 +53,118 @@ namespace ks
 
     // ============================================================= //
 
+    uint const k_latency_bucket_count = 40;
+
+    // LatencyHistogram
+    // * counts durations in power of two buckets: bucket i
+    //   holds durations in [2^i,2^(i+1)) ns, with zero in
+    //   bucket 0 and anything longer than ~9 minutes in the
+    //   last bucket
+    struct LatencyHistogram
+    {
+        LatencyHistogram();
+
+        // * Returns the mean duration, or 0 if there are none
+        double GetMeanNs() const;
+
+        // * Returns the upper bound of the bucket holding the
+        //   @percentile (0-100) duration
+        u64 GetPercentileNs(double percentile) const;
+
+        std::array<u64,k_latency_bucket_count> list_buckets;
+        u64 count;
+        u64 total_ns;
+        u64 max_ns;
+    };
+
+    // EventLoopStats
+    // * a snapshot of an EventLoop's counters, see
+    //   EventLoop::GetStats
+    struct EventLoopStats
+    {
+        // events (including tasks and callbacks) posted
+        // but not handled yet
+        u64 queue_depth;
+        u64 peak_queue_depth;
+
+        // estimated memory used by the queued events,
+        // see KsMemoryStats.hpp
+        u64 queue_bytes;
+
+        u64 events_handled;
+
+        // events handled per second since the previous
+        // GetStats call, or since the loop was created
+        double events_per_sec;
+
+        u64 timers_started;
+        u64 timers_fired;
+
+        // time from an event being posted to it being handled
+        LatencyHistogram wait_ns;
+
+        // time spent in event, timer and descriptor handlers
+        LatencyHistogram handler_ns;
+
+        // CPU time used by the loop's thread (RUSAGE_THREAD),
+        // sampled on that thread every 256 handlers and when
+        // it stops running; -1 where unsupported
+        s64 thread_cpu_ns;
+    };
+
+    enum class LoopHandlerType : u8
+    {
+        None,
+        Event, // a queued or blocking slot, or a callback
+        Task,
+        Timer,
+        Descriptor,
+        Io // asio I/O done by an Object on the loop
+    };
+
+    // * Returns the name of @type, ie "Timer"
+    char const * GetLoopHandlerTypeName(LoopHandlerType type);
+
+    // LoopHandler
+    // * describes the handler an EventLoop is running, see
+    //   EventLoop::GetCurrentHandler
+    struct LoopHandler
+    {
+        LoopHandlerType type;
+
+        // where the handler came from: the receiving Object's
+        // Id for a slot, the Timer's Id for a timeout and the
+        // descriptor's Id for a descriptor; 0 if unknown
+        Id tag;
+
+        // when the handler started (FastClock::GetPreciseNs)
+        s64 start_ns;
+
+        std::thread::id thread_id;
+
+        // the kernel's id for the loop's thread, so it can be
+        // matched up with tools like top and perf; -1 where
+        // unsupported
+        s64 os_thread_id;
+    };
+
+    // ============================================================= //
+
     class Event;
     class StartTimerEvent;
     class StopTimerEvent;
     struct TimerInfo;
 
+    namespace introspect_detail
+    {
+        class ObjectRegistry;
+    }
+
+    namespace asio_detail
+    {
+        class LoopAccess;
+    }
+
     class EventLoop final
     {
         struct Impl; // hides the implementation
@@ -83,6 +196,50 @@ namespace ks
         void PostCallback(std::function<void()> callback);
         void PostStopEvent();
 
+        // * Returns a snapshot of this loop's counters
+        // * Counting is always on; it costs a few clock reads
+        //   and relaxed atomic updates per event
+        // * With @update_rate false, events_per_sec is left at 0
+        //   and the next call's rate isn't affected, so periodic
+        //   readers (ie an exporter) don't disturb other callers
+        EventLoopStats GetStats(bool update_rate=true);
+
+        // * Returns the number of events queued on this loop, and
+        //   their estimated memory use in @bytes if it's not null
+        // * Unlike GetStats, has no side effects
+        u64 GetQueueSize(u64 * bytes=nullptr) const;
+
+        // * The Objects that live on this loop and the connections
+        //   made to them, see KsIntrospect.hpp
+        introspect_detail::ObjectRegistry & GetObjectRegistry();
+
+        // * Returns false if this loop isn't running a handler;
+        //   otherwise describes the handler in @handler
+        // * Can be called from any thread (ie a watchdog). The
+        //   current handler is always tracked; it costs a few
+        //   relaxed stores per event
+        bool GetCurrentHandler(LoopHandler &handler);
+
+        #ifdef KS_ENV_POSIX
+        // * Calls @callback on this loop's thread each time @fd
+        //   is readable, until the returned id is passed to
+        //   RemoveDescriptor. @callback must read from @fd, or it
+        //   will be called again right away
+        // * The loop takes ownership of @fd and closes it once
+        //   it's removed or the loop is destroyed
+        Id AddDescriptor(int fd, std::function<void()> callback);
+
+        // * The descriptor is removed on this loop's thread;
+        //   its callback may still be called until then
+        void RemoveDescriptor(Id descriptor_id);
+        #endif
+
+        // * Calls @fn with each EventLoop that exists, in order
+        //   of creation
+        // * Loops are kept from being created or destroyed until
+        //   @fn returns, so @fn must do neither
+        static void ForEachEventLoop(std::function<void(EventLoop&)> const &fn);
+
         static std::thread LaunchInThread(shared_ptr<EventLoop> event_loop);
 
         static void RemoveFromThread(shared_ptr<EventLoop> event_loop,
@@ -90,6 +247,8 @@ namespace ks
                                      bool post_stop=false);
 
     private:
+        friend class asio_detail::LoopAccess;
+
         void waitUntilStarted();
         void waitUntilRunning();
         void waitUntilStopped();
@@ -108,18 +267,123 @@ namespace ks
 
         bool m_started;
         bool m_running;
-        std::mutex m_mutex;
-        std::condition_variable m_cv_started;
-        std::condition_variable m_cv_running;
-        std::condition_variable m_cv_stopped;
+        Mutex m_mutex;
+        ConditionVariable m_cv_started;
+        ConditionVariable m_cv_running;
+        ConditionVariable m_cv_stopped;
         std::map<Id,shared_ptr<TimerInfo>> m_list_timers;
 
         shared_ptr<Impl> m_impl;
 
-        static std::mutex s_id_mutex;
+        static Mutex s_id_mutex;
         static Id s_id_counter;
         static Id genId();
     };
+
+    // ============================================================= //
+
+    namespace asio_detail
+    {
+        // LoopAccess
+        // * for ks Objects that do their own asio I/O on their
+        //   EventLoop (ie MetricsExporter); handlers given to
+        //   the loop's asio service must be wrapped with
+        //   Instrument so they're accounted like the loop's own
+        class LoopAccess
+        {
+        public:
+            struct HandlerStart
+            {
+                s64 start_ns;
+                bool traced;
+            };
+
+            static asio::io_service & GetService(EventLoop &event_loop);
+
+            // * Mark the start and end of a handler of @type and
+            //   @tag on @event_loop's thread: it's counted in
+            //   GetStats, reported by GetCurrentHandler (so a
+            //   watchdog sees it stall) and traced
+            static HandlerStart BeginHandler(EventLoop &event_loop,
+                                             LoopHandlerType type,
+                                             Id tag);
+
+            static void EndHandler(EventLoop &event_loop,
+                                   HandlerStart const &start,
+                                   LoopHandlerType type,
+                                   Id tag);
+        };
+
+        // InstrumentedHandler
+        // * an asio completion handler that runs @Handler
+        //   between BeginHandler and EndHandler
+        // * only the loop's own asio service may invoke it,
+        //   so the loop outlives it
+        template<typename Handler>
+        class InstrumentedHandler
+        {
+        public:
+            InstrumentedHandler(EventLoop * event_loop,
+                                LoopHandlerType type,
+                                Id tag,
+                                Handler handler) :
+                m_event_loop(event_loop),
+                m_type(type),
+                m_tag(tag),
+                m_handler(std::move(handler))
+            {
+                // empty
+            }
+
+            template<typename... Args>
+            void operator()(Args&&... args)
+            {
+                HandlerScope scope(*this);
+                m_handler(std::forward<Args>(args)...);
+            }
+
+        private:
+            // HandlerScope
+            // * ends the handler when it goes out of scope, so
+            //   a handler that throws isn't left running
+            struct HandlerScope
+            {
+                HandlerScope(InstrumentedHandler const &handler) :
+                    handler(handler),
+                    start(LoopAccess::BeginHandler(
+                              *handler.m_event_loop,
+                              handler.m_type,
+                              handler.m_tag))
+                {
+                    // empty
+                }
+
+                ~HandlerScope()
+                {
+                    LoopAccess::EndHandler(*handler.m_event_loop,start,
+                                           handler.m_type,handler.m_tag);
+                }
+
+                InstrumentedHandler const &handler;
+                LoopAccess::HandlerStart const start;
+            };
+
+            EventLoop * m_event_loop;
+            LoopHandlerType m_type;
+            Id m_tag;
+            Handler m_handler;
+        };
+
+        template<typename Handler>
+        InstrumentedHandler<Handler> Instrument(EventLoop &event_loop,
+                                                LoopHandlerType type,
+                                                Id tag,
+                                                Handler handler)
+        {
+            return InstrumentedHandler<Handler>(
+                        &event_loop,type,tag,std::move(handler));
+        }
+    }
 } // ks
 
 #endif // KS_EVENT_LOOP_HPP
@@ -0,0 +1,278 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <atomic>
+#include <cerrno>
+
+#include <ks/KsLog.hpp>
+#include <ks/KsFastClock.hpp>
+#include <ks/KsEventLoopWatchdog.hpp>
+
+#if defined(KS_ENV_LINUX) || defined(KS_ENV_ANDROID)
+    #define KS_WATCHDOG_SAMPLE_STACK 1
+    #include <signal.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace ks
+{
+    namespace
+    {
+        #ifdef KS_WATCHDOG_SAMPLE_STACK
+        uint const k_max_sample_depth = 48;
+
+        // Stack samples are taken one at a time. The target
+        // thread claims a request by swapping its id for
+        // k_sample_claimed and sets it back to k_sample_idle
+        // once the frames are written. A sample that times out
+        // before the claim is withdrawn; one that times out
+        // after it is abandoned, and no new sample starts until
+        // the target thread has finished writing
+        s64 const k_sample_idle = -1;
+        s64 const k_sample_claimed = -2;
+
+        std::mutex g_sample_mutex;
+        int g_sample_installed_signal = 0;
+        std::atomic<s64> g_sample_thread(k_sample_idle);
+        void * g_sample_frames[k_max_sample_depth];
+        uint g_sample_depth = 0;
+
+        void OnSampleSignal(int)
+        {
+            int const saved_errno = errno;
+
+            s64 expected = static_cast<s64>(syscall(SYS_gettid));
+            if(g_sample_thread.compare_exchange_strong(
+                   expected,k_sample_claimed,std::memory_order_acquire))
+            {
+                // Skip this function
+                g_sample_depth = CaptureStackFrames(
+                            g_sample_frames,k_max_sample_depth,1);
+
+                g_sample_thread.store(k_sample_idle,std::memory_order_release);
+            }
+
+            errno = saved_errno;
+        }
+
+        // * Interrupts @os_thread_id with @signum and returns
+        //   its stack, or an empty string if it didn't
+        //   respond within a short time
+        // * Best effort: unwinding from a signal handler can
+        //   block if the thread was interrupted while holding
+        //   the dynamic loader's lock. The wait is bounded
+        //   either way, so the watchdog thread never hangs
+        std::string SampleStack(int signum, s64 os_thread_id)
+        {
+            std::lock_guard<std::mutex> lock(g_sample_mutex);
+
+            if(g_sample_thread.load(std::memory_order_acquire) != k_sample_idle) {
+                // A previously abandoned sample is still
+                // being written
+                return std::string();
+            }
+
+            if(g_sample_installed_signal != signum) {
+                struct sigaction action;
+                sigemptyset(&action.sa_mask);
+                action.sa_flags = SA_RESTART;
+                action.sa_handler = OnSampleSignal;
+                if(sigaction(signum,&action,nullptr) != 0) {
+                    return std::string();
+                }
+                g_sample_installed_signal = signum;
+            }
+
+            g_sample_thread.store(os_thread_id,std::memory_order_release);
+
+            if(syscall(SYS_tgkill,getpid(),os_thread_id,signum) != 0) {
+                // The thread has exited
+                g_sample_thread.store(k_sample_idle,std::memory_order_relaxed);
+                return std::string();
+            }
+
+            s64 const timeout_ns = FastClock::GetSteadyNs()+100*1000*1000;
+            while(true) {
+                s64 state = g_sample_thread.load(std::memory_order_acquire);
+                if(state == k_sample_idle) {
+                    break;
+                }
+
+                if(FastClock::GetSteadyNs() > timeout_ns) {
+                    if(state == k_sample_claimed) {
+                        // Abandoned; the target thread resets
+                        // the state when it's done
+                        return std::string();
+                    }
+
+                    if(g_sample_thread.compare_exchange_strong(
+                           state,k_sample_idle,std::memory_order_relaxed))
+                    {
+                        // Gave up before the thread claimed it
+                        return std::string();
+                    }
+
+                    // Claimed in the meantime
+                    continue;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            return FormatStackFrames(g_sample_frames,g_sample_depth);
+        }
+        #endif
+
+        void LogStall(LoopStall const &stall)
+        {
+            std::string msg = "EventLoopWatchdog: EventLoop ";
+            AppendNumber(msg,stall.loop_id);
+            msg.append(" stalled for ");
+            AppendNumber(msg,stall.duration.count());
+            msg.append("ms in a ");
+            msg.append(GetLoopHandlerTypeName(stall.handler.type));
+            msg.append(" handler (tag ");
+            AppendNumber(msg,stall.handler.tag);
+            msg.append(", thread ");
+            AppendNumber(msg,stall.handler.os_thread_id);
+            msg.push_back(')');
+
+            if(!stall.stack_trace.empty()) {
+                msg.push_back('\n');
+                msg.append(stall.stack_trace);
+            }
+
+            LOG.Warn() << msg;
+        }
+    }
+
+    // ============================================================= //
+
+    EventLoopWatchdog::EventLoopWatchdog(Options options,
+                                         StallHandler on_stall) :
+        m_options(options),
+        m_on_stall(on_stall ? std::move(on_stall) : StallHandler(LogStall)),
+        m_stop(false),
+        m_stall_count(0)
+    {
+        m_thread = std::thread(&EventLoopWatchdog::run,this);
+    }
+
+    EventLoopWatchdog::~EventLoopWatchdog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_cv_stop.notify_all();
+        }
+        m_thread.join();
+    }
+
+    void EventLoopWatchdog::AddLoop(shared_ptr<EventLoop> const &event_loop)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_list_loops[event_loop->GetId()] = LoopInfo{event_loop,0};
+    }
+
+    void EventLoopWatchdog::RemoveLoop(Id loop_id)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_list_loops.erase(loop_id);
+    }
+
+    u64 EventLoopWatchdog::GetStallCount()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stall_count;
+    }
+
+    void EventLoopWatchdog::run()
+    {
+        std::vector<LoopStall> list_stalls;
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while(true) {
+            m_cv_stop.wait_for(lock,m_options.check_interval);
+            if(m_stop) {
+                break;
+            }
+
+            check(list_stalls);
+            if(list_stalls.empty()) {
+                continue;
+            }
+
+            m_stall_count += list_stalls.size();
+
+            // Report without the lock so the handler
+            // can add and remove loops
+            lock.unlock();
+            for(auto &stall : list_stalls) {
+                #ifdef KS_WATCHDOG_SAMPLE_STACK
+                if(m_options.sample_stack && stall.handler.os_thread_id > 0) {
+                    int const signum = (m_options.sample_signal != 0) ?
+                                m_options.sample_signal : SIGURG;
+
+                    stall.stack_trace = SampleStack(
+                                signum,stall.handler.os_thread_id);
+                }
+                #endif
+
+                m_on_stall(stall);
+            }
+            list_stalls.clear();
+            lock.lock();
+        }
+    }
+
+    void EventLoopWatchdog::check(std::vector<LoopStall> &list_stalls)
+    {
+        // Handler start times are taken with GetPreciseNs
+        s64 const now_ns = FastClock::GetPreciseNs();
+        s64 const threshold_ns =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    m_options.threshold).count();
+
+        auto it = m_list_loops.begin();
+        while(it != m_list_loops.end()) {
+            shared_ptr<EventLoop> event_loop = it->second.event_loop.lock();
+            if(!event_loop) {
+                it = m_list_loops.erase(it);
+                continue;
+            }
+
+            LoopHandler handler;
+            if(event_loop->GetCurrentHandler(handler) &&
+               handler.start_ns != it->second.reported_start_ns &&
+               now_ns-handler.start_ns >= threshold_ns)
+            {
+                it->second.reported_start_ns = handler.start_ns;
+
+                LoopStall stall;
+                stall.loop_id = it->first;
+                stall.handler = handler;
+                stall.duration = std::chrono::duration_cast<Milliseconds>(
+                            std::chrono::nanoseconds(now_ns-handler.start_ns));
+
+                list_stalls.push_back(std::move(stall));
+            }
+            ++it;
+        }
+    }
+
+    // ============================================================= //
+
+} // ks
@@ -0,0 +1,139 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_EVENT_LOOP_WATCHDOG_HPP
+#define KS_EVENT_LOOP_WATCHDOG_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <ks/KsEventLoop.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // LoopStall
+    // * a handler that ran for longer than the watchdog's
+    //   threshold, see EventLoopWatchdog
+    struct LoopStall
+    {
+        Id loop_id;
+
+        // the stuck handler, see LoopHandler
+        LoopHandler handler;
+
+        // how long the handler had been running when
+        // the stall was detected
+        Milliseconds duration;
+
+        // the loop thread's stack at the time, if stack
+        // sampling is enabled and supported; otherwise empty
+        std::string stack_trace;
+    };
+
+    // EventLoopWatchdog
+    // * watches EventLoops from its own thread and reports
+    //   handlers that block their loop for longer than a
+    //   threshold
+    // * checking a loop only reads its current handler (see
+    //   EventLoop::GetCurrentHandler), so it can be left
+    //   running in production
+    // * each stalled handler is reported once, on the
+    //   watchdog's thread
+    class EventLoopWatchdog final
+    {
+    public:
+        using StallHandler = std::function<void(LoopStall const &)>;
+
+        struct Options
+        {
+            Options() :
+                threshold(Milliseconds(1000)),
+                check_interval(Milliseconds(100)),
+                sample_stack(false),
+                sample_signal(0)
+            {
+                // empty
+            }
+
+            // handlers that run for longer than this are
+            // reported; stalls are detected within
+            // @check_interval of crossing it
+            Milliseconds threshold;
+            Milliseconds check_interval;
+
+            // * If true, the stuck thread is interrupted with
+            //   @sample_signal to capture its stack (Linux only)
+            // * The signal's handler is replaced process wide,
+            //   so pick one the application doesn't use; 0
+            //   means SIGURG
+            bool sample_stack;
+            int sample_signal;
+        };
+
+        // * @on_stall is called for each stall; by default
+        //   stalls are logged as warnings
+        EventLoopWatchdog(Options options=Options(),
+                          StallHandler on_stall=nullptr);
+
+        EventLoopWatchdog(EventLoopWatchdog const &) = delete;
+        EventLoopWatchdog & operator = (EventLoopWatchdog const &) = delete;
+
+        // * Stops the watchdog's thread
+        ~EventLoopWatchdog();
+
+        // * Loops are held weakly and dropped once destroyed
+        void AddLoop(shared_ptr<EventLoop> const &event_loop);
+        void RemoveLoop(Id loop_id);
+
+        // * Returns the number of stalls detected so far
+        u64 GetStallCount();
+
+    private:
+        struct LoopInfo
+        {
+            weak_ptr<EventLoop> event_loop;
+
+            // start_ns of the last handler reported,
+            // so a stall is only reported once
+            s64 reported_start_ns;
+        };
+
+        void run();
+        void check(std::vector<LoopStall> &list_stalls);
+
+        Options const m_options;
+        StallHandler m_on_stall;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv_stop;
+        bool m_stop;
+        u64 m_stall_count;
+        std::map<Id,LoopInfo> m_list_loops;
+
+        std::thread m_thread;
+    };
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_EVENT_LOOP_WATCHDOG_HPP
@@ -16,8 +16,138 @@
 
 #include <ks/KsException.hpp>
 
+#if defined(__GNUC__)
+    #define KS_EXCEPTION_UNWIND 1
+    #include <cstdint>
+    #include <cstdio>
+    #include <cstdlib>
+    #include <cxxabi.h>
+    #include <dlfcn.h>
+    #include <unwind.h>
+#endif
+
 namespace ks
 {
+    namespace
+    {
+        #ifdef KS_EXCEPTION_UNWIND
+        struct UnwindState
+        {
+            void ** frames;
+            uint max_depth;
+            uint depth;
+            uint skip;
+        };
+
+        _Unwind_Reason_Code OnUnwindFrame(_Unwind_Context * context, void * arg)
+        {
+            UnwindState * state = static_cast<UnwindState*>(arg);
+
+            if(state->skip > 0) {
+                state->skip--;
+                return _URC_NO_REASON;
+            }
+
+            if(state->depth == state->max_depth) {
+                return _URC_END_OF_STACK;
+            }
+
+            void * ip = reinterpret_cast<void*>(_Unwind_GetIP(context));
+            if(ip == nullptr) {
+                return _URC_END_OF_STACK;
+            }
+
+            state->frames[state->depth++] = ip;
+            return _URC_NO_REASON;
+        }
+
+        // * Appends the raw @address and, if the module holding
+        //   it is known, its offset within the module so that it
+        //   can be resolved offline (ie addr2line -f -e <module>
+        //   <offset>), followed by the function name if the
+        //   module exports one (see -rdynamic)
+        void AppendSymbol(void * address, std::string &line)
+        {
+            char buffer[64];
+            std::snprintf(buffer,sizeof(buffer),"%p",address);
+            line.append(buffer);
+
+            Dl_info info;
+            if(dladdr(address,&info) == 0) {
+                return; // info isn't filled in
+            }
+
+            if(info.dli_fname != nullptr && info.dli_fname[0] != '\0') {
+                uintptr_t const offset =
+                        reinterpret_cast<uintptr_t>(address)-
+                        reinterpret_cast<uintptr_t>(info.dli_fbase);
+
+                std::snprintf(buffer,sizeof(buffer),"+0x%llx",
+                              static_cast<unsigned long long>(offset));
+
+                line.push_back(' ');
+                line.append(info.dli_fname);
+                line.append(buffer);
+            }
+
+            if(info.dli_sname == nullptr) {
+                return;
+            }
+
+            int status = -1;
+            char * demangled =
+                    abi::__cxa_demangle(info.dli_sname,nullptr,nullptr,&status);
+
+            line.push_back(' ');
+            line.append((status == 0) ? demangled : info.dli_sname);
+            std::free(demangled);
+        }
+        #endif
+    }
+
+    #ifdef KS_EXCEPTION_UNWIND
+    __attribute__((noinline))
+    #endif
+    uint CaptureStackFrames(void ** frames, uint max_depth, uint skip)
+    {
+        #ifdef KS_EXCEPTION_UNWIND
+        // The first frame is this function
+        UnwindState state{frames,max_depth,0,skip+1};
+        _Unwind_Backtrace(OnUnwindFrame,&state);
+        return state.depth;
+        #else
+        (void)frames;
+        (void)max_depth;
+        (void)skip;
+        return 0;
+        #endif
+    }
+
+    std::string FormatStackFrames(void * const * frames, uint depth)
+    {
+        std::string trace;
+
+        #ifdef KS_EXCEPTION_UNWIND
+        for(uint i=0; i < depth; i++) {
+            if(i > 0) {
+                trace.push_back('\n');
+            }
+
+            trace.append("  #");
+            AppendNumber(trace,i);
+            trace.push_back(' ');
+            AppendSymbol(frames[i],trace);
+        }
+        #else
+        (void)frames;
+        (void)depth;
+        #endif
+
+        return trace;
+    }
+
+    // ============================================================= //
+
     const std::vector<std::string> Exception::m_lkup_err_lvl {
         "TRACE: ",
         "DEBUG: ",
@@ -27,14 +157,26 @@ namespace ks
         "FATAL: "
     };
 
-    Exception::Exception()
+    Exception::Exception() :
+        m_err_lvl(ErrorLevel::ERROR),
+        m_stack_depth(0)
     {}
 
-    Exception::Exception(ErrorLevel err_lvl, std::string msg, bool stack_trace)
+    Exception::Exception(ErrorLevel err_lvl, std::string msg, bool stack_trace) :
+        m_err_lvl(err_lvl),
+        m_msg(std::move(msg)),
+        m_stack_depth(0)
     {
-        (void)stack_trace; // TODO
-        LOG.Custom(err_lvl) << msg;
-        m_msg = m_lkup_err_lvl[static_cast<u8>(err_lvl)] + msg;
+        if(stack_trace) {
+            // Only the return addresses are saved here;
+            // symbolizing them is left to GetStackTrace().
+            // The first frame is this constructor
+            m_stack_depth = CaptureStackFrames(m_list_frames.data(),k_max_stack_depth,1);
+        }
+
+        if(m_err_lvl == ErrorLevel::FATAL) {
+            Report();
+        }
     }
 
     Exception::~Exception()
@@ -42,6 +184,54 @@ namespace ks
 
     const char* Exception::what() const noexcept
     {
-        return m_msg.c_str();
+        if(m_msg.empty()) {
+            return "";
+        }
+
+        if(m_what.empty()) {
+            try {
+                m_what = m_lkup_err_lvl[static_cast<u8>(m_err_lvl)] + m_msg;
+            }
+            catch(...) {
+                return m_msg.c_str();
+            }
+        }
+        return m_what.c_str();
+    }
+
+    Exception::ErrorLevel Exception::GetErrorLevel() const
+    {
+        return m_err_lvl;
+    }
+
+    std::string const & Exception::GetMessage() const
+    {
+        return m_msg;
+    }
+
+    uint Exception::GetStackDepth() const
+    {
+        return m_stack_depth;
+    }
+
+    std::string Exception::GetStackTrace() const
+    {
+        return FormatStackFrames(m_list_frames.data(),m_stack_depth);
+    }
+
+    void Exception::Report(Log::Logger &logger) const
+    {
+        if(!logger.GetLevelEnabled(m_err_lvl) &&
+           m_err_lvl != ErrorLevel::FATAL)
+        {
+            return;
+        }
+
+        if(m_stack_depth == 0) {
+            logger.Custom(m_err_lvl) << m_msg;
+        }
+        else {
+            logger.Custom(m_err_lvl) << m_msg << "\n" << GetStackTrace();
+        }
     }
 }
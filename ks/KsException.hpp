@@ -22,6 +22,31 @@
 
 namespace ks
 {
+    // * Saves up to @max_depth return addresses of the calling
+    //   thread's stack to @frames, skipping the innermost @skip
+    //   frames (a @skip of 1 leaves out the caller itself)
+    // * Returns the number of frames saved; always 0 on
+    //   compilers other than gcc/clang
+    // * Only walks the stack, so it can be used in a signal
+    //   handler
+    uint CaptureStackFrames(void ** frames, uint max_depth, uint skip=0);
+
+    // * Returns @frames symbolized, one per line as:
+    //   #<n> <address> <module>+<offset> <function>
+    // * function names are only known for exported symbols,
+    //   so builds without -rdynamic should resolve the module
+    //   offsets with addr2line instead
+    std::string FormatStackFrames(void * const * frames, uint depth);
+
+    // Exception
+    // * cheap to construct and throw: the stack trace (if
+    //   requested) is captured as raw return addresses, and
+    //   nothing is formatted or logged until it's asked for
+    //   with what(), GetStackTrace() or Report()
+    // * FATAL exceptions are still logged when they're
+    //   constructed since they aren't expected to be handled
+    //   (which also triggers the fatal handler, see
+    //   SetFatalHandler in KsLog.hpp)
     class Exception : public std::exception
     {
     public:
@@ -31,11 +56,38 @@ namespace ks
         Exception(ErrorLevel err_lvl,std::string msg,bool stack_trace=false);
         virtual ~Exception();
 
+        // * Returns the message prefixed with the error
+        //   level, ie "WARN:  msg"
+        // * the text is built by the first call; like
+        //   std::string, don't make the first call from
+        //   several threads at once
         virtual const char* what() const noexcept;
 
+        ErrorLevel GetErrorLevel() const;
+        std::string const & GetMessage() const;
+
+        // * Returns the number of frames captured at
+        //   construction, if a stack trace was requested
+        uint GetStackDepth() const;
+
+        // * Returns the captured frames symbolized, one per
+        //   line, or an empty string if none were captured
+        std::string GetStackTrace() const;
+
+        // * Logs the message and the stack trace (if any)
+        //   to @logger at the exception's error level
+        void Report(Log::Logger &logger=LOG) const;
+
     protected:
         static std::vector<std::string> const m_lkup_err_lvl;
+        static uint const k_max_stack_depth = 32;
+
+        ErrorLevel m_err_lvl;
         std::string m_msg;
+        mutable std::string m_what;
+
+        uint m_stack_depth;
+        std::array<void*,k_max_stack_depth> m_list_frames;
     };
 }
 
@@ -0,0 +1,222 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <thread>
+
+#include <ks/KsConfig.hpp>
+#include <ks/KsFastClock.hpp>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define KS_FAST_CLOCK_TSC 1
+    #include <cpuid.h>
+    #include <x86intrin.h>
+#endif
+
+#if defined(KS_ENV_LINUX) || defined(KS_ENV_ANDROID)
+    #define KS_FAST_CLOCK_COARSE 1
+    #include <time.h>
+#endif
+
+namespace ks
+{
+    namespace
+    {
+        s64 GetStdSteadyNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().
+                        time_since_epoch()).count();
+        }
+
+        s64 GetStdWallNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().
+                        time_since_epoch()).count();
+        }
+
+        #ifdef KS_FAST_CLOCK_TSC
+        bool GetInvariantTsc()
+        {
+            unsigned int eax=0,ebx=0,ecx=0,edx=0;
+            if(__get_cpuid(0x80000000,&eax,&ebx,&ecx,&edx) == 0 ||
+               eax < 0x80000007)
+            {
+                return false;
+            }
+
+            __get_cpuid(0x80000007,&eax,&ebx,&ecx,&edx);
+            return ((edx >> 8) & 1) != 0;
+        }
+        #endif
+
+        #ifdef KS_FAST_CLOCK_COARSE
+        s64 GetCoarseNs()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_COARSE,&ts);
+            return static_cast<s64>(ts.tv_sec)*1000000000+ts.tv_nsec;
+        }
+        #endif
+
+        // Calibration
+        // * fixed for the life of the process
+        struct Calibration
+        {
+            FastClock::Source source;
+
+            // ns = base_ns + ((tsc-base_tsc)*tsc_mult >> 32)
+            u64 base_tsc;
+            s64 base_ns;
+            u64 tsc_mult;
+
+            s64 wall_offset_ns;
+        };
+
+        s64 ReadSteadyNs(Calibration const &c)
+        {
+            #if defined(KS_FAST_CLOCK_TSC)
+            if(c.source == FastClock::Source::TSC) {
+                // Signed so that a slightly earlier read on
+                // another core can't wrap around
+                s64 const ticks = static_cast<s64>(__rdtsc()-c.base_tsc);
+                return c.base_ns+static_cast<s64>(
+                            (static_cast<__int128>(ticks)*c.tsc_mult) >> 32);
+            }
+            #endif
+
+            #if defined(KS_FAST_CLOCK_COARSE)
+            if(c.source == FastClock::Source::MonotonicCoarse) {
+                return GetCoarseNs();
+            }
+            #endif
+
+            (void)c;
+            return GetStdSteadyNs();
+        }
+
+        Calibration Calibrate()
+        {
+            Calibration calibration;
+            calibration.source = FastClock::Source::SteadyClock;
+            calibration.base_tsc = 0;
+            calibration.base_ns = 0;
+            calibration.tsc_mult = 0;
+
+            #if defined(KS_FAST_CLOCK_TSC)
+            if(GetInvariantTsc()) {
+                s64 const begin_ns = GetStdSteadyNs();
+                u64 const begin_tsc = __rdtsc();
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                s64 const end_ns = GetStdSteadyNs();
+                u64 const end_tsc = __rdtsc();
+
+                if(end_tsc > begin_tsc && end_ns > begin_ns) {
+                    calibration.source = FastClock::Source::TSC;
+                    calibration.base_tsc = end_tsc;
+                    calibration.base_ns = end_ns;
+                    calibration.tsc_mult = static_cast<u64>(
+                                (static_cast<unsigned __int128>(end_ns-begin_ns) << 32)/
+                                (end_tsc-begin_tsc));
+                }
+            }
+            #endif
+
+            #if defined(KS_FAST_CLOCK_COARSE)
+            if(calibration.source == FastClock::Source::SteadyClock) {
+                calibration.source = FastClock::Source::MonotonicCoarse;
+            }
+            #endif
+
+            // The offset is taken with the clock that will be
+            // used from now on
+            s64 const wall_ns = GetStdWallNs();
+            s64 const steady_ns = ReadSteadyNs(calibration);
+            calibration.wall_offset_ns = wall_ns-steady_ns;
+            return calibration;
+        }
+
+        Calibration const & GetCalibration()
+        {
+            // Function local static: calibrated on first use,
+            // which may be during static initialization
+            static Calibration const calibration = Calibrate();
+            return calibration;
+        }
+
+        // CalibrateAtStartup
+        // * calibrating sleeps ~10ms, so it's done during static
+        //   initialization rather than on first use, which can be
+        //   inside a lock (ie the Logger's, for the first log
+        //   line) and would stall every thread waiting on it
+        // * clocks read during static initialization before
+        //   this still calibrate on first use
+        struct CalibrateAtStartup
+        {
+            CalibrateAtStartup()
+            {
+                GetCalibration();
+            }
+        };
+
+        CalibrateAtStartup g_calibrate_at_startup;
+    }
+
+    // ============================================================= //
+
+    FastClock::time_point FastClock::now()
+    {
+        return time_point(duration(GetSteadyNs()));
+    }
+
+    s64 FastClock::GetSteadyNs()
+    {
+        return ReadSteadyNs(GetCalibration());
+    }
+
+    s64 FastClock::GetPreciseNs()
+    {
+        Calibration const &calibration = GetCalibration();
+        if(calibration.source == Source::MonotonicCoarse) {
+            return GetStdSteadyNs();
+        }
+        return ReadSteadyNs(calibration);
+    }
+
+    u64 FastClock::GetWallNs()
+    {
+        return static_cast<u64>(GetSteadyNs()+GetCalibration().wall_offset_ns);
+    }
+
+    std::chrono::system_clock::time_point FastClock::ToWallTime(time_point time)
+    {
+        std::chrono::nanoseconds const wall_ns(
+                    time.time_since_epoch().count()+
+                    GetCalibration().wall_offset_ns);
+
+        return std::chrono::system_clock::time_point(
+                    std::chrono::duration_cast<
+                        std::chrono::system_clock::duration>(wall_ns));
+    }
+
+    FastClock::Source FastClock::GetSource()
+    {
+        return GetCalibration().source;
+    }
+
+    // ============================================================= //
+
+} // ks
@@ -0,0 +1,86 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_FAST_CLOCK_HPP
+#define KS_FAST_CLOCK_HPP
+
+#include <ks/KsGlobal.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // FastClock
+    // * a steady clock for timestamps that are taken often
+    //   (ie log lines and instrumentation), where the cost
+    //   of the std clocks shows up
+    // * reads the TSC when the cpu has an invariant TSC (x86-64),
+    //   converting ticks with a rate calibrated against the
+    //   steady clock during static initialization (which
+    //   takes ~10ms). Otherwise uses CLOCK_MONOTONIC_COARSE
+    //   on Linux (a few ms resolution) and steady_clock
+    //   everywhere else
+    // * shares its epoch with std::chrono::steady_clock
+    // * wall time is derived from a system_clock offset taken
+    //   at calibration, so it doesn't follow later changes
+    //   to the system time
+    // * meets the std Clock requirements, so it can be used
+    //   with std::chrono like any other clock
+    class FastClock
+    {
+    public:
+        using rep = s64;
+        using period = std::nano;
+        using duration = std::chrono::nanoseconds;
+        using time_point = std::chrono::time_point<FastClock,duration>;
+
+        static bool const is_steady = true;
+
+        enum class Source : u8
+        {
+            TSC,
+            MonotonicCoarse,
+            SteadyClock
+        };
+
+        static time_point now();
+
+        // * Returns steady time in nanoseconds
+        static s64 GetSteadyNs();
+
+        // * Returns steady time in nanoseconds from a source
+        //   with sub microsecond resolution: the TSC where it's
+        //   used, otherwise steady_clock (never the coarse
+        //   clock), on the same epoch as GetSteadyNs
+        // * for measuring short durations (ie latencies), which
+        //   the coarse clock would round to its few ms tick
+        static s64 GetPreciseNs();
+
+        // * Returns wall time in nanoseconds since
+        //   the unix epoch
+        static u64 GetWallNs();
+
+        static std::chrono::system_clock::time_point
+        ToWallTime(time_point time);
+
+        static Source GetSource();
+    };
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_FAST_CLOCK_HPP
@@ -0,0 +1,228 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include <ks/KsConfig.hpp>
+#include <ks/KsFileStreamReader.hpp>
+
+#ifdef KS_ENV_LINUX
+#include <fcntl.h>
+#endif
+
+namespace ks
+{
+    // ============================================================= //
+
+    namespace file_stream_detail
+    {
+        // * Shared between the reader, its thread and any
+        //   chunks that are still referenced
+        struct SharedState
+        {
+            SharedState(size_t chunk_size, uint chunk_count) :
+                list_buffers(chunk_count,std::vector<char>(chunk_size)),
+                stop(false)
+            {
+                for(uint i=0; i < chunk_count; i++) {
+                    list_free_buffers.push_back(i);
+                }
+            }
+
+            std::mutex mutex;
+            std::condition_variable cv;
+
+            std::vector<std::vector<char>> list_buffers;
+            std::vector<uint> list_free_buffers;
+            bool stop;
+        };
+    }
+
+    namespace
+    {
+        using file_stream_detail::SharedState;
+
+        bool GetStopped(SharedState &state)
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            return state.stop;
+        }
+
+        shared_ptr<FileChunk const> MakeChunk(shared_ptr<SharedState> const &state,
+                                              uint buffer_index,
+                                              size_t size,
+                                              u64 offset)
+        {
+            FileChunk * chunk = new FileChunk;
+            chunk->data = state->list_buffers[buffer_index].data();
+            chunk->size = size;
+            chunk->offset = offset;
+
+            // Releasing the chunk frees its buffer for
+            // the next read
+            return shared_ptr<FileChunk const>(
+                        chunk,
+                        [state,buffer_index](FileChunk const * p) {
+                            delete p;
+                            {
+                                std::lock_guard<std::mutex> lock(state->mutex);
+                                state->list_free_buffers.push_back(buffer_index);
+                            }
+                            state->cv.notify_one();
+                        });
+        }
+
+        void ReadFile(std::FILE * file,
+                      shared_ptr<SharedState> state,
+                      shared_ptr<EventLoop> event_loop,
+                      weak_ptr<FileStreamReader> weak_reader)
+        {
+            u64 offset = 0;
+            while(true) {
+                uint buffer_index;
+                {
+                    std::unique_lock<std::mutex> lock(state->mutex);
+                    state->cv.wait(lock,[&state]() {
+                        return (state->stop || !state->list_free_buffers.empty());
+                    });
+
+                    if(state->stop) {
+                        break;
+                    }
+
+                    buffer_index = state->list_free_buffers.back();
+                    state->list_free_buffers.pop_back();
+                }
+
+                std::vector<char> &buffer = state->list_buffers[buffer_index];
+                size_t const read_size =
+                        std::fread(buffer.data(),1,buffer.size(),file);
+
+                if(read_size > 0) {
+                    shared_ptr<FileChunk const> chunk =
+                            MakeChunk(state,buffer_index,read_size,offset);
+
+                    event_loop->PostCallback(
+                                [state,weak_reader,chunk]() {
+                                    auto reader = weak_reader.lock();
+                                    if(reader && !GetStopped(*state)) {
+                                        reader->signal_chunk.Emit(chunk);
+                                    }
+                                });
+
+                    offset += read_size;
+                }
+                else {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->list_free_buffers.push_back(buffer_index);
+                }
+
+                if(read_size < buffer.size()) {
+                    // End of file or an error
+                    bool const ok = (std::ferror(file) == 0);
+                    event_loop->PostCallback(
+                                [state,weak_reader,ok]() {
+                                    auto reader = weak_reader.lock();
+                                    if(reader && !GetStopped(*state)) {
+                                        reader->signal_finished.Emit(ok);
+                                    }
+                                });
+                    break;
+                }
+            }
+
+            std::fclose(file);
+        }
+    }
+
+    // ============================================================= //
+
+    FileStreamReader::FileStreamReader(ks::Object::Key const &key,
+                                       shared_ptr<EventLoop> const &event_loop,
+                                       Options options) :
+        ks::Object(key,event_loop),
+        m_options(std::move(options))
+    {
+        // empty
+    }
+
+    void FileStreamReader::Init(ks::Object::Key const &,
+                                shared_ptr<FileStreamReader> const &)
+    {
+        // empty
+    }
+
+    FileStreamReader::~FileStreamReader()
+    {
+        Stop();
+    }
+
+    bool FileStreamReader::Start()
+    {
+        Stop();
+
+        std::FILE * file = std::fopen(m_options.file_path.c_str(),"rb");
+        if(file == nullptr) {
+            return false;
+        }
+
+        #ifdef KS_ENV_LINUX
+        // Let the kernel read ahead more aggressively
+        posix_fadvise(fileno(file),0,0,POSIX_FADV_SEQUENTIAL);
+        #endif
+
+        // The stream does its own buffering
+        std::setvbuf(file,nullptr,_IONBF,0);
+
+        m_state = make_shared<file_stream_detail::SharedState>(
+                    std::max(m_options.chunk_size,size_t(1)),
+                    std::max(m_options.max_chunks_ahead,uint(1)));
+
+        // The thread only holds a weak reference so that
+        // it doesn't keep the reader alive
+        weak_ptr<FileStreamReader> weak_reader =
+                std::static_pointer_cast<FileStreamReader>(
+                    shared_from_this());
+
+        m_thread = std::thread(ReadFile,file,m_state,GetEventLoop(),weak_reader);
+
+        return true;
+    }
+
+    void FileStreamReader::Stop()
+    {
+        if(m_state) {
+            {
+                std::lock_guard<std::mutex> lock(m_state->mutex);
+                m_state->stop = true;
+            }
+            m_state->cv.notify_all();
+        }
+
+        if(m_thread.joinable()) {
+            m_thread.join();
+        }
+
+        m_state = nullptr;
+    }
+
+    // ============================================================= //
+
+} // ks
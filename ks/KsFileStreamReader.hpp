@@ -0,0 +1,115 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_FILE_STREAM_READER_HPP
+#define KS_FILE_STREAM_READER_HPP
+
+#include <string>
+#include <thread>
+
+#include <ks/KsObject.hpp>
+#include <ks/KsSignal.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // FileChunk
+    // * a view of one chunk of a file read by FileStreamReader
+    // * the data stays valid, and the buffer it's in stays
+    //   reserved, for as long as the chunk is referenced
+    struct FileChunk
+    {
+        char const * data;
+        size_t size;
+
+        // position of the chunk in the file
+        u64 offset;
+    };
+
+    namespace file_stream_detail
+    {
+        struct SharedState;
+    }
+
+    // FileStreamReader
+    // * reads a file in fixed size chunks on a background thread
+    //   and emits each one on this Object's EventLoop, so the
+    //   loop never blocks on file reads
+    // * chunks are read into a fixed pool of buffers and emitted
+    //   without copying. The reader waits for a chunk to be
+    //   released once max_chunks_ahead are unreleased, so a
+    //   slow consumer limits how far ahead it reads
+    // * chunks are emitted in file order, followed by
+    //   signal_finished
+    class FileStreamReader : public ks::Object
+    {
+    public:
+        using base_type = ks::Object;
+
+        struct Options
+        {
+            Options(std::string file_path) :
+                file_path(std::move(file_path)),
+                chunk_size(1024*1024),
+                max_chunks_ahead(2)
+            {}
+
+            std::string file_path;
+
+            size_t chunk_size;
+
+            // number of chunks that can be read but not yet
+            // released; two double buffers the reads
+            uint max_chunks_ahead;
+        };
+
+        FileStreamReader(ks::Object::Key const &key,
+                         shared_ptr<EventLoop> const &event_loop,
+                         Options options);
+
+        void Init(ks::Object::Key const &,
+                  shared_ptr<FileStreamReader> const &);
+
+        ~FileStreamReader();
+
+        // * Opens the file and starts reading from the
+        //   beginning, stopping any previous read first
+        // * Returns false if the file couldn't be opened
+        bool Start();
+
+        // * Stops reading; chunks that were read but not yet
+        //   emitted are dropped
+        void Stop();
+
+        // * Emitted with each chunk of the file
+        Signal<shared_ptr<FileChunk const>> signal_chunk;
+
+        // * Emitted once after the last chunk, with false
+        //   if a read failed
+        Signal<bool> signal_finished;
+
+    private:
+        Options const m_options;
+        shared_ptr<file_stream_detail::SharedState> m_state;
+        std::thread m_thread;
+    };
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_FILE_STREAM_READER_HPP
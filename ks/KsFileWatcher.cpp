@@ -0,0 +1,277 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <ks/KsConfig.hpp>
+#include <ks/KsFileWatcher.hpp>
+
+#if defined(KS_ENV_LINUX) || defined(KS_ENV_ANDROID)
+    #define KS_FILE_WATCHER_INOTIFY 1
+    #include <sys/inotify.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace ks
+{
+    namespace
+    {
+        #ifdef KS_FILE_WATCHER_INOTIFY
+        u32 const k_watch_mask =
+                IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE |
+                IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+        // * Splits @path into its directory and file name
+        void SplitPath(std::string const &path,
+                       std::string &dir_path,
+                       std::string &file_name)
+        {
+            size_t const slash = path.find_last_of('/');
+            if(slash == std::string::npos) {
+                dir_path = ".";
+                file_name = path;
+            }
+            else {
+                dir_path = (slash == 0) ? "/" : path.substr(0,slash);
+                file_name = path.substr(slash+1);
+            }
+        }
+        #endif
+    }
+
+    // ============================================================= //
+
+    FileWatcher::FileWatcher(ks::Object::Key const &key,
+                             shared_ptr<EventLoop> const &event_loop,
+                             Milliseconds coalesce_interval) :
+        ks::Object(key,event_loop),
+        m_coalesce_interval(coalesce_interval),
+        m_inotify_fd(-1),
+        m_descriptor_id(0),
+        m_timer_pending(false)
+    {
+        #ifdef KS_FILE_WATCHER_INOTIFY
+        m_inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        #endif
+    }
+
+    void FileWatcher::Init(ks::Object::Key const &,
+                           shared_ptr<FileWatcher> const &this_watcher)
+    {
+        m_coalesce_timer = MakeObject<Timer>(GetEventLoop());
+        m_coalesce_timer->signal_timeout.Connect(
+                    this_watcher,
+                    &FileWatcher::onCoalesceTimeout,
+                    ConnectionType::Direct);
+
+        #ifdef KS_FILE_WATCHER_INOTIFY
+        if(m_inotify_fd < 0) {
+            return;
+        }
+
+        // The callback drains the descriptor even after the
+        // watcher is gone, until the loop removes it
+        int const fd = m_inotify_fd;
+        weak_ptr<FileWatcher> weak_watcher = this_watcher;
+
+        m_descriptor_id = GetEventLoop()->AddDescriptor(
+                    fd,
+                    [fd,weak_watcher]() {
+                        alignas(struct inotify_event) char buffer[4096];
+                        while(true) {
+                            ssize_t const size = read(fd,buffer,sizeof(buffer));
+                            if(size <= 0) {
+                                break;
+                            }
+
+                            auto watcher = weak_watcher.lock();
+                            if(watcher) {
+                                watcher->onEvents(buffer,static_cast<size_t>(size));
+                            }
+                        }
+                    });
+        #else
+        (void)this_watcher;
+        #endif
+    }
+
+    FileWatcher::~FileWatcher()
+    {
+        #ifdef KS_FILE_WATCHER_INOTIFY
+        if(m_descriptor_id != 0) {
+            // The loop closes the descriptor
+            GetEventLoop()->RemoveDescriptor(m_descriptor_id);
+        }
+        else if(m_inotify_fd >= 0) {
+            close(m_inotify_fd);
+        }
+        #endif
+    }
+
+    bool FileWatcher::AddPath(std::string const &path)
+    {
+        #ifdef KS_FILE_WATCHER_INOTIFY
+        if(m_descriptor_id == 0 || path.empty()) {
+            return false;
+        }
+
+        struct stat path_stat;
+        bool const is_dir =
+                (stat(path.c_str(),&path_stat) == 0) &&
+                S_ISDIR(path_stat.st_mode);
+
+        std::string dir_path;
+        std::string file_name;
+        if(is_dir) {
+            dir_path = path;
+        }
+        else {
+            SplitPath(path,dir_path,file_name);
+        }
+
+        // The same directory always gives the same watch
+        int const wd = inotify_add_watch(m_inotify_fd,dir_path.c_str(),k_watch_mask);
+        if(wd < 0) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        DirInfo &dir_info = m_list_dirs[wd];
+        if(is_dir) {
+            dir_info.dir_path = path;
+            dir_info.whole_dir = true;
+        }
+        else {
+            dir_info.list_files[file_name] = path;
+        }
+
+        return true;
+        #else
+        (void)path;
+        return false;
+        #endif
+    }
+
+    void FileWatcher::RemovePath(std::string const &path)
+    {
+        #ifdef KS_FILE_WATCHER_INOTIFY
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for(auto it = m_list_dirs.begin(); it != m_list_dirs.end(); ++it) {
+            DirInfo &dir_info = it->second;
+            if(dir_info.whole_dir && dir_info.dir_path == path) {
+                dir_info.whole_dir = false;
+                dir_info.dir_path.clear();
+            }
+
+            for(auto file_it = dir_info.list_files.begin();
+                file_it != dir_info.list_files.end(); ++file_it)
+            {
+                if(file_it->second == path) {
+                    dir_info.list_files.erase(file_it);
+                    break;
+                }
+            }
+
+            if(!dir_info.whole_dir && dir_info.list_files.empty()) {
+                // If the watch is already gone (ie the directory
+                // was deleted) its IN_IGNORED is still queued
+                inotify_rm_watch(m_inotify_fd,it->first);
+                m_list_retired_wds.insert(it->first);
+                m_list_dirs.erase(it);
+                break;
+            }
+        }
+
+        m_list_pending.erase(path);
+        #else
+        (void)path;
+        #endif
+    }
+
+    void FileWatcher::onEvents(char const * data, size_t size)
+    {
+        #ifdef KS_FILE_WATCHER_INOTIFY
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        size_t offset = 0;
+        while(offset+sizeof(struct inotify_event) <= size) {
+            struct inotify_event const * event =
+                    reinterpret_cast<struct inotify_event const*>(data+offset);
+
+            offset += sizeof(struct inotify_event)+event->len;
+
+            // Events are read in order, so everything before a
+            // retired watch's IN_IGNORED is from that watch even
+            // if its descriptor has been reused since
+            auto retired_it = m_list_retired_wds.find(event->wd);
+            if(retired_it != m_list_retired_wds.end()) {
+                if(event->mask & IN_IGNORED) {
+                    m_list_retired_wds.erase(retired_it);
+                }
+                continue;
+            }
+
+            auto dir_it = m_list_dirs.find(event->wd);
+            if(dir_it == m_list_dirs.end()) {
+                continue;
+            }
+
+            DirInfo const &dir_info = dir_it->second;
+            if(dir_info.whole_dir) {
+                m_list_pending.insert(dir_info.dir_path);
+            }
+
+            if(event->len > 0) {
+                auto file_it = dir_info.list_files.find(event->name);
+                if(file_it != dir_info.list_files.end()) {
+                    m_list_pending.insert(file_it->second);
+                }
+            }
+
+            if(event->mask & IN_IGNORED) {
+                // The directory was deleted or unmounted
+                m_list_dirs.erase(dir_it);
+            }
+        }
+
+        if(!m_list_pending.empty() && !m_timer_pending) {
+            m_timer_pending = true;
+            m_coalesce_timer->Start(m_coalesce_interval,false);
+        }
+        #else
+        (void)data;
+        (void)size;
+        #endif
+    }
+
+    void FileWatcher::onCoalesceTimeout()
+    {
+        std::set<std::string> list_changed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            list_changed.swap(m_list_pending);
+            m_timer_pending = false;
+        }
+
+        for(auto const &path : list_changed) {
+            signal_changed.Emit(path);
+        }
+    }
+
+    // ============================================================= //
+
+} // ks
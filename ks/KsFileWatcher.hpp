@@ -0,0 +1,106 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_FILE_WATCHER_HPP
+#define KS_FILE_WATCHER_HPP
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <ks/KsObject.hpp>
+#include <ks/KsSignal.hpp>
+#include <ks/KsTimer.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // FileWatcher
+    // * emits signal_changed when a watched file or directory
+    //   changes, instead of polling it with a Timer
+    // * uses inotify, read through this Object's EventLoop, so
+    //   nothing runs while the paths are idle. Only Linux and
+    //   Android are supported; AddPath fails elsewhere
+    // * bursts of changes (ie a file written in many pieces)
+    //   are coalesced: a path is emitted once per coalesce
+    //   interval no matter how many changes it had
+    // * files are watched through their directory so that
+    //   replacing a file (ie an editor's save by rename) and
+    //   creating a missing file are seen as changes
+    class FileWatcher : public ks::Object
+    {
+    public:
+        using base_type = ks::Object;
+
+        FileWatcher(ks::Object::Key const &key,
+                    shared_ptr<EventLoop> const &event_loop,
+                    Milliseconds coalesce_interval=Milliseconds(50));
+
+        void Init(ks::Object::Key const &,
+                  shared_ptr<FileWatcher> const &);
+
+        ~FileWatcher();
+
+        // * Starts watching @path, which is a file or directory.
+        //   A directory changes when anything in it does
+        // * The directory of a file must exist
+        // * Returns false if the path couldn't be watched
+        bool AddPath(std::string const &path);
+
+        void RemovePath(std::string const &path);
+
+        // * Emitted with the path given to AddPath
+        Signal<std::string> signal_changed;
+
+    private:
+        void onEvents(char const * data, size_t size);
+        void onCoalesceTimeout();
+
+        // A directory with an inotify watch
+        struct DirInfo
+        {
+            // path given to AddPath if the directory
+            // itself was added
+            std::string dir_path;
+            bool whole_dir;
+
+            // file name -> path given to AddPath
+            std::map<std::string,std::string> list_files;
+        };
+
+        Milliseconds const m_coalesce_interval;
+        shared_ptr<Timer> m_coalesce_timer;
+
+        std::mutex m_mutex;
+        int m_inotify_fd;
+        Id m_descriptor_id;
+        std::map<int,DirInfo> m_list_dirs; // by watch descriptor
+
+        // Watches removed by RemovePath whose IN_IGNORED
+        // hasn't been read yet. inotify can reuse their
+        // descriptors, so their queued events are skipped
+        std::set<int> m_list_retired_wds;
+        std::set<std::string> m_list_pending;
+        bool m_timer_pending;
+    };
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_FILE_WATCHER_HPP
@@ -0,0 +1,485 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cfloat>
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <ks/KsFormat.hpp>
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    #define KS_FORMAT_SWAR 1
+#endif
+
+namespace ks
+{
+    namespace format_detail
+    {
+        namespace
+        {
+            // "00" "01" ... "99"; lets us emit two
+            // digits per division
+            char const g_digit_pairs[201] =
+                    "00010203040506070809"
+                    "10111213141516171819"
+                    "20212223242526272829"
+                    "30313233343536373839"
+                    "40414243444546474849"
+                    "50515253545556575859"
+                    "60616263646566676869"
+                    "70717273747576777879"
+                    "80818283848586878889"
+                    "90919293949596979899";
+
+            // Every power of ten up to 1e22 is exact in a double
+            double const g_exact_pow10[23] = {
+                1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+                1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22
+            };
+
+            std::uint64_t const k_max_exact_mantissa = std::uint64_t(1) << 53;
+
+            inline bool IsDigit(char c)
+            {
+                return (c >= '0' && c <= '9');
+            }
+
+            #ifdef KS_FORMAT_SWAR
+            // SWAR (SIMD within a register) digit handling;
+            // @chunk is eight chars loaded little endian
+
+            inline bool IsEightDigits(std::uint64_t chunk)
+            {
+                // Each byte must be 0x30-0x39: the high nibble is
+                // 3 and adding 6 doesn't carry into it
+                return (((chunk & 0xF0F0F0F0F0F0F0F0ull) |
+                         (((chunk+0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ==
+                        0x3333333333333333ull);
+            }
+
+            inline std::uint32_t ParseEightDigits(std::uint64_t chunk)
+            {
+                // Combine pairs of digits, then pairs of
+                // pairs, then the two halves
+                chunk = ((chunk & 0x0F0F0F0F0F0F0F0Full)*2561) >> 8;
+                chunk = ((chunk & 0x00FF00FF00FF00FFull)*6553601) >> 16;
+                return static_cast<std::uint32_t>(
+                            ((chunk & 0x0000FFFF0000FFFFull)*42949672960001ull) >> 32);
+            }
+            #endif
+
+            // * Case insensitive match of @word (lowercase)
+            //   at the start of [@first,@last)
+            char const * MatchWord(char const * first,
+                                   char const * last,
+                                   char const * word)
+            {
+                char const * it = first;
+                for(; *word != '\0'; ++word, ++it) {
+                    if(it == last || (*it | 0x20) != *word) {
+                        return first;
+                    }
+                }
+                return it;
+            }
+
+            // * Writes @precision significant @digits with the
+            //   decimal exponent @exp10 the way %g would
+            char * WriteGeneral(char * first,
+                                bool negative,
+                                char const * digits,
+                                int precision,
+                                int exp10)
+            {
+                int size = precision;
+                while(size > 1 && digits[size-1] == '0') {
+                    size--;
+                }
+
+                if(negative) {
+                    *first++ = '-';
+                }
+
+                if(exp10 < -4 || exp10 >= precision) {
+                    *first++ = digits[0];
+                    if(size > 1) {
+                        *first++ = '.';
+                        std::memcpy(first,digits+1,static_cast<std::size_t>(size-1));
+                        first += size-1;
+                    }
+
+                    *first++ = 'e';
+                    *first++ = (exp10 < 0) ? '-' : '+';
+                    unsigned const exp_abs = static_cast<unsigned>((exp10 < 0) ? -exp10 : exp10);
+                    if(exp_abs < 10) {
+                        *first++ = '0';
+                    }
+                    return FormatU64(first,exp_abs);
+                }
+
+                if(exp10 < 0) {
+                    *first++ = '0';
+                    *first++ = '.';
+                    for(int i=-1; i > exp10; i--) {
+                        *first++ = '0';
+                    }
+                    std::memcpy(first,digits,static_cast<std::size_t>(size));
+                    return first+size;
+                }
+
+                int const int_size = exp10+1;
+                for(int i=0; i < int_size; i++) {
+                    *first++ = (i < size) ? digits[i] : '0';
+                }
+
+                if(size > int_size) {
+                    *first++ = '.';
+                    std::memcpy(first,digits+int_size,static_cast<std::size_t>(size-int_size));
+                    first += size-int_size;
+                }
+                return first;
+            }
+
+            double ParseDoubleSlow(char const * first, char const * last)
+            {
+                // strtod needs a null terminated copy, and reads
+                // the decimal point from the C locale
+                char const point = std::localeconv()->decimal_point[0];
+                std::size_t const size = static_cast<std::size_t>(last-first);
+
+                char buff[128];
+                std::string str;
+                char * copy = buff;
+                if(size >= sizeof(buff)) {
+                    str.resize(size+1);
+                    copy = &(str[0]);
+                }
+
+                for(std::size_t i=0; i < size; i++) {
+                    copy[i] = (first[i] == '.') ? point : first[i];
+                }
+                copy[size] = '\0';
+
+                return std::strtod(copy,nullptr);
+            }
+        }
+
+        char * FormatU64(char * first, std::uint64_t val)
+        {
+            // Write backwards into a scratch buffer,
+            // then copy forward
+            char buff[24];
+            char * p = buff+sizeof(buff);
+
+            while(val >= 100) {
+                unsigned const idx = static_cast<unsigned>(val%100)*2;
+                val /= 100;
+                *--p = g_digit_pairs[idx+1];
+                *--p = g_digit_pairs[idx];
+            }
+
+            if(val >= 10) {
+                unsigned const idx = static_cast<unsigned>(val)*2;
+                *--p = g_digit_pairs[idx+1];
+                *--p = g_digit_pairs[idx];
+            }
+            else {
+                *--p = static_cast<char>('0'+val);
+            }
+
+            std::size_t const size = static_cast<std::size_t>((buff+sizeof(buff))-p);
+            std::memcpy(first,p,size);
+            return first+size;
+        }
+
+        char * FormatS64(char * first, std::int64_t val)
+        {
+            std::uint64_t uval = static_cast<std::uint64_t>(val);
+            if(val < 0) {
+                *first++ = '-';
+                uval = 0-uval; // well defined for INT64_MIN
+            }
+            return FormatU64(first,uval);
+        }
+
+        char * FormatDouble(char * first, double val)
+        {
+            // Integral values that %g prints without an
+            // exponent take the integer path
+            if(val == std::floor(val) && std::fabs(val) < 1e6) {
+                if(val == 0 && std::signbit(val)) {
+                    *first++ = '-';
+                    *first++ = '0';
+                    return first;
+                }
+                return FormatS64(first,static_cast<std::int64_t>(val));
+            }
+
+            // Everything else (including inf and nan) goes through
+            // snprintf, which avoids the allocations and locale
+            // lookups of a stream. %g matches the default ostream
+            // float formatting
+            int const size = std::snprintf(first,k_format_max_size,"%g",val);
+            return first+((size > 0) ? size : 0);
+        }
+
+        char * FormatDoubleRoundTrip(char * first, double val)
+        {
+            if(!std::isfinite(val)) {
+                return FormatDouble(first,val);
+            }
+
+            if(val == std::floor(val) && std::fabs(val) < 1e15) {
+                if(val == 0) {
+                    return FormatDouble(first,val); // keeps -0
+                }
+                return FormatS64(first,static_cast<std::int64_t>(val));
+            }
+
+            // Format once with seventeen significant digits,
+            // which always round trip, then try shorter roundings
+            // of those digits; most values need fewer
+            char sci[k_format_max_size];
+            std::snprintf(sci,sizeof(sci),"%.16e",std::fabs(val));
+
+            // "d.dddddddddddddddde+XX"
+            char digits[17];
+            digits[0] = sci[0];
+            std::memcpy(digits+1,sci+2,16);
+            int const exp10 = std::atoi(sci+19);
+
+            bool const negative = (val < 0);
+
+            for(int precision=15; precision < 17; precision++) {
+                char rounded[17];
+                int rounded_exp10 = exp10;
+                std::memcpy(rounded,digits,static_cast<std::size_t>(precision));
+
+                if(digits[precision] >= '5') {
+                    int i = precision-1;
+                    for(; i >= 0 && rounded[i] == '9'; i--) {
+                        rounded[i] = '0';
+                    }
+                    if(i >= 0) {
+                        rounded[i]++;
+                    }
+                    else {
+                        rounded[0] = '1'; // 999... -> 1000...
+                        rounded_exp10++;
+                    }
+                }
+
+                char * last = WriteGeneral(first,negative,rounded,precision,rounded_exp10);
+
+                double parsed;
+                if(ParseDouble(first,last,parsed) == last && parsed == val) {
+                    return last;
+                }
+            }
+
+            return WriteGeneral(first,negative,digits,17,exp10);
+        }
+
+        void AppendDoubleFixed(std::string &str, double val, unsigned precision)
+        {
+            // Fixed notation has no upper bound on its size
+            // (ie 1e300), so fall back to sizing the string
+            // for large values
+            char buff[64];
+            int const size = std::snprintf(buff,sizeof(buff),"%.*f",
+                                           static_cast<int>(precision),val);
+            if(size <= 0) {
+                return;
+            }
+
+            if(static_cast<std::size_t>(size) < sizeof(buff)) {
+                str.append(buff,static_cast<std::size_t>(size));
+                return;
+            }
+
+            std::size_t const offset = str.size();
+            str.resize(offset+static_cast<std::size_t>(size)+1);
+            std::snprintf(&(str[offset]),static_cast<std::size_t>(size)+1,"%.*f",
+                          static_cast<int>(precision),val);
+            str.resize(offset+static_cast<std::size_t>(size));
+        }
+
+        // ============================================================= //
+
+        char const * ParseU64(char const * first,
+                              char const * last,
+                              std::uint64_t &val)
+        {
+            std::uint64_t const max_div10 = UINT64_MAX/10;
+            unsigned const max_mod10 = static_cast<unsigned>(UINT64_MAX%10);
+
+            std::uint64_t result = 0;
+            char const * it = first;
+
+            #ifdef KS_FORMAT_SWAR
+            // Eight digits at a time while the result can't
+            // overflow (nineteen digits always fit)
+            while(last-it >= 8 && (it-first) <= 19-8) {
+                std::uint64_t chunk;
+                std::memcpy(&chunk,it,sizeof(chunk));
+                if(!IsEightDigits(chunk)) {
+                    break;
+                }
+                result = result*100000000+ParseEightDigits(chunk);
+                it += 8;
+            }
+            #endif
+
+            for(; it != last && IsDigit(*it); ++it) {
+                unsigned const digit = static_cast<unsigned>(*it-'0');
+                if(result > max_div10 || (result == max_div10 && digit > max_mod10)) {
+                    return first; // overflow
+                }
+                result = result*10+digit;
+            }
+
+            if(it != first) {
+                val = result;
+            }
+            return it;
+        }
+
+        char const * ParseDouble(char const * first,
+                                 char const * last,
+                                 double &val)
+        {
+            char const * it = first;
+            bool negative = false;
+            if(it != last && (*it == '-' || *it == '+')) {
+                negative = (*it == '-');
+                ++it;
+            }
+
+            // inf, infinity and nan
+            if(it != last && !IsDigit(*it) && *it != '.') {
+                char const * end = MatchWord(it,last,"inf");
+                if(end != it) {
+                    end = MatchWord(end,last,"inity");
+                    val = negative ?
+                                -std::numeric_limits<double>::infinity() :
+                                std::numeric_limits<double>::infinity();
+                    return end;
+                }
+
+                end = MatchWord(it,last,"nan");
+                if(end != it) {
+                    val = negative ?
+                                -std::numeric_limits<double>::quiet_NaN() :
+                                std::numeric_limits<double>::quiet_NaN();
+                    return end;
+                }
+                return first;
+            }
+
+            // Collect up to 19 significant digits (which always
+            // fit in a u64) and the decimal exponent
+            char const * number_first = it;
+            std::uint64_t mantissa = 0;
+            int sig_digits = 0;
+            int exponent = 0;
+            bool truncated = false;
+            bool any_digits = false;
+
+            for(; it != last && IsDigit(*it); ++it) {
+                any_digits = true;
+                if(sig_digits < 19) {
+                    mantissa = mantissa*10+static_cast<unsigned>(*it-'0');
+                    sig_digits += (mantissa != 0);
+                }
+                else {
+                    truncated |= (*it != '0');
+                    exponent++;
+                }
+            }
+
+            if(it != last && *it == '.') {
+                ++it;
+                for(; it != last && IsDigit(*it); ++it) {
+                    any_digits = true;
+                    if(sig_digits < 19) {
+                        mantissa = mantissa*10+static_cast<unsigned>(*it-'0');
+                        sig_digits += (mantissa != 0);
+                        exponent--;
+                    }
+                    else {
+                        truncated |= (*it != '0');
+                    }
+                }
+            }
+
+            if(!any_digits) {
+                return first;
+            }
+
+            // The exponent is only used if it has digits
+            if(it != last && (*it == 'e' || *it == 'E')) {
+                char const * exp_it = it+1;
+                bool exp_negative = false;
+                if(exp_it != last && (*exp_it == '-' || *exp_it == '+')) {
+                    exp_negative = (*exp_it == '-');
+                    ++exp_it;
+                }
+
+                if(exp_it != last && IsDigit(*exp_it)) {
+                    int exp_val = 0;
+                    for(; exp_it != last && IsDigit(*exp_it); ++exp_it) {
+                        if(exp_val < 100000) {
+                            exp_val = exp_val*10+(*exp_it-'0');
+                        }
+                    }
+                    exponent += exp_negative ? -exp_val : exp_val;
+                    it = exp_it;
+                }
+            }
+
+            double result;
+
+            #if FLT_EVAL_METHOD == 0
+            // Fast path: when the mantissa and the power of ten
+            // are both exact doubles, a single multiply or divide
+            // is correctly rounded
+            if(!truncated &&
+               mantissa <= k_max_exact_mantissa &&
+               exponent >= -22 && exponent <= 22)
+            {
+                result = static_cast<double>(mantissa);
+                result = (exponent < 0) ?
+                            result/g_exact_pow10[-exponent] :
+                            result*g_exact_pow10[exponent];
+            }
+            else
+            #endif
+            {
+                result = std::fabs(ParseDoubleSlow(number_first,it));
+                if(std::isinf(result)) {
+                    return first; // out of range
+                }
+            }
+
+            val = negative ? -result : result;
+            return it;
+        }
+    }
+
+} // ks
@@ -0,0 +1,326 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_FORMAT_HPP
+#define KS_FORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+// Note: This header only depends on the standard library
+// so that KsGlobal.hpp can use it
+
+namespace ks
+{
+    // ============================================================= //
+
+    // Number formatting
+    // * to_chars style: each function writes into a caller
+    //   provided buffer and returns a pointer one past the
+    //   last char written; nothing is allocated and no
+    //   locale is consulted
+    // * the output matches what a default constructed
+    //   std::ostream would write for the same value
+
+    // * A buffer of this many chars is always large enough
+    std::size_t const k_format_max_size = 32;
+
+    namespace format_detail
+    {
+        char * FormatU64(char * first, std::uint64_t val);
+        char * FormatS64(char * first, std::int64_t val);
+        char * FormatDouble(char * first, double val);
+        char * FormatDoubleRoundTrip(char * first, double val);
+        void AppendDoubleFixed(std::string &str, double val, unsigned precision);
+    }
+
+    /// * Writes the decimal representation of @val
+    template<typename T>
+    typename std::enable_if<
+        std::is_integral<T>::value &&
+        std::is_unsigned<T>::value,char*>::type
+    FormatInteger(char * first, T val)
+    {
+        return format_detail::FormatU64(first,static_cast<std::uint64_t>(val));
+    }
+
+    template<typename T>
+    typename std::enable_if<
+        std::is_integral<T>::value &&
+        std::is_signed<T>::value,char*>::type
+    FormatInteger(char * first, T val)
+    {
+        return format_detail::FormatS64(first,static_cast<std::int64_t>(val));
+    }
+
+    /// * Writes @val with six significant digits in fixed or
+    ///   scientific notation, whichever is shorter (ie %g)
+    inline char * FormatFloat(char * first, double val)
+    {
+        return format_detail::FormatDouble(first,val);
+    }
+
+    /// * Writes @val with as few significant digits (fifteen
+    ///   to seventeen) as are needed for ParseFloat to read
+    ///   back exactly the same double
+    /// * Integral values below 1e15 are written without an
+    ///   exponent; inf and nan are written as by FormatFloat
+    inline char * FormatFloatRoundTrip(char * first, double val)
+    {
+        return format_detail::FormatDoubleRoundTrip(first,val);
+    }
+
+    // ============================================================= //
+
+    namespace format_detail
+    {
+        enum class NumberKind
+        {
+            Bool,
+            Char,
+            Integer,
+            Float
+        };
+
+        template<typename T>
+        struct number_kind : std::integral_constant<
+                NumberKind,
+                std::is_same<T,bool>::value ? NumberKind::Bool :
+                (std::is_same<T,char>::value ||
+                 std::is_same<T,signed char>::value ||
+                 std::is_same<T,unsigned char>::value) ? NumberKind::Char :
+                std::is_integral<T>::value ? NumberKind::Integer :
+                NumberKind::Float> {};
+
+        template<typename T>
+        void AppendNumber(std::string &str, T val,
+                          std::integral_constant<NumberKind,NumberKind::Bool>)
+        {
+            str.push_back(val ? '1' : '0');
+        }
+
+        template<typename T>
+        void AppendNumber(std::string &str, T val,
+                          std::integral_constant<NumberKind,NumberKind::Char>)
+        {
+            str.push_back(static_cast<char>(val));
+        }
+
+        template<typename T>
+        void AppendNumber(std::string &str, T val,
+                          std::integral_constant<NumberKind,NumberKind::Integer>)
+        {
+            char buff[k_format_max_size];
+            str.append(buff,FormatInteger(buff,val));
+        }
+
+        template<typename T>
+        void AppendNumber(std::string &str, T val,
+                          std::integral_constant<NumberKind,NumberKind::Float>)
+        {
+            char buff[k_format_max_size];
+            str.append(buff,FormatFloat(buff,static_cast<double>(val)));
+        }
+    }
+
+    /// * Appends an arithmetic value to @str the same way
+    ///   std::ostream would (chars as characters and bools
+    ///   as 1/0), without any temporaries
+    template<typename T>
+    void AppendNumber(std::string &str, T val)
+    {
+        static_assert(std::is_arithmetic<T>::value,
+                      "ks::AppendNumber: T must be an arithmetic type");
+
+        format_detail::AppendNumber(str,val,format_detail::number_kind<T>());
+    }
+
+    /// * Same as AppendNumber except that floating point
+    ///   values are written in fixed notation with @precision
+    ///   digits after the decimal point (ie std::fixed)
+    template<typename T>
+    void AppendNumberFixed(std::string &str, T val, unsigned precision)
+    {
+        static_assert(std::is_arithmetic<T>::value,
+                      "ks::AppendNumberFixed: T must be an arithmetic type");
+
+        if(std::is_floating_point<T>::value) {
+            format_detail::AppendDoubleFixed(str,static_cast<double>(val),precision);
+        }
+        else {
+            AppendNumber(str,val);
+        }
+    }
+
+    // ============================================================= //
+
+    // Number parsing
+    // * from_chars style: each function reads a number from
+    //   the start of [@first,@last) and returns a pointer one
+    //   past the last char used. If no number could be read,
+    //   or it's out of range for the type, @first is returned
+    //   and @val is left as is
+    // * leading whitespace is not skipped; a leading '+' is
+    //   accepted
+    // * nothing is allocated (except for floating point text
+    //   with over a hundred significant chars)
+
+    namespace format_detail
+    {
+        char const * ParseU64(char const * first,
+                              char const * last,
+                              std::uint64_t &val);
+
+        char const * ParseDouble(char const * first,
+                                 char const * last,
+                                 double &val);
+    }
+
+    /// * Reads a decimal integer; negative values are
+    ///   rejected for unsigned types
+    template<typename T>
+    typename std::enable_if<
+        std::is_integral<T>::value &&
+        std::is_unsigned<T>::value,char const*>::type
+    ParseInteger(char const * first, char const * last, T &val)
+    {
+        char const * it = first;
+        if(it != last && *it == '+') {
+            ++it;
+        }
+
+        std::uint64_t uval;
+        char const * end = format_detail::ParseU64(it,last,uval);
+        if(end == it || uval > std::numeric_limits<T>::max()) {
+            return first;
+        }
+
+        val = static_cast<T>(uval);
+        return end;
+    }
+
+    template<typename T>
+    typename std::enable_if<
+        std::is_integral<T>::value &&
+        std::is_signed<T>::value,char const*>::type
+    ParseInteger(char const * first, char const * last, T &val)
+    {
+        char const * it = first;
+        bool negative = false;
+        if(it != last && (*it == '-' || *it == '+')) {
+            negative = (*it == '-');
+            ++it;
+        }
+
+        std::uint64_t uval;
+        char const * end = format_detail::ParseU64(it,last,uval);
+
+        // The magnitude of min() is one more than max()
+        std::uint64_t const limit =
+                static_cast<std::uint64_t>(std::numeric_limits<T>::max())+
+                (negative ? 1 : 0);
+
+        if(end == it || uval > limit) {
+            return first;
+        }
+
+        val = negative ?
+                    static_cast<T>(0-uval) : // well defined for min()
+                    static_cast<T>(uval);
+        return end;
+    }
+
+    /// * Reads a decimal floating point number with an
+    ///   optional fraction and exponent, or inf, infinity
+    ///   or nan (in any case)
+    /// * The result is correctly rounded, so text written by
+    ///   FormatFloatRoundTrip reads back exactly
+    /// * Values too large for a double are rejected
+    template<typename T>
+    typename std::enable_if<
+        std::is_floating_point<T>::value,char const*>::type
+    ParseFloat(char const * first, char const * last, T &val)
+    {
+        double dval;
+        char const * end = format_detail::ParseDouble(first,last,dval);
+        if(end != first) {
+            val = static_cast<T>(dval);
+        }
+        return end;
+    }
+
+    // ============================================================= //
+
+    namespace format_detail
+    {
+        template<typename T>
+        char const * ParseNumber(char const * first, char const * last, T &val,
+                                 std::integral_constant<NumberKind,NumberKind::Bool>)
+        {
+            unsigned ival;
+            char const * end = ParseInteger(first,last,ival);
+            if(end == first || ival > 1) {
+                return first;
+            }
+            val = (ival == 1);
+            return end;
+        }
+
+        template<typename T>
+        char const * ParseNumber(char const * first, char const * last, T &val,
+                                 std::integral_constant<NumberKind,NumberKind::Char>)
+        {
+            if(first == last) {
+                return first;
+            }
+            val = static_cast<T>(*first);
+            return first+1;
+        }
+
+        template<typename T>
+        char const * ParseNumber(char const * first, char const * last, T &val,
+                                 std::integral_constant<NumberKind,NumberKind::Integer>)
+        {
+            return ParseInteger(first,last,val);
+        }
+
+        template<typename T>
+        char const * ParseNumber(char const * first, char const * last, T &val,
+                                 std::integral_constant<NumberKind,NumberKind::Float>)
+        {
+            return ParseFloat(first,last,val);
+        }
+    }
+
+    /// * Reads an arithmetic value the same way std::istream
+    ///   would (a single char for chars and 1/0 for bools)
+    template<typename T>
+    char const * ParseNumber(char const * first, char const * last, T &val)
+    {
+        static_assert(std::is_arithmetic<T>::value,
+                      "ks::ParseNumber: T must be an arithmetic type");
+
+        return format_detail::ParseNumber(first,last,val,format_detail::number_kind<T>());
+    }
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_FORMAT_HPP
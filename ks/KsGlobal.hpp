@@ -25,6 +25,8 @@
 #include <iomanip>
 #include <chrono>
 
+#include <ks/KsFormat.hpp>
+
 /// \namespace ks
 /// * The main namespace for lib ks
 /// * Contains helper utils and convenience types in addition
@@ -114,8 +116,12 @@ namespace ks
     /// * Converts common types to std::string
     /// * Included instead of using std::to_string because the latter
     ///   is missing on Android
+    /// * Arithmetic types are formatted without a stream
+    ///   (see AppendNumber); the output is the same
     template<typename T>
-    std::string ToString(T const &val)
+    typename std::enable_if<
+        !std::is_arithmetic<T>::value,std::string>::type
+    ToString(T const &val)
     {
         std::ostringstream oss;
         oss << val;
@@ -123,10 +129,22 @@ namespace ks
     }
 
     template<typename T>
-    std::string ToStringFormat(T const &val,
-                               uint precision,
-                               uint width,
-                               char fill)
+    typename std::enable_if<
+        std::is_arithmetic<T>::value,std::string>::type
+    ToString(T const &val)
+    {
+        std::string str;
+        AppendNumber(str,val);
+        return str;
+    }
+
+    template<typename T>
+    typename std::enable_if<
+        !std::is_arithmetic<T>::value,std::string>::type
+    ToStringFormat(T const &val,
+                   uint precision,
+                   uint width,
+                   char fill)
     {
         std::ostringstream oss;
         oss << std::fixed
@@ -136,6 +154,22 @@ namespace ks
         return oss.str();
     }
 
+    template<typename T>
+    typename std::enable_if<
+        std::is_arithmetic<T>::value,std::string>::type
+    ToStringFormat(T const &val,
+                   uint precision,
+                   uint width,
+                   char fill)
+    {
+        std::string str;
+        AppendNumberFixed(str,val,precision);
+        if(str.size() < width) {
+            str.insert(0,width-str.size(),fill);
+        }
+        return str;
+    }
+
     template<typename T>
     T CalcDuration(TimePoint const &before,TimePoint const &after)
     {
@@ -0,0 +1,560 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <set>
+
+#include <ks/KsFastClock.hpp>
+#include <ks/KsIntrospect.hpp>
+#include <ks/KsMiscUtils.hpp>
+
+#ifdef KS_ENV_POSIX
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace ks
+{
+    namespace
+    {
+        using ObjectRecord = introspect_detail::ObjectRegistry::ObjectRecord;
+        using ConnectionRecord = introspect_detail::ObjectRegistry::ConnectionRecord;
+
+        // Probe
+        // * filled in on the loop's thread; abandoned if the
+        //   loop doesn't get to it in time
+        struct Probe
+        {
+            Probe() :
+                done(false),
+                post_ns(FastClock::GetPreciseNs()),
+                latency_ns(0),
+                os_thread_id(-1)
+            {
+                // empty
+            }
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool done;
+            s64 const post_ns;
+            s64 latency_ns;
+            s64 os_thread_id;
+            std::vector<ObjectRecord> list_objects;
+        };
+
+        struct LoopSnapshot
+        {
+            Id id;
+            std::string thread_id;
+            s64 os_thread_id;
+            bool started;
+            bool running;
+            bool responsive;
+            s64 probe_latency_ns; // -1 if not probed
+            u64 queued_events;
+            u64 queued_bytes;
+
+            // set for unresponsive loops
+            bool handler_valid;
+            LoopHandler handler;
+
+            std::vector<ObjectRecord> list_objects;
+            shared_ptr<Probe> probe;
+        };
+
+        void AppendJsonString(std::string &json, char const * str)
+        {
+            json.push_back('"');
+            for(; *str != '\0'; str++) {
+                char const c = *str;
+                if(c == '"' || c == '\\') {
+                    json.push_back('\\');
+                    json.push_back(c);
+                }
+                else if(static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped,sizeof(escaped),"\\u%04x",c);
+                    json.append(escaped);
+                }
+                else {
+                    json.push_back(c);
+                }
+            }
+            json.push_back('"');
+        }
+
+        void AppendJsonBool(std::string &json, bool val)
+        {
+            json.append(val ? "true" : "false");
+        }
+
+        void AppendObjectsJson(std::string &json,
+                               std::vector<ObjectRecord> const &list_objects)
+        {
+            json.append("\"objects\":[");
+            for(size_t i=0; i < list_objects.size(); i++) {
+                ObjectRecord const &object = list_objects[i];
+                json.append((i == 0) ? "{\"id\":" : ",{\"id\":");
+                AppendNumber(json,object.id);
+                json.append(",\"type\":");
+                AppendJsonString(json,object.type);
+                json.append(",\"connections\":[");
+
+                for(size_t j=0; j < object.list_connections.size(); j++) {
+                    ConnectionRecord const &connection = object.list_connections[j];
+                    json.append((j == 0) ? "{\"id\":" : ",{\"id\":");
+                    AppendNumber(json,connection.id);
+                    json.append(",\"signal\":");
+                    AppendJsonString(json,connection.signal_type);
+                    json.append(",\"signal_address\":");
+                    AppendJsonString(json,ConvPointerToString(connection.signal).c_str());
+                    json.append(",\"type\":");
+                    AppendJsonString(json,connection.connection_type);
+                    json.push_back('}');
+                }
+                json.append("]}");
+            }
+            json.push_back(']');
+        }
+
+        void AppendLoopJson(std::string &json, LoopSnapshot const &loop)
+        {
+            json.append("{\"id\":");
+            AppendNumber(json,loop.id);
+            json.append(",\"thread\":");
+            AppendJsonString(json,loop.thread_id.c_str());
+            json.append(",\"os_thread_id\":");
+            AppendNumber(json,loop.os_thread_id);
+            json.append(",\"started\":");
+            AppendJsonBool(json,loop.started);
+            json.append(",\"running\":");
+            AppendJsonBool(json,loop.running);
+            json.append(",\"responsive\":");
+            AppendJsonBool(json,loop.responsive);
+
+            if(loop.probe_latency_ns >= 0) {
+                json.append(",\"probe_latency_us\":");
+                AppendNumber(json,loop.probe_latency_ns/1000);
+            }
+
+            json.append(",\"queued_events\":");
+            AppendNumber(json,loop.queued_events);
+            json.append(",\"queued_bytes\":");
+            AppendNumber(json,loop.queued_bytes);
+
+            if(loop.handler_valid) {
+                s64 const running_ns = FastClock::GetPreciseNs()-loop.handler.start_ns;
+                json.append(",\"handler\":{\"type\":");
+                AppendJsonString(json,GetLoopHandlerTypeName(loop.handler.type));
+                json.append(",\"tag\":");
+                AppendNumber(json,loop.handler.tag);
+                json.append(",\"running_ms\":");
+                AppendNumber(json,std::max(running_ns,s64(0))/1000000);
+                json.push_back('}');
+            }
+
+            json.push_back(',');
+            AppendObjectsJson(json,loop.list_objects);
+            json.push_back('}');
+        }
+
+        std::string ConvThreadIdToString(std::thread::id thread_id)
+        {
+            if(thread_id == std::thread::id()) {
+                return std::string();
+            }
+
+            std::ostringstream ss;
+            ss << thread_id;
+            return ss.str();
+        }
+    }
+
+    // ============================================================= //
+
+    std::string GetIntrospectionJson(Milliseconds timeout)
+    {
+        std::vector<LoopSnapshot> list_loops;
+
+        // Probe every running loop other than this one
+        EventLoop::ForEachEventLoop(
+                    [&list_loops](EventLoop &event_loop) {
+                        LoopSnapshot loop;
+                        loop.id = event_loop.GetId();
+                        loop.os_thread_id = -1;
+                        loop.responsive = true;
+                        loop.probe_latency_ns = -1;
+                        loop.handler_valid = false;
+                        loop.queued_events = event_loop.GetQueueSize(&(loop.queued_bytes));
+
+                        std::thread::id thread_id;
+                        event_loop.GetState(thread_id,loop.started,loop.running);
+                        loop.thread_id = ConvThreadIdToString(thread_id);
+
+                        if(loop.running && thread_id != std::this_thread::get_id()) {
+                            shared_ptr<Probe> probe = make_shared<Probe>();
+                            EventLoop * probed_loop = &event_loop;
+
+                            // The loop can't be destroyed while
+                            // it's running one of its handlers
+                            event_loop.PostCallback(
+                                        [probe,probed_loop]() {
+                                            std::vector<ObjectRecord> list_objects =
+                                                    probed_loop->GetObjectRegistry().GetObjects();
+
+                                            LoopHandler handler;
+                                            s64 os_thread_id = -1;
+                                            if(probed_loop->GetCurrentHandler(handler)) {
+                                                os_thread_id = handler.os_thread_id;
+                                            }
+
+                                            std::lock_guard<std::mutex> lock(probe->mutex);
+                                            probe->done = true;
+                                            probe->latency_ns = FastClock::GetPreciseNs()-probe->post_ns;
+                                            probe->os_thread_id = os_thread_id;
+                                            probe->list_objects = std::move(list_objects);
+                                            probe->cv.notify_all();
+                                        });
+
+                            loop.probe = std::move(probe);
+                        }
+                        else {
+                            loop.list_objects = event_loop.GetObjectRegistry().GetObjects();
+                        }
+
+                        list_loops.push_back(std::move(loop));
+                    });
+
+        // All probes share the same deadline
+        auto const deadline = std::chrono::steady_clock::now()+timeout;
+        std::set<Id> list_unresponsive;
+
+        for(auto &loop : list_loops) {
+            if(!loop.probe) {
+                continue;
+            }
+
+            Probe &probe = *(loop.probe);
+            std::unique_lock<std::mutex> lock(probe.mutex);
+            while(!probe.done) {
+                if(probe.cv.wait_until(lock,deadline) == std::cv_status::timeout) {
+                    break;
+                }
+            }
+
+            if(probe.done) {
+                loop.probe_latency_ns = probe.latency_ns;
+                loop.os_thread_id = probe.os_thread_id;
+                loop.list_objects = std::move(probe.list_objects);
+            }
+            else {
+                loop.responsive = false;
+                list_unresponsive.insert(loop.id);
+            }
+        }
+
+        // Read the loops that didn't answer from here, and
+        // note what they're stuck on
+        if(!list_unresponsive.empty()) {
+            EventLoop::ForEachEventLoop(
+                        [&list_loops,&list_unresponsive](EventLoop &event_loop) {
+                            if(list_unresponsive.count(event_loop.GetId()) == 0) {
+                                return;
+                            }
+
+                            auto loop_it = std::find_if(
+                                        list_loops.begin(),
+                                        list_loops.end(),
+                                        [&event_loop](LoopSnapshot const &loop) {
+                                            return (loop.id == event_loop.GetId());
+                                        });
+
+                            loop_it->list_objects = event_loop.GetObjectRegistry().GetObjects();
+                            loop_it->handler_valid = event_loop.GetCurrentHandler(loop_it->handler);
+                            if(loop_it->handler_valid) {
+                                loop_it->os_thread_id = loop_it->handler.os_thread_id;
+                            }
+                        });
+        }
+
+        std::string json = "{\"loops\":[";
+        for(size_t i=0; i < list_loops.size(); i++) {
+            if(i > 0) {
+                json.push_back(',');
+            }
+            AppendLoopJson(json,list_loops[i]);
+        }
+        json.append("]}\n");
+
+        return json;
+    }
+
+    bool WriteIntrospectionJson(std::string const &file_path,
+                                Milliseconds timeout)
+    {
+        std::string const json = GetIntrospectionJson(timeout);
+
+        std::FILE * file = std::fopen(file_path.c_str(),"wb");
+        if(file == nullptr) {
+            return false;
+        }
+
+        bool ok = (std::fwrite(json.data(),1,json.size(),file) == json.size());
+        ok = (std::fclose(file) == 0) && ok;
+        return ok;
+    }
+
+    // ============================================================= //
+
+    namespace introspect_detail
+    {
+        ObjectRegistry::ObjectRegistry() :
+            m_mutex("EventLoop::objects")
+        {
+            // empty
+        }
+
+        void ObjectRegistry::AddObject(Id object_id, char const * type)
+        {
+            std::lock_guard<Mutex> lock(m_mutex);
+
+            ObjectRecord &object = m_list_objects[object_id];
+            object.id = object_id;
+            object.type = type;
+        }
+
+        void ObjectRegistry::RemoveObject(Id object_id)
+        {
+            std::lock_guard<Mutex> lock(m_mutex);
+            m_list_objects.erase(object_id);
+        }
+
+        void ObjectRegistry::AddConnection(Id object_id,
+                                           ConnectionRecord const &record)
+        {
+            std::lock_guard<Mutex> lock(m_mutex);
+
+            auto it = m_list_objects.find(object_id);
+            if(it != m_list_objects.end()) {
+                it->second.list_connections.push_back(record);
+            }
+        }
+
+        void ObjectRegistry::RemoveConnection(Id object_id, Id connection_id)
+        {
+            std::lock_guard<Mutex> lock(m_mutex);
+
+            auto it = m_list_objects.find(object_id);
+            if(it == m_list_objects.end()) {
+                return;
+            }
+
+            auto &list_connections = it->second.list_connections;
+            list_connections.erase(
+                        std::remove_if(
+                            list_connections.begin(),
+                            list_connections.end(),
+                            [connection_id](ConnectionRecord const &record) {
+                                return (record.id == connection_id);
+                            }),
+                        list_connections.end());
+        }
+
+        std::vector<ObjectRegistry::ObjectRecord> ObjectRegistry::GetObjects() const
+        {
+            std::vector<ObjectRecord> list_objects;
+
+            std::lock_guard<Mutex> lock(m_mutex);
+            list_objects.reserve(m_list_objects.size());
+            for(auto const &object_it : m_list_objects) {
+                list_objects.push_back(object_it.second);
+            }
+            return list_objects;
+        }
+
+        void AddConnection(Object const &receiver,
+                           ObjectRegistry::ConnectionRecord const &record)
+        {
+            auto const &event_loop = receiver.GetEventLoop();
+            if(event_loop) {
+                event_loop->GetObjectRegistry().AddConnection(receiver.GetId(),record);
+            }
+        }
+
+        void RemoveConnection(Object const &receiver, Id connection_id)
+        {
+            auto const &event_loop = receiver.GetEventLoop();
+            if(event_loop) {
+                event_loop->GetObjectRegistry().RemoveConnection(
+                            receiver.GetId(),connection_id);
+            }
+        }
+    }
+
+    // ============================================================= //
+
+    #ifdef KS_ENV_POSIX
+    namespace
+    {
+        // The signal handler writes a byte to the pipe, whose
+        // read end is watched by the trigger's EventLoop. The
+        // pipe is created once and never closed, so a handler
+        // that's still running as a trigger is removed can't
+        // write to a closed or reused descriptor
+        std::mutex g_trigger_mutex;
+        bool g_trigger_installed = false;
+        int g_trigger_pipe[2] = { -1, -1 };
+        struct sigaction g_trigger_prev_action;
+
+        void OnTriggerSignal(int)
+        {
+            int const saved_errno = errno;
+
+            char const byte = 0;
+            ssize_t const written = write(g_trigger_pipe[1],&byte,1);
+            (void)written; // the pipe is full; a dump is pending anyway
+
+            errno = saved_errno;
+        }
+
+        bool CreateTriggerPipe()
+        {
+            if(g_trigger_pipe[0] >= 0) {
+                return true;
+            }
+
+            if(pipe(g_trigger_pipe) != 0) {
+                return false;
+            }
+
+            for(int fd : g_trigger_pipe) {
+                fcntl(fd,F_SETFL,fcntl(fd,F_GETFL)|O_NONBLOCK);
+                fcntl(fd,F_SETFD,FD_CLOEXEC);
+            }
+            return true;
+        }
+
+        // * Returns true if anything was read
+        bool DrainDescriptor(int fd)
+        {
+            bool drained = false;
+            char buffer[64];
+            while(read(fd,buffer,sizeof(buffer)) > 0) {
+                drained = true;
+            }
+            return drained;
+        }
+    }
+
+    IntrospectionTrigger::IntrospectionTrigger(ks::Object::Key const &key,
+                                               shared_ptr<EventLoop> const &event_loop,
+                                               std::string file_path,
+                                               int signum,
+                                               Milliseconds timeout) :
+        ks::Object(key,event_loop),
+        m_file_path(std::move(file_path)),
+        m_signum(signum),
+        m_timeout(timeout),
+        m_installed(false),
+        m_descriptor_id(0),
+        m_dump_count(0)
+    {
+        // empty
+    }
+
+    void IntrospectionTrigger::Init(ks::Object::Key const &,
+                                    shared_ptr<IntrospectionTrigger> const &this_trigger)
+    {
+        std::lock_guard<std::mutex> lock(g_trigger_mutex);
+        if(g_trigger_installed || !CreateTriggerPipe()) {
+            return;
+        }
+
+        // Discard signals received while no trigger
+        // was installed
+        DrainDescriptor(g_trigger_pipe[0]);
+
+        // The loop closes its copy of the read end
+        int const fd = fcntl(g_trigger_pipe[0],F_DUPFD_CLOEXEC,0);
+        if(fd < 0) {
+            return;
+        }
+
+        struct sigaction action;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        action.sa_handler = OnTriggerSignal;
+        if(sigaction(m_signum,&action,&g_trigger_prev_action) != 0) {
+            close(fd);
+            return;
+        }
+
+        weak_ptr<IntrospectionTrigger> weak_trigger = this_trigger;
+        m_descriptor_id = GetEventLoop()->AddDescriptor(
+                    fd,
+                    [fd,weak_trigger]() {
+                        if(!DrainDescriptor(fd)) {
+                            return;
+                        }
+
+                        auto trigger = weak_trigger.lock();
+                        if(trigger) {
+                            trigger->onTriggered();
+                        }
+                    });
+
+        m_installed = true;
+        g_trigger_installed = true;
+    }
+
+    IntrospectionTrigger::~IntrospectionTrigger()
+    {
+        if(!m_installed) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(g_trigger_mutex);
+        sigaction(m_signum,&g_trigger_prev_action,nullptr);
+        g_trigger_installed = false;
+
+        GetEventLoop()->RemoveDescriptor(m_descriptor_id);
+    }
+
+    bool IntrospectionTrigger::GetValid() const
+    {
+        return m_installed;
+    }
+
+    uint IntrospectionTrigger::GetDumpCount() const
+    {
+        return m_dump_count.load(std::memory_order_acquire);
+    }
+
+    void IntrospectionTrigger::onTriggered()
+    {
+        WriteIntrospectionJson(m_file_path,m_timeout);
+        m_dump_count.fetch_add(1,std::memory_order_release);
+    }
+    #endif
+
+    // ============================================================= //
+
+} // ks
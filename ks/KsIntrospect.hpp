@@ -0,0 +1,169 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_INTROSPECT_HPP
+#define KS_INTROSPECT_HPP
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ks/KsConfig.hpp>
+#include <ks/KsMutex.hpp>
+#include <ks/KsObject.hpp>
+
+#ifdef KS_ENV_POSIX
+#include <signal.h>
+#endif
+
+namespace ks
+{
+    // ============================================================= //
+
+    // Introspection
+    // * a JSON snapshot of a running process: each EventLoop's
+    //   thread and queue, the Objects that live on it and the
+    //   Signal connections made to each of those Objects:
+    //
+    //   {"loops":[{"id":1,"thread":"140...","os_thread_id":812,
+    //     "started":true,"running":true,"responsive":true,
+    //     "probe_latency_us":35,"queued_events":0,"queued_bytes":0,
+    //     "objects":[{"id":4,"type":"Widget","connections":[
+    //       {"id":9,"signal":"ks::Signal<int>",
+    //        "signal_address":"0x7ff...","type":"Queued"}]}]}]}
+    //
+    // * each running loop is sent a probe that's queued behind
+    //   its pending events, so the snapshot is gathered on the
+    //   loops' own threads and nothing else has to stop. A loop
+    //   that doesn't run its probe in time is reported with
+    //   "responsive":false, the handler it's stuck in, and its
+    //   Objects read from the calling thread instead
+    // * connections without a receiver Object aren't listed
+
+    // * Returns the snapshot, waiting up to @timeout for
+    //   each loop's probe
+    // * Mustn't be called from a handler that other loops
+    //   are blocked on (ie a Blocking slot)
+    std::string GetIntrospectionJson(Milliseconds timeout=Milliseconds(1000));
+
+    // * Writes GetIntrospectionJson to @file_path
+    // * Returns false if the file couldn't be written
+    bool WriteIntrospectionJson(std::string const &file_path,
+                                Milliseconds timeout=Milliseconds(1000));
+
+    namespace introspect_detail
+    {
+        // ObjectRegistry
+        // * the Objects that live on an EventLoop and the
+        //   connections made to them; each loop has its own,
+        //   see EventLoop::GetObjectRegistry
+        class ObjectRegistry
+        {
+        public:
+            struct ConnectionRecord
+            {
+                Id id;
+                char const * signal_type;
+                void const * signal;
+                char const * connection_type;
+            };
+
+            struct ObjectRecord
+            {
+                Id id;
+                char const * type;
+                std::vector<ConnectionRecord> list_connections;
+            };
+
+            ObjectRegistry();
+
+            // * @type must outlive the Object
+            void AddObject(Id object_id, char const * type);
+            void RemoveObject(Id object_id);
+
+            void AddConnection(Id object_id, ConnectionRecord const &record);
+            void RemoveConnection(Id object_id, Id connection_id);
+
+            // * Returns the Objects in order of creation
+            std::vector<ObjectRecord> GetObjects() const;
+
+        private:
+            mutable Mutex m_mutex;
+            std::map<Id,ObjectRecord> m_list_objects;
+        };
+
+        // * Records a connection made to @receiver by @signal
+        void AddConnection(Object const &receiver,
+                           ObjectRegistry::ConnectionRecord const &record);
+
+        void RemoveConnection(Object const &receiver, Id connection_id);
+    }
+
+    // ============================================================= //
+
+    #ifdef KS_ENV_POSIX
+    // IntrospectionTrigger
+    // * writes an introspection snapshot to a file each time
+    //   the process receives a signal, ie:
+    //   kill -USR2 <pid>
+    // * the signal handler only wakes this Object's EventLoop,
+    //   which writes the snapshot, so the loop should be one
+    //   that's free to wait on the others' probes
+    // * only one trigger can be installed at a time; the
+    //   signal's previous handler is restored when it's
+    //   destroyed
+    class IntrospectionTrigger : public ks::Object
+    {
+    public:
+        using base_type = ks::Object;
+
+        IntrospectionTrigger(ks::Object::Key const &key,
+                             shared_ptr<EventLoop> const &event_loop,
+                             std::string file_path,
+                             int signum=SIGUSR2,
+                             Milliseconds timeout=Milliseconds(1000));
+
+        void Init(ks::Object::Key const &,
+                  shared_ptr<IntrospectionTrigger> const &);
+
+        ~IntrospectionTrigger();
+
+        // * Returns false if the signal handler couldn't be
+        //   installed (ie another trigger is installed)
+        bool GetValid() const;
+
+        // * Returns the number of snapshots written so far
+        uint GetDumpCount() const;
+
+    private:
+        void onTriggered();
+
+        std::string const m_file_path;
+        int const m_signum;
+        Milliseconds const m_timeout;
+
+        bool m_installed;
+        Id m_descriptor_id;
+        std::atomic<uint> m_dump_count;
+    };
+    #endif
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_INTROSPECT_HPP
@@ -14,6 +14,9 @@
    limitations under the License.
 */
 
+#include <cstring>
+#include <algorithm>
+
 #include <ks/KsLog.hpp>
 
 #ifdef KS_ENV_ANDROID
@@ -24,6 +27,138 @@ namespace ks
 {
     namespace Log
     {
+        void Sink::log_batch(std::string const * list_lines,
+                             size_t count)
+        {
+            for(size_t i=0; i < count; i++) {
+                this->log(list_lines[i]);
+            }
+        }
+
+        void Sink::log_buffer(char const * data,
+                              size_t size)
+        {
+            std::string line;
+            char const * const end = data+size;
+
+            while(data < end) {
+                char const * line_end =
+                        static_cast<char const*>(
+                            std::memchr(data,'\n',
+                                        static_cast<size_t>(end-data)));
+
+                if(line_end == nullptr) {
+                    line_end = end;
+                }
+
+                line.assign(data,line_end);
+                this->log(line);
+                data = line_end+1;
+            }
+        }
+
+        // ============================================================= //
+
+        SinkAsync::SinkAsync(shared_ptr<Sink> sink,
+                             size_t max_queue_size) :
+            m_sink(std::move(sink)),
+            m_max_queue_size(std::max(max_queue_size,size_t(1))),
+            m_stop(false),
+            m_writing(false),
+            m_queue_size(0)
+        {
+            m_thread = std::thread(&SinkAsync::writeLoop,this);
+        }
+
+        SinkAsync::~SinkAsync()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+                m_cv_queued.notify_all();
+            }
+            m_thread.join();
+        }
+
+        void SinkAsync::log(std::string const &line)
+        {
+            this->log_batch(&line,1);
+        }
+
+        void SinkAsync::log_batch(std::string const * list_lines,
+                                  size_t count)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            for(size_t i=0; i < count; i++) {
+                while(m_queue_size >= m_max_queue_size) {
+                    // The writer may be idle if this batch
+                    // filled the queue by itself
+                    m_cv_queued.notify_one();
+                    m_cv_written.wait(lock);
+                }
+
+                // Assigning to an existing string reuses
+                // its capacity from an earlier batch
+                if(m_queue_size == m_queue.size()) {
+                    m_queue.push_back(list_lines[i]);
+                }
+                else {
+                    m_queue[m_queue_size] = list_lines[i];
+                }
+                m_queue_size++;
+            }
+
+            m_cv_queued.notify_one();
+        }
+
+        void SinkAsync::Flush()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(m_queue_size > 0 || m_writing) {
+                m_cv_written.wait(lock);
+            }
+        }
+
+        void SinkAsync::writeLoop()
+        {
+            std::vector<std::string> list_lines;
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(true) {
+                while(m_queue_size == 0 && !m_stop) {
+                    m_cv_queued.wait(lock);
+                }
+
+                if(m_queue_size == 0 && m_stop) {
+                    break;
+                }
+
+                // Swap the queue out so that the wrapped sink
+                // is written to without holding the lock
+                size_t const count = m_queue_size;
+                list_lines.swap(m_queue);
+                m_queue_size = 0;
+                m_writing = true;
+                m_cv_written.notify_all();
+
+                lock.unlock();
+                m_sink->log_batch(list_lines.data(),count);
+                lock.lock();
+
+                m_writing = false;
+                m_cv_written.notify_all();
+
+                // Keep whichever vector has more capacity
+                // for the queue
+                if(list_lines.size() > m_queue.size() && m_queue_size == 0) {
+                    list_lines.swap(m_queue);
+                }
+            }
+        }
+
+        // ============================================================= //
+
         #ifdef KS_ENV_ANDROID
             void SinkToLogCat::log(std::string const &line)
             {
@@ -36,9 +171,14 @@ namespace ks
         // ============================================================= //
 
         FBRunTimeMs::FBRunTimeMs() :
-            m_time_str("00:00:00.000"),
-            m_start(std::chrono::system_clock::now()),
-            m_list_num_chars({{'0','1','2','3','4','5','6','7','8','9'}})
+            m_time_str({{'0','0',':','0','0',':','0','0','.','0','0','0'}}),
+            // FastClock shares steady_clock's epoch; reading
+            // steady_clock here avoids calibrating FastClock
+            // while the global logger is constructed
+            m_start_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().
+                           time_since_epoch()).count()),
+            m_time_str_ms(0)
         {
             // empty
         }
@@ -48,50 +188,39 @@ namespace ks
             // empty
         }
 
-        std::string FBRunTimeMs::Get()
+        void FBRunTimeMs::Append(std::string &line)
         {
-            // TODO: should we use steady_clock, not system clock?
-            auto now = std::chrono::system_clock::now();
-            std::chrono::system_clock::duration elapsed = now-m_start;
-
-            std::chrono::hours hours =
-                    std::chrono::duration_cast<std::chrono::hours>(
-                        elapsed);
-            elapsed -= hours;
+            s64 const elapsed_ms =
+                    (FastClock::GetSteadyNs()-m_start_ns)/1000000;
 
-            std::chrono::minutes mins =
-                    std::chrono::duration_cast<std::chrono::minutes>(
-                        elapsed);
-            elapsed -= mins;
+            // Consecutive lines are often logged within the
+            // same millisecond; reuse the text in that case
+            if(elapsed_ms != m_time_str_ms && elapsed_ms >= 0) {
+                m_time_str_ms = elapsed_ms;
 
-            std::chrono::seconds secs =
-                    std::chrono::duration_cast<std::chrono::seconds>(
-                        elapsed);
-            elapsed -= secs;
+                u64 const total_ms = static_cast<u64>(elapsed_ms);
+                u64 const total_secs = total_ms/1000;
 
-            std::chrono::milliseconds ms =
-                    std::chrono::duration_cast<std::chrono::milliseconds>(
-                        elapsed);
+                uint const ms_count = static_cast<uint>(total_ms%1000);
+                uint const secs_count = static_cast<uint>(total_secs%60);
+                uint const mins_count = static_cast<uint>((total_secs/60)%60);
+                uint const hours_count = static_cast<uint>((total_secs/3600)%100);
 
-            uint_fast8_t const hours_count = hours.count();
-            uint_fast8_t const mins_count = mins.count();
-            uint_fast8_t const secs_count = secs.count();
-            uint_fast16_t const ms_count = ms.count();
+                m_time_str[0] = static_cast<char>('0'+hours_count/10);
+                m_time_str[1] = static_cast<char>('0'+hours_count%10);
 
-            m_time_str[0] = m_list_num_chars[hours_count/10];
-            m_time_str[1] = m_list_num_chars[hours_count%10];
+                m_time_str[3] = static_cast<char>('0'+mins_count/10);
+                m_time_str[4] = static_cast<char>('0'+mins_count%10);
 
-            m_time_str[3] = m_list_num_chars[mins_count/10];
-            m_time_str[4] = m_list_num_chars[mins_count%10];
+                m_time_str[6] = static_cast<char>('0'+secs_count/10);
+                m_time_str[7] = static_cast<char>('0'+secs_count%10);
 
-            m_time_str[6] = m_list_num_chars[secs_count/10];
-            m_time_str[7] = m_list_num_chars[secs_count%10];
-
-            m_time_str[9] = m_list_num_chars[ms_count/100];
-            m_time_str[10] = m_list_num_chars[(ms_count%100)/10];
-            m_time_str[11] = m_list_num_chars[(ms_count%100)%10];
+                m_time_str[9] = static_cast<char>('0'+ms_count/100);
+                m_time_str[10] = static_cast<char>('0'+(ms_count%100)/10);
+                m_time_str[11] = static_cast<char>('0'+ms_count%10);
+            }
 
-            return m_time_str;
+            line.append(m_time_str.data(),m_time_str.size());
         }
 
         FBCustomStr::FBCustomStr(std::string const &s) : m_s(s)
@@ -104,29 +233,23 @@ namespace ks
             // empty
         }
 
-        std::string FBCustomStr::Get()
+        void FBCustomStr::Append(std::string &line)
         {
-            return m_s;
+            line.append(m_s);
         }
 
         // ============================================================= //
 
-        Logger::Logger()
+        Logger::Logger() :
+            m_filter(0x3F) // default filter is all on
         {
             m_mutex = make_unique<MutexSTL>();
-
-            // default filter is all on
-            m_filter.set(static_cast<size_t>(Level::TRACE));
-            m_filter.set(static_cast<size_t>(Level::DEBUG));
-            m_filter.set(static_cast<size_t>(Level::INFO));
-            m_filter.set(static_cast<size_t>(Level::WARN));
-            m_filter.set(static_cast<size_t>(Level::ERROR));
-            m_filter.set(static_cast<size_t>(Level::FATAL));
         }
 
         Logger::Logger(bool thread_safe,
                        shared_ptr<Sink> const &sink,
-                       std::array<std::vector<FormatBlock*>,6> && list_fbs)
+                       std::array<std::vector<FormatBlock*>,6> && list_fbs) :
+            m_filter(0x3F) // default filter is all on
         {
             if(thread_safe) {
                 m_mutex = make_unique<MutexSTL>();
@@ -145,14 +268,6 @@ namespace ks
                                 unique_ptr<FormatBlock>(list_fbs[level][fb_idx]));
                 }
             }
-
-            // default filter is all on
-            m_filter.set(static_cast<size_t>(Level::TRACE));
-            m_filter.set(static_cast<size_t>(Level::DEBUG));
-            m_filter.set(static_cast<size_t>(Level::INFO));
-            m_filter.set(static_cast<size_t>(Level::WARN));
-            m_filter.set(static_cast<size_t>(Level::ERROR));
-            m_filter.set(static_cast<size_t>(Level::FATAL));
         }
 
         bool Logger::AddSink(shared_ptr<Sink> const &new_sink)
@@ -195,16 +310,14 @@ namespace ks
 
         void Logger::SetLevel(Level level)
         {
-            m_mutex->lock();
-            m_filter.set(static_cast<size_t>(level));
-            m_mutex->unlock();
+            u8 const bit = static_cast<u8>(1 << static_cast<u8>(level));
+            m_filter.fetch_or(bit,std::memory_order_relaxed);
         }
 
         void Logger::UnsetLevel(Level level)
         {
-            m_mutex->lock();
-            m_filter.reset(static_cast<size_t>(level));
-            m_mutex->unlock();
+            u8 const bit = static_cast<u8>(1 << static_cast<u8>(level));
+            m_filter.fetch_and(static_cast<u8>(~bit),std::memory_order_relaxed);
         }
 
         void Logger::AddFormatBlock(unique_ptr<FormatBlock> fb,
@@ -217,8 +330,35 @@ namespace ks
         }
 
         // logging methods
+        namespace
+        {
+            std::atomic<FatalHandler> & GetFatalHandler()
+            {
+                static std::atomic<FatalHandler> fatal_handler(nullptr);
+                return fatal_handler;
+            }
+        }
+
+        void SetFatalHandler(FatalHandler handler)
+        {
+            GetFatalHandler().store(handler);
+        }
+
         Logger::Line Logger::Custom(Level level)
         {
+            if(level == Level::FATAL) {
+                FatalHandler handler = GetFatalHandler().load();
+                if(handler) {
+                    handler();
+                }
+            }
+
+            // Filtered lines skip the lock and the prefix
+            // entirely; the Line just swallows its input
+            if(!GetLevelEnabled(level)) {
+                return Line(nullptr,nullptr,nullptr,nullptr,false);
+            }
+
             m_mutex->lock();
 
             size_t const level_int = static_cast<size_t>(level);
@@ -226,80 +366,38 @@ namespace ks
             return Line(&m_list_sinks,
                         &(m_list_fb[level_int]),
                         m_mutex.get(),
-                        m_filter[level_int]);
+                        &m_line_buffers,
+                        true);
         }
 
-
         Logger::Line Logger::Trace()
         {
-            m_mutex->lock();
-
-            size_t const level = static_cast<size_t>(Level::TRACE);
-
-            return Line(&m_list_sinks,
-                        &(m_list_fb[level]),
-                        m_mutex.get(),
-                        m_filter[level]);
+            return Custom(Level::TRACE);
         }
 
         Logger::Line Logger::Debug()
         {
-            m_mutex->lock();
-
-            size_t const level = static_cast<size_t>(Level::DEBUG);
-
-            return Line(&m_list_sinks,
-                        &(m_list_fb[level]),
-                        m_mutex.get(),
-                        m_filter[level]);
+            return Custom(Level::DEBUG);
         }
 
         Logger::Line Logger::Info()
         {
-            m_mutex->lock();
-
-            size_t const level = static_cast<size_t>(Level::INFO);
-
-            return Line(&m_list_sinks,
-                        &(m_list_fb[level]),
-                        m_mutex.get(),
-                        m_filter[level]);
+            return Custom(Level::INFO);
         }
 
         Logger::Line Logger::Warn()
         {
-            m_mutex->lock();
-
-            size_t const level = static_cast<size_t>(Level::WARN);
-
-            return Line(&m_list_sinks,
-                        &(m_list_fb[level]),
-                        m_mutex.get(),
-                        m_filter[level]);
+            return Custom(Level::WARN);
         }
 
         Logger::Line Logger::Error()
         {
-            m_mutex->lock();
-
-            size_t const level = static_cast<size_t>(Level::ERROR);
-
-            return Line(&m_list_sinks,
-                        &(m_list_fb[level]),
-                        m_mutex.get(),
-                        m_filter[level]);
+            return Custom(Level::ERROR);
         }
 
         Logger::Line Logger::Fatal()
         {
-            m_mutex->lock();
-
-            size_t const level = static_cast<size_t>(Level::FATAL);
-
-            return Line(&m_list_sinks,
-                        &(m_list_fb[level]),
-                        m_mutex.get(),
-                        m_filter[level]);
+            return Custom(Level::FATAL);
         }
 
         // ============================================================= //
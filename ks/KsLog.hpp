@@ -22,11 +22,16 @@
 #include <array>
 #include <ctime>
 #include <mutex>
-#include <bitset>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 #include <iostream>
 
 #include <ks/KsConfig.hpp>
+#include <ks/KsMutex.hpp>
 #include <ks/KsGlobal.hpp>
+#include <ks/KsFormat.hpp>
+#include <ks/KsFastClock.hpp>
 
 namespace ks
 {
@@ -37,11 +42,23 @@ namespace ks
         // Sink
         // * abstract class that represents logging output
         // * concrete classes must implement the log() method
+        // * sinks that can write several lines in one go (ie
+        //   with a single syscall) should also override the
+        //   batch methods; the defaults call log() per line
         class Sink
         {
         public:
             virtual ~Sink() = default;
             virtual void log(std::string const &line)=0;
+
+            // * Logs @count lines from @list_lines in order
+            virtual void log_batch(std::string const * list_lines,
+                                   size_t count);
+
+            // * Logs a contiguous buffer of '\n' terminated
+            //   lines; a missing final '\n' is implied
+            virtual void log_buffer(char const * data,
+                                    size_t size);
         };
 
         // SinkToStdOut
@@ -60,6 +77,47 @@ namespace ks
             std::mutex m_mutex;
         };
 
+        // SinkAsync
+        // * moves the cost of a sink off of the logging thread
+        // * log() copies the line into a queue; a background
+        //   thread hands everything queued since the last write
+        //   to the wrapped sink with a single log_batch() call
+        // * the queue holds up to @max_queue_size lines after
+        //   which log() blocks until the writer catches up, so
+        //   no lines are dropped
+        // * line storage is recycled between batches so steady
+        //   state logging doesn't allocate
+        class SinkAsync : public ks::Log::Sink
+        {
+        public:
+            SinkAsync(shared_ptr<Sink> sink,
+                      size_t max_queue_size=8192);
+
+            ~SinkAsync();
+
+            void log(std::string const &line);
+            void log_batch(std::string const * list_lines, size_t count);
+
+            // * Blocks until all queued lines have been
+            //   handed to the wrapped sink
+            void Flush();
+
+        private:
+            void writeLoop();
+
+            shared_ptr<Sink> const m_sink;
+            size_t const m_max_queue_size;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv_queued;
+            std::condition_variable m_cv_written;
+            bool m_stop;
+            bool m_writing;
+            std::vector<std::string> m_queue;
+            size_t m_queue_size;
+            std::thread m_thread;
+        };
+
         #ifdef KS_ENV_ANDROID
         // SinkToLogCat
         // * simple sink that outputs to logcat
@@ -78,28 +136,32 @@ namespace ks
         // FormatBlock
         // * abstract class that represents a specific token
         //   of formatting that is prefixed to logging output
+        // * Append() writes the token to the end of the line
+        //   being built so no temporary strings are needed
         class FormatBlock
         {
         public:
             virtual ~FormatBlock() = default;
-            virtual std::string Get() = 0;
+            virtual void Append(std::string &line) = 0;
         };
 
         // FBRunTimeMs
         // * format block that provides elapsed time since
         //   its creation in the format (00:00:00.000)
+        // * the text is only rebuilt when the millisecond
+        //   count changes
         class FBRunTimeMs : public FormatBlock
         {
         public:
             FBRunTimeMs();
             ~FBRunTimeMs();
 
-            std::string Get();
+            void Append(std::string &line);
 
         private:
-            std::string m_time_str;
-            std::chrono::system_clock::time_point const m_start;
-            std::array<char,10> const m_list_num_chars;
+            std::array<char,12> m_time_str;
+            s64 const m_start_ns; // FastClock steady time
+            s64 m_time_str_ms;
         };
 
         // FBCustomStr
@@ -110,7 +172,7 @@ namespace ks
             FBCustomStr(std::string const &s);
             ~FBCustomStr();
 
-            std::string Get();
+            void Append(std::string &line);
 
         private:
             std::string const m_s;
@@ -137,6 +199,7 @@ namespace ks
 
             struct MutexSTL : public Mutex
             {
+                MutexSTL() : m_mutex("Logger") {}
                 ~MutexSTL() {}
 
                 void lock() {
@@ -148,7 +211,7 @@ namespace ks
                 }
 
                 // Note: Mutex must be recursive!
-                std::recursive_mutex m_mutex;
+                RecursiveMutex m_mutex;
             };
 
             struct MutexDummy : public Mutex
@@ -158,6 +221,39 @@ namespace ks
                 void unlock() {}
             };
 
+            // LineBuffers
+            // * reusable line storage so that steady state
+            //   logging doesn't allocate
+            // * Lines can nest (ie an argument that logs while
+            //   the line is being built, allowed since the mutex
+            //   is recursive), so there is one buffer per depth
+            // * only accessed with the Logger mutex held
+            struct LineBuffers
+            {
+                LineBuffers() : depth(0) {}
+
+                std::string * Acquire()
+                {
+                    if(depth == list_buffers.size()) {
+                        list_buffers.emplace_back(new std::string());
+                        list_buffers.back()->reserve(256);
+                    }
+
+                    std::string * buffer = list_buffers[depth].get();
+                    buffer->clear();
+                    depth++;
+                    return buffer;
+                }
+
+                void Release()
+                {
+                    depth--;
+                }
+
+                uint depth;
+                std::vector<unique_ptr<std::string>> list_buffers;
+            };
+
             // Line
             // * class that wraps logging a line with RAII
             // * line is commited to log on destruction
@@ -167,16 +263,21 @@ namespace ks
                 Line(std::vector<shared_ptr<Sink>> const * list_sinks,
                      std::vector<unique_ptr<FormatBlock>> const * list_fb,
                      Mutex * mutex,
+                     LineBuffers * line_buffers,
                      bool line_valid) :
                     m_list_sinks(list_sinks),
                     m_list_fb(list_fb),
                     m_mutex(mutex),
-                    m_line_valid(line_valid)
+                    m_line_buffers(line_buffers),
+                    m_line_valid(line_valid),
+                    m_line(nullptr)
                 {
                     if(m_line_valid) {
+                        m_line = m_line_buffers->Acquire();
+
                         // create the prefix
                         for(auto & fb : (*m_list_fb)) {
-                            m_line.append(fb->Get());
+                            fb->Append(*m_line);
                         }
                     }
                 }
@@ -185,17 +286,23 @@ namespace ks
                 {
                     if(m_line_valid) {
                         for(auto &sink : (*m_list_sinks)) {
-                            sink->log(m_line);
+                            sink->log(*m_line);
                         }
+                        m_line_buffers->Release();
+                    }
+
+                    // Lines for filtered levels never
+                    // take the lock (see Logger::Custom)
+                    if(m_mutex) {
+                        m_mutex->unlock();
                     }
-                    m_mutex->unlock();
                 }
 
                 template<typename T>
                 Line & operator << (T const &msg)
                 {
                     if(m_line_valid) {
-                        m_line.append(ToString(msg));
+                        append(msg,std::is_arithmetic<T>());
                     }
                     return *this;
                 }
@@ -203,7 +310,7 @@ namespace ks
                 Line & operator << (std::string const &msg)
                 {
                     if(m_line_valid) {
-                        m_line.append(msg);
+                        m_line->append(msg);
                     }
                     return *this;
                 }
@@ -211,18 +318,32 @@ namespace ks
                 Line & operator << (const char * msg)
                 {
                     if(m_line_valid) {
-                        m_line.append(msg);
+                        m_line->append(msg);
                     }
                     return *this;
                 }
 
             private:
+                // numbers are formatted straight into the line
+                template<typename T>
+                void append(T const &msg, std::true_type)
+                {
+                    AppendNumber(*m_line,msg);
+                }
+
+                template<typename T>
+                void append(T const &msg, std::false_type)
+                {
+                    m_line->append(ToString(msg));
+                }
+
                 std::vector<shared_ptr<Sink>> const * m_list_sinks;
                 std::vector<unique_ptr<FormatBlock>> const * m_list_fb;
                 Mutex * m_mutex;
+                LineBuffers * m_line_buffers;
                 bool const m_line_valid;
 
-                std::string m_line;
+                std::string * m_line;
             };
 
         public:
@@ -261,6 +382,17 @@ namespace ks
             bool RemoveSink(shared_ptr<Sink> const &sink);
             void SetLevel(Level level);
             void UnsetLevel(Level level);
+
+            // * Returns true if @level is currently enabled
+            // * Lock free (a single relaxed atomic load) so it
+            //   can be checked before any message arguments are
+            //   evaluated; see the KS_LOG_* macros below
+            bool GetLevelEnabled(Level level) const
+            {
+                return ((m_filter.load(std::memory_order_relaxed) >>
+                         static_cast<u8>(level)) & 1) != 0;
+            }
+
             void AddFormatBlock(unique_ptr<FormatBlock> fb,
                                 Level level);
 
@@ -276,10 +408,25 @@ namespace ks
         private:
             std::unique_ptr<Mutex> m_mutex;
             std::vector<shared_ptr<Sink>> m_list_sinks;
-            std::bitset<6> m_filter;
+            std::atomic<u8> m_filter; // one bit per Level
             std::array<std::vector<unique_ptr<FormatBlock>>,6> m_list_fb;
+            LineBuffers m_line_buffers;
         };
 
+        // ============================================================= //
+
+        // FatalHandler
+        // * called whenever a FATAL line is started on any Logger
+        //   (even if FATAL is filtered), before the line itself is
+        //   logged; used to dump diagnostics such as the flight
+        //   recorder (see KsLogFlightRecorder.hpp)
+        // * the handler must not log FATAL lines itself
+        using FatalHandler = void(*)();
+
+        // * Sets the process wide fatal handler; pass
+        //   nullptr to remove it
+        void SetFatalHandler(FatalHandler handler);
+
     } // Log
 
     // ============================================================= //
@@ -291,4 +438,68 @@ namespace ks
 
 } // ks
 
+// ============================================================= //
+
+// KS_LOG_MIN_LEVEL
+// * compile time minimum level for the KS_LOG_* macros
+// * statements below this level are compiled out entirely;
+//   their arguments are type checked but never evaluated
+// * 0 (TRACE) through 5 (FATAL), or 6 to disable all levels
+#ifndef KS_LOG_MIN_LEVEL
+    #define KS_LOG_MIN_LEVEL 0
+#endif
+
+// KS_LOG_CUSTOM
+// * checks the logger's level filter before evaluating
+//   anything on the right hand side of the stream, so
+//   disabled statements cost a single atomic load:
+//
+//   KS_LOG_DEBUG(ks::LOG) << "expensive: " << Describe(obj);
+//
+// * the if/else form makes the macro safe to use as the
+//   body of an unbraced if statement
+#define KS_LOG_CUSTOM(logger,level) \
+    if(!(logger).GetLevelEnabled(level)) {} \
+    else (logger).Custom(level)
+
+#define KS_LOG_DISABLED(logger,level) \
+    if(true) {} \
+    else (logger).Custom(level)
+
+#if KS_LOG_MIN_LEVEL <= 0
+    #define KS_LOG_TRACE(logger) KS_LOG_CUSTOM(logger,ks::Log::Logger::Level::TRACE)
+#else
+    #define KS_LOG_TRACE(logger) KS_LOG_DISABLED(logger,ks::Log::Logger::Level::TRACE)
+#endif
+
+#if KS_LOG_MIN_LEVEL <= 1
+    #define KS_LOG_DEBUG(logger) KS_LOG_CUSTOM(logger,ks::Log::Logger::Level::DEBUG)
+#else
+    #define KS_LOG_DEBUG(logger) KS_LOG_DISABLED(logger,ks::Log::Logger::Level::DEBUG)
+#endif
+
+#if KS_LOG_MIN_LEVEL <= 2
+    #define KS_LOG_INFO(logger) KS_LOG_CUSTOM(logger,ks::Log::Logger::Level::INFO)
+#else
+    #define KS_LOG_INFO(logger) KS_LOG_DISABLED(logger,ks::Log::Logger::Level::INFO)
+#endif
+
+#if KS_LOG_MIN_LEVEL <= 3
+    #define KS_LOG_WARN(logger) KS_LOG_CUSTOM(logger,ks::Log::Logger::Level::WARN)
+#else
+    #define KS_LOG_WARN(logger) KS_LOG_DISABLED(logger,ks::Log::Logger::Level::WARN)
+#endif
+
+#if KS_LOG_MIN_LEVEL <= 4
+    #define KS_LOG_ERROR(logger) KS_LOG_CUSTOM(logger,ks::Log::Logger::Level::ERROR)
+#else
+    #define KS_LOG_ERROR(logger) KS_LOG_DISABLED(logger,ks::Log::Logger::Level::ERROR)
+#endif
+
+#if KS_LOG_MIN_LEVEL <= 5
+    #define KS_LOG_FATAL(logger) KS_LOG_CUSTOM(logger,ks::Log::Logger::Level::FATAL)
+#else
+    #define KS_LOG_FATAL(logger) KS_LOG_DISABLED(logger,ks::Log::Logger::Level::FATAL)
+#endif
+
 #endif // KS_LOG_HPP
@@ -0,0 +1,605 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <ctime>
+
+#include <ks/KsLogBinary.hpp>
+
+namespace ks
+{
+    namespace Log
+    {
+        namespace
+        {
+            // The registry is only locked when a call site
+            // is first registered or looked up by a decoder.
+            // Function local statics make it safe to use
+            // during static initialization.
+            std::mutex & GetFormatMutex()
+            {
+                static std::mutex format_mutex;
+                return format_mutex;
+            }
+
+            std::vector<BinaryFormat> & GetFormatList()
+            {
+                static std::vector<BinaryFormat> list_formats;
+                return list_formats;
+            }
+
+            template<typename T>
+            bool ReadRaw(u8 const * &in, u8 const * end, T &val)
+            {
+                if(static_cast<size_t>(end-in) < sizeof(T)) {
+                    return false;
+                }
+                std::memcpy(&val,in,sizeof(T));
+                in += sizeof(T);
+                return true;
+            }
+
+            void RenderArg(u8 const * &in,
+                           u8 const * end,
+                           std::string &line,
+                           bool &ok)
+            {
+                u8 type;
+                if(!ReadRaw(in,end,type)) {
+                    ok = false;
+                    return;
+                }
+
+                switch(static_cast<binary_detail::ArgType>(type))
+                {
+                    case binary_detail::ArgType::Bool: {
+                        u8 val;
+                        if((ok = ReadRaw(in,end,val))) {
+                            line.append(val ? "1" : "0");
+                        }
+                        break;
+                    }
+                    case binary_detail::ArgType::Char: {
+                        u8 val;
+                        if((ok = ReadRaw(in,end,val))) {
+                            line.push_back(static_cast<char>(val));
+                        }
+                        break;
+                    }
+                    case binary_detail::ArgType::SInt: {
+                        s64 val;
+                        if((ok = ReadRaw(in,end,val))) {
+                            AppendNumber(line,val);
+                        }
+                        break;
+                    }
+                    case binary_detail::ArgType::UInt: {
+                        u64 val;
+                        if((ok = ReadRaw(in,end,val))) {
+                            AppendNumber(line,val);
+                        }
+                        break;
+                    }
+                    case binary_detail::ArgType::Float: {
+                        double val;
+                        if((ok = ReadRaw(in,end,val))) {
+                            AppendNumber(line,val);
+                        }
+                        break;
+                    }
+                    case binary_detail::ArgType::String: {
+                        u32 size;
+                        ok = ReadRaw(in,end,size) &&
+                                (static_cast<size_t>(end-in) >= size);
+                        if(ok) {
+                            line.append(reinterpret_cast<char const*>(in),size);
+                            in += size;
+                        }
+                        break;
+                    }
+                    case binary_detail::ArgType::Pointer: {
+                        u64 val;
+                        if((ok = ReadRaw(in,end,val))) {
+                            char buff[32];
+                            std::snprintf(buff,sizeof(buff),"0x%llx",
+                                          static_cast<unsigned long long>(val));
+                            line.append(buff);
+                        }
+                        break;
+                    }
+                    default: {
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // ============================================================= //
+
+        namespace binary_detail
+        {
+            bool RenderArgs(char const * format,
+                            u8 const * args,
+                            size_t args_size,
+                            std::string &line)
+            {
+                u8 const * in = args;
+                u8 const * const end = args+args_size;
+                bool ok = true;
+
+                // Replace each {} with the next argument
+                char const * f = format;
+                while(*f != '\0') {
+                    if(f[0] == '{' && f[1] == '}' && in < end) {
+                        RenderArg(in,end,line,ok);
+                        if(!ok) {
+                            return false;
+                        }
+                        f += 2;
+                    }
+                    else {
+                        line.push_back(*f);
+                        f++;
+                    }
+                }
+
+                // Append any arguments without a placeholder
+                while(in < end) {
+                    line.push_back(' ');
+                    RenderArg(in,end,line,ok);
+                    if(!ok) {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            char const * GetLevelLabel(Logger::Level level)
+            {
+                static char const * const list_labels[] = {
+                    "TRACE: ",
+                    "DEBUG: ",
+                    "INFO:  ",
+                    "WARN:  ",
+                    "ERROR: ",
+                    "FATAL: "
+                };
+
+                u8 const level_int = static_cast<u8>(level);
+                return (level_int < 6) ? list_labels[level_int] : "?????: ";
+            }
+
+            void RenderLevel(Logger::Level level,
+                             std::string &line)
+            {
+                line.append(GetLevelLabel(level));
+            }
+
+            void RenderTimestamp(u64 timestamp_ns,
+                                 std::string &line)
+            {
+                std::time_t const secs =
+                        static_cast<std::time_t>(timestamp_ns/1000000000ull);
+
+                uint const ms =
+                        static_cast<uint>((timestamp_ns/1000000ull)%1000);
+
+                std::tm tm_utc;
+                gmtime_r(&secs,&tm_utc);
+
+                char buff[64];
+                std::snprintf(buff,sizeof(buff),
+                              "%04d-%02d-%02d %02d:%02d:%02d.%03u",
+                              tm_utc.tm_year+1900,
+                              tm_utc.tm_mon+1,
+                              tm_utc.tm_mday,
+                              tm_utc.tm_hour,
+                              tm_utc.tm_min,
+                              tm_utc.tm_sec,
+                              ms);
+
+                line.append(buff);
+            }
+
+            u64 GetTimestamp()
+            {
+                return FastClock::GetWallNs();
+            }
+
+        } // binary_detail
+
+        // ============================================================= //
+
+        u32 RegisterBinaryFormat(Logger::Level level,
+                                 char const * file,
+                                 u32 line,
+                                 char const * format)
+        {
+            std::lock_guard<std::mutex> lock(GetFormatMutex());
+            auto &list_formats = GetFormatList();
+
+            u32 const id = static_cast<u32>(list_formats.size()+1);
+            list_formats.push_back(
+                        BinaryFormat{
+                            id,
+                            level,
+                            line,
+                            std::string(file),
+                            std::string(format)
+                        });
+
+            return id;
+        }
+
+        bool GetBinaryFormat(u32 id, BinaryFormat &binary_format)
+        {
+            std::lock_guard<std::mutex> lock(GetFormatMutex());
+            auto const &list_formats = GetFormatList();
+
+            if(id == 0 || id > list_formats.size()) {
+                return false;
+            }
+
+            binary_format = list_formats[id-1];
+            return true;
+        }
+
+        // ============================================================= //
+
+        BinarySinkToFile::BinarySinkToFile(std::string const &file_path) :
+            m_file(std::fopen(file_path.c_str(),"wb"))
+        {
+            // empty
+        }
+
+        BinarySinkToFile::~BinarySinkToFile()
+        {
+            if(m_file) {
+                std::fclose(m_file);
+            }
+        }
+
+        bool BinarySinkToFile::GetValid() const
+        {
+            return (m_file != nullptr);
+        }
+
+        void BinarySinkToFile::write(u8 const * data, size_t size)
+        {
+            if(m_file) {
+                std::fwrite(data,1,size,m_file);
+            }
+        }
+
+        void BinarySinkToFile::flush()
+        {
+            if(m_file) {
+                std::fflush(m_file);
+            }
+        }
+
+        // ============================================================= //
+
+        BinaryLogger::BinaryLogger(shared_ptr<BinarySink> sink,
+                                   size_t buffer_size) :
+            m_sink(std::move(sink)),
+            m_filter(0x3F), // default filter is all on
+            m_buffer(std::max(buffer_size,size_t(1024))),
+            m_buffer_used(0)
+        {
+            // Every stream starts with the header
+            u8 * out = &(m_buffer[0]);
+            std::memcpy(out,binary_detail::k_magic,4);
+            out += 4;
+            *out++ = binary_detail::k_version;
+            *out++ = 0;
+            *out++ = 0;
+            *out++ = 0;
+            binary_detail::WriteRaw(out,binary_detail::k_byte_order_mark);
+            m_buffer_used = binary_detail::k_header_size;
+        }
+
+        BinaryLogger::~BinaryLogger()
+        {
+            Flush();
+        }
+
+        void BinaryLogger::SetLevel(Logger::Level level)
+        {
+            u8 const bit = static_cast<u8>(1 << static_cast<u8>(level));
+            m_filter.fetch_or(bit,std::memory_order_relaxed);
+        }
+
+        void BinaryLogger::UnsetLevel(Logger::Level level)
+        {
+            u8 const bit = static_cast<u8>(1 << static_cast<u8>(level));
+            m_filter.fetch_and(static_cast<u8>(~bit),std::memory_order_relaxed);
+        }
+
+        void BinaryLogger::Flush()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            flushBuffer();
+            m_sink->flush();
+        }
+
+        u8 * BinaryLogger::beginRecord(u32 format_id,
+                                       u64 timestamp,
+                                       size_t args_size)
+        {
+            // The format record is written into the stream
+            // the first time its id is used so that the
+            // stream can be decoded on its own
+            if(format_id >= m_list_format_written.size()) {
+                m_list_format_written.resize(format_id+1,false);
+            }
+
+            if(!m_list_format_written[format_id]) {
+                writeFormatRecord(format_id);
+                m_list_format_written[format_id] = true;
+            }
+
+            size_t const record_size =
+                    binary_detail::k_line_record_size+args_size;
+
+            if(m_buffer_used+record_size > m_buffer.size()) {
+                flushBuffer();
+
+                if(record_size > m_buffer.size()) {
+                    m_buffer.resize(record_size);
+                }
+            }
+
+            u8 * out = &(m_buffer[m_buffer_used]);
+            *out++ = static_cast<u8>(binary_detail::RecordType::Line);
+            binary_detail::WriteRaw(out,format_id);
+            binary_detail::WriteRaw(out,timestamp);
+            binary_detail::WriteRaw(out,static_cast<u32>(args_size));
+            m_buffer_used += binary_detail::k_line_record_size;
+
+            return out;
+        }
+
+        void BinaryLogger::writeFormatRecord(u32 format_id)
+        {
+            BinaryFormat binary_format;
+            if(!GetBinaryFormat(format_id,binary_format)) {
+                binary_format.id = format_id;
+                binary_format.level = Logger::Level::INFO;
+                binary_format.line = 0;
+            }
+
+            size_t const file_size =
+                    std::min(binary_format.file.size(),size_t(0xFFFF));
+
+            size_t const format_size =
+                    std::min(binary_format.format.size(),size_t(0xFFFF));
+
+            size_t const record_size =
+                    1+4+1+4+2+file_size+2+format_size;
+
+            if(m_buffer_used+record_size > m_buffer.size()) {
+                flushBuffer();
+
+                if(record_size > m_buffer.size()) {
+                    m_buffer.resize(record_size);
+                }
+            }
+
+            u8 * out = &(m_buffer[m_buffer_used]);
+            *out++ = static_cast<u8>(binary_detail::RecordType::Format);
+            binary_detail::WriteRaw(out,format_id);
+            *out++ = static_cast<u8>(binary_format.level);
+            binary_detail::WriteRaw(out,binary_format.line);
+            binary_detail::WriteRaw(out,static_cast<u16>(file_size));
+            std::memcpy(out,binary_format.file.data(),file_size);
+            out += file_size;
+            binary_detail::WriteRaw(out,static_cast<u16>(format_size));
+            std::memcpy(out,binary_format.format.data(),format_size);
+
+            m_buffer_used += record_size;
+        }
+
+        void BinaryLogger::flushBuffer()
+        {
+            if(m_buffer_used > 0) {
+                m_sink->write(&(m_buffer[0]),m_buffer_used);
+                m_buffer_used = 0;
+            }
+        }
+
+        // ============================================================= //
+
+        BinaryDecoder::BinaryDecoder(shared_ptr<Sink> sink) :
+            m_sink(std::move(sink)),
+            m_valid(true),
+            m_header_read(false)
+        {
+            // empty
+        }
+
+        bool BinaryDecoder::Feed(u8 const * data, size_t size)
+        {
+            if(!m_valid) {
+                return false;
+            }
+
+            m_pending.insert(m_pending.end(),data,data+size);
+            return decode();
+        }
+
+        size_t BinaryDecoder::GetPendingSize() const
+        {
+            return m_pending.size();
+        }
+
+        bool BinaryDecoder::decode()
+        {
+            size_t offset = 0;
+
+            if(!m_header_read) {
+                if(m_pending.size() < binary_detail::k_header_size) {
+                    return true;
+                }
+
+                u8 const * in = &(m_pending[0]);
+                u32 byte_order_mark;
+                std::memcpy(&byte_order_mark,in+8,4);
+
+                if(std::memcmp(in,binary_detail::k_magic,4) != 0 ||
+                   in[4] != binary_detail::k_version ||
+                   byte_order_mark != binary_detail::k_byte_order_mark)
+                {
+                    m_valid = false;
+                    return false;
+                }
+
+                m_header_read = true;
+                offset = binary_detail::k_header_size;
+            }
+
+            while(offset < m_pending.size()) {
+                size_t const record_size =
+                        decodeRecord(&(m_pending[offset]),
+                                     m_pending.size()-offset);
+
+                if(!m_valid) {
+                    return false;
+                }
+
+                if(record_size == 0) {
+                    break; // need more data
+                }
+
+                offset += record_size;
+            }
+
+            m_pending.erase(m_pending.begin(),m_pending.begin()+offset);
+            return true;
+        }
+
+        size_t BinaryDecoder::decodeRecord(u8 const * data, size_t size)
+        {
+            u8 const * in = data;
+            u8 const * const end = data+size;
+
+            u8 type;
+            u32 id;
+            if(!ReadRaw(in,end,type) || !ReadRaw(in,end,id)) {
+                return 0;
+            }
+
+            if(type == static_cast<u8>(binary_detail::RecordType::Format))
+            {
+                u8 level;
+                u32 line;
+                u16 file_size;
+                u16 format_size;
+
+                if(!ReadRaw(in,end,level) ||
+                   !ReadRaw(in,end,line) ||
+                   !ReadRaw(in,end,file_size) ||
+                   static_cast<size_t>(end-in) < file_size)
+                {
+                    return 0;
+                }
+
+                std::string file(reinterpret_cast<char const*>(in),file_size);
+                in += file_size;
+
+                if(!ReadRaw(in,end,format_size) ||
+                   static_cast<size_t>(end-in) < format_size)
+                {
+                    return 0;
+                }
+
+                std::string format(reinterpret_cast<char const*>(in),format_size);
+                in += format_size;
+
+                if(id == 0 || id > binary_detail::k_max_format_id) {
+                    m_valid = false;
+                    return 0;
+                }
+
+                if(id >= m_list_formats.size()) {
+                    m_list_formats.resize(id+1);
+                }
+
+                m_list_formats[id] =
+                        BinaryFormat{
+                            id,
+                            static_cast<Logger::Level>(level),
+                            line,
+                            std::move(file),
+                            std::move(format)
+                        };
+
+                return static_cast<size_t>(in-data);
+            }
+            else if(type == static_cast<u8>(binary_detail::RecordType::Line))
+            {
+                u64 timestamp;
+                u32 args_size;
+
+                if(!ReadRaw(in,end,timestamp) ||
+                   !ReadRaw(in,end,args_size) ||
+                   static_cast<size_t>(end-in) < args_size)
+                {
+                    return 0;
+                }
+
+                if(id == 0 || id >= m_list_formats.size() ||
+                   m_list_formats[id].id != id)
+                {
+                    // Line record for an undefined format
+                    m_valid = false;
+                    return 0;
+                }
+
+                BinaryFormat const &binary_format = m_list_formats[id];
+
+                m_line.clear();
+                binary_detail::RenderTimestamp(timestamp,m_line);
+                m_line.append(": ");
+                binary_detail::RenderLevel(binary_format.level,m_line);
+                m_line.append(binary_format.file);
+                m_line.push_back(':');
+                m_line.append(ToString(binary_format.line));
+                m_line.append(": ");
+
+                if(!binary_detail::RenderArgs(
+                       binary_format.format.c_str(),
+                       in,args_size,m_line))
+                {
+                    m_valid = false;
+                    return 0;
+                }
+
+                m_sink->log(m_line);
+
+                return static_cast<size_t>((in+args_size)-data);
+            }
+
+            m_valid = false;
+            return 0;
+        }
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
@@ -0,0 +1,451 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_LOG_BINARY_HPP
+#define KS_LOG_BINARY_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#include <ks/KsLog.hpp>
+
+namespace ks
+{
+    namespace Log
+    {
+        // ============================================================= //
+
+        // Binary logging
+        // * deferred formatting: a call site is registered once with
+        //   its format string and gets a static format id. Each log
+        //   call then only copies the id, a timestamp and the raw
+        //   argument bytes into a buffer
+        // * the text is rendered later (offline) by BinaryDecoder,
+        //   see tools/ks_log_decode
+        // * format strings use {} as the argument placeholder:
+        //
+        //   KS_LOG_BINARY(binlog,Level::INFO,"rx {} bytes from {}",n,name);
+        //
+        // * supported argument types are bool, char, integers,
+        //   floating point, strings and pointers
+
+        // Stream layout (native byte order):
+        // * header: "KSBL", u8 version, u8 reserved[3], u32 byte order mark
+        // * format record: u8 type, u32 id, u8 level, u32 line,
+        //                  u16 file len, file, u16 format len, format
+        // * line record: u8 type, u32 id, u64 timestamp (ns since
+        //                the unix epoch), u32 args size, args
+        namespace binary_detail
+        {
+            char const * const k_magic = "KSBL";
+            u8 const k_version = 2;
+            u32 const k_byte_order_mark = 0x01020304;
+            size_t const k_header_size = 12;
+
+            // strings longer than this are truncated
+            size_t const k_max_string_size = 1024;
+
+            enum class RecordType : u8
+            {
+                Format = 1,
+                Line = 2
+            };
+
+            size_t const k_line_record_size = 1+4+8+4;
+
+            // format ids are assigned in order from 1, so a
+            // larger id means the stream is corrupt
+            u32 const k_max_format_id = 1 << 20;
+
+            enum class ArgType : u8
+            {
+                Bool = 1,
+                Char,
+                SInt,
+                UInt,
+                Float,
+                String,
+                Pointer
+            };
+
+            template<typename T>
+            inline void WriteRaw(u8 * &out, T const &val)
+            {
+                std::memcpy(out,&val,sizeof(T));
+                out += sizeof(T);
+            }
+
+            template<typename T>
+            struct is_char_pointer : std::integral_constant<
+                    bool,
+                    std::is_pointer<T>::value &&
+                    std::is_same<
+                        typename std::remove_cv<
+                            typename std::remove_pointer<T>::type
+                        >::type,
+                        char
+                    >::value> {};
+
+            // ArgCodec
+            // * computes encoded sizes and writes arguments
+            struct ArgCodec
+            {
+                // bool
+                static size_t Size(bool) { return 2; }
+                static void Write(u8 * &out, bool val)
+                {
+                    *out++ = static_cast<u8>(ArgType::Bool);
+                    *out++ = val ? 1 : 0;
+                }
+
+                // char
+                static size_t Size(char) { return 2; }
+                static void Write(u8 * &out, char val)
+                {
+                    *out++ = static_cast<u8>(ArgType::Char);
+                    *out++ = static_cast<u8>(val);
+                }
+
+                // signed integers (widened to s64)
+                template<typename T>
+                static typename std::enable_if<
+                    std::is_integral<T>::value &&
+                    std::is_signed<T>::value,size_t>::type
+                Size(T) { return 9; }
+
+                template<typename T>
+                static typename std::enable_if<
+                    std::is_integral<T>::value &&
+                    std::is_signed<T>::value>::type
+                Write(u8 * &out, T val)
+                {
+                    *out++ = static_cast<u8>(ArgType::SInt);
+                    WriteRaw(out,static_cast<s64>(val));
+                }
+
+                // unsigned integers (widened to u64)
+                template<typename T>
+                static typename std::enable_if<
+                    std::is_integral<T>::value &&
+                    std::is_unsigned<T>::value,size_t>::type
+                Size(T) { return 9; }
+
+                template<typename T>
+                static typename std::enable_if<
+                    std::is_integral<T>::value &&
+                    std::is_unsigned<T>::value>::type
+                Write(u8 * &out, T val)
+                {
+                    *out++ = static_cast<u8>(ArgType::UInt);
+                    WriteRaw(out,static_cast<u64>(val));
+                }
+
+                // floating point (widened to double)
+                template<typename T>
+                static typename std::enable_if<
+                    std::is_floating_point<T>::value,size_t>::type
+                Size(T) { return 9; }
+
+                template<typename T>
+                static typename std::enable_if<
+                    std::is_floating_point<T>::value>::type
+                Write(u8 * &out, T val)
+                {
+                    *out++ = static_cast<u8>(ArgType::Float);
+                    WriteRaw(out,static_cast<double>(val));
+                }
+
+                // strings
+                static size_t Size(char const * s)
+                {
+                    return 5+strSize(s);
+                }
+
+                static void Write(u8 * &out, char const * s)
+                {
+                    writeStr(out,s,strSize(s));
+                }
+
+                static size_t Size(std::string const &s)
+                {
+                    return 5+std::min(s.size(),k_max_string_size);
+                }
+
+                static void Write(u8 * &out, std::string const &s)
+                {
+                    writeStr(out,s.data(),std::min(s.size(),k_max_string_size));
+                }
+
+                // pointers (other than char pointers)
+                template<typename T>
+                static typename std::enable_if<
+                    std::is_pointer<T>::value &&
+                    !is_char_pointer<T>::value,size_t>::type
+                Size(T) { return 9; }
+
+                template<typename T>
+                static typename std::enable_if<
+                    std::is_pointer<T>::value &&
+                    !is_char_pointer<T>::value>::type
+                Write(u8 * &out, T val)
+                {
+                    *out++ = static_cast<u8>(ArgType::Pointer);
+                    WriteRaw(out,static_cast<u64>(
+                                 reinterpret_cast<std::uintptr_t>(val)));
+                }
+
+            private:
+                static size_t strSize(char const * s)
+                {
+                    if(s == nullptr) {
+                        return 0;
+                    }
+                    size_t size=0;
+                    while(size < k_max_string_size && s[size] != '\0') {
+                        size++;
+                    }
+                    return size;
+                }
+
+                static void writeStr(u8 * &out, char const * s, size_t size)
+                {
+                    *out++ = static_cast<u8>(ArgType::String);
+                    WriteRaw(out,static_cast<u32>(size));
+                    if(size > 0) {
+                        std::memcpy(out,s,size);
+                    }
+                    out += size;
+                }
+            };
+
+            inline size_t ArgsSize()
+            {
+                return 0;
+            }
+
+            template<typename T, typename... Rest>
+            size_t ArgsSize(T const &arg, Rest const &... rest)
+            {
+                return ArgCodec::Size(arg)+ArgsSize(rest...);
+            }
+
+            inline void WriteArgs(u8 * &)
+            {
+                // empty
+            }
+
+            template<typename T, typename... Rest>
+            void WriteArgs(u8 * &out, T const &arg, Rest const &... rest)
+            {
+                ArgCodec::Write(out,arg);
+                WriteArgs(out,rest...);
+            }
+
+            // * Renders @format with the encoded @args into @line
+            // * Returns false if @args is malformed
+            bool RenderArgs(char const * format,
+                            u8 const * args,
+                            size_t args_size,
+                            std::string &line);
+
+            // * Returns the label used for @level in text
+            //   output, ie "INFO:  "
+            char const * GetLevelLabel(Logger::Level level);
+
+            // * Appends GetLevelLabel(@level) to @line
+            void RenderLevel(Logger::Level level,
+                             std::string &line);
+
+            // * Appends "YYYY-MM-DD HH:MM:SS.mmm" (UTC) for a
+            //   timestamp in nanoseconds since the unix epoch
+            void RenderTimestamp(u64 timestamp_ns,
+                                 std::string &line);
+
+            // * Timestamp source used for binary records
+            u64 GetTimestamp();
+
+        } // binary_detail
+
+        // ============================================================= //
+
+        // BinaryFormat
+        // * the static description of one binary logging call site
+        struct BinaryFormat
+        {
+            u32 id;
+            Logger::Level level;
+            u32 line;
+            std::string file;
+            std::string format;
+        };
+
+        // * Registers a call site and returns its format id
+        // * Called once per call site by KS_LOG_BINARY, ids are
+        //   never recycled and start at one
+        u32 RegisterBinaryFormat(Logger::Level level,
+                                 char const * file,
+                                 u32 line,
+                                 char const * format);
+
+        // * Looks up a registered call site in this process
+        bool GetBinaryFormat(u32 id, BinaryFormat &binary_format);
+
+        // ============================================================= //
+
+        // BinarySink
+        // * abstract class that represents binary logging output
+        class BinarySink
+        {
+        public:
+            virtual ~BinarySink() = default;
+            virtual void write(u8 const * data, size_t size)=0;
+            virtual void flush() {}
+        };
+
+        // BinarySinkToFile
+        // * writes the binary stream to a file (truncated on open)
+        class BinarySinkToFile : public BinarySink
+        {
+        public:
+            BinarySinkToFile(std::string const &file_path);
+            ~BinarySinkToFile();
+
+            bool GetValid() const;
+
+            void write(u8 const * data, size_t size);
+            void flush();
+
+        private:
+            std::FILE * m_file;
+        };
+
+        // ============================================================= //
+
+        // BinaryLogger
+        // * buffers binary records and hands them to its
+        //   sink when the buffer fills up or on Flush()
+        // * thread safe; the lock is held while a record is
+        //   copied into the buffer, and while the buffer is
+        //   written to the sink when it fills up
+        class BinaryLogger
+        {
+        public:
+            BinaryLogger(shared_ptr<BinarySink> sink,
+                         size_t buffer_size=64*1024);
+
+            ~BinaryLogger();
+
+            BinaryLogger(BinaryLogger const &) = delete;
+            BinaryLogger & operator = (BinaryLogger const &) = delete;
+
+            void SetLevel(Logger::Level level);
+            void UnsetLevel(Logger::Level level);
+
+            bool GetLevelEnabled(Logger::Level level) const
+            {
+                return ((m_filter.load(std::memory_order_relaxed) >>
+                         static_cast<u8>(level)) & 1) != 0;
+            }
+
+            // * Logs a line for a registered call site; prefer
+            //   the KS_LOG_BINARY macro to calling this directly
+            template<typename... Args>
+            void Log(u32 format_id, Args const &... args)
+            {
+                size_t const args_size = binary_detail::ArgsSize(args...);
+                u64 const timestamp = binary_detail::GetTimestamp();
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                u8 * out = beginRecord(format_id,timestamp,args_size);
+                binary_detail::WriteArgs(out,args...);
+                m_buffer_used += args_size;
+            }
+
+            void Flush();
+
+        private:
+            u8 * beginRecord(u32 format_id,
+                             u64 timestamp,
+                             size_t args_size);
+
+            void writeFormatRecord(u32 format_id);
+            void flushBuffer();
+
+            std::mutex m_mutex;
+            shared_ptr<BinarySink> m_sink;
+            std::atomic<u8> m_filter;
+            std::vector<u8> m_buffer;
+            size_t m_buffer_used;
+            std::vector<bool> m_list_format_written;
+        };
+
+        // ============================================================= //
+
+        // BinaryDecoder
+        // * renders a binary log stream as text lines
+        // * data can be fed in arbitrarily sized pieces; records
+        //   that are split across calls are kept until complete
+        class BinaryDecoder
+        {
+        public:
+            BinaryDecoder(shared_ptr<Sink> sink);
+
+            // * Returns false if the stream is malformed, after
+            //   which all further input is ignored
+            bool Feed(u8 const * data, size_t size);
+
+            // * Returns the number of bytes received but not
+            //   yet decoded (ie a truncated final record)
+            size_t GetPendingSize() const;
+
+        private:
+            bool decode();
+
+            // * Returns the size of the record at @data, or 0
+            //   if more data is needed. Sets m_valid on error
+            size_t decodeRecord(u8 const * data, size_t size);
+
+            shared_ptr<Sink> m_sink;
+            bool m_valid;
+            bool m_header_read;
+            std::vector<u8> m_pending;
+            std::vector<BinaryFormat> m_list_formats;
+            std::string m_line;
+        };
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
+
+// ============================================================= //
+
+// KS_LOG_BINARY
+// * logs through a BinaryLogger; @level must be the same
+//   every time a given call site runs
+#define KS_LOG_BINARY(logger,level,format,...) \
+    do { \
+        if((logger).GetLevelEnabled(level)) { \
+            static ks::u32 const ks_log_binary_id = \
+                ks::Log::RegisterBinaryFormat( \
+                    level,__FILE__,__LINE__,format); \
+            (logger).Log(ks_log_binary_id,##__VA_ARGS__); \
+        } \
+    } while(0)
+
+#endif // KS_LOG_BINARY_HPP
@@ -0,0 +1,210 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <map>
+
+#include <ks/KsLogCategory.hpp>
+
+namespace ks
+{
+    namespace Log
+    {
+        // ============================================================= //
+
+        // CategoryRegistry
+        // * owns all categories and the thresholds set for them
+        // * the mutex is only taken to create a category or to
+        //   change thresholds, never to check a level
+        struct CategoryRegistry
+        {
+            static CategoryRegistry & Get()
+            {
+                static CategoryRegistry registry;
+                return registry;
+            }
+
+            // * Returns the threshold for @name from the most
+            //   specific rule that covers it
+            u8 resolve(std::string const &name) const
+            {
+                std::string ancestor = name;
+                while(true) {
+                    auto rule_it = list_rules.find(ancestor);
+                    if(rule_it != list_rules.end()) {
+                        return rule_it->second;
+                    }
+
+                    if(ancestor.empty()) {
+                        return 0; // everything enabled
+                    }
+
+                    size_t const dot = ancestor.rfind('.');
+                    ancestor.resize((dot == std::string::npos) ? 0 : dot);
+                }
+            }
+
+            void update()
+            {
+                for(auto &category_it : list_categories) {
+                    Category &category = *(category_it.second);
+                    category.m_threshold.store(
+                                resolve(category.m_name),
+                                std::memory_order_relaxed);
+                }
+            }
+
+            Category & getOrCreate(std::string const &name)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                auto category_it = list_categories.find(name);
+                if(category_it == list_categories.end()) {
+                    category_it = list_categories.emplace(
+                                name,make_unique<Category>(name)).first;
+
+                    category_it->second->m_threshold.store(
+                                resolve(name),
+                                std::memory_order_relaxed);
+                }
+
+                return *(category_it->second);
+            }
+
+            void setRule(std::string const &name, u8 threshold)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                list_rules[name] = threshold;
+                update();
+            }
+
+            void removeRule(std::string const &name)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                list_rules.erase(name);
+                update();
+            }
+
+            std::mutex mutex;
+            std::map<std::string,unique_ptr<Category>> list_categories;
+            std::map<std::string,u8> list_rules;
+        };
+
+        // ============================================================= //
+
+        Category::Category(std::string name) :
+            m_name(std::move(name)),
+            m_prefix("["+m_name+"] "),
+            m_threshold(0)
+        {
+            // empty
+        }
+
+        std::string const & Category::GetName() const
+        {
+            return m_name;
+        }
+
+        std::string const & Category::GetPrefix() const
+        {
+            return m_prefix;
+        }
+
+        u8 Category::GetThreshold() const
+        {
+            return m_threshold.load(std::memory_order_relaxed);
+        }
+
+        // ============================================================= //
+
+        Category & GetCategory(std::string const &name)
+        {
+            return CategoryRegistry::Get().getOrCreate(name);
+        }
+
+        void SetCategoryThreshold(std::string const &name,
+                                  Logger::Level level)
+        {
+            CategoryRegistry::Get().setRule(name,static_cast<u8>(level));
+        }
+
+        void DisableCategory(std::string const &name)
+        {
+            CategoryRegistry::Get().setRule(name,Category::k_threshold_off);
+        }
+
+        void ResetCategoryThreshold(std::string const &name)
+        {
+            CategoryRegistry::Get().removeRule(name);
+        }
+
+        bool ConfigureCategories(std::string const &spec)
+        {
+            static std::vector<std::string> const list_level_names{
+                "TRACE","DEBUG","INFO","WARN","ERROR","FATAL","OFF"
+            };
+
+            bool ok = true;
+            size_t begin = 0;
+
+            while(begin <= spec.size()) {
+                size_t end = spec.find(',',begin);
+                if(end == std::string::npos) {
+                    end = spec.size();
+                }
+
+                std::string const entry = spec.substr(begin,end-begin);
+                begin = end+1;
+
+                if(entry.empty()) {
+                    continue;
+                }
+
+                size_t const eq = entry.find('=');
+                if(eq == std::string::npos) {
+                    ok = false;
+                    continue;
+                }
+
+                std::string name = entry.substr(0,eq);
+                std::string const level_name = entry.substr(eq+1);
+
+                if(name == "*") {
+                    name.clear();
+                }
+
+                auto level_it = std::find(list_level_names.begin(),
+                                          list_level_names.end(),
+                                          level_name);
+
+                if(level_it == list_level_names.end()) {
+                    ok = false;
+                    continue;
+                }
+
+                CategoryRegistry::Get().setRule(
+                            name,
+                            static_cast<u8>(level_it-list_level_names.begin()));
+            }
+
+            return ok;
+        }
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
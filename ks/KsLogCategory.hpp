@@ -0,0 +1,131 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_LOG_CATEGORY_HPP
+#define KS_LOG_CATEGORY_HPP
+
+#include <ks/KsLog.hpp>
+
+namespace ks
+{
+    namespace Log
+    {
+        // ============================================================= //
+
+        struct CategoryRegistry;
+
+        // Category
+        // * a named logging category with its own level threshold;
+        //   names are hierarchical and separated by dots, so a
+        //   threshold set for "net" also applies to "net.tcp"
+        //   unless "net.tcp" has a threshold of its own
+        // * categories are created on first use and never destroyed,
+        //   so a reference can be resolved once and cached:
+        //
+        //   static ks::Log::Category & s_log_tcp =
+        //          ks::Log::GetCategory("net.tcp");
+        //
+        //   KS_LOG_CATEGORY(ks::LOG,s_log_tcp,Level::DEBUG) << "rx";
+        //
+        // * checking a category is a single relaxed atomic load;
+        //   thresholds can be changed at any time from any thread
+        class Category
+        {
+        public:
+            // * Threshold value that disables every level
+            static u8 const k_threshold_off = 6;
+
+            Category(std::string name);
+            Category(Category const &) = delete;
+            Category & operator = (Category const &) = delete;
+
+            std::string const & GetName() const;
+
+            // * Returns "[name] ", prefixed to each line
+            std::string const & GetPrefix() const;
+
+            // * Returns the lowest enabled level, or
+            //   k_threshold_off
+            u8 GetThreshold() const;
+
+            bool GetLevelEnabled(Logger::Level level) const
+            {
+                return static_cast<u8>(level) >=
+                        m_threshold.load(std::memory_order_relaxed);
+            }
+
+        private:
+            friend struct CategoryRegistry;
+
+            std::string const m_name;
+            std::string const m_prefix;
+            std::atomic<u8> m_threshold;
+        };
+
+        // * Returns the category called @name, creating it
+        //   if it doesn't exist yet
+        // * Safe to call during static initialization
+        Category & GetCategory(std::string const &name);
+
+        // * Sets the lowest enabled level for @name and all of
+        //   its descendants without a more specific threshold
+        // * An empty @name sets the default for all categories.
+        //   The initial default enables every level
+        void SetCategoryThreshold(std::string const &name,
+                                  Logger::Level level);
+
+        // * Disables every level for @name and its descendants
+        void DisableCategory(std::string const &name);
+
+        // * Removes the threshold set for @name so that it
+        //   inherits from its parent again
+        void ResetCategoryThreshold(std::string const &name);
+
+        // * Applies a list of thresholds like
+        //   "net=DEBUG,net.tcp=OFF,evloop=WARN,*=INFO"
+        //   where * sets the default (ie from an environment
+        //   variable or a config file)
+        // * Returns false if any entry couldn't be parsed;
+        //   the valid entries are still applied
+        bool ConfigureCategories(std::string const &spec);
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
+
+// ============================================================= //
+
+// KS_LOG_CATEGORY
+// * like KS_LOG_CUSTOM but also checks @category before
+//   evaluating anything, and prefixes the line with the
+//   category's name
+// * honours KS_LOG_MIN_LEVEL when @level is a constant
+#if KS_LOG_MIN_LEVEL > 0
+    #define KS_LOG_CATEGORY(logger,category,level) \
+        if(static_cast<int>(level) < KS_LOG_MIN_LEVEL || \
+           !(category).GetLevelEnabled(level) || \
+           !(logger).GetLevelEnabled(level)) {} \
+        else (logger).Custom(level) << (category).GetPrefix()
+#else
+    #define KS_LOG_CATEGORY(logger,category,level) \
+        if(!(category).GetLevelEnabled(level) || \
+           !(logger).GetLevelEnabled(level)) {} \
+        else (logger).Custom(level) << (category).GetPrefix()
+#endif
+
+#endif // KS_LOG_CATEGORY_HPP
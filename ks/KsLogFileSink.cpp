@@ -0,0 +1,515 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <ks/KsLogFileSink.hpp>
+
+#ifdef KS_ENV_POSIX
+
+#include <cstdio>
+#include <cstring>
+
+#include <cerrno>
+#include <climits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ks/KsCompress.hpp>
+
+namespace ks
+{
+    namespace Log
+    {
+        namespace
+        {
+            bool PreallocateFile(int fd, size_t size)
+            {
+                #ifdef KS_ENV_LINUX
+                // Reserve the blocks up front so that a full disk is
+                // reported here instead of as a SIGBUS on a mapped write
+                if(posix_fallocate(fd,0,static_cast<off_t>(size)) == 0) {
+                    return true;
+                }
+                #endif
+
+                return (ftruncate(fd,static_cast<off_t>(size)) == 0);
+            }
+        }
+
+        // ============================================================= //
+
+        SinkToFd::SinkToFd(int fd, bool close_fd) :
+            m_fd(fd),
+            m_close_fd(close_fd)
+        {
+            // empty
+        }
+
+        SinkToFd::SinkToFd() :
+            m_fd(-1),
+            m_close_fd(false)
+        {
+            // empty
+        }
+
+        SinkToFd::~SinkToFd()
+        {
+            if(m_close_fd && m_fd >= 0) {
+                close(m_fd);
+            }
+        }
+
+        bool SinkToFd::GetValid() const
+        {
+            return (m_fd >= 0);
+        }
+
+        void SinkToFd::setFd(int fd, bool close_fd)
+        {
+            m_fd = fd;
+            m_close_fd = close_fd;
+        }
+
+        void SinkToFd::log(std::string const &line)
+        {
+            this->log_batch(&line,1);
+        }
+
+        void SinkToFd::log_batch(std::string const * list_lines, size_t count)
+        {
+            // Each line takes two iovecs (the line and its
+            // newline); gather as many as writev accepts
+            #ifdef IOV_MAX
+            size_t const max_iovs = std::min(IOV_MAX,1024);
+            #else
+            size_t const max_iovs = 1024;
+            #endif
+
+            static char newline = '\n';
+            struct iovec list_iovs[1024];
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_fd < 0) {
+                return;
+            }
+
+            size_t iov_count = 0;
+            for(size_t i=0; i < count; i++) {
+                list_iovs[iov_count].iov_base =
+                        const_cast<char*>(list_lines[i].data());
+                list_iovs[iov_count].iov_len = list_lines[i].size();
+                list_iovs[iov_count+1].iov_base = &newline;
+                list_iovs[iov_count+1].iov_len = 1;
+                iov_count += 2;
+
+                if(iov_count+2 > max_iovs) {
+                    writeAll(list_iovs,iov_count);
+                    iov_count = 0;
+                }
+            }
+
+            if(iov_count > 0) {
+                writeAll(list_iovs,iov_count);
+            }
+        }
+
+        void SinkToFd::log_buffer(char const * data, size_t size)
+        {
+            if(size == 0) {
+                return;
+            }
+
+            static char newline = '\n';
+            struct iovec list_iovs[2];
+            list_iovs[0].iov_base = const_cast<char*>(data);
+            list_iovs[0].iov_len = size;
+            list_iovs[1].iov_base = &newline;
+            list_iovs[1].iov_len = 1;
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_fd >= 0) {
+                writeAll(list_iovs,(data[size-1] == '\n') ? 1 : 2);
+            }
+        }
+
+        void SinkToFd::writeAll(struct iovec * list_iovs, size_t count)
+        {
+            // writev may write less than requested (ie for
+            // pipes); skip past what was written and retry
+            while(count > 0) {
+                ssize_t written = writev(m_fd,list_iovs,static_cast<int>(count));
+                if(written < 0) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+                    return; // nowhere to report sink errors
+                }
+
+                size_t remaining = static_cast<size_t>(written);
+                while(count > 0 && remaining >= list_iovs->iov_len) {
+                    remaining -= list_iovs->iov_len;
+                    list_iovs++;
+                    count--;
+                }
+
+                if(count > 0) {
+                    list_iovs->iov_base =
+                            static_cast<char*>(list_iovs->iov_base)+remaining;
+                    list_iovs->iov_len -= remaining;
+                }
+            }
+        }
+
+        SinkToFile::SinkToFile(std::string const &file_path)
+        {
+            setFd(open(file_path.c_str(),
+                       O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC,0644),
+                  true);
+        }
+
+        // ============================================================= //
+
+        SinkToMappedFile::SinkToMappedFile(Options options) :
+            m_options(std::move(options)),
+            m_fd(-1),
+            m_map(nullptr),
+            m_map_size(0),
+            m_offset(0),
+            m_synced_offset(0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            openFile();
+        }
+
+        SinkToMappedFile::~SinkToMappedFile()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            closeFile();
+            joinCompressThread();
+        }
+
+        bool SinkToMappedFile::GetValid()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return (m_map != nullptr);
+        }
+
+        size_t SinkToMappedFile::GetSize()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_offset;
+        }
+
+        void SinkToMappedFile::log(std::string const &line)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            append(line.data(),line.size());
+            afterAppend();
+        }
+
+        void SinkToMappedFile::log_batch(std::string const * list_lines,
+                                         size_t count)
+        {
+            // One lock and (at most) one sync for the batch
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(size_t i=0; i < count; i++) {
+                append(list_lines[i].data(),list_lines[i].size());
+            }
+            afterAppend();
+        }
+
+        void SinkToMappedFile::log_buffer(char const * data, size_t size)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            char const * const end = data+size;
+            while(data < end) {
+                char const * line_end =
+                        static_cast<char const*>(
+                            std::memchr(data,'\n',
+                                        static_cast<size_t>(end-data)));
+
+                if(line_end == nullptr) {
+                    line_end = end;
+                }
+
+                append(data,static_cast<size_t>(line_end-data));
+                data = line_end+1;
+            }
+            afterAppend();
+        }
+
+        void SinkToMappedFile::Sync()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_map) {
+                syncRange(m_synced_offset,m_offset);
+            }
+        }
+
+        void SinkToMappedFile::Rotate()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            closeFile();
+            shiftRotatedFiles();
+            openFile();
+        }
+
+        void SinkToMappedFile::append(char const * data, size_t size)
+        {
+            // Lines that can't fit in a single file are truncated
+            size = std::min(size,m_options.segment_size-1);
+
+            checkRotate(size+1);
+            if(m_map == nullptr) {
+                return;
+            }
+
+            std::memcpy(m_map+m_offset,data,size);
+            m_map[m_offset+size] = '\n';
+            m_offset += (size+1);
+        }
+
+        void SinkToMappedFile::afterAppend()
+        {
+            if(m_map == nullptr) {
+                return;
+            }
+
+            if(m_options.sync_policy == SyncPolicy::EveryLine) {
+                syncRange(m_synced_offset,m_offset);
+            }
+            else if(m_options.sync_policy == SyncPolicy::Interval) {
+                auto const now = std::chrono::steady_clock::now();
+                if(now-m_sync_time >= m_options.sync_interval) {
+                    syncRange(m_synced_offset,m_offset);
+                }
+            }
+        }
+
+        void SinkToMappedFile::checkRotate(size_t size)
+        {
+            if(m_map == nullptr) {
+                return;
+            }
+
+            bool rotate = (m_offset+size > m_map_size);
+
+            if(!rotate &&
+               m_options.rotate_interval.count() > 0 &&
+               m_offset > 0)
+            {
+                auto const now = std::chrono::steady_clock::now();
+                rotate = (now-m_open_time >= m_options.rotate_interval);
+            }
+
+            if(rotate) {
+                closeFile();
+                shiftRotatedFiles();
+                openFile();
+            }
+        }
+
+        void SinkToMappedFile::syncRange(size_t begin, size_t end)
+        {
+            if(end > begin) {
+                // msync needs a page aligned address
+                static size_t const page_size =
+                        static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+                size_t const aligned_begin = begin-(begin%page_size);
+                msync(m_map+aligned_begin,end-aligned_begin,MS_SYNC);
+            }
+
+            m_synced_offset = end;
+            m_sync_time = std::chrono::steady_clock::now();
+        }
+
+        bool SinkToMappedFile::openFile()
+        {
+            std::string const &path = m_options.file_path;
+            size_t const segment_size = m_options.segment_size;
+
+            m_fd = open(path.c_str(),O_RDWR|O_CREAT|O_CLOEXEC,0644);
+            if(m_fd < 0) {
+                return false;
+            }
+
+            struct stat file_stat;
+            if(fstat(m_fd,&file_stat) != 0) {
+                close(m_fd);
+                m_fd = -1;
+                return false;
+            }
+
+            size_t existing_size = static_cast<size_t>(file_stat.st_size);
+
+            if(existing_size > segment_size) {
+                // Left over from a sink with a larger segment
+                // size; move it out of the way
+                close(m_fd);
+                shiftRotatedFiles();
+                m_fd = open(path.c_str(),O_RDWR|O_CREAT|O_CLOEXEC,0644);
+                if(m_fd < 0) {
+                    return false;
+                }
+                existing_size = 0;
+            }
+
+            if(existing_size < segment_size &&
+               !PreallocateFile(m_fd,segment_size))
+            {
+                close(m_fd);
+                m_fd = -1;
+                return false;
+            }
+
+            void * map = mmap(nullptr,segment_size,
+                              PROT_READ|PROT_WRITE,
+                              MAP_SHARED,m_fd,0);
+
+            if(map == MAP_FAILED) {
+                close(m_fd);
+                m_fd = -1;
+                return false;
+            }
+
+            m_map = static_cast<char*>(map);
+            m_map_size = segment_size;
+
+            // Recover the end of any existing data. Everything
+            // past it is zero since the file is zero filled when
+            // it's extended
+            m_offset = existing_size;
+            while(m_offset > 0 && m_map[m_offset-1] == '\0') {
+                m_offset--;
+            }
+
+            if(m_offset > 0 && m_offset < m_map_size &&
+               m_map[m_offset-1] != '\n')
+            {
+                // Terminate a line that was cut short
+                m_map[m_offset] = '\n';
+                m_offset++;
+            }
+
+            m_synced_offset = m_offset;
+            m_open_time = std::chrono::steady_clock::now();
+            m_sync_time = m_open_time;
+
+            return true;
+        }
+
+        void SinkToMappedFile::closeFile()
+        {
+            if(m_map) {
+                if(m_options.sync_policy != SyncPolicy::None) {
+                    syncRange(m_synced_offset,m_offset);
+                }
+                munmap(m_map,m_map_size);
+                m_map = nullptr;
+                m_map_size = 0;
+            }
+
+            if(m_fd >= 0) {
+                // Drop the unused preallocated tail
+                if(ftruncate(m_fd,static_cast<off_t>(m_offset)) != 0) {
+                    // The zero filled tail is skipped on recovery
+                    // so the file is still usable
+                }
+                close(m_fd);
+                m_fd = -1;
+            }
+
+            m_offset = 0;
+            m_synced_offset = 0;
+        }
+
+        void SinkToMappedFile::WaitForCompression()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            joinCompressThread();
+        }
+
+        std::string SinkToMappedFile::GetRotatedPath(uint index) const
+        {
+            return m_options.file_path+"."+ToString(index)+
+                    (m_options.compress_rotated ? ".ksz" : "");
+        }
+
+        void SinkToMappedFile::shiftRotatedFiles()
+        {
+            // The previous compression writes to <path>.1.ksz,
+            // so it has to finish before the files move
+            joinCompressThread();
+
+            uint const max_files = m_options.max_rotated_files;
+
+            if(max_files == 0) {
+                unlink(m_options.file_path.c_str());
+                return;
+            }
+
+            // path.N is dropped, path.i becomes path.i+1. A file
+            // that failed to compress is shifted uncompressed
+            auto get_raw_path = [this](uint index) {
+                return m_options.file_path+"."+ToString(index);
+            };
+
+            unlink(GetRotatedPath(max_files).c_str());
+            unlink(get_raw_path(max_files).c_str());
+            for(uint i=max_files-1; i > 0; i--) {
+                std::rename(GetRotatedPath(i).c_str(),
+                            GetRotatedPath(i+1).c_str());
+
+                if(m_options.compress_rotated) {
+                    std::rename(get_raw_path(i).c_str(),
+                                get_raw_path(i+1).c_str());
+                }
+            }
+
+            std::string const raw_path = get_raw_path(1);
+            std::rename(m_options.file_path.c_str(),raw_path.c_str());
+
+            if(m_options.compress_rotated) {
+                std::string const compressed_path = GetRotatedPath(1);
+                m_compress_thread = std::thread([raw_path,compressed_path]() {
+                    if(CompressFile(raw_path,compressed_path)) {
+                        unlink(raw_path.c_str());
+                    }
+                    else {
+                        unlink(compressed_path.c_str());
+                    }
+                });
+            }
+        }
+
+        void SinkToMappedFile::joinCompressThread()
+        {
+            if(m_compress_thread.joinable()) {
+                m_compress_thread.join();
+            }
+        }
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
+
+#endif // KS_ENV_POSIX
@@ -0,0 +1,202 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_LOG_FILE_SINK_HPP
+#define KS_LOG_FILE_SINK_HPP
+
+#include <ks/KsLog.hpp>
+
+#ifdef KS_ENV_POSIX
+
+#include <sys/uio.h>
+
+namespace ks
+{
+    namespace Log
+    {
+        // ============================================================= //
+
+        // SinkToFd
+        // * sink that writes to a file descriptor with writev;
+        //   a batch of lines is gathered into as few syscalls
+        //   as possible instead of one write per line
+        class SinkToFd : public ks::Log::Sink
+        {
+        public:
+            // * @fd is not closed by the sink unless
+            //   @close_fd is set
+            SinkToFd(int fd, bool close_fd=false);
+            ~SinkToFd();
+
+            bool GetValid() const;
+
+            void log(std::string const &line);
+            void log_batch(std::string const * list_lines, size_t count);
+            void log_buffer(char const * data, size_t size);
+
+        protected:
+            SinkToFd();
+            void setFd(int fd, bool close_fd);
+
+        private:
+            void writeAll(struct iovec * list_iovs, size_t count);
+
+            std::mutex m_mutex;
+            int m_fd;
+            bool m_close_fd;
+        };
+
+        // SinkToFile
+        // * SinkToFd that appends to the file at @file_path
+        class SinkToFile : public SinkToFd
+        {
+        public:
+            SinkToFile(std::string const &file_path);
+            ~SinkToFile() = default;
+        };
+
+        // ============================================================= //
+
+        // SinkToMappedFile
+        // * sink that appends lines to a preallocated,
+        //   memory mapped file; each line is a memcpy into
+        //   the mapping rather than a stream write
+        // * the active file is rotated to <path>.1, <path>.2 ...
+        //   when it's full or when the rotation interval passes
+        // * the preallocated tail of the file is zero filled. If
+        //   the process dies without closing the sink, the next
+        //   sink opened on the same path finds the end of the
+        //   data by skipping the zeros and continues from there.
+        //   A line that was cut short is terminated first
+        // * on a clean close the file is truncated to its data
+        // * rotated files can be compressed in the background
+        //   (see KsCompress.hpp), in which case they're named
+        //   <path>.1.ksz, <path>.2.ksz ...
+        class SinkToMappedFile : public ks::Log::Sink
+        {
+        public:
+            // SyncPolicy
+            // * when to msync mapped pages to the disk; the data
+            //   survives a process crash with any policy since the
+            //   pages belong to the kernel, this is for power loss
+            enum class SyncPolicy : u8
+            {
+                None,
+                OnRotate,
+                Interval,
+                EveryLine
+            };
+
+            struct Options
+            {
+                Options(std::string file_path) :
+                    file_path(std::move(file_path)),
+                    segment_size(16*1024*1024),
+                    rotate_interval(0),
+                    max_rotated_files(8),
+                    sync_policy(SyncPolicy::OnRotate),
+                    sync_interval(1000),
+                    compress_rotated(false)
+                {}
+
+                // path of the active log file
+                std::string file_path;
+
+                // preallocated size of each file; the file is
+                // rotated once the next line doesn't fit
+                size_t segment_size;
+
+                // rotate after this much time even if the file
+                // isn't full (zero to disable)
+                Seconds rotate_interval;
+
+                // rotated files beyond this count are deleted
+                uint max_rotated_files;
+
+                SyncPolicy sync_policy;
+
+                // used with SyncPolicy::Interval
+                Milliseconds sync_interval;
+
+                // compress each rotated file on a background
+                // thread; logging only waits for it if the next
+                // rotation happens before it's done
+                bool compress_rotated;
+            };
+
+            SinkToMappedFile(Options options);
+            ~SinkToMappedFile();
+
+            // * Returns false if the log file couldn't be
+            //   opened and mapped; lines are dropped
+            bool GetValid();
+
+            // * Returns the write offset in the active file
+            size_t GetSize();
+
+            void log(std::string const &line);
+            void log_batch(std::string const * list_lines, size_t count);
+            void log_buffer(char const * data, size_t size);
+
+            // * Forces the written part of the active file
+            //   to the disk
+            void Sync();
+
+            // * Closes the active file, shifts the rotated
+            //   files and opens a new active file
+            void Rotate();
+
+            // * Waits for the background compression of
+            //   the last rotated file, if any
+            void WaitForCompression();
+
+            // * Returns the path of the @index th rotated file,
+            //   including the compressed suffix if enabled
+            std::string GetRotatedPath(uint index) const;
+
+        private:
+            void append(char const * data, size_t size);
+            void afterAppend();
+            void checkRotate(size_t size);
+            void syncRange(size_t begin, size_t end);
+            bool openFile();
+            void closeFile();
+            void shiftRotatedFiles();
+            void joinCompressThread();
+
+            Options const m_options;
+
+            std::mutex m_mutex;
+            int m_fd;
+            char * m_map;
+            size_t m_map_size;
+            size_t m_offset;
+            size_t m_synced_offset;
+            std::chrono::steady_clock::time_point m_open_time;
+            std::chrono::steady_clock::time_point m_sync_time;
+
+            std::thread m_compress_thread;
+        };
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
+
+#endif // KS_ENV_POSIX
+
+#endif // KS_LOG_FILE_SINK_HPP
@@ -0,0 +1,701 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cmath>
+
+#include <ks/KsLogFlightRecorder.hpp>
+
+#ifdef KS_ENV_POSIX
+#include <csignal>
+#include <unistd.h>
+#endif
+
+namespace ks
+{
+    namespace Log
+    {
+        namespace flight_detail
+        {
+            std::atomic<bool> g_enabled(false);
+
+            // Slot
+            // * one record; seq is a per slot seqlock so that a
+            //   dump running alongside the writer can tell if
+            //   it read a slot that was being overwritten. The
+            //   fields are relaxed atomics (and args is copied
+            //   byte wise) since they're read while the writer
+            //   may be changing them
+            struct Slot
+            {
+                std::atomic<u64> seq; // 2*index+1 while writing, 2*index+2 once done
+                std::atomic<char const *> format;
+                std::atomic<u64> timestamp;
+                std::atomic<u8> level;
+                std::atomic<u8> args_size;
+                u8 args[k_slot_args_size];
+            };
+
+            static_assert(sizeof(Slot) == k_slot_size,
+                          "ks::Log::flight_detail::Slot: unexpected size");
+
+            // SlotCopy
+            // * a slot read out of a ring
+            struct SlotCopy
+            {
+                char const * format;
+                u64 timestamp;
+                u8 level;
+                u8 args_size;
+                u8 args[k_slot_args_size];
+            };
+
+            // Ring
+            // * written only by the thread that owns it
+            struct Ring
+            {
+                Ring(uint id, size_t size) :
+                    id(id),
+                    mask(size-1),
+                    list_slots(new Slot[size]),
+                    head(0),
+                    dumped(0),
+                    in_use(true)
+                {
+                    for(size_t i=0; i < size; i++) {
+                        list_slots[i].seq.store(0,std::memory_order_relaxed);
+                    }
+                }
+
+                uint const id;
+                size_t const mask;
+                std::unique_ptr<Slot[]> list_slots;
+                std::atomic<u64> head; // records written
+                u64 dumped; // records dumped, guarded by Recorder::dumping
+                std::atomic<bool> in_use;
+            };
+
+            // LineBuffer
+            // * a fixed size line that silently truncates
+            struct LineBuffer
+            {
+                void clear()
+                {
+                    size = 0;
+                }
+
+                void append(char const * s, size_t s_size)
+                {
+                    s_size = std::min(s_size,k_max_line_size-size);
+                    std::memcpy(data+size,s,s_size);
+                    size += s_size;
+                }
+
+                void append(char const * s)
+                {
+                    append(s,std::strlen(s));
+                }
+
+                void push_back(char c)
+                {
+                    append(&c,1);
+                }
+
+                char data[k_max_line_size];
+                size_t size;
+            };
+
+            // Recorder
+            // * rings belong to the recorder, not to their threads,
+            //   so records survive the thread that wrote them. The
+            //   ring of a thread that exits is reused by the next
+            //   new thread
+            // * rings are never destroyed and their slots in
+            //   list_rings are only ever appended, so a dump can
+            //   walk them without taking rings_mutex
+            struct Recorder
+            {
+                static Recorder & Get()
+                {
+                    static Recorder recorder;
+                    return recorder;
+                }
+
+                Recorder() :
+                    ring_count(0),
+                    ring_size(1024),
+                    dumping(false)
+                {
+                    line.reserve(k_max_line_size);
+                }
+
+                // * Returns null if k_max_rings are in use
+                Ring * acquireRing()
+                {
+                    std::lock_guard<std::mutex> lock(rings_mutex);
+
+                    uint const count = ring_count.load(std::memory_order_relaxed);
+                    for(uint i=0; i < count; i++) {
+                        Ring * ring = list_rings[i].load(std::memory_order_relaxed);
+                        bool expected = false;
+                        if(ring->in_use.compare_exchange_strong(expected,true)) {
+                            return ring;
+                        }
+                    }
+
+                    if(count == k_max_rings) {
+                        return nullptr;
+                    }
+
+                    Ring * ring = new Ring(count+1,ring_size);
+                    list_rings[count].store(ring,std::memory_order_relaxed);
+                    ring_count.store(count+1,std::memory_order_release);
+                    return ring;
+                }
+
+                std::mutex rings_mutex;
+                std::array<std::atomic<Ring*>,k_max_rings> list_rings;
+                std::atomic<uint> ring_count;
+                size_t ring_size;
+
+                // Held by whoever is dumping; a flag rather than a
+                // mutex so that it can be taken in a signal handler
+                std::atomic<bool> dumping;
+                LineBuffer line_buffer;
+
+                std::mutex sink_mutex;
+                shared_ptr<Sink> dump_sink;
+                std::string line;
+            };
+
+            // RingHandle
+            // * returns the ring to the recorder on thread exit
+            struct RingHandle
+            {
+                RingHandle() :
+                    ring(nullptr),
+                    full(false)
+                {}
+
+                ~RingHandle()
+                {
+                    if(ring) {
+                        ring->in_use.store(false);
+                    }
+                }
+
+                Ring * ring;
+                bool full; // no ring was available
+            };
+
+            thread_local RingHandle t_ring_handle;
+            thread_local u64 t_record_index;
+
+            // Written to by threads that don't have a ring
+            thread_local Slot t_unrecorded_slot;
+
+            Slot & BeginRecord()
+            {
+                Ring * ring = t_ring_handle.ring;
+                if(ring == nullptr) {
+                    if(!t_ring_handle.full) {
+                        ring = Recorder::Get().acquireRing();
+                        t_ring_handle.ring = ring;
+                        t_ring_handle.full = (ring == nullptr);
+                    }
+
+                    if(ring == nullptr) {
+                        return t_unrecorded_slot;
+                    }
+                }
+
+                t_record_index = ring->head.load(std::memory_order_relaxed);
+
+                Slot &slot = ring->list_slots[t_record_index & ring->mask];
+                slot.seq.store(2*t_record_index+1,std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                return slot;
+            }
+
+            u8 * GetSlotArgs(Slot &slot)
+            {
+                return slot.args;
+            }
+
+            void CommitRecord(Slot &slot,
+                              Logger::Level level,
+                              char const * format,
+                              size_t args_size)
+            {
+                Ring * ring = t_ring_handle.ring;
+                if(ring == nullptr) {
+                    return;
+                }
+
+                slot.format.store(format,std::memory_order_relaxed);
+                slot.timestamp.store(binary_detail::GetTimestamp(),std::memory_order_relaxed);
+                slot.level.store(static_cast<u8>(level),std::memory_order_relaxed);
+                slot.args_size.store(static_cast<u8>(args_size),std::memory_order_relaxed);
+                slot.seq.store(2*t_record_index+2,std::memory_order_release);
+
+                ring->head.store(t_record_index+1,std::memory_order_release);
+            }
+
+            // * Reads the slot for record @index into @record
+            // * Returns false if the slot was overwritten
+            //   or is being written
+            bool ReadSlot(Ring const &ring, u64 index, SlotCopy &record)
+            {
+                Slot const &slot = ring.list_slots[index & ring.mask];
+
+                u64 const seq = slot.seq.load(std::memory_order_acquire);
+                if(seq != 2*index+2) {
+                    return false;
+                }
+
+                record.format = slot.format.load(std::memory_order_relaxed);
+                record.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+                record.level = slot.level.load(std::memory_order_relaxed);
+                record.args_size = std::min(slot.args_size.load(std::memory_order_relaxed),
+                                            static_cast<u8>(k_slot_args_size));
+                std::memcpy(record.args,slot.args,record.args_size);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return (slot.seq.load(std::memory_order_relaxed) == seq);
+            }
+
+            // ============================================================= //
+
+            // Rendering
+            // * the same text as binary_detail::RenderTimestamp,
+            //   RenderLevel and RenderArgs, written into a
+            //   LineBuffer without allocating or calling into libc
+            //   so that it can run in a signal handler
+
+            void AppendU64(LineBuffer &line, u64 val, uint min_digits=1)
+            {
+                char buff[24];
+                char * last = buff+sizeof(buff);
+                char * first = last;
+                do {
+                    *--first = static_cast<char>('0'+(val%10));
+                    val /= 10;
+                    min_digits = (min_digits > 0) ? min_digits-1 : 0;
+                }
+                while(val > 0 || min_digits > 0);
+
+                line.append(first,static_cast<size_t>(last-first));
+            }
+
+            void AppendS64(LineBuffer &line, s64 val)
+            {
+                u64 uval = static_cast<u64>(val);
+                if(val < 0) {
+                    line.push_back('-');
+                    uval = 0-uval;
+                }
+                AppendU64(line,uval);
+            }
+
+            void AppendHex(LineBuffer &line, u64 val)
+            {
+                char buff[16];
+                char * last = buff+sizeof(buff);
+                char * first = last;
+                do {
+                    *--first = "0123456789abcdef"[val & 0xF];
+                    val >>= 4;
+                }
+                while(val > 0);
+
+                line.append("0x");
+                line.append(first,static_cast<size_t>(last-first));
+            }
+
+            void AppendFloat(LineBuffer &line, double val, bool in_signal)
+            {
+                if(!in_signal) {
+                    char buff[k_format_max_size];
+                    line.append(buff,static_cast<size_t>(FormatFloat(buff,val)-buff));
+                    return;
+                }
+
+                // FormatFloat may use snprintf, so a plain fixed
+                // notation is used instead
+                if(std::isnan(val)) {
+                    line.append("nan");
+                    return;
+                }
+
+                if(std::signbit(val)) {
+                    line.push_back('-');
+                    val = -val;
+                }
+
+                if(val >= 1e18) {
+                    line.append((val == INFINITY) ? "inf" : "<large>");
+                    return;
+                }
+
+                u64 const integral = static_cast<u64>(val);
+                u64 const fraction = static_cast<u64>((val-integral)*1e6+0.5);
+
+                // Rounding may carry into the integral part
+                AppendU64(line,integral+(fraction/1000000));
+
+                u64 digits = fraction%1000000;
+                if(digits != 0) {
+                    uint digit_count = 6;
+                    while(digits%10 == 0) {
+                        digits /= 10;
+                        digit_count--;
+                    }
+                    line.push_back('.');
+                    AppendU64(line,digits,digit_count);
+                }
+            }
+
+            void AppendTimestamp(LineBuffer &line, u64 timestamp_ns)
+            {
+                u64 const secs = timestamp_ns/1000000000ull;
+                u64 const secs_of_day = secs%86400;
+
+                // Civil date from days since the epoch
+                // (H. Hinnant's days_from_civil, inverted)
+                u64 const z = secs/86400+719468;
+                u64 const era = z/146097;
+                u64 const doe = z-era*146097;
+                u64 const yoe = (doe-doe/1460+doe/36524-doe/146096)/365;
+                u64 const doy = doe-(365*yoe+yoe/4-yoe/100);
+                u64 const mp = (5*doy+2)/153;
+                u64 const day = doy-(153*mp+2)/5+1;
+                u64 const month = (mp < 10) ? mp+3 : mp-9;
+                u64 const year = yoe+era*400+((month <= 2) ? 1 : 0);
+
+                AppendU64(line,year,4);
+                line.push_back('-');
+                AppendU64(line,month,2);
+                line.push_back('-');
+                AppendU64(line,day,2);
+                line.push_back(' ');
+                AppendU64(line,secs_of_day/3600,2);
+                line.push_back(':');
+                AppendU64(line,(secs_of_day/60)%60,2);
+                line.push_back(':');
+                AppendU64(line,secs_of_day%60,2);
+                line.push_back('.');
+                AppendU64(line,(timestamp_ns/1000000ull)%1000,3);
+            }
+
+            template<typename T>
+            bool ReadArg(u8 const * &in, u8 const * end, T &val)
+            {
+                if(static_cast<size_t>(end-in) < sizeof(T)) {
+                    return false;
+                }
+                std::memcpy(&val,in,sizeof(T));
+                in += sizeof(T);
+                return true;
+            }
+
+            bool AppendArg(LineBuffer &line,
+                           u8 const * &in,
+                           u8 const * end,
+                           bool in_signal)
+            {
+                using binary_detail::ArgType;
+
+                u8 type;
+                if(!ReadArg(in,end,type)) {
+                    return false;
+                }
+
+                switch(static_cast<ArgType>(type))
+                {
+                    case ArgType::Bool:
+                    case ArgType::Char: {
+                        u8 val;
+                        if(!ReadArg(in,end,val)) {
+                            return false;
+                        }
+                        if(static_cast<ArgType>(type) == ArgType::Bool) {
+                            line.push_back(val ? '1' : '0');
+                        }
+                        else {
+                            line.push_back(static_cast<char>(val));
+                        }
+                        return true;
+                    }
+                    case ArgType::SInt: {
+                        s64 val;
+                        if(!ReadArg(in,end,val)) {
+                            return false;
+                        }
+                        AppendS64(line,val);
+                        return true;
+                    }
+                    case ArgType::UInt: {
+                        u64 val;
+                        if(!ReadArg(in,end,val)) {
+                            return false;
+                        }
+                        AppendU64(line,val);
+                        return true;
+                    }
+                    case ArgType::Float: {
+                        double val;
+                        if(!ReadArg(in,end,val)) {
+                            return false;
+                        }
+                        AppendFloat(line,val,in_signal);
+                        return true;
+                    }
+                    case ArgType::String: {
+                        u32 size;
+                        if(!ReadArg(in,end,size) ||
+                           static_cast<size_t>(end-in) < size)
+                        {
+                            return false;
+                        }
+                        line.append(reinterpret_cast<char const*>(in),size);
+                        in += size;
+                        return true;
+                    }
+                    case ArgType::Pointer: {
+                        u64 val;
+                        if(!ReadArg(in,end,val)) {
+                            return false;
+                        }
+                        AppendHex(line,val);
+                        return true;
+                    }
+                    default: {
+                        return false;
+                    }
+                }
+            }
+
+            void RenderRecord(SlotCopy const &record,
+                              LineBuffer &line,
+                              bool in_signal)
+            {
+                line.clear();
+                AppendTimestamp(line,record.timestamp);
+                line.push_back(' ');
+                line.append(binary_detail::GetLevelLabel(
+                                static_cast<Logger::Level>(record.level)));
+
+                u8 const * in = record.args;
+                u8 const * const end = record.args+record.args_size;
+
+                // Replace each {} with the next argument
+                for(char const * f = record.format; *f != '\0'; f++) {
+                    if(f[0] == '{' && f[1] == '}' && in < end) {
+                        if(!AppendArg(line,in,end,in_signal)) {
+                            line.append(" <malformed>");
+                            return;
+                        }
+                        f++;
+                    }
+                    else {
+                        line.push_back(*f);
+                    }
+                }
+
+                // Append any arguments without a placeholder
+                while(in < end) {
+                    line.push_back(' ');
+                    if(!AppendArg(line,in,end,in_signal)) {
+                        line.append(" <malformed>");
+                        return;
+                    }
+                }
+            }
+
+            // ============================================================= //
+
+            // * Calls @output with each line to dump; @output
+            //   mustn't dump itself
+            // * Returns the number of records dumped, or 0 if
+            //   another dump is in progress
+            template<typename Output>
+            uint Dump(Output const &output, bool in_signal)
+            {
+                Recorder &recorder = Recorder::Get();
+
+                // A fatal signal raised while dumping (or a second
+                // thread hitting a FATAL) must not wait on the dump
+                bool expected = false;
+                if(!recorder.dumping.compare_exchange_strong(
+                       expected,true,std::memory_order_acquire))
+                {
+                    return 0;
+                }
+
+                LineBuffer &line = recorder.line_buffer;
+                SlotCopy record;
+                uint count = 0;
+
+                uint const ring_count =
+                        recorder.ring_count.load(std::memory_order_acquire);
+
+                for(uint i=0; i < ring_count; i++) {
+                    Ring &ring = *(recorder.list_rings[i].load(std::memory_order_relaxed));
+
+                    u64 const head = ring.head.load(std::memory_order_acquire);
+                    u64 const size = ring.mask+1;
+                    u64 const first = std::max(ring.dumped,(head > size) ? head-size : 0);
+
+                    if(first == head) {
+                        continue;
+                    }
+
+                    line.clear();
+                    line.append("flight recorder: thread ");
+                    AppendU64(line,ring.id);
+                    line.append(", ");
+                    AppendU64(line,head-first);
+                    line.append(" records");
+                    output(line);
+
+                    for(u64 index=first; index < head; index++) {
+                        if(ReadSlot(ring,index,record)) {
+                            RenderRecord(record,line,in_signal);
+                            output(line);
+                            count++;
+                        }
+                    }
+
+                    ring.dumped = head;
+                }
+
+                recorder.dumping.store(false,std::memory_order_release);
+                return count;
+            }
+
+            void OnFatal()
+            {
+                DumpFlightRecorder();
+            }
+
+            #ifdef KS_ENV_POSIX
+            int const k_list_fatal_signals[] = {
+                SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT
+            };
+
+            std::atomic<int> g_signal_fd(2);
+
+            void OnFatalSignal(int signal)
+            {
+                int const fd = g_signal_fd.load(std::memory_order_relaxed);
+
+                Dump([fd](LineBuffer &line) {
+                         line.size = std::min(line.size,k_max_line_size-1);
+                         line.data[line.size++] = '\n';
+
+                         // Best effort; nothing can be done
+                         // about a failed write here
+                         ssize_t const written = write(fd,line.data,line.size);
+                         (void)written;
+                     },
+                     true);
+
+                // Let the default action (ie a core dump)
+                // happen with the original signal
+                std::signal(signal,SIG_DFL);
+                std::raise(signal);
+            }
+            #endif
+        }
+
+        // ============================================================= //
+
+        void EnableFlightRecorder(shared_ptr<Sink> dump_sink,
+                                  uint records_per_thread)
+        {
+            using namespace flight_detail;
+            Recorder &recorder = Recorder::Get();
+
+            size_t ring_size = 1;
+            while(ring_size < records_per_thread) {
+                ring_size <<= 1;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(recorder.rings_mutex);
+                recorder.ring_size = ring_size;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(recorder.sink_mutex);
+                recorder.dump_sink = std::move(dump_sink);
+            }
+
+            SetFatalHandler(OnFatal);
+            g_enabled.store(true);
+        }
+
+        void DisableFlightRecorder()
+        {
+            flight_detail::g_enabled.store(false);
+            SetFatalHandler(nullptr);
+        }
+
+        uint DumpFlightRecorder()
+        {
+            using namespace flight_detail;
+            Recorder &recorder = Recorder::Get();
+
+            std::unique_lock<std::mutex> sink_lock(
+                        recorder.sink_mutex,std::try_to_lock);
+
+            if(!sink_lock.owns_lock() || !recorder.dump_sink) {
+                return 0;
+            }
+
+            Sink &sink = *(recorder.dump_sink);
+            std::string &text = recorder.line;
+
+            return Dump([&sink,&text](LineBuffer const &line) {
+                            text.assign(line.data,line.size);
+                            sink.log(text);
+                        },
+                        false);
+        }
+
+        #ifdef KS_ENV_POSIX
+        void InstallFlightRecorderSignalHandlers(int fd)
+        {
+            flight_detail::g_signal_fd.store(fd);
+
+            // Created now rather than in the handler
+            flight_detail::Recorder::Get();
+
+            for(int signal : flight_detail::k_list_fatal_signals) {
+                struct sigaction action;
+                std::memset(&action,0,sizeof(action));
+                action.sa_handler = flight_detail::OnFatalSignal;
+                sigemptyset(&action.sa_mask);
+                action.sa_flags = SA_RESETHAND;
+                sigaction(signal,&action,nullptr);
+            }
+        }
+        #endif
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
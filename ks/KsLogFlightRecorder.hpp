@@ -0,0 +1,152 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_LOG_FLIGHT_RECORDER_HPP
+#define KS_LOG_FLIGHT_RECORDER_HPP
+
+#include <ks/KsLogBinary.hpp>
+
+namespace ks
+{
+    namespace Log
+    {
+        // ============================================================= //
+
+        // Flight recorder
+        // * keeps the most recent records of each thread in an
+        //   in memory ring, in binary form (see KsLogBinary.hpp),
+        //   so that verbose levels can be captured all the time
+        //   without paying for formatting or output:
+        //
+        //   KS_LOG_FLIGHT(Level::TRACE,"rx {} bytes from {}",n,name);
+        //
+        // * the rings are only rendered when they're dumped: when
+        //   a FATAL line is started on any Logger (which includes
+        //   constructing a FATAL ks::Exception), on a fatal signal
+        //   if the signal handlers are installed, or by calling
+        //   DumpFlightRecorder()
+        // * each thread only ever writes to its own ring, so
+        //   recording is lock free. A record is a fixed size slot;
+        //   arguments that don't fit in a slot are dropped
+        // * up to k_max_rings threads can record at once; threads
+        //   started while that many are recording aren't recorded
+        // * the format string must be a literal (only its
+        //   address is recorded)
+
+        namespace flight_detail
+        {
+            size_t const k_slot_size = 128;
+
+            // seq, format, timestamp, level and args size
+            // take 26 bytes; the rest holds the arguments
+            size_t const k_slot_args_size = k_slot_size-26;
+
+            size_t const k_max_rings = 256;
+
+            // dumped lines longer than this are truncated
+            size_t const k_max_line_size = 1024;
+
+            // * Returns the calling thread's next slot to fill
+            //   in; creates the ring on first use
+            struct Slot;
+            Slot & BeginRecord();
+
+            // * Returns the args area of @slot
+            u8 * GetSlotArgs(Slot &slot);
+
+            void CommitRecord(Slot &slot,
+                              Logger::Level level,
+                              char const * format,
+                              size_t args_size);
+
+            extern std::atomic<bool> g_enabled;
+
+            template<typename... Args>
+            void Record(Logger::Level level,
+                        char const * format,
+                        Args const &... args)
+            {
+                size_t args_size = binary_detail::ArgsSize(args...);
+
+                Slot &slot = BeginRecord();
+                if(args_size > k_slot_args_size) {
+                    args_size = 0; // rendered without arguments
+                }
+                else {
+                    u8 * out = GetSlotArgs(slot);
+                    binary_detail::WriteArgs(out,args...);
+                }
+                CommitRecord(slot,level,format,args_size);
+            }
+        }
+
+        // * Starts recording and sets the sink records are
+        //   dumped to. Also installs the fatal handler that
+        //   dumps on FATAL lines (see SetFatalHandler)
+        // * @records_per_thread is rounded up to a power of two
+        //   and applies to rings created after the call
+        void EnableFlightRecorder(shared_ptr<Sink> dump_sink,
+                                  uint records_per_thread=1024);
+
+        // * Stops recording and removes the fatal handler;
+        //   existing records are kept
+        void DisableFlightRecorder();
+
+        // * Returns true if KS_LOG_FLIGHT records
+        inline bool GetFlightRecorderEnabled()
+        {
+            return flight_detail::g_enabled.load(std::memory_order_relaxed);
+        }
+
+        // * Renders the records that haven't been dumped yet
+        //   to the dump sink, oldest first, one thread at a time
+        // * Returns the number of records dumped. If another
+        //   thread is already dumping this returns 0 right away
+        uint DumpFlightRecorder();
+
+        #ifdef KS_ENV_POSIX
+        // * Dumps the flight recorder on SIGSEGV, SIGBUS, SIGFPE,
+        //   SIGILL and SIGABRT, then lets the signal take its
+        //   default action
+        // * the signal may have been raised with the heap or a
+        //   lock in a bad state, so the dump is written straight
+        //   to @fd (stderr by default) instead of the dump sink;
+        //   it doesn't allocate, lock or call into libc beyond
+        //   write(). Non integral floats are written with at
+        //   most six decimal places
+        void InstallFlightRecorderSignalHandlers(int fd=2);
+        #endif
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
+
+// ============================================================= //
+
+// KS_LOG_FLIGHT
+// * records a line in the calling thread's flight recorder
+//   ring; costs a single atomic load while the recorder
+//   is disabled
+#define KS_LOG_FLIGHT(level,format,...) \
+    do { \
+        if(ks::Log::GetFlightRecorderEnabled()) { \
+            ks::Log::flight_detail::Record(level,format,##__VA_ARGS__); \
+        } \
+    } while(0)
+
+#endif // KS_LOG_FLIGHT_RECORDER_HPP
@@ -0,0 +1,138 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <random>
+
+#include <ks/KsLogLimit.hpp>
+
+namespace ks
+{
+    namespace Log
+    {
+        namespace
+        {
+            // xorshift32; plenty for sampling and much
+            // cheaper than the std engines
+            u32 NextRandom()
+            {
+                static thread_local u32 state = 0;
+                if(state == 0) {
+                    std::random_device rd;
+                    state = rd() | 1;
+                }
+
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                return state;
+            }
+        }
+
+        // ============================================================= //
+
+        RateLimiter::Permit::Permit(bool allowed, u32 suppressed) :
+            m_allowed(allowed)
+        {
+            m_prefix[0] = '\0';
+            if(allowed && suppressed > 0) {
+                static char const begin[] = "(suppressed ";
+                static char const end[] = " messages) ";
+
+                char * p = m_prefix;
+                p = std::copy(begin,begin+sizeof(begin)-1,p);
+                p = FormatInteger(p,suppressed);
+                p = std::copy(end,end+sizeof(end)-1,p);
+                *p = '\0';
+            }
+        }
+
+        RateLimiter::RateLimiter(uint max_count, Milliseconds interval) :
+            m_max_count(max_count),
+            m_interval_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              interval).count()),
+            m_window_start_ns(FastClock::GetSteadyNs()),
+            m_count(0),
+            m_suppressed(0)
+        {
+            // empty
+        }
+
+        RateLimiter::Permit RateLimiter::Allow()
+        {
+            if(m_max_count == 0) {
+                m_suppressed.fetch_add(1,std::memory_order_relaxed);
+                return Permit(false,0);
+            }
+
+            s64 const now_ns = FastClock::GetSteadyNs();
+            s64 window_start_ns =
+                    m_window_start_ns.load(std::memory_order_relaxed);
+
+            if(now_ns-window_start_ns >= m_interval_ns) {
+                // Only the thread that starts the new window
+                // resets the count and reports what was dropped
+                if(m_window_start_ns.compare_exchange_strong(
+                       window_start_ns,now_ns,std::memory_order_relaxed))
+                {
+                    m_count.store(1,std::memory_order_relaxed);
+                    return Permit(true,m_suppressed.exchange(
+                                      0,std::memory_order_relaxed));
+                }
+            }
+
+            if(m_count.fetch_add(1,std::memory_order_relaxed) < m_max_count) {
+                return Permit(true,0);
+            }
+
+            m_suppressed.fetch_add(1,std::memory_order_relaxed);
+            return Permit(false,0);
+        }
+
+        u32 RateLimiter::GetSuppressed() const
+        {
+            return m_suppressed.load(std::memory_order_relaxed);
+        }
+
+        // ============================================================= //
+
+        EveryN::EveryN(uint n) :
+            m_n(std::max(n,1u)),
+            m_count(0)
+        {
+            // empty
+        }
+
+        // ============================================================= //
+
+        Sampler::Sampler(double probability) :
+            m_threshold(static_cast<u64>(
+                            std::min(std::max(probability,0.0),1.0)*
+                            4294967296.0))
+        {
+            // empty
+        }
+
+        bool Sampler::Allow() const
+        {
+            return NextRandom() < m_threshold;
+        }
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
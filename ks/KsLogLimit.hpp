@@ -0,0 +1,178 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_LOG_LIMIT_HPP
+#define KS_LOG_LIMIT_HPP
+
+#include <ks/KsLog.hpp>
+
+namespace ks
+{
+    namespace Log
+    {
+        // ============================================================= //
+
+        // RateLimiter
+        // * lets at most @max_count lines through per @interval;
+        //   meant to be used once per call site through the
+        //   KS_LOG_RATE_LIMITED macro
+        // * lines that are dropped are counted, and the count is
+        //   reported as a prefix of the next line let through:
+        //
+        //   "(suppressed 1234 messages) peer timed out"
+        //
+        // * lock free; a dropped line costs a clock read and
+        //   two atomic operations and is never formatted
+        class RateLimiter
+        {
+        public:
+            // Permit
+            // * the result of Allow(); converts to true if the
+            //   line should be logged
+            class Permit
+            {
+            public:
+                Permit(bool allowed, u32 suppressed);
+
+                explicit operator bool() const
+                {
+                    return m_allowed;
+                }
+
+                // * Returns the suppressed summary, or an
+                //   empty string if nothing was suppressed
+                char const * GetPrefix() const
+                {
+                    return m_prefix;
+                }
+
+                // * Used by KS_LOG_RATE_LIMITED to end its loop
+                void Release()
+                {
+                    m_allowed = false;
+                }
+
+            private:
+                bool m_allowed;
+                char m_prefix[48];
+            };
+
+            RateLimiter(uint max_count, Milliseconds interval);
+            RateLimiter(RateLimiter const &) = delete;
+            RateLimiter & operator = (RateLimiter const &) = delete;
+
+            Permit Allow();
+
+            // * Returns the number of lines dropped in
+            //   the current interval
+            u32 GetSuppressed() const;
+
+        private:
+            s64 const m_max_count;
+            s64 const m_interval_ns;
+            std::atomic<s64> m_window_start_ns;
+            std::atomic<s64> m_count;
+            std::atomic<u32> m_suppressed;
+        };
+
+        // ============================================================= //
+
+        // EveryN
+        // * lets the first line and then every @n th line through
+        class EveryN
+        {
+        public:
+            EveryN(uint n);
+            EveryN(EveryN const &) = delete;
+            EveryN & operator = (EveryN const &) = delete;
+
+            bool Allow()
+            {
+                return (m_count.fetch_add(1,std::memory_order_relaxed)%m_n) == 0;
+            }
+
+        private:
+            u32 const m_n;
+            std::atomic<u32> m_count;
+        };
+
+        // Sampler
+        // * lets each line through with @probability (0 to 1)
+        // * uses a per thread generator, so sampling from
+        //   many threads doesn't contend
+        class Sampler
+        {
+        public:
+            Sampler(double probability);
+            Sampler(Sampler const &) = delete;
+            Sampler & operator = (Sampler const &) = delete;
+
+            bool Allow() const;
+
+        private:
+            u64 const m_threshold; // out of 2^32
+        };
+
+        // ============================================================= //
+
+    } // Log
+
+} // ks
+
+// ============================================================= //
+
+// KS_LOG_RATE_LIMITED
+// * logs at most @max_count lines per @interval from this
+//   call site; the level is checked first, then the limit,
+//   and only lines that pass both are formatted:
+//
+//   KS_LOG_RATE_LIMITED(ks::LOG,Level::WARN,10,ks::Seconds(1))
+//           << "bad packet from " << peer;
+//
+// * @max_count and @interval are evaluated once, the
+//   first time the statement runs
+// * the for statement runs its body once at most and
+//   (unlike an if) can't capture a trailing else
+#define KS_LOG_RATE_LIMITED(logger,level,max_count,interval) \
+    if(!(logger).GetLevelEnabled(level)) {} \
+    else for(ks::Log::RateLimiter::Permit ks_log_permit = \
+             ([&]() -> ks::Log::RateLimiter & { \
+                 static ks::Log::RateLimiter limiter(max_count,interval); \
+                 return limiter; }()).Allow(); \
+             ks_log_permit; ks_log_permit.Release()) \
+        (logger).Custom(level) << ks_log_permit.GetPrefix()
+
+// KS_LOG_EVERY_N
+// * logs the first and then every @n th line from this
+//   call site; @n is evaluated once
+#define KS_LOG_EVERY_N(logger,level,n) \
+    if(!(logger).GetLevelEnabled(level) || \
+       !([&]() -> ks::Log::EveryN & { \
+            static ks::Log::EveryN sampler(n); \
+            return sampler; }()).Allow()) {} \
+    else (logger).Custom(level)
+
+// KS_LOG_SAMPLED
+// * logs each line from this call site with @probability;
+//   @probability is evaluated once
+#define KS_LOG_SAMPLED(logger,level,probability) \
+    if(!(logger).GetLevelEnabled(level) || \
+       !([&]() -> ks::Log::Sampler const & { \
+            static ks::Log::Sampler const sampler(probability); \
+            return sampler; }()).Allow()) {} \
+    else (logger).Custom(level)
+
+#endif // KS_LOG_LIMIT_HPP
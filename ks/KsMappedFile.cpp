@@ -0,0 +1,238 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdio>
+
+#include <ks/KsConfig.hpp>
+#include <ks/KsMappedFile.hpp>
+
+#ifdef KS_ENV_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ks
+{
+    namespace
+    {
+        #ifdef KS_ENV_POSIX
+        int GetMadvise(MappedFile::Advice advice)
+        {
+            switch(advice) {
+                case MappedFile::Advice::Sequential: return MADV_SEQUENTIAL;
+                case MappedFile::Advice::Random: return MADV_RANDOM;
+                case MappedFile::Advice::WillNeed: return MADV_WILLNEED;
+                default: return MADV_NORMAL;
+            }
+        }
+        #endif
+    }
+
+    // ============================================================= //
+
+    MappedFile::MappedFile() :
+        m_data(""),
+        m_size(0),
+        m_valid(false),
+        m_mapped(false)
+    {
+        // empty
+    }
+
+    MappedFile::MappedFile(std::string const &file_path, Advice advice) :
+        MappedFile()
+    {
+        Open(file_path,advice);
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) :
+        MappedFile()
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile & MappedFile::operator = (MappedFile &&other)
+    {
+        if(this != &other) {
+            Close();
+
+            m_size = other.m_size;
+            m_valid = other.m_valid;
+            m_mapped = other.m_mapped;
+            m_buffer = std::move(other.m_buffer);
+
+            // A copied view points into the buffer
+            // that was just moved
+            m_data = m_mapped ? other.m_data : m_buffer.data();
+
+            other.m_data = "";
+            other.m_size = 0;
+            other.m_valid = false;
+            other.m_mapped = false;
+        }
+        return *this;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    bool MappedFile::Open(std::string const &file_path, Advice advice)
+    {
+        Close();
+
+        m_valid = openMapped(file_path,advice) || openRead(file_path);
+        return m_valid;
+    }
+
+    void MappedFile::Close()
+    {
+        #ifdef KS_ENV_POSIX
+        if(m_mapped) {
+            munmap(const_cast<char*>(m_data),m_size);
+        }
+        #endif
+
+        m_data = "";
+        m_size = 0;
+        m_valid = false;
+        m_mapped = false;
+        m_buffer.clear();
+        m_buffer.shrink_to_fit();
+    }
+
+    bool MappedFile::GetValid() const
+    {
+        return m_valid;
+    }
+
+    bool MappedFile::GetMapped() const
+    {
+        return m_mapped;
+    }
+
+    char const * MappedFile::data() const
+    {
+        return m_data;
+    }
+
+    size_t MappedFile::size() const
+    {
+        return m_size;
+    }
+
+    bool MappedFile::openMapped(std::string const &file_path, Advice advice)
+    {
+        #ifdef KS_ENV_POSIX
+        int const fd = open(file_path.c_str(),O_RDONLY|O_CLOEXEC);
+        if(fd < 0) {
+            return false;
+        }
+
+        struct stat file_stat;
+        if(fstat(fd,&file_stat) != 0 ||
+           !S_ISREG(file_stat.st_mode) ||
+           file_stat.st_size == 0)
+        {
+            // Empty and special files are read instead
+            close(fd);
+            return false;
+        }
+
+        size_t const size = static_cast<size_t>(file_stat.st_size);
+        void * map = mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+
+        // The mapping keeps its own reference to the file
+        close(fd);
+
+        if(map == MAP_FAILED) {
+            return false;
+        }
+
+        if(advice != Advice::Normal) {
+            madvise(map,size,GetMadvise(advice));
+        }
+
+        m_data = static_cast<char const*>(map);
+        m_size = size;
+        m_mapped = true;
+        return true;
+        #else
+        (void)file_path;
+        (void)advice;
+        return false;
+        #endif
+    }
+
+    bool MappedFile::openRead(std::string const &file_path)
+    {
+        std::FILE * file = std::fopen(file_path.c_str(),"rb");
+        if(file == nullptr) {
+            return false;
+        }
+
+        // Size the buffer up front so a regular file is read
+        // with a single call. Files that report no size (ie
+        // /proc entries) are read until EOF
+        long file_size = -1;
+        if(std::fseek(file,0,SEEK_END) == 0) {
+            file_size = std::ftell(file);
+            std::fseek(file,0,SEEK_SET);
+        }
+
+        size_t used = 0;
+        m_buffer.resize((file_size > 0) ? static_cast<size_t>(file_size) : 4096);
+
+        while(true) {
+            size_t const read_size =
+                    std::fread(&(m_buffer[used]),1,m_buffer.size()-used,file);
+
+            used += read_size;
+            if(used < m_buffer.size()) {
+                break; // EOF or error
+            }
+
+            // The buffer is full; done unless the
+            // file is larger than it reported
+            int const c = std::fgetc(file);
+            if(c == EOF) {
+                break;
+            }
+
+            m_buffer.resize(m_buffer.size()*2);
+            m_buffer[used++] = static_cast<char>(c);
+        }
+
+        bool const ok = (std::ferror(file) == 0);
+        std::fclose(file);
+
+        if(!ok) {
+            m_buffer.clear();
+            return false;
+        }
+
+        m_buffer.resize(used);
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+        return true;
+    }
+
+    // ============================================================= //
+
+} // ks
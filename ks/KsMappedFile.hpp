@@ -0,0 +1,95 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_MAPPED_FILE_HPP
+#define KS_MAPPED_FILE_HPP
+
+#include <string>
+
+#include <ks/KsGlobal.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // MappedFile
+    // * a read only view of a whole file
+    // * on POSIX the file is memory mapped, so nothing is copied
+    //   and pages are only read as they're touched. Files that
+    //   can't be mapped (ie pipes or /proc entries) and other
+    //   platforms fall back to reading the file into a buffer
+    //   with a single sized read
+    // * the file must not be truncated while it's mapped;
+    //   touching pages past the new end raises SIGBUS
+    class MappedFile
+    {
+    public:
+        // Advice
+        // * how the view is expected to be accessed; passed to
+        //   madvise for mapped files
+        enum class Advice : u8
+        {
+            Normal,
+            Sequential, // read ahead aggressively
+            Random,     // don't read ahead
+            WillNeed    // start reading the whole file in now
+        };
+
+        MappedFile();
+        MappedFile(std::string const &file_path,
+                   Advice advice=Advice::Sequential);
+
+        MappedFile(MappedFile &&other);
+        MappedFile & operator = (MappedFile &&other);
+
+        MappedFile(MappedFile const &) = delete;
+        MappedFile & operator = (MappedFile const &) = delete;
+
+        ~MappedFile();
+
+        // * Replaces the current view with @file_path
+        // * Returns false if the file couldn't be read
+        bool Open(std::string const &file_path,
+                  Advice advice=Advice::Sequential);
+
+        void Close();
+
+        bool GetValid() const;
+
+        // * Returns true if the view is memory mapped
+        //   rather than a copy
+        bool GetMapped() const;
+
+        // * Never null for a valid view, even if it's empty
+        char const * data() const;
+        size_t size() const;
+
+    private:
+        bool openMapped(std::string const &file_path, Advice advice);
+        bool openRead(std::string const &file_path);
+
+        char const * m_data;
+        size_t m_size;
+        bool m_valid;
+        bool m_mapped;
+        std::string m_buffer;
+    };
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_MAPPED_FILE_HPP
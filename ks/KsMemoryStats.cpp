@@ -0,0 +1,164 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <typeindex>
+
+#include <ks/KsEventLoop.hpp>
+#include <ks/KsMemoryStats.hpp>
+
+#if defined(__GNUC__)
+    #include <cstdlib>
+    #include <cxxabi.h>
+#endif
+
+namespace ks
+{
+    namespace memory_detail
+    {
+        namespace
+        {
+            std::string GetTypeName(std::type_info const &type)
+            {
+                #if defined(__GNUC__)
+                int status = 0;
+                char * demangled =
+                        abi::__cxa_demangle(type.name(),nullptr,nullptr,&status);
+                if(status == 0) {
+                    std::string name(demangled);
+                    std::free(demangled);
+                    return name;
+                }
+                #endif
+
+                return type.name();
+            }
+
+            struct TypeCounterRegistry
+            {
+                using Key = std::pair<TypeCounter::Category,std::type_index>;
+
+                std::mutex mutex;
+                std::map<Key,TypeCounter*> list_counters;
+            };
+
+            TypeCounterRegistry & GetRegistry()
+            {
+                // Leaked so counters outlive static destruction
+                static TypeCounterRegistry * registry = new TypeCounterRegistry();
+                return *registry;
+            }
+
+            void AppendTypeStats(std::vector<TypeMemoryStats> &list_stats,
+                                 TypeCounter const &counter)
+            {
+                TypeMemoryStats stats = counter.GetStats();
+                if(stats.count > 0) {
+                    list_stats.push_back(std::move(stats));
+                }
+            }
+
+            void SortTypeStats(std::vector<TypeMemoryStats> &list_stats)
+            {
+                std::stable_sort(
+                            list_stats.begin(),
+                            list_stats.end(),
+                            [](TypeMemoryStats const &a, TypeMemoryStats const &b) {
+                                return a.bytes > b.bytes;
+                            });
+            }
+        }
+
+        TypeCounter::TypeCounter(std::string type_name, size_t size) :
+            m_type_name(std::move(type_name)),
+            m_size(size)
+        {
+            // empty
+        }
+
+        TypeMemoryStats TypeCounter::GetStats() const
+        {
+            // Read destroyed first; an instance is always
+            // counted as created before it's destroyed
+            u64 const destroyed = m_destroyed.Get();
+            u64 const created = m_created.Get();
+
+            TypeMemoryStats stats;
+            stats.type_name = m_type_name;
+            stats.count = (created > destroyed) ? (created-destroyed) : 0;
+            stats.bytes = stats.count*m_size;
+            return stats;
+        }
+
+        TypeCounter & GetTypeCounter(TypeCounter::Category category,
+                                     std::type_info const &type,
+                                     size_t size)
+        {
+            TypeCounterRegistry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            TypeCounterRegistry::Key const key(category,std::type_index(type));
+            auto it = registry.list_counters.find(key);
+            if(it == registry.list_counters.end()) {
+                it = registry.list_counters.emplace(
+                            key,new TypeCounter(GetTypeName(type),size)).first;
+            }
+            return *(it->second);
+        }
+    }
+
+    // ============================================================= //
+
+    MemoryStats GetMemoryStats()
+    {
+        using namespace memory_detail;
+
+        MemoryStats stats;
+
+        EventLoop::ForEachEventLoop(
+                    [&stats](EventLoop &event_loop) {
+                        LoopMemoryStats loop_stats;
+                        loop_stats.loop_id = event_loop.GetId();
+                        loop_stats.queued_events =
+                                event_loop.GetQueueSize(&(loop_stats.queued_bytes));
+                        stats.list_loops.push_back(loop_stats);
+                    });
+
+        {
+            TypeCounterRegistry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            for(auto const &counter_it : registry.list_counters) {
+                if(counter_it.first.first == TypeCounter::Category::Object) {
+                    AppendTypeStats(stats.list_objects,*(counter_it.second));
+                }
+                else {
+                    AppendTypeStats(stats.list_connections,*(counter_it.second));
+                }
+            }
+        }
+
+        SortTypeStats(stats.list_objects);
+        SortTypeStats(stats.list_connections);
+
+        return stats;
+    }
+
+    // ============================================================= //
+
+} // ks
@@ -0,0 +1,135 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_MEMORY_STATS_HPP
+#define KS_MEMORY_STATS_HPP
+
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include <ks/KsGlobal.hpp>
+#include <ks/KsMetrics.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // Memory accounting
+    // * counts what ks keeps alive so memory growth can be
+    //   attributed without a heap profiler: events queued on
+    //   each EventLoop, Signal connections by Signal type and
+    //   live Objects by concrete type
+    // * counting is always on; it's a sharded counter update
+    //   per Object created or destroyed and per connection
+    //   made or removed, and a relaxed atomic add per event
+    // * bytes are estimates from the sizes of the types
+    //   involved; heap memory they own (ie a slot's bound
+    //   arguments or an Object's members) isn't counted
+
+    struct TypeMemoryStats
+    {
+        // demangled where possible
+        std::string type_name;
+        u64 count;
+        u64 bytes;
+    };
+
+    struct LoopMemoryStats
+    {
+        Id loop_id;
+        u64 queued_events;
+        u64 queued_bytes;
+    };
+
+    struct MemoryStats
+    {
+        // in order of creation
+        std::vector<LoopMemoryStats> list_loops;
+
+        // live Objects by concrete type and connections
+        // by Signal type, most bytes first; types that
+        // have none are left out
+        std::vector<TypeMemoryStats> list_objects;
+        std::vector<TypeMemoryStats> list_connections;
+    };
+
+    // * Returns a snapshot of the memory accounting; the
+    //   counts aren't read at a single instant, so ones that
+    //   are changing may be slightly off
+    MemoryStats GetMemoryStats();
+
+    namespace memory_detail
+    {
+        // TypeCounter
+        // * counts the live instances of a type; created on
+        //   first use and never destroyed
+        class TypeCounter
+        {
+        public:
+            enum class Category : u8
+            {
+                Object,
+                Connection
+            };
+
+            TypeCounter(std::string type_name, size_t size);
+            TypeCounter(TypeCounter const &) = delete;
+            TypeCounter & operator = (TypeCounter const &) = delete;
+
+            void Add(u64 n=1)
+            {
+                m_created.Add(n);
+            }
+
+            void Remove(u64 n=1)
+            {
+                m_destroyed.Add(n);
+            }
+
+            TypeMemoryStats GetStats() const;
+
+            // * Never changes, so the string outlives
+            //   anything that refers to it
+            std::string const & GetTypeName() const
+            {
+                return m_type_name;
+            }
+
+        private:
+            std::string const m_type_name;
+            size_t const m_size;
+
+            // live = created-destroyed; two counters so
+            // that neither is ever contended
+            metrics::Counter m_created;
+            metrics::Counter m_destroyed;
+        };
+
+        // * Returns the counter for @type in @category; @size is
+        //   the bytes counted per instance
+        // * Callers should keep the reference (ie in a function
+        //   local static) since this takes a lock
+        TypeCounter & GetTypeCounter(TypeCounter::Category category,
+                                     std::type_info const &type,
+                                     size_t size);
+    }
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_MEMORY_STATS_HPP
@@ -0,0 +1,297 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+
+#include <ks/KsMetrics.hpp>
+
+namespace ks
+{
+    namespace metrics
+    {
+        namespace metrics_detail
+        {
+            uint GetShardIndex()
+            {
+                static std::atomic<uint> s_next_shard(0);
+
+                static thread_local uint const t_shard_index =
+                        s_next_shard.fetch_add(1,std::memory_order_relaxed)%
+                        k_shard_count;
+
+                return t_shard_index;
+            }
+        }
+
+        namespace
+        {
+            struct MetricRegistry
+            {
+                std::mutex mutex;
+                std::map<std::string,RegisteredMetric> list_metrics;
+            };
+
+            MetricRegistry & GetRegistry()
+            {
+                // Leaked so metrics can be unregistered
+                // during static destruction
+                static MetricRegistry * registry = new MetricRegistry();
+                return *registry;
+            }
+
+            void Register(std::string name,
+                          std::string help,
+                          Counter const * counter,
+                          Gauge const * gauge,
+                          Histogram const * histogram)
+            {
+                MetricRegistry &registry = GetRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+
+                RegisteredMetric &metric = registry.list_metrics[name];
+                metric.name = std::move(name);
+                metric.help = std::move(help);
+                metric.counter = counter;
+                metric.gauge = gauge;
+                metric.histogram = histogram;
+            }
+        }
+
+        // ============================================================= //
+
+        Counter::Counter()
+        {
+            Reset();
+        }
+
+        u64 Counter::Get() const
+        {
+            u64 sum = 0;
+            for(auto const &shard : m_list_shards) {
+                sum += shard.value.load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+        void Counter::Reset()
+        {
+            for(auto &shard : m_list_shards) {
+                shard.value.store(0,std::memory_order_relaxed);
+            }
+        }
+
+        // ============================================================= //
+
+        Gauge::Gauge() :
+            m_value(0)
+        {
+            // empty
+        }
+
+        // ============================================================= //
+
+        HistogramSnapshot::HistogramSnapshot() :
+            list_buckets(metrics_detail::k_bucket_count,0),
+            sum(0),
+            max(0)
+        {
+            // empty
+        }
+
+        void HistogramSnapshot::Merge(HistogramSnapshot const &other)
+        {
+            for(uint i=0; i < metrics_detail::k_bucket_count; i++) {
+                list_buckets[i] += other.list_buckets[i];
+            }
+            sum += other.sum;
+            max = std::max(max,other.max);
+        }
+
+        u64 HistogramSnapshot::GetCount() const
+        {
+            u64 count = 0;
+            for(u64 bucket : list_buckets) {
+                count += bucket;
+            }
+            return count;
+        }
+
+        double HistogramSnapshot::GetMean() const
+        {
+            u64 const count = GetCount();
+            return (count == 0) ? 0.0 : static_cast<double>(sum)/count;
+        }
+
+        u64 HistogramSnapshot::GetPercentile(double percentile) const
+        {
+            u64 const count = GetCount();
+            if(count == 0) {
+                return 0;
+            }
+
+            percentile = std::min(std::max(percentile,0.0),100.0);
+            u64 const rank = std::max(
+                        static_cast<u64>(std::ceil(percentile*count/100.0)),
+                        u64(1));
+
+            u64 seen = 0;
+            for(uint i=0; i < metrics_detail::k_bucket_count; i++) {
+                seen += list_buckets[i];
+                if(seen >= rank) {
+                    return std::min(Histogram::GetBucketUpperBound(i),GetMax());
+                }
+            }
+
+            return GetMax();
+        }
+
+        u64 HistogramSnapshot::GetMin() const
+        {
+            for(uint i=0; i < metrics_detail::k_bucket_count; i++) {
+                if(list_buckets[i] > 0) {
+                    return Histogram::GetBucketLowerBound(i);
+                }
+            }
+            return 0;
+        }
+
+        u64 HistogramSnapshot::GetMax() const
+        {
+            // max can be lower than the top bucket if it
+            // lost a race; see Histogram::Record
+            for(uint i=metrics_detail::k_bucket_count; i > 0; i--) {
+                if(list_buckets[i-1] > 0) {
+                    return std::max(max,Histogram::GetBucketLowerBound(i-1));
+                }
+            }
+            return 0;
+        }
+
+        // ============================================================= //
+
+        Histogram::Histogram()
+        {
+            Reset();
+        }
+
+        HistogramSnapshot Histogram::GetSnapshot() const
+        {
+            HistogramSnapshot snapshot;
+            for(auto const &shard : m_list_shards) {
+                for(uint i=0; i < metrics_detail::k_bucket_count; i++) {
+                    snapshot.list_buckets[i] +=
+                            shard.list_buckets[i].load(std::memory_order_relaxed);
+                }
+                snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+                snapshot.max = std::max(
+                            snapshot.max,
+                            shard.max.load(std::memory_order_relaxed));
+            }
+            return snapshot;
+        }
+
+        void Histogram::Reset()
+        {
+            for(auto &shard : m_list_shards) {
+                for(auto &bucket : shard.list_buckets) {
+                    bucket.store(0,std::memory_order_relaxed);
+                }
+                shard.sum.store(0,std::memory_order_relaxed);
+                shard.max.store(0,std::memory_order_relaxed);
+            }
+        }
+
+        u64 Histogram::GetBucketLowerBound(uint index)
+        {
+            using namespace metrics_detail;
+
+            if(index < (1u << k_sub_bucket_bits)) {
+                return index;
+            }
+
+            index = std::min(index,k_bucket_count-1);
+            uint const shift = index/k_sub_bucket_half-1;
+            u64 const sub_bucket = index-shift*k_sub_bucket_half;
+            return sub_bucket << shift;
+        }
+
+        u64 Histogram::GetBucketUpperBound(uint index)
+        {
+            using namespace metrics_detail;
+
+            if(index < (1u << k_sub_bucket_bits)) {
+                return index;
+            }
+
+            if(index >= k_bucket_count-1) {
+                // Also holds everything out of range
+                return std::numeric_limits<u64>::max();
+            }
+
+            uint const shift = index/k_sub_bucket_half-1;
+            u64 const sub_bucket = index-shift*k_sub_bucket_half;
+            return ((sub_bucket+1) << shift)-1;
+        }
+
+        // ============================================================= //
+
+        void RegisterCounter(std::string name,
+                             std::string help,
+                             Counter const &counter)
+        {
+            Register(std::move(name),std::move(help),&counter,nullptr,nullptr);
+        }
+
+        void RegisterGauge(std::string name,
+                           std::string help,
+                           Gauge const &gauge)
+        {
+            Register(std::move(name),std::move(help),nullptr,&gauge,nullptr);
+        }
+
+        void RegisterHistogram(std::string name,
+                               std::string help,
+                               Histogram const &histogram)
+        {
+            Register(std::move(name),std::move(help),nullptr,nullptr,&histogram);
+        }
+
+        void Unregister(std::string const &name)
+        {
+            MetricRegistry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.list_metrics.erase(name);
+        }
+
+        void ForEachRegisteredMetric(
+                std::function<void(RegisteredMetric const &)> const &fn)
+        {
+            MetricRegistry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for(auto const &metric_it : registry.list_metrics) {
+                fn(metric_it.second);
+            }
+        }
+
+        // ============================================================= //
+
+    } // metrics
+
+} // ks
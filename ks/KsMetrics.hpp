@@ -0,0 +1,292 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_METRICS_HPP
+#define KS_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <ks/KsGlobal.hpp>
+
+namespace ks
+{
+    namespace metrics
+    {
+        // ============================================================= //
+
+        // Metrics
+        // * counters, gauges and histograms that can be updated
+        //   from any number of threads without locks
+        // * counters and histograms are split into shards, each
+        //   on its own cache line(s). A thread always updates the
+        //   same shard, so threads on different shards don't
+        //   contend; reads sum the shards
+        // * recording is wait free and never allocates; all of a
+        //   metric's memory is allocated when it's created
+
+        namespace metrics_detail
+        {
+            uint const k_shard_count = 8;
+            size_t const k_cache_line_size = 64;
+
+            // * Returns the calling thread's shard; threads
+            //   are assigned shards round robin
+            uint GetShardIndex();
+
+            // Histogram buckets
+            // * values below 2^k_sub_bucket_bits each get their
+            //   own bucket; above that, each power of two range
+            //   is split into 2^(k_sub_bucket_bits-1) buckets, so
+            //   a bucket's width is at most 1/16th of its values
+            //   (~3% error at the midpoint)
+            // * values of 2^(k_max_exponent+1) and above are
+            //   counted in the last bucket
+            uint const k_sub_bucket_bits = 5;
+            uint const k_sub_bucket_half = 1u << (k_sub_bucket_bits-1);
+            uint const k_max_exponent = 47;
+            uint const k_bucket_count =
+                    (k_max_exponent-k_sub_bucket_bits+2)*k_sub_bucket_half+
+                    k_sub_bucket_half;
+
+            struct CounterShard
+            {
+                std::atomic<u64> value;
+                char padding[k_cache_line_size-sizeof(std::atomic<u64>)];
+            };
+
+            struct HistogramShard
+            {
+                std::array<std::atomic<u64>,k_bucket_count> list_buckets;
+                std::atomic<u64> sum;
+                std::atomic<u64> max;
+                char padding[k_cache_line_size];
+            };
+        }
+
+        // ============================================================= //
+
+        // Counter
+        // * a sum that only goes up, ie requests served
+        class Counter
+        {
+        public:
+            Counter();
+            Counter(Counter const &) = delete;
+            Counter & operator = (Counter const &) = delete;
+
+            void Add(u64 n=1)
+            {
+                m_list_shards[metrics_detail::GetShardIndex()].value.fetch_add(
+                            n,std::memory_order_relaxed);
+            }
+
+            // * Returns the sum over all shards; updates made
+            //   while reading may or may not be included
+            u64 Get() const;
+
+            void Reset();
+
+        private:
+            std::array<
+                metrics_detail::CounterShard,
+                metrics_detail::k_shard_count
+            > m_list_shards;
+        };
+
+        // ============================================================= //
+
+        // Gauge
+        // * a value that's set and read as a whole, ie the
+        //   current queue size. Set and Add from different
+        //   threads do contend; a gauge isn't sharded since
+        //   a Set has to replace every shard's value
+        class Gauge
+        {
+        public:
+            Gauge();
+            Gauge(Gauge const &) = delete;
+            Gauge & operator = (Gauge const &) = delete;
+
+            void Set(s64 value)
+            {
+                m_value.store(value,std::memory_order_relaxed);
+            }
+
+            void Add(s64 n)
+            {
+                m_value.fetch_add(n,std::memory_order_relaxed);
+            }
+
+            s64 Get() const
+            {
+                return m_value.load(std::memory_order_relaxed);
+            }
+
+        private:
+            char m_padding_begin[metrics_detail::k_cache_line_size];
+            std::atomic<s64> m_value;
+            char m_padding_end[metrics_detail::k_cache_line_size-sizeof(std::atomic<s64>)];
+        };
+
+        // ============================================================= //
+
+        // HistogramSnapshot
+        // * the state of a Histogram at some point; snapshots
+        //   of different histograms (ie one per thread or loop)
+        //   can be merged to get their combined distribution
+        struct HistogramSnapshot
+        {
+            HistogramSnapshot();
+
+            // * Adds the values counted by @other
+            void Merge(HistogramSnapshot const &other);
+
+            u64 GetCount() const;
+            double GetMean() const;
+
+            // * Returns the largest value that falls in the
+            //   same bucket as the @percentile (0-100) value,
+            //   or 0 if there are no values
+            u64 GetPercentile(double percentile) const;
+
+            // * The smallest and largest values recorded; the
+            //   minimum is only known to bucket precision
+            u64 GetMin() const;
+            u64 GetMax() const;
+
+            std::vector<u64> list_buckets;
+            u64 sum;
+            u64 max;
+        };
+
+        // Histogram
+        // * counts values (ie latencies in ns) in log-linear
+        //   buckets: exact below 32, and within ~3% above that
+        //   (see metrics_detail)
+        // * uses about 46KB, so it's meant for long lived
+        //   metrics rather than one per request
+        class Histogram
+        {
+        public:
+            Histogram();
+            Histogram(Histogram const &) = delete;
+            Histogram & operator = (Histogram const &) = delete;
+
+            void Record(u64 value)
+            {
+                metrics_detail::HistogramShard &shard =
+                        m_list_shards[metrics_detail::GetShardIndex()];
+
+                shard.list_buckets[GetBucketIndex(value)].fetch_add(
+                            1,std::memory_order_relaxed);
+
+                shard.sum.fetch_add(value,std::memory_order_relaxed);
+
+                // Not a CAS loop, so this stays wait free: two
+                // threads sharing a shard can race and lose the
+                // larger value, in which case GetMax falls back
+                // to the top bucket
+                if(value > shard.max.load(std::memory_order_relaxed)) {
+                    shard.max.store(value,std::memory_order_relaxed);
+                }
+            }
+
+            HistogramSnapshot GetSnapshot() const;
+
+            void Reset();
+
+            static uint GetBucketIndex(u64 value)
+            {
+                using namespace metrics_detail;
+
+                if(value < (u64(1) << k_sub_bucket_bits)) {
+                    return static_cast<uint>(value);
+                }
+
+                uint const exponent = 63-static_cast<uint>(__builtin_clzll(value));
+                if(exponent > k_max_exponent) {
+                    return k_bucket_count-1;
+                }
+
+                // value >> shift is in [half,2*half)
+                uint const shift = exponent-(k_sub_bucket_bits-1);
+                return shift*k_sub_bucket_half+static_cast<uint>(value >> shift);
+            }
+
+            // * Returns the smallest and largest values
+            //   counted in bucket @index
+            static u64 GetBucketLowerBound(uint index);
+            static u64 GetBucketUpperBound(uint index);
+
+        private:
+            std::array<
+                metrics_detail::HistogramShard,
+                metrics_detail::k_shard_count
+            > m_list_shards;
+        };
+
+        // ============================================================= //
+
+        // Registry
+        // * metrics registered by name are rendered by exporters
+        //   (see MetricsExporter); a metric must be unregistered
+        //   before it's destroyed
+        // * names should follow Prometheus conventions, ie
+        //   "app_requests_total"; registering a name again
+        //   replaces the earlier metric
+
+        void RegisterCounter(std::string name,
+                             std::string help,
+                             Counter const &counter);
+
+        void RegisterGauge(std::string name,
+                           std::string help,
+                           Gauge const &gauge);
+
+        void RegisterHistogram(std::string name,
+                               std::string help,
+                               Histogram const &histogram);
+
+        void Unregister(std::string const &name);
+
+        // RegisteredMetric
+        // * exactly one of counter, gauge and histogram is set
+        struct RegisteredMetric
+        {
+            std::string name;
+            std::string help;
+            Counter const * counter;
+            Gauge const * gauge;
+            Histogram const * histogram;
+        };
+
+        // * Calls @fn with each registered metric in order of
+        //   name; metrics can't be registered or unregistered
+        //   until @fn returns
+        void ForEachRegisteredMetric(
+                std::function<void(RegisteredMetric const &)> const &fn);
+
+        // ============================================================= //
+
+    } // metrics
+
+} // ks
+
+#endif // KS_METRICS_HPP
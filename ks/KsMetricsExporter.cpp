@@ -0,0 +1,740 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <cerrno>
+#include <cstdio>
+#include <istream>
+#include <utility>
+#include <vector>
+
+#include <ks/KsConfig.hpp>
+#include <ks/KsEventLoop.hpp>
+#include <ks/KsMemoryStats.hpp>
+#include <ks/KsMetrics.hpp>
+#include <ks/KsMetricsExporter.hpp>
+#include <ks/KsMutex.hpp>
+#include <ks/thirdparty/asio/asio.hpp>
+
+#ifdef KS_ENV_POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ks
+{
+    namespace
+    {
+        // Requests larger than this are dropped; a scrape
+        // is a few hundred bytes of headers
+        size_t const k_max_request_size = 8192;
+
+        char const * const k_content_type = "text/plain; version=0.0.4; charset=utf-8";
+
+        #ifdef KS_ENV_POSIX
+        // * Removes a stale socket at @path, which would
+        //   fail the bind
+        // * Returns false if something other than a socket
+        //   is at @path, so a wrong path can't destroy data
+        bool RemoveStaleSocket(std::string const &path)
+        {
+            struct stat path_stat;
+            if(lstat(path.c_str(),&path_stat) != 0) {
+                return (errno == ENOENT);
+            }
+
+            if(!S_ISSOCK(path_stat.st_mode)) {
+                return false;
+            }
+
+            return (unlink(path.c_str()) == 0);
+        }
+        #endif
+
+        // ============================================================= //
+
+        // (le, cumulative count) pairs of a histogram's buckets
+        using BucketList = std::vector<std::pair<u64,u64>>;
+
+        std::string EscapeHelp(std::string const &help)
+        {
+            std::string escaped;
+            escaped.reserve(help.size());
+            for(char c : help) {
+                if(c == '\\') { escaped += "\\\\"; }
+                else if(c == '\n') { escaped += "\\n"; }
+                else { escaped += c; }
+            }
+            return escaped;
+        }
+
+        // * Returns @key="@value" with @value escaped
+        std::string Label(char const * key, std::string const &value)
+        {
+            std::string label(key);
+            label += "=\"";
+            for(char c : value) {
+                if(c == '\\') { label += "\\\\"; }
+                else if(c == '"') { label += "\\\""; }
+                else if(c == '\n') { label += "\\n"; }
+                else { label += c; }
+            }
+            label += "\"";
+            return label;
+        }
+
+        void AppendFamily(std::string &text,
+                          char const * name,
+                          std::string const &help,
+                          char const * type)
+        {
+            text += "# HELP ";
+            text += name;
+            text += " ";
+            text += EscapeHelp(help);
+            text += "\n# TYPE ";
+            text += name;
+            text += " ";
+            text += type;
+            text += "\n";
+        }
+
+        void AppendSample(std::string &text,
+                          char const * name,
+                          std::string const &labels,
+                          std::string const &value)
+        {
+            text += name;
+            if(!labels.empty()) {
+                text += "{";
+                text += labels;
+                text += "}";
+            }
+            text += " ";
+            text += value;
+            text += "\n";
+        }
+
+        void AppendHistogram(std::string &text,
+                             char const * name,
+                             std::string const &labels,
+                             BucketList const &list_bounds,
+                             u64 count,
+                             u64 sum)
+        {
+            std::string const bucket_name = std::string(name)+"_bucket";
+            std::string const le_prefix = labels.empty() ? "" : labels+",";
+
+            for(auto const &bound : list_bounds) {
+                AppendSample(text,bucket_name.c_str(),
+                             le_prefix+Label("le",std::to_string(bound.first)),
+                             std::to_string(bound.second));
+            }
+
+            AppendSample(text,bucket_name.c_str(),
+                         le_prefix+Label("le","+Inf"),
+                         std::to_string(count));
+
+            AppendSample(text,(std::string(name)+"_sum").c_str(),
+                         labels,std::to_string(sum));
+
+            AppendSample(text,(std::string(name)+"_count").c_str(),
+                         labels,std::to_string(count));
+        }
+
+        // * metrics::Histogram buckets are finer than a scraper
+        //   needs; only the power of two boundaries are exported
+        BucketList GetBucketList(metrics::HistogramSnapshot const &snapshot)
+        {
+            BucketList list_bounds;
+
+            u64 cumulative = 0;
+            for(uint i=0; i+1 < snapshot.list_buckets.size(); i++) {
+                cumulative += snapshot.list_buckets[i];
+
+                u64 const upper = metrics::Histogram::GetBucketUpperBound(i);
+                if(((upper+1) & upper) == 0) {
+                    list_bounds.emplace_back(upper,cumulative);
+                }
+            }
+
+            return list_bounds;
+        }
+
+        BucketList GetBucketList(LatencyHistogram const &histogram)
+        {
+            BucketList list_bounds;
+
+            // Bucket i holds [2^i,2^(i+1)) ns; the last
+            // bucket is left to +Inf
+            u64 cumulative = 0;
+            for(uint i=0; i+1 < k_latency_bucket_count; i++) {
+                cumulative += histogram.list_buckets[i];
+                list_bounds.emplace_back((u64(2) << i)-1,cumulative);
+            }
+
+            return list_bounds;
+        }
+
+        void AppendRegisteredMetrics(std::string &text)
+        {
+            metrics::ForEachRegisteredMetric(
+                        [&text](metrics::RegisteredMetric const &metric) {
+                char const * name = metric.name.c_str();
+
+                if(metric.counter) {
+                    AppendFamily(text,name,metric.help,"counter");
+                    AppendSample(text,name,"",std::to_string(metric.counter->Get()));
+                }
+                else if(metric.gauge) {
+                    AppendFamily(text,name,metric.help,"gauge");
+                    AppendSample(text,name,"",std::to_string(metric.gauge->Get()));
+                }
+                else if(metric.histogram) {
+                    metrics::HistogramSnapshot const snapshot =
+                            metric.histogram->GetSnapshot();
+
+                    AppendFamily(text,name,metric.help,"histogram");
+                    AppendHistogram(text,name,"",GetBucketList(snapshot),
+                                    snapshot.GetCount(),snapshot.sum);
+                }
+            });
+        }
+
+        void AppendEventLoopMetrics(std::string &text)
+        {
+            // Collected first since each family's samples
+            // have to be listed together
+            std::vector<std::pair<std::string,EventLoopStats>> list_loops;
+            EventLoop::ForEachEventLoop(
+                        [&list_loops](EventLoop &event_loop) {
+                // Reading the stats shouldn't reset the
+                // loop's events_per_sec window
+                list_loops.emplace_back(
+                            Label("loop",std::to_string(event_loop.GetId())),
+                            event_loop.GetStats(false));
+            });
+
+            if(list_loops.empty()) {
+                return;
+            }
+
+            AppendFamily(text,"ks_event_loop_queue_depth",
+                         "Events queued on the EventLoop","gauge");
+            for(auto const &loop : list_loops) {
+                AppendSample(text,"ks_event_loop_queue_depth",loop.first,
+                             std::to_string(loop.second.queue_depth));
+            }
+
+            AppendFamily(text,"ks_event_loop_queued_bytes",
+                         "Estimated bytes of the events queued on the EventLoop","gauge");
+            for(auto const &loop : list_loops) {
+                AppendSample(text,"ks_event_loop_queued_bytes",loop.first,
+                             std::to_string(loop.second.queue_bytes));
+            }
+
+            AppendFamily(text,"ks_event_loop_events_handled_total",
+                         "Events handled by the EventLoop","counter");
+            for(auto const &loop : list_loops) {
+                AppendSample(text,"ks_event_loop_events_handled_total",loop.first,
+                             std::to_string(loop.second.events_handled));
+            }
+
+            AppendFamily(text,"ks_event_loop_timers_fired_total",
+                         "Timers fired by the EventLoop","counter");
+            for(auto const &loop : list_loops) {
+                AppendSample(text,"ks_event_loop_timers_fired_total",loop.first,
+                             std::to_string(loop.second.timers_fired));
+            }
+
+            AppendFamily(text,"ks_event_loop_wait_ns",
+                         "Time events spent queued before being handled, in ns","histogram");
+            for(auto const &loop : list_loops) {
+                AppendHistogram(text,"ks_event_loop_wait_ns",loop.first,
+                                GetBucketList(loop.second.wait_ns),
+                                loop.second.wait_ns.count,
+                                loop.second.wait_ns.total_ns);
+            }
+
+            AppendFamily(text,"ks_event_loop_handler_ns",
+                         "Time spent in the EventLoop's handlers, in ns","histogram");
+            for(auto const &loop : list_loops) {
+                AppendHistogram(text,"ks_event_loop_handler_ns",loop.first,
+                                GetBucketList(loop.second.handler_ns),
+                                loop.second.handler_ns.count,
+                                loop.second.handler_ns.total_ns);
+            }
+        }
+
+        void AppendTypeStats(std::string &text,
+                             char const * label_key,
+                             char const * count_name,
+                             std::string const &count_help,
+                             char const * bytes_name,
+                             std::string const &bytes_help,
+                             std::vector<TypeMemoryStats> const &list_stats)
+        {
+            if(list_stats.empty()) {
+                return;
+            }
+
+            AppendFamily(text,count_name,count_help,"gauge");
+            for(auto const &stats : list_stats) {
+                AppendSample(text,count_name,Label(label_key,stats.type_name),
+                             std::to_string(stats.count));
+            }
+
+            AppendFamily(text,bytes_name,bytes_help,"gauge");
+            for(auto const &stats : list_stats) {
+                AppendSample(text,bytes_name,Label(label_key,stats.type_name),
+                             std::to_string(stats.bytes));
+            }
+        }
+
+        void AppendMemoryMetrics(std::string &text)
+        {
+            MemoryStats const stats = GetMemoryStats();
+
+            AppendTypeStats(text,"type",
+                            "ks_objects","Live Objects by type",
+                            "ks_object_bytes","Estimated bytes of live Objects by type",
+                            stats.list_objects);
+
+            AppendTypeStats(text,"signal",
+                            "ks_signal_connections","Signal connections by Signal type",
+                            "ks_signal_connection_bytes","Estimated bytes of Signal connections by Signal type",
+                            stats.list_connections);
+        }
+
+        void AppendLockMetrics(std::string &text)
+        {
+            // Empty unless built with KS_PROFILE_LOCKS
+            std::vector<LockSiteStats> const list_sites = GetLockSiteStats();
+            if(list_sites.empty()) {
+                return;
+            }
+
+            AppendFamily(text,"ks_lock_acquisitions_total",
+                         "Acquisitions of the lock site","counter");
+            for(auto const &site : list_sites) {
+                AppendSample(text,"ks_lock_acquisitions_total",Label("site",site.name),
+                             std::to_string(site.acquisitions));
+            }
+
+            AppendFamily(text,"ks_lock_contended_total",
+                         "Acquisitions of the lock site that had to wait","counter");
+            for(auto const &site : list_sites) {
+                AppendSample(text,"ks_lock_contended_total",Label("site",site.name),
+                             std::to_string(site.contended));
+            }
+
+            AppendFamily(text,"ks_lock_wait_ns",
+                         "Time spent waiting for the lock site, in ns","histogram");
+            for(auto const &site : list_sites) {
+                AppendHistogram(text,"ks_lock_wait_ns",Label("site",site.name),
+                                GetBucketList(site.wait_ns),
+                                site.wait_ns.GetCount(),site.wait_ns.sum);
+            }
+
+            AppendFamily(text,"ks_lock_hold_ns",
+                         "Time the lock site was held, in ns","histogram");
+            for(auto const &site : list_sites) {
+                AppendHistogram(text,"ks_lock_hold_ns",Label("site",site.name),
+                                GetBucketList(site.hold_ns),
+                                site.hold_ns.GetCount(),site.hold_ns.sum);
+            }
+        }
+
+        // ============================================================= //
+
+        // * Returns the response to the first line of a request,
+        //   ie "GET /metrics HTTP/1.1"
+        std::string GetResponse(std::string request_line)
+        {
+            if(!request_line.empty() && request_line.back() == '\r') {
+                request_line.pop_back();
+            }
+
+            std::string status;
+            std::string content_type;
+            std::string body;
+
+            size_t const method_end = request_line.find(' ');
+            size_t const path_end = request_line.find(' ',method_end+1);
+
+            std::string const method = request_line.substr(0,method_end);
+            std::string const path =
+                    (method_end == std::string::npos) ? "" :
+                    request_line.substr(method_end+1,path_end-method_end-1);
+
+            if(method != "GET" && method != "HEAD") {
+                status = "405 Method Not Allowed";
+                content_type = "text/plain";
+                body = "Method Not Allowed\n";
+            }
+            else if(path != "/metrics" && path != "/") {
+                status = "404 Not Found";
+                content_type = "text/plain";
+                body = "Not Found\n";
+            }
+            else {
+                status = "200 OK";
+                content_type = k_content_type;
+                body = RenderPrometheusMetrics();
+            }
+
+            std::string response;
+            response.reserve(body.size()+128);
+            response += "HTTP/1.1 ";
+            response += status;
+            response += "\r\nContent-Type: ";
+            response += content_type;
+            response += "\r\nContent-Length: ";
+            response += std::to_string(body.size());
+            response += "\r\nConnection: close\r\n\r\n";
+
+            if(method != "HEAD") {
+                response += body;
+            }
+
+            return response;
+        }
+
+        // Loop
+        // * where a Session or Acceptor runs its handlers
+        struct Loop
+        {
+            // * Returns @handler wrapped so the loop accounts
+            //   for it like its own handlers
+            template<typename Handler>
+            asio_detail::InstrumentedHandler<Handler> Wrap(Handler handler) const
+            {
+                return asio_detail::Instrument(*event_loop,LoopHandlerType::Io,
+                                               tag,std::move(handler));
+            }
+
+            EventLoop * event_loop;
+            Id tag; // the exporter's Id
+        };
+
+        // Session
+        // * reads one request from a connection and writes
+        //   the response; kept alive by its pending handlers
+        template<typename Protocol>
+        class Session : public std::enable_shared_from_this<Session<Protocol>>
+        {
+        public:
+            Session(Loop const &loop, Milliseconds timeout) :
+                m_loop(loop),
+                m_socket(asio_detail::LoopAccess::GetService(*loop.event_loop)),
+                m_timer(asio_detail::LoopAccess::GetService(*loop.event_loop)),
+                m_timeout(timeout),
+                m_request(k_max_request_size)
+            {
+                // empty
+            }
+
+            typename Protocol::socket & GetSocket()
+            {
+                return m_socket;
+            }
+
+            void Start()
+            {
+                auto self = this->shared_from_this();
+
+                m_timer.expires_from_now(m_timeout);
+                m_timer.async_wait(
+                            m_loop.Wrap([self](asio::error_code const &ec) {
+                    if(!ec) {
+                        // Cancels the pending read or write
+                        asio::error_code ignored;
+                        self->m_socket.close(ignored);
+                    }
+                }));
+
+                asio::async_read_until(
+                            m_socket,m_request,"\r\n\r\n",
+                            m_loop.Wrap([self](asio::error_code const &ec, size_t) {
+                    self->onRequest(ec);
+                }));
+            }
+
+        private:
+            void onRequest(asio::error_code const &ec)
+            {
+                if(ec) {
+                    // Closed, timed out or too large
+                    m_timer.cancel();
+                    return;
+                }
+
+                std::istream stream(&m_request);
+                std::string request_line;
+                std::getline(stream,request_line);
+
+                m_response = GetResponse(std::move(request_line));
+
+                auto self = this->shared_from_this();
+                asio::async_write(
+                            m_socket,asio::buffer(m_response),
+                            m_loop.Wrap([self](asio::error_code const &, size_t) {
+                    asio::error_code ignored;
+                    self->m_socket.shutdown(Protocol::socket::shutdown_both,ignored);
+                    self->m_socket.close(ignored);
+                    self->m_timer.cancel();
+                }));
+            }
+
+            Loop const m_loop;
+            typename Protocol::socket m_socket;
+            asio::steady_timer m_timer;
+            Milliseconds const m_timeout;
+            asio::streambuf m_request;
+            std::string m_response;
+        };
+    }
+
+    // ============================================================= //
+
+    std::string RenderPrometheusMetrics()
+    {
+        std::string text;
+        AppendRegisteredMetrics(text);
+        AppendEventLoopMetrics(text);
+        AppendMemoryMetrics(text);
+        AppendLockMetrics(text);
+        return text;
+    }
+
+    // ============================================================= //
+
+    namespace exporter_detail
+    {
+        // Server
+        // * the listening socket; only used on the exporter's
+        //   EventLoop once it's listening
+        class Server
+        {
+        public:
+            virtual ~Server()
+            {
+                // empty
+            }
+
+            virtual void Accept() = 0;
+            virtual void Close() = 0;
+        };
+    }
+
+    namespace
+    {
+        // Failed accepts (ie running out of descriptors) are
+        // retried after this long rather than right away
+        Milliseconds const k_accept_retry_delay(100);
+
+        template<typename Protocol>
+        class Acceptor :
+                public exporter_detail::Server,
+                public std::enable_shared_from_this<Acceptor<Protocol>>
+        {
+        public:
+            Acceptor(Loop const &loop, Milliseconds request_timeout) :
+                m_loop(loop),
+                m_acceptor(asio_detail::LoopAccess::GetService(*loop.event_loop)),
+                m_retry_timer(asio_detail::LoopAccess::GetService(*loop.event_loop)),
+                m_request_timeout(request_timeout)
+            {
+                // empty
+            }
+
+            ~Acceptor()
+            {
+                if(!m_unlink_path.empty()) {
+                    std::remove(m_unlink_path.c_str());
+                }
+            }
+
+            // * Returns false if @endpoint couldn't be listened on
+            bool Listen(typename Protocol::endpoint const &endpoint,
+                        bool reuse_address)
+            {
+                asio::error_code ec;
+                m_acceptor.open(endpoint.protocol(),ec);
+                if(!ec && reuse_address) {
+                    m_acceptor.set_option(asio::socket_base::reuse_address(true),ec);
+                }
+                if(!ec) {
+                    m_acceptor.bind(endpoint,ec);
+                }
+                if(!ec) {
+                    m_acceptor.listen(asio::socket_base::max_connections,ec);
+                }
+                if(ec) {
+                    m_acceptor.close(ec);
+                    return false;
+                }
+                return true;
+            }
+
+            typename Protocol::endpoint GetEndpoint() const
+            {
+                asio::error_code ec;
+                return m_acceptor.local_endpoint(ec);
+            }
+
+            void SetUnlinkPath(std::string path)
+            {
+                m_unlink_path = std::move(path);
+            }
+
+            void Accept() override
+            {
+                auto session = make_shared<Session<Protocol>>(
+                            m_loop,m_request_timeout);
+
+                auto self = this->shared_from_this();
+                m_acceptor.async_accept(
+                            session->GetSocket(),
+                            m_loop.Wrap([self,session](asio::error_code const &ec) {
+                    if(!self->m_acceptor.is_open()) {
+                        return; // closed
+                    }
+
+                    if(ec) {
+                        self->retryAccept();
+                        return;
+                    }
+
+                    session->Start();
+                    self->Accept();
+                }));
+            }
+
+            void Close() override
+            {
+                asio::error_code ignored;
+                m_acceptor.close(ignored);
+                m_retry_timer.cancel(ignored);
+            }
+
+        private:
+            void retryAccept()
+            {
+                auto self = this->shared_from_this();
+                m_retry_timer.expires_from_now(k_accept_retry_delay);
+                m_retry_timer.async_wait(
+                            m_loop.Wrap([self](asio::error_code const &ec) {
+                    if(!ec && self->m_acceptor.is_open()) {
+                        self->Accept();
+                    }
+                }));
+            }
+
+            Loop const m_loop;
+            typename Protocol::acceptor m_acceptor;
+            asio::steady_timer m_retry_timer;
+            Milliseconds const m_request_timeout;
+            std::string m_unlink_path;
+        };
+    }
+
+    // ============================================================= //
+
+    MetricsExporter::MetricsExporter(ks::Object::Key const &key,
+                                     shared_ptr<EventLoop> const &event_loop,
+                                     Options options) :
+        ks::Object(key,event_loop),
+        m_options(std::move(options)),
+        m_port(0)
+    {
+        // empty
+    }
+
+    void MetricsExporter::Init(ks::Object::Key const &,
+                               shared_ptr<MetricsExporter> const &)
+    {
+        Loop const loop{GetEventLoop().get(),GetId()};
+
+        if(!m_options.unix_socket_path.empty()) {
+            #ifdef KS_ENV_POSIX
+            using Protocol = asio::local::stream_protocol;
+
+            if(RemoveStaleSocket(m_options.unix_socket_path)) {
+                auto server = make_shared<Acceptor<Protocol>>(
+                            loop,m_options.request_timeout);
+
+                if(server->Listen(Protocol::endpoint(m_options.unix_socket_path),false)) {
+                    server->SetUnlinkPath(m_options.unix_socket_path);
+                    m_server = server;
+                }
+            }
+            #endif
+        }
+        else {
+            using Protocol = asio::ip::tcp;
+
+            asio::error_code ec;
+            asio::ip::address const address =
+                    asio::ip::address::from_string(m_options.address,ec);
+
+            if(!ec) {
+                auto server = make_shared<Acceptor<Protocol>>(
+                            loop,m_options.request_timeout);
+
+                if(server->Listen(Protocol::endpoint(address,m_options.port),true)) {
+                    m_port = server->GetEndpoint().port();
+                    m_server = server;
+                }
+            }
+        }
+
+        if(m_server) {
+            // Nothing else uses the acceptor yet, so the
+            // first accept can be started from here
+            m_server->Accept();
+        }
+    }
+
+    MetricsExporter::~MetricsExporter()
+    {
+        if(!m_server) {
+            return;
+        }
+
+        // The acceptor is closed on the loop's thread, where
+        // its handlers run; if the loop never runs again it's
+        // closed with the loop's asio service
+        shared_ptr<exporter_detail::Server> server = m_server;
+        GetEventLoop()->PostCallback(
+                    [server]() {
+            server->Close();
+        });
+    }
+
+    bool MetricsExporter::GetValid() const
+    {
+        return (m_server != nullptr);
+    }
+
+    u16 MetricsExporter::GetPort() const
+    {
+        return m_port;
+    }
+
+    // ============================================================= //
+
+} // ks
@@ -0,0 +1,112 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef KS_METRICS_EXPORTER_HPP
+#define KS_METRICS_EXPORTER_HPP
+
+#include <string>
+
+#include <ks/KsObject.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // * Returns every registered metric (see metrics::Register*),
+    //   the stats of each EventLoop, the memory accounting and
+    //   the lock site stats in the Prometheus text exposition
+    //   format (version 0.0.4)
+    // * everything is read from snapshots and atomic counters;
+    //   no EventLoop is waited on
+    std::string RenderPrometheusMetrics();
+
+    namespace exporter_detail
+    {
+        class Server;
+    }
+
+    // ============================================================= //
+
+    // MetricsExporter
+    // * serves RenderPrometheusMetrics over HTTP for Prometheus
+    //   to scrape, ie:
+    //   curl http://127.0.0.1:9464/metrics
+    // * scrapes are handled on the exporter's EventLoop, and are
+    //   counted, traced and watched like the loop's other
+    //   handlers; give it a loop of its own to keep rendering
+    //   off the loops it reports on
+    // * each connection serves a single request and is closed
+    class MetricsExporter : public ks::Object
+    {
+    public:
+        using base_type = ks::Object;
+
+        struct Options
+        {
+            Options() :
+                address("127.0.0.1"),
+                port(9464),
+                request_timeout(5000)
+            {
+                // empty
+            }
+
+            // TCP address and port to listen on; a port of 0
+            // picks any free port (see GetPort)
+            std::string address;
+            u16 port;
+
+            // * if set, listens on a Unix socket at this path
+            //   instead of TCP; a stale socket at the path is
+            //   replaced, but anything else there is left alone
+            //   and the exporter isn't valid
+            // * POSIX only
+            std::string unix_socket_path;
+
+            // connections that don't send a complete request
+            // within this time are closed
+            Milliseconds request_timeout;
+        };
+
+        MetricsExporter(ks::Object::Key const &key,
+                        shared_ptr<EventLoop> const &event_loop,
+                        Options options=Options());
+
+        void Init(ks::Object::Key const &,
+                  shared_ptr<MetricsExporter> const &);
+
+        ~MetricsExporter();
+
+        // * Returns false if the socket couldn't be opened
+        //   (ie the port is in use)
+        bool GetValid() const;
+
+        // * Returns the TCP port being listened on, or 0
+        //   for a Unix socket
+        u16 GetPort() const;
+
+    private:
+        Options const m_options;
+        shared_ptr<exporter_detail::Server> m_server;
+        u16 m_port;
+    };
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_METRICS_EXPORTER_HPP
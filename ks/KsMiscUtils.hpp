@@ -17,9 +17,11 @@
 #ifndef KS_MISC_UTILS_HPP
 #define KS_MISC_UTILS_HPP
 
+#include <cctype>
 #include <fstream>
 
 #include <ks/KsGlobal.hpp>
+#include <ks/KsMappedFile.hpp>
 
 namespace ks
 {
@@ -38,14 +40,37 @@ namespace ks
     template<typename N>
     std::string ConvNumberToString(N const &num)
     {
-        std::ostringstream ss;
-        ss << num;
-        return ss.str();
+        return ToString(num);
+    }
+
+    // * Reads a number from the start of @str the same way
+    //   std::istream would: leading whitespace is skipped and
+    //   anything after the number is ignored
+    // * Arithmetic types are parsed without a stream
+    //   (see ParseNumber)
+    template<typename N>
+    typename std::enable_if<std::is_arithmetic<N>::value,N>::type
+    ConvStringToNumber(std::string const &str,
+                       bool * ok)
+    {
+        char const * first = str.data();
+        char const * last = first+str.size();
+        while(first != last && std::isspace(static_cast<unsigned char>(*first))) {
+            ++first;
+        }
+
+        N num = N();
+        bool const conv_ok = (ParseNumber(first,last,num) != first);
+        if(ok != NULL) {
+            *ok = conv_ok;
+        }
+        return num;
     }
 
     template<typename N>
-    N ConvStringToNumber(std::string const &str,
-                         bool * ok)
+    typename std::enable_if<!std::is_arithmetic<N>::value,N>::type
+    ConvStringToNumber(std::string const &str,
+                       bool * ok)
     {
         N num;
         std::istringstream ss(str);
@@ -72,27 +97,17 @@ namespace ks
         return ss.str();
     }
 
+    // * Reads the whole file at @file_path into @str
+    // * see MappedFile to read a file without copying it
     inline bool ReadFileIntoString(std::string const &file_path,
                                    std::string &str)
     {
-        std::ifstream ifs(file_path.c_str());
-        if(!(ifs.good())) {
-            // Not really clear if there's a robust
-            // way to check if a file exists in C++
-            ifs.close();
+        MappedFile file(file_path,MappedFile::Advice::Sequential);
+        if(!file.GetValid()) {
             return false;
         }
 
-        // ref:
-        // http://stackoverflow.com/questions/...
-        // ...2602013/read-whole-ascii-file-into-c-stdstring
-
-        str.clear();
-        // @1 returns an iterator to the beginning of @ifs
-        // @2 returns an EOS iterator
-        str = std::string((std::istreambuf_iterator<char>(ifs) ),   // @1
-                          (std::istreambuf_iterator<char>()    ));  // @2
-        ifs.close();
+        str.assign(file.data(),file.size());
         return true;
     }
 }
@@ -0,0 +1,115 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <map>
+
+#include <ks/KsMutex.hpp>
+
+namespace ks
+{
+    namespace mutex_detail
+    {
+        namespace
+        {
+            struct LockSiteRegistry
+            {
+                std::mutex mutex;
+                std::map<std::string,LockSite*> list_sites;
+            };
+
+            LockSiteRegistry & GetRegistry()
+            {
+                // Leaked so sites outlive static destruction
+                static LockSiteRegistry * registry = new LockSiteRegistry();
+                return *registry;
+            }
+        }
+
+        LockSite::LockSite(std::string name) :
+            name(std::move(name))
+        {
+            // empty
+        }
+
+        LockSite & GetLockSite(char const * name)
+        {
+            LockSiteRegistry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            auto it = registry.list_sites.find(name);
+            if(it == registry.list_sites.end()) {
+                it = registry.list_sites.emplace(
+                            name,new LockSite(name)).first;
+            }
+            return *(it->second);
+        }
+    }
+
+    // ============================================================= //
+
+    std::vector<LockSiteStats> GetLockSiteStats()
+    {
+        using namespace mutex_detail;
+
+        std::vector<LockSiteStats> list_stats;
+
+        {
+            LockSiteRegistry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            for(auto const &site_it : registry.list_sites) {
+                LockSite const &site = *(site_it.second);
+
+                LockSiteStats stats;
+                stats.name = site.name;
+                stats.acquisitions = site.acquisitions.Get();
+                stats.contended = site.contended.Get();
+                stats.wait_ns = site.wait_ns.GetSnapshot();
+                stats.hold_ns = site.hold_ns.GetSnapshot();
+                list_stats.push_back(std::move(stats));
+            }
+        }
+
+        std::stable_sort(
+                    list_stats.begin(),
+                    list_stats.end(),
+                    [](LockSiteStats const &a, LockSiteStats const &b) {
+                        return a.wait_ns.sum > b.wait_ns.sum;
+                    });
+
+        return list_stats;
+    }
+
+    void ResetLockSiteStats()
+    {
+        using namespace mutex_detail;
+
+        LockSiteRegistry &registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        for(auto const &site_it : registry.list_sites) {
+            LockSite &site = *(site_it.second);
+            site.acquisitions.Reset();
+            site.contended.Reset();
+            site.wait_ns.Reset();
+            site.hold_ns.Reset();
+        }
+    }
+
+    // ============================================================= //
+
+} // ks
@@ -0,0 +1,191 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_MUTEX_HPP
+#define KS_MUTEX_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ks/KsConfig.hpp>
+#include <ks/KsGlobal.hpp>
+#include <ks/KsMetrics.hpp>
+
+#ifdef KS_PROFILE_LOCKS
+#include <ks/KsFastClock.hpp>
+#endif
+
+namespace ks
+{
+    // ============================================================= //
+
+    // Lock profiling
+    // * ks's own mutexes are Mutex and RecursiveMutex, each
+    //   named after its lock site (ie "EventLoop"); mutexes
+    //   that share a name (ie every Signal's) share a site
+    // * building with KS_PROFILE_LOCKS defined makes them
+    //   ProfiledMutexes, which count acquisitions and contended
+    //   acquisitions and record wait and hold times per site.
+    //   Otherwise they're plain std mutexes and the name is
+    //   dropped, so there's no cost
+    // * lock a Mutex with MutexLock or std::lock_guard<Mutex>,
+    //   and wait on it with a ConditionVariable
+    // * ProfiledMutexes are initialized dynamically, so static
+    //   ones can't be used by other static initializers
+
+    // LockSiteStats
+    struct LockSiteStats
+    {
+        std::string name;
+        u64 acquisitions;
+
+        // acquisitions that had to wait for another thread
+        u64 contended;
+
+        // time spent waiting for contended acquisitions
+        // and time the lock was held, in ns
+        metrics::HistogramSnapshot wait_ns;
+        metrics::HistogramSnapshot hold_ns;
+    };
+
+    // * Returns the stats of every lock site, most total
+    //   wait time first; empty unless KS_PROFILE_LOCKS is
+    //   defined
+    std::vector<LockSiteStats> GetLockSiteStats();
+
+    // * Zeroes every lock site's stats
+    void ResetLockSiteStats();
+
+    namespace mutex_detail
+    {
+        // LockSite
+        // * created on first use and never destroyed, so
+        //   mutexes can be used during static destruction
+        struct LockSite
+        {
+            LockSite(std::string name);
+
+            std::string const name;
+            metrics::Counter acquisitions;
+            metrics::Counter contended;
+            metrics::Histogram wait_ns;
+            metrics::Histogram hold_ns;
+        };
+
+        LockSite & GetLockSite(char const * name);
+
+        // NamedMutex
+        // * a std mutex that takes (and ignores) a site name,
+        //   so code reads the same with profiling off
+        template<typename MutexType>
+        class NamedMutex : public MutexType
+        {
+        public:
+            // constexpr so that static mutexes are
+            // constant initialized, like std::mutex
+            constexpr explicit NamedMutex(char const *)
+            {
+                // empty
+            }
+        };
+    }
+
+    #ifdef KS_PROFILE_LOCKS
+    // ProfiledMutex
+    // * wraps a std mutex; satisfies Lockable
+    // * an uncontended lock costs a try_lock and two clock
+    //   reads more than the plain mutex; hold times are
+    //   recorded when a recursive mutex is fully unlocked
+    template<typename MutexType>
+    class ProfiledMutex
+    {
+    public:
+        explicit ProfiledMutex(char const * site) :
+            m_site(mutex_detail::GetLockSite(site)),
+            m_depth(0),
+            m_lock_ns(0)
+        {
+            // empty
+        }
+
+        ProfiledMutex(ProfiledMutex const &) = delete;
+        ProfiledMutex & operator = (ProfiledMutex const &) = delete;
+
+        void lock()
+        {
+            if(!m_mutex.try_lock()) {
+                s64 const begin_ns = FastClock::GetPreciseNs();
+                m_mutex.lock();
+
+                m_site.contended.Add();
+                m_site.wait_ns.Record(static_cast<u64>(
+                            FastClock::GetPreciseNs()-begin_ns));
+            }
+            onLocked();
+        }
+
+        bool try_lock()
+        {
+            if(!m_mutex.try_lock()) {
+                return false;
+            }
+            onLocked();
+            return true;
+        }
+
+        void unlock()
+        {
+            // Only the owner touches m_depth and m_lock_ns
+            if(--m_depth == 0) {
+                m_site.hold_ns.Record(static_cast<u64>(
+                            FastClock::GetPreciseNs()-m_lock_ns));
+            }
+            m_mutex.unlock();
+        }
+
+    private:
+        void onLocked()
+        {
+            m_site.acquisitions.Add();
+            if(m_depth++ == 0) {
+                m_lock_ns = FastClock::GetPreciseNs();
+            }
+        }
+
+        MutexType m_mutex;
+        mutex_detail::LockSite & m_site;
+        uint m_depth;
+        s64 m_lock_ns;
+    };
+
+    using Mutex = ProfiledMutex<std::mutex>;
+    using RecursiveMutex = ProfiledMutex<std::recursive_mutex>;
+    using MutexLock = std::unique_lock<Mutex>;
+    using ConditionVariable = std::condition_variable_any;
+    #else
+    using Mutex = mutex_detail::NamedMutex<std::mutex>;
+    using RecursiveMutex = mutex_detail::NamedMutex<std::recursive_mutex>;
+    using MutexLock = std::unique_lock<std::mutex>;
+    using ConditionVariable = std::condition_variable;
+    #endif
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_MUTEX_HPP
@@ -15,11 +15,12 @@
 */
 
 #include <ks/KsObject.hpp>
+#include <ks/KsIntrospect.hpp>
 #include <ks/KsLog.hpp>
 
 namespace ks
 {
-    std::mutex Object::s_id_mutex;
+    Mutex Object::s_id_mutex("Object::genId");
 
     // Start at one so that an Id of 0
     // can be considered invalid / unset
@@ -27,7 +28,7 @@ namespace ks
 
     Id Object::genId()
     {
-        std::lock_guard<std::mutex> lock(s_id_mutex);
+        std::lock_guard<Mutex> lock(s_id_mutex);
         Id id = s_id_counter;
         s_id_counter++;
         return id;
@@ -37,7 +38,8 @@ namespace ks
 
     Object::Object(Key const &,shared_ptr<EventLoop> const &event_loop) :
         m_id(genId()),
-        m_event_loop(event_loop)
+        m_event_loop(event_loop),
+        m_type_counter(nullptr)
     {
 
     }
@@ -49,7 +51,23 @@ namespace ks
 
     Object::~Object()
     {
+        if(m_type_counter) {
+            m_type_counter->Remove();
+            if(m_event_loop) {
+                m_event_loop->GetObjectRegistry().RemoveObject(m_id);
+            }
+        }
+    }
+
+    void Object::onCreated(memory_detail::TypeCounter &type_counter)
+    {
+        type_counter.Add();
+        m_type_counter = &type_counter;
 
+        if(m_event_loop) {
+            m_event_loop->GetObjectRegistry().AddObject(
+                        m_id,type_counter.GetTypeName().c_str());
+        }
     }
 
     Id Object::GetId() const
@@ -18,12 +18,12 @@
 #define KS_OBJECT_HPP
 
 #include <vector>
-#include <mutex>
 #include <atomic>
 #include <typeindex>
 
 #include <ks/KsGlobal.hpp>
 #include <ks/KsEventLoop.hpp>
+#include <ks/KsMemoryStats.hpp>
 
 namespace ks
 {
@@ -135,6 +135,11 @@ namespace ks
         shared_ptr<EventLoop> const & GetEventLoop() const;
 
     private:
+        template<typename T, typename... Args>
+        friend std::shared_ptr<T> MakeObject(Args&& ...args);
+
+        void onCreated(memory_detail::TypeCounter &type_counter);
+
         Object(Object const &other) = delete;
         Object(Object &&other) = delete;
         Object & operator = (Object const &) = delete;
@@ -144,7 +149,10 @@ namespace ks
 
         shared_ptr<EventLoop> m_event_loop;
 
-        static std::mutex s_id_mutex;
+        // counts the Object's concrete type; set by MakeObject
+        memory_detail::TypeCounter * m_type_counter;
+
+        static Mutex s_id_mutex;
         static Id s_id_counter;
         static Id genId();
     };
@@ -180,6 +188,16 @@ namespace ks
                 std::make_shared<T>(
                     key,std::forward<Args>(args)...);
 
+        // count live Objects by concrete type and list
+        // them on their EventLoop
+        static memory_detail::TypeCounter &type_counter =
+                memory_detail::GetTypeCounter(
+                    memory_detail::TypeCounter::Category::Object,
+                    typeid(T),
+                    sizeof(T));
+
+        static_cast<Object*>(object.get())->onCreated(type_counter);
+
         // initialize T
         init_object(key,object);
 
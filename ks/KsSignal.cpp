@@ -23,11 +23,11 @@ namespace ks
         // Start at one so that an Id of 0
 		// can be considered invalid / unset
         Id g_cid_counter(1);
-        std::mutex g_cid_mutex;
+        Mutex g_cid_mutex("Signal::genId");
 		
 		Id genId()
 		{
-            std::lock_guard<std::mutex> lock(g_cid_mutex);
+            std::lock_guard<Mutex> lock(g_cid_mutex);
             Id id = g_cid_counter;
             g_cid_counter++;
             return id;
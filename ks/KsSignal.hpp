@@ -25,7 +25,10 @@
 #include <algorithm>
 
 #include <ks/KsEvent.hpp>
+#include <ks/KsIntrospect.hpp>
+#include <ks/KsMutex.hpp>
 #include <ks/KsObject.hpp>
+#include <ks/KsTrace.hpp>
 
 namespace ks
 {
@@ -38,11 +41,20 @@ namespace ks
         Blocking
     };
 
+    inline char const * GetConnectionTypeName(ConnectionType type)
+    {
+        switch(type) {
+            case ConnectionType::Direct: return "Direct";
+            case ConnectionType::Queued: return "Queued";
+            default: return "Blocking";
+        }
+    }
+
     namespace signal_detail
     {
         // connection id
         extern Id g_cid_counter;
-        extern std::mutex g_cid_mutex;
+        extern Mutex g_cid_mutex;
 
         Id genId();
 
@@ -63,12 +75,13 @@ namespace ks
     class DefaultSignalMutex final : public SignalMutex
     {
     public:
+        DefaultSignalMutex() : m_mutex("Signal") { }
         ~DefaultSignalMutex() { }
         void lock() { m_mutex.lock(); }
         void unlock() { m_mutex.unlock(); }
 
     private:
-        std::mutex m_mutex;
+        Mutex m_mutex;
     };
 
     class DummySignalMutex final : public SignalMutex
@@ -130,7 +143,15 @@ namespace ks
         {}
 
         ~Signal()
-        {}
+        {
+            for(auto const &connection : m_list_managed_connections) {
+                unregisterConnection(connection);
+            }
+
+            getConnectionCounter().Remove(
+                        m_list_managed_connections.size()+
+                        m_list_unmanaged_connections.size());
+        }
 
         template<typename FunctionType>
         Id Connect(FunctionType fn,
@@ -154,6 +175,8 @@ namespace ks
                                     }
                                 }
                             });
+
+                registerConnection(id,type,*context);
             }
             else {
                 m_list_unmanaged_connections.emplace_back(
@@ -162,6 +185,7 @@ namespace ks
                             });
             }
 
+            getConnectionCounter().Add();
             return id;
         }
 
@@ -191,6 +215,8 @@ namespace ks
                                     }
                                 }
                             });
+
+                registerConnection(id,type,*context);
             }
             else {
                 m_list_unmanaged_connections.emplace_back(
@@ -202,6 +228,7 @@ namespace ks
                             });
             }
 
+            getConnectionCounter().Add();
             return id;
         }
 
@@ -233,6 +260,8 @@ namespace ks
                                 }
                         }});
 
+            registerConnection(id,type,*receiver);
+            getConnectionCounter().Add();
             return id;
         }
 
@@ -243,7 +272,9 @@ namespace ks
             auto managed_cnxn_it = findManagedConnection(connection_id);
             if(managed_cnxn_it != m_list_managed_connections.end())
             {
+                unregisterConnection(*managed_cnxn_it);
                 m_list_managed_connections.erase(managed_cnxn_it);
+                getConnectionCounter().Remove();
                 return true;
             }
 
@@ -251,6 +282,7 @@ namespace ks
             if(unmanaged_cnxn_it != m_list_unmanaged_connections.end())
             {
                 m_list_unmanaged_connections.erase(unmanaged_cnxn_it);
+                getConnectionCounter().Remove();
                 return true;
             }
 
@@ -292,7 +324,9 @@ namespace ks
                 {
                     // Post the slot to the receivers thread
                     unique_ptr<Event> event(new SlotEvent(
-                        std::bind(connection.fn,args...)));
+                        std::bind(connection.fn,args...),
+                        context->GetId(),
+                        this));
 
                     context->GetEventLoop()->PostEvent(std::move(event));
                 }
@@ -349,7 +383,20 @@ namespace ks
                             std::bind(connection.fn,args...),
                             &invoked,
                             &invoked_mutex,
-                            &invoked_cv));
+                            &invoked_cv,
+                            context->GetId(),
+                            this));
+
+                        // The wait is traced on this thread, around
+                        // the post that links it to the slot
+                        Id const evl_id = context->GetEventLoop()->GetId();
+                        bool const traced = trace_detail::TraceSample();
+                        if(traced) {
+                            trace_detail::Record(
+                                        trace_detail::Kind::BlockingBegin,
+                                        evl_id,LoopHandlerType::Event,
+                                        context->GetId(),0,false,this);
+                        }
 
                         std::unique_lock<std::mutex> invoked_lock(invoked_mutex);
                         context->GetEventLoop()->PostEvent(std::move(event));
@@ -357,6 +404,13 @@ namespace ks
                         while(!invoked) {
                             invoked_cv.wait(invoked_lock);
                         }
+
+                        if(traced) {
+                            trace_detail::Record(
+                                        trace_detail::Kind::BlockingEnd,
+                                        evl_id,LoopHandlerType::Event,
+                                        context->GetId(),0);
+                        }
                     }
                 }
             }
@@ -370,6 +424,9 @@ namespace ks
                                 return (connection.context.expired());
                             });
 
+                getConnectionCounter().Remove(
+                            m_list_managed_connections.end()-remove_begin);
+
                 m_list_managed_connections.erase(
                             remove_begin,
                             m_list_managed_connections.end());
@@ -401,6 +458,42 @@ namespace ks
         }
 
     private:
+        // * Counts the connections of this Signal type,
+        //   see KsMemoryStats.hpp
+        static memory_detail::TypeCounter & getConnectionCounter()
+        {
+            static memory_detail::TypeCounter &counter =
+                    memory_detail::GetTypeCounter(
+                        memory_detail::TypeCounter::Category::Connection,
+                        typeid(Signal),
+                        sizeof(ManagedConnection));
+            return counter;
+        }
+
+        // * Lists the connection on @receiver's EventLoop,
+        //   see KsIntrospect.hpp
+        void registerConnection(Id id,
+                                ConnectionType type,
+                                Object const &receiver)
+        {
+            introspect_detail::AddConnection(
+                        receiver,
+                        introspect_detail::ObjectRegistry::ConnectionRecord{
+                            id,
+                            getConnectionCounter().GetTypeName().c_str(),
+                            this,
+                            GetConnectionTypeName(type)});
+        }
+
+        void unregisterConnection(ManagedConnection const &connection)
+        {
+            // An expired receiver's record is already gone
+            auto context = connection.context.lock();
+            if(context) {
+                introspect_detail::RemoveConnection(*context,connection.id);
+            }
+        }
+
         void directInvoke(Args... args,std::function<void(Args&...)> &fn)
         {
             fn(args...);
@@ -0,0 +1,516 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include <ks/KsFastClock.hpp>
+#include <ks/KsMiscUtils.hpp>
+#include <ks/KsTrace.hpp>
+
+#if defined(KS_ENV_LINUX) || defined(KS_ENV_ANDROID)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ks
+{
+    namespace trace_detail
+    {
+        std::atomic<bool> g_enabled(false);
+        std::atomic<uint> g_sample_interval(1);
+
+        // Slot
+        // * one record; seq works like the flight recorder's,
+        //   so an export running alongside the writer can skip
+        //   slots that are being overwritten
+        // * thread_id is copied from the ring, since a reused
+        //   ring still holds records from its previous thread
+        struct Slot
+        {
+            std::atomic<u64> seq; // 2*index+1 while writing, 2*index+2 once done
+            s64 time_ns;
+            s64 thread_id;
+            u64 flow_id;
+            Id loop_id;
+            Id tag;
+            void const * signal;
+            u8 kind;
+            u8 type;
+            u8 failed;
+        };
+
+        // Ring
+        // * written only by the thread that owns it
+        struct Ring
+        {
+            Ring(uint id, size_t size) :
+                id(id),
+                thread_id(id),
+                mask(size-1),
+                list_slots(new Slot[size]),
+                head(0),
+                first(0),
+                flow_count(0),
+                in_use(true)
+            {
+                for(size_t i=0; i < size; i++) {
+                    list_slots[i].seq.store(0,std::memory_order_relaxed);
+                }
+            }
+
+            uint const id;
+            s64 thread_id; // set by the owner when it acquires the ring
+            size_t const mask;
+            std::unique_ptr<Slot[]> list_slots;
+            std::atomic<u64> head; // records written
+            u64 first; // first record kept, guarded by the export mutex
+            u64 flow_count; // written by the owner only
+            std::atomic<bool> in_use;
+        };
+
+        // Tracer
+        // * like the flight recorder, rings outlive their threads
+        //   and are reused by new threads
+        struct Tracer
+        {
+            static Tracer & Get()
+            {
+                static Tracer tracer;
+                return tracer;
+            }
+
+            Tracer() :
+                ring_size(16384)
+            {
+                // empty
+            }
+
+            Ring * acquireRing()
+            {
+                std::lock_guard<std::mutex> lock(rings_mutex);
+                for(auto &ring : list_rings) {
+                    bool expected = false;
+                    if(ring->in_use.compare_exchange_strong(expected,true)) {
+                        return ring.get();
+                    }
+                }
+
+                list_rings.emplace_back(
+                            new Ring(static_cast<uint>(list_rings.size()+1),
+                                     ring_size));
+
+                return list_rings.back().get();
+            }
+
+            // * Returns the rings; they're never destroyed,
+            //   so they can be used after the lock
+            std::vector<Ring*> getRings()
+            {
+                std::lock_guard<std::mutex> lock(rings_mutex);
+
+                std::vector<Ring*> rings;
+                rings.reserve(list_rings.size());
+                for(auto &ring : list_rings) {
+                    rings.push_back(ring.get());
+                }
+                return rings;
+            }
+
+            std::mutex rings_mutex;
+            std::vector<unique_ptr<Ring>> list_rings;
+            size_t ring_size;
+
+            std::mutex export_mutex;
+        };
+
+        // RingHandle
+        // * returns the ring to the tracer on thread exit
+        struct RingHandle
+        {
+            RingHandle() :
+                ring(nullptr)
+            {}
+
+            ~RingHandle()
+            {
+                if(ring) {
+                    ring->in_use.store(false);
+                }
+            }
+
+            Ring * ring;
+        };
+
+        thread_local RingHandle t_ring_handle;
+        thread_local uint t_sample_count = 0;
+
+        // * Returns the calling thread's OS thread id, or
+        //   @ring's id where there isn't one
+        s64 GetThreadId(Ring const &ring)
+        {
+        #if defined(KS_ENV_LINUX) || defined(KS_ENV_ANDROID)
+            (void)ring;
+            return static_cast<s64>(syscall(SYS_gettid));
+        #else
+            return ring.id;
+        #endif
+        }
+
+        Ring & GetRing()
+        {
+            Ring * ring = t_ring_handle.ring;
+            if(ring == nullptr) {
+                ring = Tracer::Get().acquireRing();
+                ring->thread_id = GetThreadId(*ring);
+                t_ring_handle.ring = ring;
+            }
+            return *ring;
+        }
+
+        void Write(Ring &ring,
+                   Kind kind,
+                   Id loop_id,
+                   LoopHandlerType type,
+                   Id tag,
+                   void const * signal,
+                   u64 flow_id,
+                   bool failed)
+        {
+            u64 const index = ring.head.load(std::memory_order_relaxed);
+
+            Slot &slot = ring.list_slots[index & ring.mask];
+            slot.seq.store(2*index+1,std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            slot.time_ns = FastClock::GetPreciseNs();
+            slot.thread_id = ring.thread_id;
+            slot.flow_id = flow_id;
+            slot.loop_id = loop_id;
+            slot.tag = tag;
+            slot.signal = signal;
+            slot.kind = static_cast<u8>(kind);
+            slot.type = static_cast<u8>(type);
+            slot.failed = failed ? 1 : 0;
+
+            slot.seq.store(2*index+2,std::memory_order_release);
+            ring.head.store(index+1,std::memory_order_release);
+        }
+
+        // * Reads the slot for record @index into @copy
+        // * Returns false if the slot was overwritten
+        //   or is being written
+        bool ReadSlot(Ring const &ring, u64 index, Slot &copy)
+        {
+            Slot const &slot = ring.list_slots[index & ring.mask];
+
+            u64 const seq = slot.seq.load(std::memory_order_acquire);
+            if(seq != 2*index+2) {
+                return false;
+            }
+
+            copy.time_ns = slot.time_ns;
+            copy.thread_id = slot.thread_id;
+            copy.flow_id = slot.flow_id;
+            copy.loop_id = slot.loop_id;
+            copy.tag = slot.tag;
+            copy.signal = slot.signal;
+            copy.kind = slot.kind;
+            copy.type = slot.type;
+            copy.failed = slot.failed;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return (slot.seq.load(std::memory_order_relaxed) == seq);
+        }
+
+        bool Sample()
+        {
+            uint const interval = g_sample_interval.load(std::memory_order_relaxed);
+            if(interval <= 1) {
+                return true;
+            }
+
+            t_sample_count++;
+            if(t_sample_count < interval) {
+                return false;
+            }
+
+            t_sample_count = 0;
+            return true;
+        }
+
+        u64 RecordStart(Kind kind,
+                        Id loop_id,
+                        LoopHandlerType type,
+                        Id tag,
+                        void const * signal)
+        {
+            if(!Sample()) {
+                return 0;
+            }
+
+            // Flow ids are made unique across threads by
+            // the ring id, so no shared counter is needed
+            Ring &ring = GetRing();
+            ring.flow_count++;
+            u64 const flow_id = (static_cast<u64>(ring.id) << 40) |
+                    (ring.flow_count & ((u64(1) << 40)-1));
+
+            Write(ring,kind,loop_id,type,tag,signal,flow_id,false);
+            return flow_id;
+        }
+
+        void Record(Kind kind,
+                    Id loop_id,
+                    LoopHandlerType type,
+                    Id tag,
+                    u64 flow_id,
+                    bool failed,
+                    void const * signal)
+        {
+            Write(GetRing(),kind,loop_id,type,tag,signal,flow_id,failed);
+        }
+
+        // * Appends the fields shared by every trace event
+        void AppendEventBegin(std::string &json,
+                              char const * phase,
+                              Slot const &slot)
+        {
+            json.append(",\n{\"ph\":\"");
+            json.append(phase);
+            json.append("\",\"cat\":\"ks\",\"pid\":1,\"tid\":");
+            AppendNumber(json,slot.thread_id);
+
+            // Timestamps are in microseconds
+            s64 const time_ns = slot.time_ns;
+            json.append(",\"ts\":");
+            AppendNumber(json,time_ns/1000);
+            json.push_back('.');
+
+            s64 const ns = time_ns%1000;
+            if(ns < 100) {
+                json.push_back('0');
+            }
+            if(ns < 10) {
+                json.push_back('0');
+            }
+            AppendNumber(json,ns);
+        }
+
+        void AppendArgs(std::string &json, Slot const &slot)
+        {
+            json.append(",\"args\":{\"loop\":");
+            AppendNumber(json,slot.loop_id);
+            json.append(",\"tag\":");
+            AppendNumber(json,slot.tag);
+            if(slot.signal) {
+                json.append(",\"signal\":\"");
+                json.append(ConvPointerToString(slot.signal));
+                json.push_back('"');
+            }
+            json.append("}}");
+        }
+
+        void AppendFlow(std::string &json,
+                        char const * phase,
+                        Slot const &slot)
+        {
+            AppendEventBegin(json,phase,slot);
+            json.append(",\"name\":\"post\",\"id\":\"");
+            AppendNumber(json,slot.flow_id);
+            json.push_back('"');
+            if(phase[0] == 'f') {
+                // Binds to the handler slice that starts here
+                json.append(",\"bp\":\"e\"");
+            }
+            json.push_back('}');
+        }
+
+        // * Async spans are matched by name and id across
+        //   threads, since a timer can be started on any thread
+        void AppendAsync(std::string &json,
+                         char const * phase,
+                         Slot const &slot,
+                         char const * type_name)
+        {
+            AppendEventBegin(json,phase,slot);
+            json.append(",\"name\":\"");
+            json.append(type_name);
+            json.append(" wait\",\"id\":\"");
+            AppendNumber(json,slot.flow_id);
+            json.push_back('"');
+        }
+
+        void AppendRecord(std::string &json, Slot const &slot)
+        {
+            char const * type_name =
+                    GetLoopHandlerTypeName(static_cast<LoopHandlerType>(slot.type));
+
+            switch(static_cast<Kind>(slot.kind)) {
+                case Kind::Post: {
+                    // A zero length slice for the flow to start from
+                    AppendEventBegin(json,"X",slot);
+                    json.append(",\"dur\":0,\"name\":\"post ");
+                    json.append(type_name);
+                    json.push_back('"');
+                    AppendArgs(json,slot);
+                    AppendFlow(json,"s",slot);
+                    break;
+                }
+                case Kind::Begin: {
+                    AppendEventBegin(json,"B",slot);
+                    json.append(",\"name\":\"");
+                    json.append(type_name);
+                    json.push_back('"');
+                    AppendArgs(json,slot);
+                    if(slot.flow_id != 0) {
+                        AppendFlow(json,"f",slot);
+                    }
+                    break;
+                }
+                case Kind::BlockingBegin: {
+                    AppendEventBegin(json,"B",slot);
+                    json.append(",\"name\":\"Blocking wait\"");
+                    AppendArgs(json,slot);
+                    break;
+                }
+                case Kind::AsyncBegin: {
+                    AppendAsync(json,"b",slot,type_name);
+                    AppendArgs(json,slot);
+                    break;
+                }
+                case Kind::AsyncEnd: {
+                    AppendAsync(json,"e",slot,type_name);
+                    json.append(slot.failed ?
+                                    ",\"args\":{\"failed\":true}}" :
+                                    ",\"args\":{\"failed\":false}}");
+                    break;
+                }
+                default: {
+                    // Kind::End, Kind::BlockingEnd
+                    AppendEventBegin(json,"E",slot);
+                    json.push_back('}');
+                    break;
+                }
+            }
+        }
+    }
+
+    // ============================================================= //
+
+    void EnableTracing(uint sample_interval, uint records_per_thread)
+    {
+        using namespace trace_detail;
+        Tracer &tracer = Tracer::Get();
+
+        size_t ring_size = 1;
+        while(ring_size < records_per_thread) {
+            ring_size <<= 1;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(tracer.rings_mutex);
+            tracer.ring_size = ring_size;
+        }
+
+        g_sample_interval.store(std::max(sample_interval,1u));
+        g_enabled.store(true);
+    }
+
+    void DisableTracing()
+    {
+        trace_detail::g_enabled.store(false);
+    }
+
+    void ClearTrace()
+    {
+        using namespace trace_detail;
+        Tracer &tracer = Tracer::Get();
+
+        std::lock_guard<std::mutex> lock(tracer.export_mutex);
+        for(Ring * ring : tracer.getRings()) {
+            ring->first = ring->head.load(std::memory_order_acquire);
+        }
+    }
+
+    uint AppendChromeTrace(std::string &json)
+    {
+        using namespace trace_detail;
+        Tracer &tracer = Tracer::Get();
+
+        std::lock_guard<std::mutex> lock(tracer.export_mutex);
+
+        json.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        json.append("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,"
+                    "\"args\":{\"name\":\"ks\"}}");
+
+        // Lanes are named once per OS thread; a ring
+        // can hold records from more than one
+        std::vector<s64> list_thread_ids;
+
+        uint count = 0;
+        Slot copy;
+        for(Ring * ring : tracer.getRings()) {
+            u64 const head = ring->head.load(std::memory_order_acquire);
+            u64 const size = ring->mask+1;
+            u64 const first = std::max(ring->first,(head > size) ? head-size : 0);
+
+            for(u64 index=first; index < head; index++) {
+                if(!ReadSlot(*ring,index,copy)) {
+                    continue;
+                }
+
+                if(std::find(list_thread_ids.begin(),
+                             list_thread_ids.end(),
+                             copy.thread_id) == list_thread_ids.end()) {
+                    list_thread_ids.push_back(copy.thread_id);
+
+                    json.append(",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":");
+                    AppendNumber(json,copy.thread_id);
+                    json.append(",\"args\":{\"name\":\"thread ");
+                    AppendNumber(json,copy.thread_id);
+                    json.append("\"}}");
+                }
+
+                AppendRecord(json,copy);
+                count++;
+            }
+        }
+
+        json.append("\n]}\n");
+        return count;
+    }
+
+    bool WriteChromeTrace(std::string const &file_path)
+    {
+        std::string json;
+        AppendChromeTrace(json);
+
+        std::FILE * file = std::fopen(file_path.c_str(),"wb");
+        if(file == nullptr) {
+            return false;
+        }
+
+        bool ok = (std::fwrite(json.data(),1,json.size(),file) == json.size());
+        ok = (std::fclose(file) == 0) && ok;
+        return ok;
+    }
+
+    // ============================================================= //
+
+} // ks
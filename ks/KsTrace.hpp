@@ -0,0 +1,151 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TRACE_HPP
+#define KS_TRACE_HPP
+
+#include <atomic>
+#include <string>
+
+#include <ks/KsEventLoop.hpp>
+
+namespace ks
+{
+    // ============================================================= //
+
+    // Event tracing
+    // * records events, tasks and callbacks being posted to and
+    //   handled by EventLoops, timer timeouts and Blocking signal
+    //   waits, for viewing as a timeline in chrome://tracing or
+    //   ui.perfetto.dev
+    // * each post is linked to its handler by a flow arrow, and
+    //   records carry the loop's Id and a tag: the receiving
+    //   Object's Id for a slot, the Timer's Id for a timeout.
+    //   Slot records also carry the address of the emitting
+    //   Signal, to tell apart signals with the same receiver
+    // * the asio operations EventLoop starts for timers and
+    //   descriptors are recorded as async spans from the wait
+    //   being started to its handler being called, including
+    //   waits that are canceled
+    // * records go into a fixed size ring per thread, so only
+    //   the most recent are kept and recording is lock free.
+    //   While tracing is disabled a post costs one relaxed load
+    // * rings are reused by new threads, so each record keeps
+    //   the OS thread id of the thread that wrote it and lanes
+    //   are per OS thread
+    // * tracing can be sampled: only every Nth post, timeout
+    //   and Blocking wait on each thread is recorded
+
+    namespace trace_detail
+    {
+        enum class Kind : u8
+        {
+            Post,
+            Begin,
+            End,
+            BlockingBegin,
+            BlockingEnd,
+            AsyncBegin,
+            AsyncEnd
+        };
+
+        extern std::atomic<bool> g_enabled;
+
+        // * Returns true if the calling thread's next
+        //   post, timeout or wait should be recorded
+        bool Sample();
+
+        // * Records the start of a post (Kind::Post) or an
+        //   async operation (Kind::AsyncBegin)
+        // * Returns the id linking the start to its handler,
+        //   or 0 if it isn't recorded
+        // * @signal is the Signal a slot was emitted from
+        u64 RecordStart(Kind kind,
+                        Id loop_id,
+                        LoopHandlerType type,
+                        Id tag,
+                        void const * signal=nullptr);
+
+        // * @failed marks an async operation that completed
+        //   with an error (ie it was canceled)
+        void Record(Kind kind,
+                    Id loop_id,
+                    LoopHandlerType type,
+                    Id tag,
+                    u64 flow_id,
+                    bool failed=false,
+                    void const * signal=nullptr);
+
+        inline u64 TracePost(Id loop_id,
+                             LoopHandlerType type,
+                             Id tag,
+                             void const * signal=nullptr)
+        {
+            if(!g_enabled.load(std::memory_order_relaxed)) {
+                return 0;
+            }
+            return RecordStart(Kind::Post,loop_id,type,tag,signal);
+        }
+
+        inline u64 TraceAsyncBegin(Id loop_id, LoopHandlerType type, Id tag)
+        {
+            if(!g_enabled.load(std::memory_order_relaxed)) {
+                return 0;
+            }
+            return RecordStart(Kind::AsyncBegin,loop_id,type,tag);
+        }
+
+        // * Returns true if a Blocking wait should be
+        //   recorded
+        inline bool TraceSample()
+        {
+            return g_enabled.load(std::memory_order_relaxed) && Sample();
+        }
+    }
+
+    // * Starts recording
+    // * @sample_interval of N records every Nth post, timeout
+    //   and Blocking wait of each thread
+    // * @records_per_thread is rounded up to a power of two
+    //   and applies to rings created after the call
+    void EnableTracing(uint sample_interval=1,
+                       uint records_per_thread=16384);
+
+    // * Stops recording; existing records are kept
+    void DisableTracing();
+
+    inline bool GetTracingEnabled()
+    {
+        return trace_detail::g_enabled.load(std::memory_order_relaxed);
+    }
+
+    // * Discards all records
+    void ClearTrace();
+
+    // * Appends the records as a Chrome trace event JSON
+    //   document to @json
+    // * Returns the number of records written
+    uint AppendChromeTrace(std::string &json);
+
+    // * Writes the records to @file_path as Chrome trace JSON
+    // * Returns false if the file couldn't be written
+    bool WriteChromeTrace(std::string const &file_path);
+
+    // ============================================================= //
+
+} // ks
+
+#endif // KS_TRACE_HPP
@@ -18,9 +18,42 @@
 #include <catch/catch.hpp>
 
 #include <ks/KsGlobal.hpp>
+#include <ks/KsCompress.hpp>
+#include <ks/KsDelimitedText.hpp>
+#include <ks/KsException.hpp>
+#include <ks/KsEventLoopWatchdog.hpp>
+#include <ks/KsFileStreamReader.hpp>
+#include <ks/KsFileWatcher.hpp>
+#include <ks/KsFormat.hpp>
+#include <ks/KsIntrospect.hpp>
+#include <ks/KsFastClock.hpp>
+#include <ks/KsLog.hpp>
+#include <ks/KsLogBinary.hpp>
+#include <ks/KsLogCategory.hpp>
+#include <ks/KsLogFileSink.hpp>
+#include <ks/KsLogFlightRecorder.hpp>
+#include <ks/KsMappedFile.hpp>
+#include <ks/KsMemoryStats.hpp>
+#include <ks/KsMetrics.hpp>
+#include <ks/KsMetricsExporter.hpp>
+#include <ks/KsLogLimit.hpp>
+#include <ks/KsMiscUtils.hpp>
+#include <ks/KsMutex.hpp>
 #include <ks/KsObject.hpp>
 #include <ks/KsTimer.hpp>
+#include <ks/KsTrace.hpp>
 #include <ks/KsTask.hpp>
+#include <ks/thirdparty/asio/asio.hpp>
+
+#ifdef KS_ENV_POSIX
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef KS_ENV_LINUX
+#include <sys/syscall.h>
+#endif
 
 using namespace ks;
 
@@ -212,6 +245,68 @@ TEST_CASE("EventLoop","[evloop]")
             }
         }
     }
+
+    SECTION("Stats")
+    {
+        for(uint i=0; i < 300; i++) {
+            event_loop->PostCallback([&count,sleep_ms,i]() {
+                count++;
+                if(i == 0) {
+                    std::this_thread::sleep_for(sleep_ms);
+                }
+            });
+        }
+
+        EventLoopStats stats = event_loop->GetStats();
+        REQUIRE(stats.queue_depth == 300);
+        REQUIRE(stats.peak_queue_depth == 300);
+        REQUIRE(stats.events_handled == 0);
+
+        event_loop->Start();
+        event_loop->ProcessEvents();
+        REQUIRE(count == 300);
+
+        stats = event_loop->GetStats();
+        REQUIRE(stats.queue_depth == 0);
+        REQUIRE(stats.peak_queue_depth == 300);
+        REQUIRE(stats.events_handled == 300);
+        REQUIRE(stats.events_per_sec > 0);
+        REQUIRE(stats.wait_ns.count == 300);
+        REQUIRE(stats.handler_ns.count == 300);
+
+        // The first handler slept; the rest queued behind it
+        REQUIRE(stats.handler_ns.max_ns >= 10*1000*1000);
+        REQUIRE(stats.handler_ns.GetPercentileNs(50) < 10*1000*1000);
+        REQUIRE(stats.handler_ns.GetPercentileNs(100) == stats.handler_ns.max_ns);
+        REQUIRE(stats.wait_ns.GetPercentileNs(90) >= 8*1000*1000);
+
+        #ifdef KS_ENV_LINUX
+        REQUIRE(stats.thread_cpu_ns > 0);
+        #endif
+
+        shared_ptr<Timer> timer = MakeObject<Timer>(event_loop);
+        timer->Start(Milliseconds(1),false);
+        std::this_thread::sleep_for(Milliseconds(20));
+        event_loop->ProcessEvents();
+
+        stats = event_loop->GetStats();
+        REQUIRE(stats.timers_started == 1);
+        REQUIRE(stats.timers_fired == 1);
+        REQUIRE(stats.events_handled == 301);
+
+        // A handler that throws is still ended
+        event_loop->PostCallback([]() {
+            throw std::runtime_error("handler failed");
+        });
+        REQUIRE_THROWS(event_loop->ProcessEvents());
+
+        LoopHandler handler;
+        REQUIRE_FALSE(event_loop->GetCurrentHandler(handler));
+
+        stats = event_loop->GetStats();
+        REQUIRE(stats.events_handled == 302);
+        REQUIRE(stats.handler_ns.count == 302);
+    }
 }
 
 // ============================================================= //
@@ -1000,3 +1095,2058 @@ TEST_CASE("ks::Timer","[timers]") {
 
 // ============================================================= //
 // ============================================================= //
+
+TEST_CASE("EventLoopWatchdog","[evloop]")
+{
+    shared_ptr<EventLoop> event_loop = make_shared<EventLoop>();
+    std::thread thread = EventLoop::LaunchInThread(event_loop);
+    std::thread::id const thread_id = thread.get_id();
+
+    std::mutex stall_mutex;
+    std::vector<LoopStall> list_stalls;
+
+    EventLoopWatchdog::Options options;
+    options.threshold = Milliseconds(50);
+    options.check_interval = Milliseconds(5);
+    options.sample_stack = true;
+
+    EventLoopWatchdog watchdog(
+                options,
+                [&](LoopStall const &stall) {
+                    std::lock_guard<std::mutex> lock(stall_mutex);
+                    list_stalls.push_back(stall);
+                });
+
+    watchdog.AddLoop(event_loop);
+
+    // Idle loops and short handlers aren't reported
+    LoopHandler handler;
+    REQUIRE_FALSE(event_loop->GetCurrentHandler(handler));
+
+    for(uint i=0; i < 20; i++) {
+        event_loop->PostCallback([]() {
+            std::this_thread::sleep_for(Milliseconds(1));
+        });
+    }
+    std::this_thread::sleep_for(Milliseconds(100));
+    REQUIRE(watchdog.GetStallCount() == 0);
+
+    // A slot is reported once and tagged with its receiver
+    shared_ptr<TrivialReceiver> receiver =
+            MakeObject<TrivialReceiver>(event_loop);
+
+    Signal<> signal_stall;
+    signal_stall.Connect([]() {
+        std::this_thread::sleep_for(Milliseconds(200));
+    },receiver);
+
+    signal_stall.Emit();
+    std::this_thread::sleep_for(Milliseconds(20));
+    REQUIRE(event_loop->GetCurrentHandler(handler));
+    REQUIRE(handler.type == LoopHandlerType::Event);
+    REQUIRE(handler.tag == receiver->GetId());
+
+    std::this_thread::sleep_for(Milliseconds(300));
+    REQUIRE_FALSE(event_loop->GetCurrentHandler(handler));
+
+    // A timeout is tagged with its timer
+    shared_ptr<Timer> timer = MakeObject<Timer>(event_loop);
+    timer->signal_timeout.Connect([]() {
+        std::this_thread::sleep_for(Milliseconds(200));
+    },receiver,ConnectionType::Direct);
+
+    timer->Start(Milliseconds(1),false);
+    std::this_thread::sleep_for(Milliseconds(300));
+
+    EventLoop::RemoveFromThread(event_loop,thread,true);
+
+    std::lock_guard<std::mutex> lock(stall_mutex);
+    REQUIRE(watchdog.GetStallCount() == 2);
+    REQUIRE(list_stalls.size() == 2);
+
+    for(auto const &stall : list_stalls) {
+        REQUIRE(stall.loop_id == event_loop->GetId());
+        REQUIRE(stall.handler.thread_id == thread_id);
+        REQUIRE(stall.duration.count() >= 50);
+
+        #ifdef KS_ENV_LINUX
+        REQUIRE(stall.handler.os_thread_id > 0);
+        REQUIRE_FALSE(stall.stack_trace.empty());
+        #endif
+    }
+
+    REQUIRE(list_stalls[0].handler.type == LoopHandlerType::Event);
+    REQUIRE(list_stalls[0].handler.tag == receiver->GetId());
+    REQUIRE(list_stalls[1].handler.type == LoopHandlerType::Timer);
+    REQUIRE(list_stalls[1].handler.tag == timer->GetId());
+}
+
+// ============================================================= //
+// ============================================================= //
+
+uint CountMatches(std::string const &str, std::string const &match)
+{
+    uint count = 0;
+    size_t pos = str.find(match);
+    while(pos != std::string::npos) {
+        count++;
+        pos = str.find(match,pos+match.size());
+    }
+    return count;
+}
+
+TEST_CASE("Trace","[evloop]")
+{
+    shared_ptr<EventLoop> event_loop = make_shared<EventLoop>();
+    std::thread thread = EventLoop::LaunchInThread(event_loop);
+
+    shared_ptr<TrivialReceiver> receiver =
+            MakeObject<TrivialReceiver>(event_loop);
+
+    ClearTrace();
+
+    SECTION("Events, waits and timers")
+    {
+        EnableTracing();
+
+        Signal<> signal_queued;
+        signal_queued.Connect([](){},receiver);
+
+        Signal<> signal_blocking;
+        signal_blocking.Connect([](){},receiver,ConnectionType::Blocking);
+
+        shared_ptr<Timer> timer = MakeObject<Timer>(event_loop);
+        timer->signal_timeout.Connect([](){},receiver,ConnectionType::Direct);
+
+        for(uint i=0; i < 3; i++) {
+            signal_queued.Emit();
+        }
+        signal_blocking.Emit();
+
+        timer->Start(Milliseconds(1),false);
+        std::this_thread::sleep_for(Milliseconds(20));
+
+        // A canceled wait
+        timer->Start(Milliseconds(1000),false);
+        timer->Stop();
+        std::this_thread::sleep_for(Milliseconds(20));
+
+        EventLoop::RemoveFromThread(event_loop,thread,true);
+        DisableTracing();
+
+        std::string json;
+        REQUIRE(AppendChromeTrace(json) == 20);
+
+        // Timer waits are async spans
+        REQUIRE(CountMatches(json,"\"ph\":\"b\",\"cat\":\"ks\"") == 2);
+        REQUIRE(CountMatches(json,"\"ph\":\"e\",\"cat\":\"ks\"") == 2);
+        REQUIRE(CountMatches(json,"\"name\":\"Timer wait\"") == 4);
+        REQUIRE(CountMatches(json,"\"failed\":false") == 1);
+        REQUIRE(CountMatches(json,"\"failed\":true") == 1);
+
+        // Every post is linked to its handler
+        REQUIRE(CountMatches(json,"\"ph\":\"s\"") == 4);
+        REQUIRE(CountMatches(json,"\"ph\":\"f\"") == 4);
+        REQUIRE(CountMatches(json,"\"ph\":\"B\"") == 6);
+        REQUIRE(CountMatches(json,"\"ph\":\"E\"") == 6);
+        REQUIRE(CountMatches(json,"\"name\":\"Blocking wait\"") == 1);
+        REQUIRE(CountMatches(json,"\"name\":\"Timer\"") == 1);
+
+        std::string const loop_tag =
+                "\"loop\":"+ToString(event_loop->GetId())+
+                ",\"tag\":"+ToString(receiver->GetId());
+
+        REQUIRE(CountMatches(json,loop_tag) == 9);
+
+        // Slot records carry the emitting signal
+        std::string const queued_signal =
+                "\"signal\":\""+ConvPointerToString(&signal_queued)+"\"";
+        std::string const blocking_signal =
+                "\"signal\":\""+ConvPointerToString(&signal_blocking)+"\"";
+
+        REQUIRE(CountMatches(json,queued_signal) == 6);
+        REQUIRE(CountMatches(json,blocking_signal) == 3);
+
+        #ifdef KS_ENV_LINUX
+        // Lanes are OS threads
+        std::string const tid =
+                "\"tid\":"+ToString(static_cast<s64>(syscall(SYS_gettid)));
+
+        REQUIRE(CountMatches(json,"\"name\":\"thread_name\","
+                                  "\"pid\":1,"+tid+",") == 1);
+        #endif
+    }
+
+    SECTION("Sampling")
+    {
+        EnableTracing(4);
+        for(uint i=0; i < 100; i++) {
+            event_loop->PostCallback([](){});
+        }
+
+        EventLoop::RemoveFromThread(event_loop,thread,true);
+        DisableTracing();
+
+        std::string json;
+        AppendChromeTrace(json);
+        REQUIRE(CountMatches(json,"\"ph\":\"s\"") == 25);
+        REQUIRE(CountMatches(json,"\"ph\":\"f\"") == 25);
+
+        // Nothing is recorded while disabled
+        ClearTrace();
+        event_loop->PostCallback([](){});
+
+        json.clear();
+        REQUIRE(AppendChromeTrace(json) == 0);
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+u64 GetLiveCount(std::vector<TypeMemoryStats> const &list_stats,
+                 std::string const &type_name)
+{
+    for(auto const &stats : list_stats) {
+        if(stats.type_name == type_name) {
+            return stats.count;
+        }
+    }
+    return 0;
+}
+
+TEST_CASE("Memory Stats","[evloop]")
+{
+    shared_ptr<EventLoop> event_loop = make_shared<EventLoop>();
+
+    // Queued events
+    event_loop->Start();
+    for(uint i=0; i < 10; i++) {
+        event_loop->PostCallback([](){});
+    }
+
+    MemoryStats stats = GetMemoryStats();
+    auto loop_it = std::find_if(
+                stats.list_loops.begin(),
+                stats.list_loops.end(),
+                [&event_loop](LoopMemoryStats const &loop_stats) {
+                    return (loop_stats.loop_id == event_loop->GetId());
+                });
+
+    REQUIRE(loop_it != stats.list_loops.end());
+    REQUIRE(loop_it->queued_events == 10);
+    REQUIRE(loop_it->queued_bytes >= 10*sizeof(SlotEvent));
+    REQUIRE(event_loop->GetStats().queue_bytes == loop_it->queued_bytes);
+
+    event_loop->ProcessEvents();
+
+    u64 queued_bytes;
+    REQUIRE(event_loop->GetQueueSize(&queued_bytes) == 0);
+    REQUIRE(queued_bytes == 0);
+
+    // Objects and connections
+    std::string const receiver_name = "TrivialReceiver";
+    std::string const signal_name = "ks::Signal<unsigned int, bool>";
+
+    u64 const receiver_count = GetLiveCount(stats.list_objects,receiver_name);
+    u64 const connection_count = GetLiveCount(stats.list_connections,signal_name);
+
+    {
+        std::vector<shared_ptr<TrivialReceiver>> list_receivers;
+        for(uint i=0; i < 3; i++) {
+            list_receivers.push_back(MakeObject<TrivialReceiver>(event_loop));
+        }
+
+        Signal<uint,bool> signal;
+        for(auto &receiver : list_receivers) {
+            signal.Connect([](uint,bool){},receiver);
+        }
+        Id const unmanaged_id = signal.Connect([](uint,bool){});
+
+        stats = GetMemoryStats();
+        REQUIRE(GetLiveCount(stats.list_objects,receiver_name) == receiver_count+3);
+        REQUIRE(GetLiveCount(stats.list_connections,signal_name) == connection_count+4);
+
+        // Disconnecting, expiring and destroying
+        // the Signal each remove connections
+        signal.Disconnect(unmanaged_id);
+        list_receivers.pop_back();
+        signal.Emit(0,false);
+
+        stats = GetMemoryStats();
+        REQUIRE(GetLiveCount(stats.list_objects,receiver_name) == receiver_count+2);
+        REQUIRE(GetLiveCount(stats.list_connections,signal_name) == connection_count+2);
+    }
+
+    stats = GetMemoryStats();
+    REQUIRE(GetLiveCount(stats.list_objects,receiver_name) == receiver_count);
+    REQUIRE(GetLiveCount(stats.list_connections,signal_name) == connection_count);
+
+    event_loop->Stop();
+
+    // Destroyed loops are left out
+    Id const loop_id = event_loop->GetId();
+    event_loop.reset();
+
+    stats = GetMemoryStats();
+    for(auto const &loop_stats : stats.list_loops) {
+        REQUIRE(loop_stats.loop_id != loop_id);
+    }
+}
+
+TEST_CASE("Introspection","[evloop]")
+{
+    shared_ptr<EventLoop> event_loop = make_shared<EventLoop>();
+    std::thread thread = EventLoop::LaunchInThread(event_loop);
+
+    shared_ptr<EventLoop> stopped_loop = make_shared<EventLoop>();
+
+    shared_ptr<TrivialReceiver> receiver =
+            MakeObject<TrivialReceiver>(event_loop);
+
+    Signal<uint,bool> signal;
+    Id const connection_id =
+            signal.Connect([](uint,bool){},receiver,ConnectionType::Blocking);
+
+    std::string const loop_json =
+            "{\"id\":"+ToString(event_loop->GetId())+",";
+    std::string const stopped_json =
+            "{\"id\":"+ToString(stopped_loop->GetId())+",";
+    std::string const object_json =
+            "{\"id\":"+ToString(receiver->GetId())+
+            ",\"type\":\"TrivialReceiver\",\"connections\":[{\"id\":"+
+            ToString(connection_id)+",\"signal\":\"ks::Signal<unsigned int, bool>\"";
+
+    SECTION("Snapshot")
+    {
+        std::string json = GetIntrospectionJson();
+
+        // The running loop answers its probe and
+        // lists the receiver and its connection
+        size_t const loop_pos = json.find(loop_json);
+        REQUIRE(loop_pos != std::string::npos);
+        REQUIRE(json.find("\"responsive\":true,\"probe_latency_us\":",loop_pos) != std::string::npos);
+        REQUIRE(json.find(object_json,loop_pos) != std::string::npos);
+        REQUIRE(json.find("\"type\":\"Blocking\"}",loop_pos) != std::string::npos);
+
+        // Loops that aren't running are read directly
+        size_t const stopped_pos = json.find(stopped_json);
+        REQUIRE(stopped_pos != std::string::npos);
+        REQUIRE(json.find("\"running\":false,\"responsive\":true,\"queued_events\":0",
+                          stopped_pos) != std::string::npos);
+
+        // Disconnecting removes the connection
+        signal.Disconnect(connection_id);
+        json = GetIntrospectionJson();
+        REQUIRE(json.find(object_json) == std::string::npos);
+        REQUIRE(json.find("{\"id\":"+ToString(receiver->GetId())+
+                          ",\"type\":\"TrivialReceiver\",\"connections\":[]}") !=
+                std::string::npos);
+    }
+
+    SECTION("Unresponsive loop")
+    {
+        // Shared since the callback may still be polling
+        // the flag after the section is left
+        shared_ptr<std::atomic<bool>> blocked =
+                make_shared<std::atomic<bool>>(true);
+
+        event_loop->PostCallback(
+                    [blocked]() {
+                        while(*blocked) {
+                            std::this_thread::sleep_for(Milliseconds(1));
+                        }
+                    });
+
+        std::string const json = GetIntrospectionJson(Milliseconds(50));
+        *blocked = false;
+
+        size_t const loop_pos = json.find(loop_json);
+        REQUIRE(loop_pos != std::string::npos);
+        REQUIRE(json.find("\"responsive\":false",loop_pos) != std::string::npos);
+        REQUIRE(json.find("\"handler\":{\"type\":\"Event\"",loop_pos) != std::string::npos);
+        REQUIRE(json.find(object_json,loop_pos) != std::string::npos);
+    }
+
+    #ifdef KS_ENV_LINUX
+    SECTION("Signal trigger")
+    {
+        std::string const file_path = "/tmp/ks_introspect_test.json";
+        std::remove(file_path.c_str());
+
+        shared_ptr<IntrospectionTrigger> trigger =
+                MakeObject<IntrospectionTrigger>(event_loop,file_path);
+        REQUIRE(trigger->GetValid());
+
+        // Only one trigger can be installed
+        REQUIRE_FALSE(MakeObject<IntrospectionTrigger>(event_loop,file_path)->GetValid());
+
+        raise(SIGUSR2);
+
+        s64 const timeout_ns = FastClock::GetSteadyNs()+5000*1000*1000ll;
+        while(trigger->GetDumpCount() == 0 && FastClock::GetSteadyNs() < timeout_ns) {
+            std::this_thread::sleep_for(Milliseconds(1));
+        }
+        REQUIRE(trigger->GetDumpCount() == 1);
+
+        std::string json;
+        REQUIRE(ReadFileIntoString(file_path,json));
+        REQUIRE(json.find(object_json) != std::string::npos);
+        std::remove(file_path.c_str());
+
+        // The previous handler is restored
+        trigger.reset();
+        struct sigaction action;
+        sigaction(SIGUSR2,nullptr,&action);
+        REQUIRE(action.sa_handler == SIG_DFL);
+    }
+    #endif
+
+    EventLoop::RemoveFromThread(event_loop,thread,true);
+}
+
+// ============================================================= //
+// ============================================================= //
+
+class CaptureSink : public ks::Log::Sink
+{
+public:
+    void log(std::string const &line)
+    {
+        list_lines.push_back(line);
+    }
+
+    std::vector<std::string> list_lines;
+};
+
+uint CountEvaluation(uint * count)
+{
+    (*count) += 1;
+    return (*count);
+}
+
+// ============================================================= //
+
+TEST_CASE("Log","[log]")
+{
+    shared_ptr<CaptureSink> sink = make_shared<CaptureSink>();
+
+    Log::Logger logger(
+                true,
+                sink,
+                {{
+                   { new Log::FBCustomStr("T: ") },
+                   { new Log::FBCustomStr("D: ") },
+                   { new Log::FBCustomStr("I: ") },
+                   { new Log::FBCustomStr("W: ") },
+                   { new Log::FBCustomStr("E: ") },
+                   { new Log::FBCustomStr("F: ") }
+                 }});
+
+    SECTION("Level filter")
+    {
+        uint count = 0;
+
+        logger.UnsetLevel(Log::Logger::Level::DEBUG);
+        REQUIRE_FALSE(logger.GetLevelEnabled(Log::Logger::Level::DEBUG));
+        REQUIRE(logger.GetLevelEnabled(Log::Logger::Level::INFO));
+
+        // Disabled statements must not evaluate their arguments
+        KS_LOG_DEBUG(logger) << "count: " << CountEvaluation(&count);
+        REQUIRE(count == 0);
+        REQUIRE(sink->list_lines.empty());
+
+        KS_LOG_INFO(logger) << "count: " << CountEvaluation(&count);
+        REQUIRE(count == 1);
+        REQUIRE(sink->list_lines.size() == 1);
+        REQUIRE(sink->list_lines.back() == "I: count: 1");
+
+        // The macros must be safe as an unbraced if body
+        if(count == 1)
+            KS_LOG_DEBUG(logger) << "hidden";
+        else
+            KS_LOG_INFO(logger) << "else branch";
+
+        REQUIRE(sink->list_lines.size() == 1);
+
+        logger.SetLevel(Log::Logger::Level::DEBUG);
+        KS_LOG_DEBUG(logger) << "count: " << CountEvaluation(&count);
+        REQUIRE(count == 2);
+        REQUIRE(sink->list_lines.back() == "D: count: 2");
+
+        // The non macro interface respects the filter too
+        logger.UnsetLevel(Log::Logger::Level::WARN);
+        logger.Warn() << "hidden";
+        logger.Error() << "shown";
+        REQUIRE(sink->list_lines.size() == 3);
+        REQUIRE(sink->list_lines.back() == "E: shown");
+    }
+
+    SECTION("Numbers")
+    {
+        logger.Info() << 'c' << ' ' << u8(65) << ' ' << true << ' '
+                      << -42 << ' ' << u64(18446744073709551615ull) << ' '
+                      << 0.5 << ' ' << 2.0f << ' ' << 1e-7;
+
+        REQUIRE(sink->list_lines.back() ==
+                "I: c A 1 -42 18446744073709551615 0.5 2 1e-07");
+    }
+
+    SECTION("Nested lines")
+    {
+        auto describe = [&logger]() {
+            logger.Debug() << "nested";
+            return std::string("outer");
+        };
+
+        logger.Info() << describe();
+        REQUIRE(sink->list_lines.size() == 2);
+        REQUIRE(sink->list_lines[0] == "D: nested");
+        REQUIRE(sink->list_lines[1] == "I: outer");
+    }
+
+    SECTION("Batches")
+    {
+        // The default adapters forward to log()
+        std::vector<std::string> list_lines{"a","b","c"};
+        sink->log_batch(list_lines.data(),list_lines.size());
+        REQUIRE(sink->list_lines == list_lines);
+
+        std::string const buffer("d\ne\nf");
+        sink->log_buffer(buffer.data(),buffer.size());
+        REQUIRE(sink->list_lines.size() == 6);
+        REQUIRE(sink->list_lines[3] == "d");
+        REQUIRE(sink->list_lines[5] == "f");
+    }
+
+    SECTION("Categories")
+    {
+        using Level = Log::Logger::Level;
+
+        Log::Category &cat_net = Log::GetCategory("test.net");
+        Log::Category &cat_tcp = Log::GetCategory("test.net.tcp");
+        Log::Category &cat_evl = Log::GetCategory("test.evloop");
+
+        // Resolving a name again returns the same category
+        REQUIRE(&cat_tcp == &Log::GetCategory("test.net.tcp"));
+        REQUIRE(cat_tcp.GetLevelEnabled(Level::TRACE));
+
+        Log::SetCategoryThreshold("test.net",Level::WARN);
+        REQUIRE_FALSE(cat_net.GetLevelEnabled(Level::INFO));
+        REQUIRE_FALSE(cat_tcp.GetLevelEnabled(Level::INFO));
+        REQUIRE(cat_tcp.GetLevelEnabled(Level::WARN));
+        REQUIRE(cat_evl.GetLevelEnabled(Level::TRACE));
+
+        // More specific thresholds take precedence
+        Log::SetCategoryThreshold("test.net.tcp",Level::DEBUG);
+        REQUIRE(cat_tcp.GetLevelEnabled(Level::DEBUG));
+        REQUIRE_FALSE(cat_net.GetLevelEnabled(Level::DEBUG));
+
+        uint count = 0;
+        KS_LOG_CATEGORY(logger,cat_net,Level::INFO) << CountEvaluation(&count);
+        KS_LOG_CATEGORY(logger,cat_tcp,Level::INFO) << CountEvaluation(&count);
+        REQUIRE(count == 1);
+        REQUIRE(sink->list_lines.size() == 1);
+        REQUIRE(sink->list_lines.back() == "I: [test.net.tcp] 1");
+
+        REQUIRE(Log::ConfigureCategories("test=ERROR,test.net.tcp=OFF"));
+        REQUIRE(cat_evl.GetThreshold() == static_cast<u8>(Level::ERROR));
+        REQUIRE(cat_net.GetThreshold() == static_cast<u8>(Level::WARN));
+        REQUIRE_FALSE(cat_tcp.GetLevelEnabled(Level::FATAL));
+
+        Log::ResetCategoryThreshold("test.net.tcp");
+        REQUIRE(cat_tcp.GetThreshold() == static_cast<u8>(Level::WARN));
+
+        REQUIRE_FALSE(Log::ConfigureCategories("test=LOUD,test.evloop"));
+
+        Log::ResetCategoryThreshold("test");
+        Log::ResetCategoryThreshold("test.net");
+        REQUIRE(cat_evl.GetLevelEnabled(Level::TRACE));
+        REQUIRE(cat_tcp.GetLevelEnabled(Level::TRACE));
+    }
+
+    SECTION("Rate limits and sampling")
+    {
+        using Level = Log::Logger::Level;
+
+        // Dropped lines are never evaluated
+        uint count = 0;
+        for(uint i=0; i < 10; i++) {
+            KS_LOG_RATE_LIMITED(logger,Level::WARN,3,Hours(1))
+                    << CountEvaluation(&count);
+        }
+        REQUIRE(count == 3);
+        REQUIRE(sink->list_lines.size() == 3);
+        REQUIRE(sink->list_lines.back() == "W: 3");
+
+        // The next line through reports what was dropped
+        Log::RateLimiter limiter(2,Milliseconds(20));
+        REQUIRE(limiter.Allow());
+        REQUIRE(limiter.Allow());
+        REQUIRE_FALSE(limiter.Allow());
+        REQUIRE_FALSE(limiter.Allow());
+        REQUIRE(limiter.GetSuppressed() == 2);
+
+        std::this_thread::sleep_for(Milliseconds(30));
+        Log::RateLimiter::Permit permit = limiter.Allow();
+        REQUIRE(permit);
+        REQUIRE(std::string(permit.GetPrefix()) == "(suppressed 2 messages) ");
+        REQUIRE(std::string(limiter.Allow().GetPrefix()).empty());
+
+        // Filtered levels skip the limiter entirely
+        logger.UnsetLevel(Level::DEBUG);
+        KS_LOG_RATE_LIMITED(logger,Level::DEBUG,1,Seconds(1))
+                << CountEvaluation(&count);
+        REQUIRE(count == 3);
+
+        // The macros are safe as the body of an unbraced if
+        bool else_taken = false;
+        if(count == 0)
+            KS_LOG_RATE_LIMITED(logger,Level::INFO,1,Seconds(1)) << "x";
+        else
+            else_taken = true;
+        REQUIRE(else_taken);
+
+        count = 0;
+        for(uint i=0; i < 10; i++) {
+            KS_LOG_EVERY_N(logger,Level::INFO,4) << CountEvaluation(&count);
+        }
+        REQUIRE(count == 3); // 0, 4 and 8
+
+        count = 0;
+        for(uint i=0; i < 100; i++) {
+            KS_LOG_SAMPLED(logger,Level::INFO,0.0) << CountEvaluation(&count);
+            KS_LOG_SAMPLED(logger,Level::INFO,1.0) << CountEvaluation(&count);
+        }
+        REQUIRE(count == 100);
+
+        Log::Sampler sampler(0.25);
+        uint sampled = 0;
+        for(uint i=0; i < 10000; i++) {
+            sampled += sampler.Allow() ? 1 : 0;
+        }
+        REQUIRE(sampled > 2000);
+        REQUIRE(sampled < 3000);
+    }
+
+    SECTION("Exceptions")
+    {
+        // Nothing is logged or formatted on construction
+        Exception ex(Exception::ErrorLevel::WARN,"recoverable",true);
+        REQUIRE(sink->list_lines.empty());
+        REQUIRE(ex.GetMessage() == "recoverable");
+        REQUIRE(std::string(ex.what()) == "WARN:  recoverable");
+
+        #ifdef __GNUC__
+        REQUIRE(ex.GetStackDepth() > 0);
+        REQUIRE(ex.GetStackTrace().find("  #0 0x") == 0);
+
+        // Module offsets are given for addr2line
+        REQUIRE(ex.GetStackTrace().find("+0x") != std::string::npos);
+        #endif
+
+        ex.Report(logger);
+        REQUIRE(sink->list_lines.size() == 1);
+        REQUIRE(sink->list_lines[0].find("W: recoverable") == 0);
+
+        Exception plain(Exception::ErrorLevel::ERROR,"no trace");
+        REQUIRE(plain.GetStackDepth() == 0);
+        REQUIRE(plain.GetStackTrace().empty());
+
+        plain.Report(logger);
+        REQUIRE(sink->list_lines.back() == "E: no trace");
+    }
+
+    SECTION("Async sink")
+    {
+        shared_ptr<Log::SinkAsync> async_sink =
+                make_shared<Log::SinkAsync>(sink,16);
+
+        logger.RemoveSink(sink);
+        logger.AddSink(async_sink);
+
+        for(uint i=0; i < 1000; i++) {
+            logger.Info() << i;
+        }
+        async_sink->Flush();
+
+        REQUIRE(sink->list_lines.size() == 1000);
+        REQUIRE(sink->list_lines[0] == "I: 0");
+        REQUIRE(sink->list_lines[999] == "I: 999");
+
+        // A batch larger than the queue wakes the writer
+        // while it waits for space
+        Log::SinkAsync small_sink(sink,2);
+        std::vector<std::string> list_batch;
+        for(uint i=0; i < 5; i++) {
+            list_batch.push_back("batch "+ToString(i));
+        }
+        small_sink.log_batch(list_batch.data(),list_batch.size());
+        small_sink.Flush();
+
+        REQUIRE(sink->list_lines.size() == 1005);
+        REQUIRE(sink->list_lines[1000] == "batch 0");
+        REQUIRE(sink->list_lines[1004] == "batch 4");
+    }
+}
+
+// ============================================================= //
+
+template<typename T>
+bool FormatMatchesStream(T val)
+{
+    std::string str;
+    AppendNumber(str,val);
+
+    std::ostringstream oss;
+    oss << val;
+    return (str == oss.str());
+}
+
+TEST_CASE("Format","[format]")
+{
+    REQUIRE(FormatMatchesStream(0));
+    REQUIRE(FormatMatchesStream(7));
+    REQUIRE(FormatMatchesStream(-10));
+    REQUIRE(FormatMatchesStream(99));
+    REQUIRE(FormatMatchesStream(100));
+    REQUIRE(FormatMatchesStream(12345));
+    REQUIRE(FormatMatchesStream(std::numeric_limits<s64>::min()));
+    REQUIRE(FormatMatchesStream(std::numeric_limits<s64>::max()));
+    REQUIRE(FormatMatchesStream(std::numeric_limits<u64>::max()));
+    REQUIRE(FormatMatchesStream(std::numeric_limits<s16>::min()));
+    REQUIRE(FormatMatchesStream(false));
+    REQUIRE(FormatMatchesStream('x'));
+
+    REQUIRE(FormatMatchesStream(0.0));
+    REQUIRE(FormatMatchesStream(-0.0));
+    REQUIRE(FormatMatchesStream(1.0));
+    REQUIRE(FormatMatchesStream(-3.25));
+    REQUIRE(FormatMatchesStream(999999.0));
+    REQUIRE(FormatMatchesStream(1000000.0));
+    REQUIRE(FormatMatchesStream(123456789.0));
+    REQUIRE(FormatMatchesStream(3.14159265358979));
+    REQUIRE(FormatMatchesStream(1e-300));
+    REQUIRE(FormatMatchesStream(0.1f));
+    REQUIRE(FormatMatchesStream(std::numeric_limits<double>::infinity()));
+    REQUIRE(FormatMatchesStream(-std::numeric_limits<double>::max()));
+
+    SECTION("Round trip")
+    {
+        auto round_trip = [](double val) {
+            char buff[k_format_max_size];
+            char * last = FormatFloatRoundTrip(buff,val);
+
+            double parsed = 0;
+            return (ParseFloat(buff,last,parsed) == last) &&
+                    (std::memcmp(&parsed,&val,sizeof(val)) == 0);
+        };
+
+        REQUIRE(round_trip(0.1));
+        REQUIRE(round_trip(-0.0));
+        REQUIRE(round_trip(1.0/3.0));
+        REQUIRE(round_trip(123456789012345.0));
+        REQUIRE(round_trip(1e300));
+        REQUIRE(round_trip(std::numeric_limits<double>::max()));
+        REQUIRE(round_trip(std::numeric_limits<double>::min()));
+        REQUIRE(round_trip(std::numeric_limits<double>::denorm_min()));
+
+        // Random bit patterns cover the slow parse path
+        u64 bits = 88172645463325252ull;
+        bool all_ok = true;
+        for(uint i=0; i < 20000; i++) {
+            bits ^= bits << 13;
+            bits ^= bits >> 7;
+            bits ^= bits << 17;
+
+            double val;
+            std::memcpy(&val,&bits,sizeof(val));
+            if(std::isfinite(val)) {
+                all_ok = all_ok && round_trip(val);
+            }
+        }
+        REQUIRE(all_ok);
+
+        char buff[k_format_max_size];
+        REQUIRE(std::string(buff,FormatFloatRoundTrip(buff,0.1)) == "0.1");
+        REQUIRE(std::string(buff,FormatFloatRoundTrip(buff,-42.0)) == "-42");
+        REQUIRE(std::string(buff,FormatFloatRoundTrip(buff,-1.5e-7)) == "-1.5e-07");
+        REQUIRE(std::string(buff,FormatFloatRoundTrip(buff,1e20)) == "1e+20");
+        REQUIRE(std::string(buff,FormatFloatRoundTrip(buff,0.3)) == "0.3");
+        REQUIRE(std::string(buff,FormatFloatRoundTrip(buff,0.1+0.2)) == "0.30000000000000004");
+    }
+
+    SECTION("Parse")
+    {
+        std::string const text = "-123abc";
+        char const * first = text.data();
+        char const * last = first+text.size();
+
+        int ival = 0;
+        REQUIRE(ParseInteger(first,last,ival) == first+4);
+        REQUIRE(ival == -123);
+
+        // Out of range and no digits leave the value as is
+        u8 u8val = 7;
+        REQUIRE(ParseInteger(first,last,u8val) == first);
+        std::string const big = "300";
+        REQUIRE(ParseInteger(big.data(),big.data()+3,u8val) == big.data());
+        REQUIRE(u8val == 7);
+
+        std::string const s64_min = "-9223372036854775808";
+        s64 s64val = 0;
+        REQUIRE(ParseInteger(s64_min.data(),s64_min.data()+s64_min.size(),s64val) !=
+                s64_min.data());
+        REQUIRE(s64val == std::numeric_limits<s64>::min());
+
+        std::string const u64_over = "18446744073709551616";
+        u64 u64val = 0;
+        REQUIRE(ParseInteger(u64_over.data(),u64_over.data()+u64_over.size(),u64val) ==
+                u64_over.data());
+
+        double dval = 0;
+        std::string const exp = "2.5e-3x";
+        REQUIRE(ParseFloat(exp.data(),exp.data()+exp.size(),dval) == exp.data()+6);
+        REQUIRE(dval == 2.5e-3);
+
+        // An exponent without digits isn't part of the number
+        std::string const no_exp = "7e";
+        REQUIRE(ParseFloat(no_exp.data(),no_exp.data()+2,dval) == no_exp.data()+1);
+        REQUIRE(dval == 7);
+
+        std::string const inf = "-Infinity";
+        REQUIRE(ParseFloat(inf.data(),inf.data()+inf.size(),dval) == inf.data()+inf.size());
+        REQUIRE(dval == -std::numeric_limits<double>::infinity());
+
+        std::string const long_digits = "0.1000000000000000055511151231257827021181583404541015625";
+        REQUIRE(ParseFloat(long_digits.data(),long_digits.data()+long_digits.size(),dval) !=
+                long_digits.data());
+        REQUIRE(dval == 0.1);
+
+        std::string const too_big = "1e400";
+        REQUIRE(ParseFloat(too_big.data(),too_big.data()+too_big.size(),dval) == too_big.data());
+    }
+
+    SECTION("Conversion helpers")
+    {
+        bool ok = false;
+        REQUIRE(ConvStringToNumber<int>("  42 apples",&ok) == 42);
+        REQUIRE(ok);
+        REQUIRE(ConvStringToNumber<double>("-1.5e2",&ok) == -150.0);
+        REQUIRE(ok);
+        REQUIRE(ConvStringToNumber<int>("apples",&ok) == 0);
+        REQUIRE_FALSE(ok);
+        REQUIRE(ConvStringToNumber<bool>("1",&ok));
+        REQUIRE(ok);
+        REQUIRE(ConvStringToNumber<char>(" z",&ok) == 'z');
+
+        REQUIRE(ConvNumberToString(-17) == "-17");
+        REQUIRE(ToString(2.5f) == "2.5");
+        REQUIRE(ToString(std::string("str")) == "str");
+
+        auto format_matches_stream = [](double val, uint precision, uint width) {
+            std::ostringstream oss;
+            oss << std::fixed << std::setw(width) << std::setfill('0')
+                << std::setprecision(precision) << val;
+            return (ToStringFormat(val,precision,width,'0') == oss.str());
+        };
+
+        REQUIRE(format_matches_stream(3.14159,2,8));
+        REQUIRE(format_matches_stream(-3.14159,0,1));
+        REQUIRE(format_matches_stream(1e300,3,0));
+        REQUIRE(ToStringFormat(7,2,3,' ') == "  7");
+    }
+}
+
+// ============================================================= //
+
+TEST_CASE("FastClock","[clock]")
+{
+    s64 const std_begin_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    FastClock::time_point const begin = FastClock::now();
+    std::this_thread::sleep_for(Milliseconds(50));
+    FastClock::time_point const end = FastClock::now();
+
+    s64 const std_end_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // Same epoch and rate as steady_clock, within the
+    // resolution of the coarse clock
+    s64 const tolerance_ns = 10*1000*1000;
+    REQUIRE(begin.time_since_epoch().count() > std_begin_ns-tolerance_ns);
+    REQUIRE(end.time_since_epoch().count() < std_end_ns+tolerance_ns);
+
+    s64 const elapsed_ms =
+            std::chrono::duration_cast<Milliseconds>(end-begin).count();
+    REQUIRE(elapsed_ms >= 40);
+    REQUIRE(elapsed_ms < 1000);
+
+    // Successive reads never go backwards
+    bool monotonic = true;
+    s64 prev_ns = FastClock::GetSteadyNs();
+    for(uint i=0; i < 10000; i++) {
+        s64 const now_ns = FastClock::GetSteadyNs();
+        monotonic = monotonic && (now_ns >= prev_ns);
+        prev_ns = now_ns;
+    }
+    REQUIRE(monotonic);
+
+    // The precise clock ticks much faster than the
+    // coarse clock's few ms
+    s64 const precise_begin_ns = FastClock::GetPreciseNs();
+    s64 precise_ns = precise_begin_ns;
+    while(precise_ns == precise_begin_ns) {
+        precise_ns = FastClock::GetPreciseNs();
+    }
+    REQUIRE(precise_ns-precise_begin_ns < 100*1000);
+    REQUIRE(std::abs(precise_ns-FastClock::GetSteadyNs()) < tolerance_ns);
+
+    s64 const wall_diff_ms =
+            std::chrono::duration_cast<Milliseconds>(
+                FastClock::ToWallTime(FastClock::now())-
+                std::chrono::system_clock::now()).count();
+
+    REQUIRE(std::abs(wall_diff_ms) < 50);
+}
+
+// ============================================================= //
+// ============================================================= //
+
+class CaptureBinarySink : public ks::Log::BinarySink
+{
+public:
+    void write(u8 const * data, size_t size)
+    {
+        buffer.insert(buffer.end(),data,data+size);
+    }
+
+    std::vector<u8> buffer;
+};
+
+bool EndsWith(std::string const &str, std::string const &suffix)
+{
+    return (str.size() >= suffix.size()) &&
+            (str.compare(str.size()-suffix.size(),
+                         suffix.size(),suffix) == 0);
+}
+
+// ============================================================= //
+
+TEST_CASE("Binary Log","[log]")
+{
+    using Level = Log::Logger::Level;
+
+    shared_ptr<CaptureBinarySink> binary_sink =
+            make_shared<CaptureBinarySink>();
+
+    shared_ptr<CaptureSink> sink = make_shared<CaptureSink>();
+
+    {
+        Log::BinaryLogger binlog(binary_sink,1024);
+        binlog.UnsetLevel(Level::TRACE);
+
+        std::string const name("peer");
+        for(uint i=0; i < 100; i++) {
+            KS_LOG_BINARY(binlog,Level::INFO,"rx {} bytes from {}",i,name);
+        }
+        KS_LOG_BINARY(binlog,Level::TRACE,"filtered {}",1);
+        KS_LOG_BINARY(binlog,Level::WARN,"{} {} {} {} extra",
+                      true,'c',-1.5,"str",s64(-7));
+        KS_LOG_BINARY(binlog,Level::ERROR,"no args {}");
+    }
+
+    // Feed the stream in small pieces to check that
+    // records split across calls are decoded
+    Log::BinaryDecoder decoder(sink);
+    for(size_t i=0; i < binary_sink->buffer.size(); i += 7) {
+        size_t const size = std::min(size_t(7),binary_sink->buffer.size()-i);
+        REQUIRE(decoder.Feed(&(binary_sink->buffer[i]),size));
+    }
+
+    REQUIRE(decoder.GetPendingSize() == 0);
+    REQUIRE(sink->list_lines.size() == 102);
+    REQUIRE(EndsWith(sink->list_lines[0],": rx 0 bytes from peer"));
+    REQUIRE(EndsWith(sink->list_lines[99],": rx 99 bytes from peer"));
+    REQUIRE(EndsWith(sink->list_lines[100],": 1 c -1.5 str extra -7"));
+    REQUIRE(EndsWith(sink->list_lines[101],": no args {}"));
+    REQUIRE(sink->list_lines[100].find("WARN:") != std::string::npos);
+
+    // A stream without the header is rejected
+    Log::BinaryDecoder bad_decoder(sink);
+    u8 const garbage[16] = {0};
+    REQUIRE_FALSE(bad_decoder.Feed(garbage,sizeof(garbage)));
+
+    // So is a format record with an id that
+    // can't have been assigned
+    std::vector<u8> bad_stream(binary_sink->buffer.begin(),
+                               binary_sink->buffer.begin()+12);
+    bad_stream.push_back(1); // format record
+    bad_stream.insert(bad_stream.end(),4,0xFF);
+    bad_stream.insert(bad_stream.end(),9,0);
+    Log::BinaryDecoder bad_id_decoder(sink);
+    REQUIRE_FALSE(bad_id_decoder.Feed(bad_stream.data(),bad_stream.size()));
+}
+
+TEST_CASE("Binary Log large record","[log]")
+{
+    using Level = Log::Logger::Level;
+
+    shared_ptr<CaptureBinarySink> binary_sink =
+            make_shared<CaptureBinarySink>();
+
+    shared_ptr<CaptureSink> sink = make_shared<CaptureSink>();
+
+    // 64 arguments of 1KB each are more than a
+    // u16 record length can hold
+    std::string const s(1024,'x');
+    {
+        Log::BinaryLogger binlog(binary_sink);
+        #define KS_TEST_ARGS8 s,s,s,s,s,s,s,s
+        KS_LOG_BINARY(binlog,Level::INFO,"{}",
+                      KS_TEST_ARGS8,KS_TEST_ARGS8,KS_TEST_ARGS8,KS_TEST_ARGS8,
+                      KS_TEST_ARGS8,KS_TEST_ARGS8,KS_TEST_ARGS8,KS_TEST_ARGS8);
+        #undef KS_TEST_ARGS8
+        KS_LOG_BINARY(binlog,Level::INFO,"after {}",1);
+    }
+
+    Log::BinaryDecoder decoder(sink);
+    REQUIRE(decoder.Feed(binary_sink->buffer.data(),binary_sink->buffer.size()));
+    REQUIRE(decoder.GetPendingSize() == 0);
+    REQUIRE(sink->list_lines.size() == 2);
+    REQUIRE(sink->list_lines[0].size() > 64*1024);
+    REQUIRE(EndsWith(sink->list_lines[1],": after 1"));
+}
+
+// ============================================================= //
+
+TEST_CASE("Flight Recorder","[log]")
+{
+    using Level = Log::Logger::Level;
+
+    shared_ptr<CaptureSink> sink = make_shared<CaptureSink>();
+
+    KS_LOG_FLIGHT(Level::TRACE,"not recorded {}",1);
+    Log::EnableFlightRecorder(sink,16);
+
+    // Only the most recent records are kept, and they
+    // outlive the thread that wrote them
+    std::thread thread([](){
+        for(uint i=0; i < 40; i++) {
+            KS_LOG_FLIGHT(Level::DEBUG,"worker {}",i);
+        }
+    });
+    thread.join();
+
+    REQUIRE(Log::DumpFlightRecorder() == 16);
+    REQUIRE(sink->list_lines.size() == 17);
+    REQUIRE(EndsWith(sink->list_lines[0],", 16 records"));
+    REQUIRE(EndsWith(sink->list_lines[1],"DEBUG: worker 24"));
+    REQUIRE(EndsWith(sink->list_lines[16],"DEBUG: worker 39"));
+
+    // Timestamps are rendered as by the binary decoder
+    std::string now;
+    Log::binary_detail::RenderTimestamp(Log::binary_detail::GetTimestamp(),now);
+    REQUIRE(sink->list_lines[1].compare(0,11,now,0,11) == 0);
+    REQUIRE(sink->list_lines[1].size() > 24);
+    REQUIRE(sink->list_lines[1][19] == '.');
+
+    // Records are only dumped once
+    REQUIRE(Log::DumpFlightRecorder() == 0);
+
+    // FATAL lines dump the recorder before they're logged
+    Log::Logger logger(
+                true,
+                sink,
+                {{
+                   {},{},{},{},{},
+                   { new Log::FBCustomStr("F: ") }
+                 }});
+
+    sink->list_lines.clear();
+    KS_LOG_FLIGHT(Level::TRACE,"too large {}",std::string(200,'x'));
+    KS_LOG_FLIGHT(Level::TRACE,"state {}",7);
+    logger.Fatal() << "boom";
+
+    REQUIRE(sink->list_lines.size() == 4);
+    REQUIRE(EndsWith(sink->list_lines[1],"TRACE: too large {}"));
+    REQUIRE(EndsWith(sink->list_lines[2],"TRACE: state 7"));
+    REQUIRE(sink->list_lines[3] == "F: boom");
+
+    Log::DisableFlightRecorder();
+    KS_LOG_FLIGHT(Level::TRACE,"not recorded {}",2);
+    logger.Fatal() << "no dump";
+    REQUIRE(sink->list_lines.size() == 5);
+    REQUIRE(Log::DumpFlightRecorder() == 0);
+}
+
+#ifdef KS_ENV_POSIX
+TEST_CASE("Flight Recorder signal dump","[log]")
+{
+    using Level = Log::Logger::Level;
+
+    int list_fds[2];
+    REQUIRE(pipe(list_fds) == 0);
+
+    pid_t const pid = fork();
+    REQUIRE(pid >= 0);
+
+    if(pid == 0) {
+        // Child: the dump is written to the pipe
+        // before the default action
+        close(list_fds[0]);
+        Log::EnableFlightRecorder(make_shared<CaptureSink>(),16);
+        KS_LOG_FLIGHT(Level::INFO,"crash {} {} {}",1.25,-3,"now");
+        Log::InstallFlightRecorderSignalHandlers(list_fds[1]);
+        std::abort();
+    }
+
+    close(list_fds[1]);
+
+    std::string output;
+    char buff[256];
+    ssize_t size;
+    while((size = read(list_fds[0],buff,sizeof(buff))) > 0) {
+        output.append(buff,static_cast<size_t>(size));
+    }
+    close(list_fds[0]);
+
+    int status = 0;
+    REQUIRE(waitpid(pid,&status,0) == pid);
+    REQUIRE(WIFSIGNALED(status));
+    REQUIRE(WTERMSIG(status) == SIGABRT);
+
+    REQUIRE(output.find("flight recorder: thread ") == 0);
+    REQUIRE(output.find(" INFO:  crash 1.25 -3 now\n") != std::string::npos);
+}
+#endif
+
+// ============================================================= //
+// ============================================================= //
+
+TEST_CASE("Metrics","[misc]")
+{
+    uint const thread_count = 8;
+
+    SECTION("Counters and gauges")
+    {
+        metrics::Counter counter;
+        metrics::Gauge gauge;
+
+        std::vector<std::thread> list_threads;
+        for(uint i=0; i < thread_count; i++) {
+            list_threads.emplace_back([&counter,&gauge]() {
+                for(uint j=0; j < 100000; j++) {
+                    counter.Add();
+                    gauge.Add(1);
+                }
+            });
+        }
+
+        for(auto &thread : list_threads) {
+            thread.join();
+        }
+
+        REQUIRE(counter.Get() == thread_count*100000);
+        REQUIRE(gauge.Get() == thread_count*100000);
+
+        counter.Reset();
+        gauge.Set(-5);
+        REQUIRE(counter.Get() == 0);
+        REQUIRE(gauge.Get() == -5);
+    }
+
+    SECTION("Histogram buckets")
+    {
+        std::vector<u64> list_values;
+        for(u64 i=0; i < 4096; i++) {
+            list_values.push_back(i);
+        }
+        for(uint i=12; i < 64; i++) {
+            list_values.push_back((u64(1) << i)-1);
+            list_values.push_back(u64(1) << i);
+            list_values.push_back((u64(1) << i)+(u64(1) << (i-3))+7);
+        }
+
+        uint bad_bucket_count = 0;
+        for(u64 value : list_values) {
+            uint const index = metrics::Histogram::GetBucketIndex(value);
+            u64 const lower = metrics::Histogram::GetBucketLowerBound(index);
+            u64 const upper = metrics::Histogram::GetBucketUpperBound(index);
+
+            // The last bucket also holds everything out of range
+            if(lower > value || value > upper ||
+               (value < (u64(1) << 47) && upper-lower > value/16))
+            {
+                bad_bucket_count++;
+            }
+        }
+        REQUIRE(bad_bucket_count == 0);
+
+        // Buckets are contiguous
+        uint gap_count = 0;
+        for(uint i=1; i < metrics::metrics_detail::k_bucket_count; i++) {
+            if(metrics::Histogram::GetBucketLowerBound(i) !=
+               metrics::Histogram::GetBucketUpperBound(i-1)+1)
+            {
+                gap_count++;
+            }
+        }
+        REQUIRE(gap_count == 0);
+    }
+
+    SECTION("Histogram recording")
+    {
+        metrics::Histogram histogram;
+        REQUIRE(histogram.GetSnapshot().GetCount() == 0);
+        REQUIRE(histogram.GetSnapshot().GetPercentile(50) == 0);
+
+        std::vector<std::thread> list_threads;
+        for(uint i=0; i < thread_count; i++) {
+            list_threads.emplace_back([&histogram]() {
+                for(u64 value=1; value <= 10000; value++) {
+                    histogram.Record(value);
+                }
+            });
+        }
+
+        for(auto &thread : list_threads) {
+            thread.join();
+        }
+
+        metrics::HistogramSnapshot snapshot = histogram.GetSnapshot();
+        REQUIRE(snapshot.GetCount() == thread_count*10000);
+        REQUIRE(snapshot.sum == thread_count*50005000);
+        REQUIRE(snapshot.GetMean() == Approx(5000.5));
+        REQUIRE(snapshot.GetMin() == 1);
+        REQUIRE(snapshot.GetMax() == 10000);
+        REQUIRE(snapshot.GetPercentile(100) == 10000);
+        REQUIRE(snapshot.GetPercentile(50) >= 5000);
+        REQUIRE(snapshot.GetPercentile(50) <= 5000*17/16);
+        REQUIRE(snapshot.GetPercentile(99) >= 9900);
+
+        // Merging
+        metrics::Histogram other;
+        other.Record(1000000);
+        snapshot.Merge(other.GetSnapshot());
+        REQUIRE(snapshot.GetCount() == thread_count*10000+1);
+        REQUIRE(snapshot.GetMax() == 1000000);
+
+        histogram.Reset();
+        REQUIRE(histogram.GetSnapshot().GetCount() == 0);
+    }
+}
+
+TEST_CASE("Lock profiling","[misc]")
+{
+    uint const thread_count = 4;
+    uint const lock_count = 10000;
+
+    Mutex mutex("Test::shared");
+    Mutex other_mutex("Test::shared");
+    RecursiveMutex recursive_mutex("Test::recursive");
+    uint value = 0;
+
+    ResetLockSiteStats();
+
+    std::vector<std::thread> list_threads;
+    for(uint i=0; i < thread_count; i++) {
+        list_threads.emplace_back([&]() {
+            for(uint j=0; j < lock_count; j++) {
+                std::lock_guard<Mutex> lock(mutex);
+                value++;
+            }
+        });
+    }
+
+    for(auto &thread : list_threads) {
+        thread.join();
+    }
+
+    {
+        MutexLock lock(other_mutex);
+        REQUIRE(lock.owns_lock());
+    }
+
+    recursive_mutex.lock();
+    recursive_mutex.lock();
+    recursive_mutex.unlock();
+    recursive_mutex.unlock();
+
+    REQUIRE(value == thread_count*lock_count);
+
+    std::vector<LockSiteStats> list_stats = GetLockSiteStats();
+
+    #ifdef KS_PROFILE_LOCKS
+    auto find_site = [&list_stats](std::string const &name) {
+        return std::find_if(
+                    list_stats.begin(),
+                    list_stats.end(),
+                    [&name](LockSiteStats const &stats) {
+                        return (stats.name == name);
+                    });
+    };
+
+    // Mutexes with the same name share a site
+    auto shared_it = find_site("Test::shared");
+    REQUIRE(shared_it != list_stats.end());
+    REQUIRE(shared_it->acquisitions == thread_count*lock_count+1);
+    REQUIRE(shared_it->hold_ns.GetCount() == thread_count*lock_count+1);
+    REQUIRE(shared_it->wait_ns.GetCount() == shared_it->contended);
+    REQUIRE(shared_it->contended <= thread_count*lock_count);
+
+    // A recursive mutex's hold time is recorded
+    // once it's fully unlocked
+    auto recursive_it = find_site("Test::recursive");
+    REQUIRE(recursive_it != list_stats.end());
+    REQUIRE(recursive_it->acquisitions == 2);
+    REQUIRE(recursive_it->hold_ns.GetCount() == 1);
+    REQUIRE(recursive_it->contended == 0);
+
+    // Sorted by total wait
+    for(size_t i=1; i < list_stats.size(); i++) {
+        REQUIRE(list_stats[i-1].wait_ns.sum >= list_stats[i].wait_ns.sum);
+    }
+
+    ResetLockSiteStats();
+    list_stats = GetLockSiteStats();
+    REQUIRE(find_site("Test::shared")->acquisitions == 0);
+    #else
+    REQUIRE(list_stats.empty());
+    #endif
+}
+
+// ============================================================= //
+// ============================================================= //
+
+template<typename Protocol>
+std::string ScrapeMetrics(typename Protocol::endpoint const &endpoint,
+                          std::string const &path)
+{
+    asio::io_service service;
+    typename Protocol::socket socket(service);
+
+    asio::error_code ec;
+    socket.connect(endpoint,ec);
+    if(ec) {
+        return "";
+    }
+
+    std::string const request =
+            "GET "+path+" HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    asio::write(socket,asio::buffer(request),ec);
+
+    // The exporter closes the connection after responding
+    asio::streambuf response;
+    asio::read(socket,response,ec);
+
+    return std::string(asio::buffers_begin(response.data()),
+                       asio::buffers_end(response.data()));
+}
+
+TEST_CASE("Metrics Exporter","[misc]")
+{
+    metrics::Counter counter;
+    counter.Add(42);
+    metrics::RegisterCounter("test_requests_total","Requests \\ handled",counter);
+
+    metrics::Histogram histogram;
+    histogram.Record(3);
+    histogram.Record(100);
+    metrics::RegisterHistogram("test_latency_ns","Request latency",histogram);
+
+    shared_ptr<EventLoop> event_loop = make_shared<EventLoop>();
+    std::thread thread = EventLoop::LaunchInThread(event_loop);
+
+    SECTION("Render")
+    {
+        std::string const text = RenderPrometheusMetrics();
+
+        REQUIRE(text.find("# HELP test_requests_total Requests \\\\ handled\n"
+                          "# TYPE test_requests_total counter\n"
+                          "test_requests_total 42\n") != std::string::npos);
+
+        // Buckets are cumulative and end with +Inf
+        REQUIRE(text.find("# TYPE test_latency_ns histogram\n") != std::string::npos);
+        REQUIRE(text.find("test_latency_ns_bucket{le=\"3\"} 1\n") != std::string::npos);
+        REQUIRE(text.find("test_latency_ns_bucket{le=\"127\"} 2\n") != std::string::npos);
+        REQUIRE(text.find("test_latency_ns_bucket{le=\"+Inf\"} 2\n") != std::string::npos);
+        REQUIRE(text.find("test_latency_ns_sum 103\n") != std::string::npos);
+        REQUIRE(text.find("test_latency_ns_count 2\n") != std::string::npos);
+
+        // Each family is only described once
+        std::string const loop_type = "# TYPE ks_event_loop_queue_depth gauge\n";
+        size_t const loop_pos = text.find(loop_type);
+        REQUIRE(loop_pos != std::string::npos);
+        REQUIRE(text.find(loop_type,loop_pos+1) == std::string::npos);
+        REQUIRE(text.find("ks_event_loop_queue_depth{loop=\""+
+                          ToString(event_loop->GetId())+"\"} ") != std::string::npos);
+
+        metrics::Unregister("test_requests_total");
+        REQUIRE(RenderPrometheusMetrics().find("test_requests_total") == std::string::npos);
+    }
+
+    SECTION("TCP")
+    {
+        MetricsExporter::Options options;
+        options.port = 0;
+
+        shared_ptr<MetricsExporter> exporter =
+                MakeObject<MetricsExporter>(event_loop,options);
+
+        REQUIRE(exporter->GetValid());
+        REQUIRE(exporter->GetPort() != 0);
+
+        asio::ip::tcp::endpoint const endpoint(
+                    asio::ip::address::from_string("127.0.0.1"),
+                    exporter->GetPort());
+
+        u64 const handled_before = event_loop->GetStats(false).events_handled;
+
+        std::string response = ScrapeMetrics<asio::ip::tcp>(endpoint,"/metrics");
+        REQUIRE(response.find("HTTP/1.1 200 OK\r\n") == 0);
+
+        // The accept and read are counted as handlers of the
+        // exporter's loop (the write may still be finishing)
+        REQUIRE(event_loop->GetStats(false).events_handled >= handled_before+2);
+        REQUIRE(response.find("Content-Type: text/plain; version=0.0.4") != std::string::npos);
+        REQUIRE(response.find("\r\n\r\n# HELP ") != std::string::npos);
+        REQUIRE(response.find("test_requests_total 42\n") != std::string::npos);
+
+        // Scrapes are served from the exporter's loop
+        // while it keeps running
+        counter.Add(1);
+        response = ScrapeMetrics<asio::ip::tcp>(endpoint,"/");
+        REQUIRE(response.find("test_requests_total 43\n") != std::string::npos);
+
+        response = ScrapeMetrics<asio::ip::tcp>(endpoint,"/other");
+        REQUIRE(response.find("HTTP/1.1 404 Not Found\r\n") == 0);
+
+        // The port is closed once the exporter is destroyed
+        exporter.reset();
+        event_loop->PostCallback([](){});
+        std::this_thread::sleep_for(Milliseconds(50));
+        REQUIRE(ScrapeMetrics<asio::ip::tcp>(endpoint,"/metrics").empty());
+    }
+
+    #ifdef KS_ENV_POSIX
+    SECTION("Unix socket")
+    {
+        std::string const socket_path = "ks_metrics_exporter_test.sock";
+
+        MetricsExporter::Options options;
+        options.unix_socket_path = socket_path;
+
+        shared_ptr<MetricsExporter> exporter =
+                MakeObject<MetricsExporter>(event_loop,options);
+
+        REQUIRE(exporter->GetValid());
+        REQUIRE(exporter->GetPort() == 0);
+
+        std::string const response =
+                ScrapeMetrics<asio::local::stream_protocol>(
+                    asio::local::stream_protocol::endpoint(socket_path),"/metrics");
+
+        REQUIRE(response.find("HTTP/1.1 200 OK\r\n") == 0);
+        REQUIRE(response.find("test_requests_total 42\n") != std::string::npos);
+
+        // The socket file is removed with the exporter
+        exporter.reset();
+        std::this_thread::sleep_for(Milliseconds(50));
+
+        struct stat socket_stat;
+        REQUIRE(stat(socket_path.c_str(),&socket_stat) != 0);
+
+        // A file that isn't a socket is left alone
+        std::string const file_path = "ks_metrics_exporter_test.txt";
+        {
+            std::ofstream ofs(file_path.c_str());
+            ofs << "data";
+        }
+
+        options.unix_socket_path = file_path;
+        exporter = MakeObject<MetricsExporter>(event_loop,options);
+        REQUIRE_FALSE(exporter->GetValid());
+
+        std::string contents;
+        REQUIRE(ReadFileIntoString(file_path,contents));
+        REQUIRE(contents == "data");
+
+        exporter.reset();
+        std::remove(file_path.c_str());
+    }
+    #endif
+
+    metrics::Unregister("test_requests_total");
+    metrics::Unregister("test_latency_ns");
+
+    EventLoop::RemoveFromThread(event_loop,thread,true);
+}
+
+// ============================================================= //
+// ============================================================= //
+
+bool CompressRoundTrip(std::string const &data)
+{
+    std::vector<u8> frame;
+    AppendFrameHeader(frame);
+    AppendFrameBlock(reinterpret_cast<u8 const*>(data.data()),
+                     data.size(),frame);
+
+    std::string out;
+    FrameDecoder decoder;
+    return decoder.Feed(frame.data(),frame.size(),out) &&
+            (decoder.GetPendingSize() == 0) &&
+            (out == data);
+}
+
+TEST_CASE("Compress","[compress]")
+{
+    REQUIRE(CompressRoundTrip(""));
+    REQUIRE(CompressRoundTrip("a"));
+    REQUIRE(CompressRoundTrip("0123456789abc"));
+    REQUIRE(CompressRoundTrip(std::string(100000,'x')));
+
+    // Empty input can come without a buffer
+    {
+        u8 empty_block[16];
+        REQUIRE(CompressBlock(nullptr,0,empty_block) == 1);
+
+        std::vector<u8> frame;
+        AppendFrameHeader(frame);
+        AppendFrameBlock(nullptr,0,frame);
+
+        std::string out;
+        FrameDecoder decoder;
+        REQUIRE(decoder.Feed(frame.data(),frame.size(),out));
+        REQUIRE(out.empty());
+    }
+
+    std::string text;
+    for(uint i=0; i < 2000; i++) {
+        text += "12:00:00.000: INFO:  KS: connection "+ToString(i%37)+
+                " received "+ToString(i*7)+" bytes\n";
+    }
+    REQUIRE(CompressRoundTrip(text));
+
+    // Log text should compress several fold
+    std::vector<u8> compressed(GetCompressBound(text.size()));
+    size_t const compressed_size =
+            CompressBlock(reinterpret_cast<u8 const*>(text.data()),
+                          text.size(),compressed.data());
+    REQUIRE(compressed_size < text.size()/4);
+
+    // Incompressible data is stored as is
+    std::string noise;
+    u32 state = 12345;
+    for(uint i=0; i < 10000; i++) {
+        state = state*1103515245u+12345u;
+        noise.push_back(static_cast<char>(state >> 24));
+    }
+    REQUIRE(CompressRoundTrip(noise));
+
+    // Frames fed in pieces decode every complete block,
+    // and a truncated final block is left pending
+    std::vector<u8> frame;
+    AppendFrameHeader(frame);
+    for(uint i=0; i < 4; i++) {
+        AppendFrameBlock(reinterpret_cast<u8 const*>(text.data()),
+                         text.size(),frame);
+    }
+    frame.resize(frame.size()-10);
+
+    std::string out;
+    FrameDecoder decoder;
+    for(size_t i=0; i < frame.size(); i += 1000) {
+        size_t const size = std::min(size_t(1000),frame.size()-i);
+        REQUIRE(decoder.Feed(&(frame[i]),size,out));
+    }
+    REQUIRE(out == text+text+text);
+    REQUIRE(decoder.GetPendingSize() > 0);
+
+    // Corruption is detected
+    std::vector<u8> corrupt;
+    AppendFrameHeader(corrupt);
+    AppendFrameBlock(reinterpret_cast<u8 const*>(text.data()),
+                     text.size(),corrupt);
+    corrupt[corrupt.size()/2] ^= 0x5A;
+
+    FrameDecoder corrupt_decoder;
+    out.clear();
+    REQUIRE_FALSE(corrupt_decoder.Feed(corrupt.data(),corrupt.size(),out));
+}
+
+// ============================================================= //
+
+TEST_CASE("MappedFile","[misc]")
+{
+    std::string const path = "ks_test_mapped_file.txt";
+
+    std::string expected;
+    for(uint i=0; i < 10000; i++) {
+        expected += "line "+ToString(i)+"\n";
+    }
+
+    {
+        std::ofstream ofs(path.c_str(),std::ios::binary);
+        ofs.write(expected.data(),expected.size());
+    }
+
+    MappedFile file(path);
+    REQUIRE(file.GetValid());
+    REQUIRE(std::string(file.data(),file.size()) == expected);
+
+    #ifdef KS_ENV_POSIX
+    REQUIRE(file.GetMapped());
+    #endif
+
+    // Moving keeps the view
+    MappedFile moved(std::move(file));
+    REQUIRE_FALSE(file.GetValid());
+    REQUIRE(file.size() == 0);
+    REQUIRE(moved.size() == expected.size());
+    REQUIRE(std::memcmp(moved.data(),expected.data(),expected.size()) == 0);
+
+    std::string contents;
+    REQUIRE(ReadFileIntoString(path,contents));
+    REQUIRE(contents == expected);
+
+    // Empty files give a valid, empty view
+    {
+        std::ofstream ofs(path.c_str(),std::ios::binary|std::ios::trunc);
+    }
+    REQUIRE(moved.Open(path,MappedFile::Advice::Random));
+    REQUIRE(moved.size() == 0);
+    REQUIRE(moved.data() != nullptr);
+
+    std::remove(path.c_str());
+    REQUIRE_FALSE(moved.Open(path));
+    REQUIRE_FALSE(ReadFileIntoString(path,contents));
+
+    #ifdef KS_ENV_LINUX
+    // Special files are read instead of mapped
+    REQUIRE(moved.Open("/proc/self/status"));
+    REQUIRE_FALSE(moved.GetMapped());
+    REQUIRE(moved.size() > 0);
+    #endif
+}
+
+// ============================================================= //
+
+std::vector<std::vector<std::string>> ReadAllRows(std::string const &text,
+                                                  char delimiter)
+{
+    DelimitedReader reader(text.data(),text.size(),delimiter);
+    std::vector<TextField> list_fields;
+    std::vector<std::vector<std::string>> list_rows;
+
+    while(reader.NextRow(list_fields)) {
+        list_rows.emplace_back();
+        for(auto const &field : list_fields) {
+            list_rows.back().emplace_back();
+            AppendUnquoted(field,list_rows.back().back());
+        }
+    }
+    return list_rows;
+}
+
+TEST_CASE("Delimited Text","[misc]")
+{
+    SECTION("Fields")
+    {
+        auto list_rows = ReadAllRows("a,b,c\n1,,3\n",',');
+        REQUIRE(list_rows.size() == 2);
+        REQUIRE(list_rows[0] == std::vector<std::string>({"a","b","c"}));
+        REQUIRE(list_rows[1] == std::vector<std::string>({"1","","3"}));
+
+        // Quoted fields, CRLF and no final newline
+        list_rows = ReadAllRows("\"x,y\",\"say \"\"hi\"\"\"\r\n"
+                                "\"two\nlines\"\tz\r\n"
+                                "last",',');
+        REQUIRE(list_rows.size() == 3);
+        REQUIRE(list_rows[0] == std::vector<std::string>({"x,y","say \"hi\""}));
+        REQUIRE(list_rows[1] == std::vector<std::string>({"two\nlines\"\tz"}));
+        REQUIRE(list_rows[2] == std::vector<std::string>({"last"}));
+
+        REQUIRE(ReadAllRows("",',').empty());
+    }
+
+    SECTION("Large input")
+    {
+        // Spans many SIMD blocks and index windows
+        std::vector<std::vector<std::string>> list_expected;
+        std::string text;
+        u64 seed = 12345;
+        for(uint i=0; i < 40000; i++) {
+            list_expected.emplace_back();
+            uint const field_count = 1+(i%7);
+            for(uint j=0; j < field_count; j++) {
+                seed = seed*6364136223846793005ull+1442695040888963407ull;
+                std::string field = ToString(seed >> (seed%64));
+                if(j%3 == 2) {
+                    field = "q\t\"\n"+field;
+                    text += "\"q\t\"\"\n"+ToString(seed >> (seed%64))+"\"";
+                }
+                else {
+                    text += field;
+                }
+                text += (j+1 < field_count) ? "\t" : "\n";
+                list_expected.back().push_back(field);
+            }
+        }
+
+        REQUIRE(text.size() > 2*256*1024);
+        REQUIRE(ReadAllRows(text,'\t') == list_expected);
+    }
+
+    SECTION("Number columns")
+    {
+        std::string const text = "1\t2.5\n-3\t1e3\n";
+        DelimitedReader reader(text.data(),text.size(),'\t');
+        std::vector<std::vector<double>> list_columns;
+        REQUIRE(ReadNumberColumns(reader,list_columns));
+        REQUIRE(list_columns.size() == 2);
+        REQUIRE(list_columns[0] == std::vector<double>({1,-3}));
+        REQUIRE(list_columns[1] == std::vector<double>({2.5,1000}));
+
+        std::string const bad = "1,2\n3,x\n";
+        DelimitedReader bad_reader(bad.data(),bad.size(),',');
+        std::vector<std::vector<s64>> list_int_columns;
+        REQUIRE_FALSE(ReadNumberColumns(bad_reader,list_int_columns));
+    }
+}
+
+// ============================================================= //
+
+TEST_CASE("FileStreamReader","[misc]")
+{
+    std::string const path = "ks_test_file_stream.bin";
+
+    std::string expected;
+    for(uint i=0; i < 50000; i++) {
+        expected += "chunk data "+ToString(i)+"\n";
+    }
+    {
+        std::ofstream ofs(path.c_str(),std::ios::binary);
+        ofs.write(expected.data(),expected.size());
+    }
+
+    shared_ptr<EventLoop> event_loop = make_shared<EventLoop>();
+    std::thread thread = EventLoop::LaunchInThread(event_loop);
+
+    FileStreamReader::Options options(path);
+    options.chunk_size = 4096;
+    options.max_chunks_ahead = 3;
+    shared_ptr<FileStreamReader> reader =
+            MakeObject<FileStreamReader>(event_loop,options);
+
+    // Chunks are held until released below
+    std::mutex mutex;
+    std::vector<shared_ptr<FileChunk const>> list_held;
+    std::string received;
+    bool finished = false;
+    bool finished_ok = false;
+    bool in_order = true;
+
+    reader->signal_chunk.Connect(
+                [&](shared_ptr<FileChunk const> chunk) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    in_order = in_order && (chunk->offset == received.size());
+                    received.append(chunk->data,chunk->size);
+                    list_held.push_back(chunk);
+                });
+
+    reader->signal_finished.Connect(
+                [&](bool ok) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished = true;
+                    finished_ok = ok;
+                });
+
+    REQUIRE(reader->Start());
+
+    // The reader can't get further ahead than
+    // max_chunks_ahead
+    std::this_thread::sleep_for(Milliseconds(100));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        REQUIRE(list_held.size() == 3);
+        list_held.clear();
+    }
+
+    // Released chunks let it continue
+    for(uint i=0; i < 500; i++) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            list_held.clear();
+            if(finished) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(Milliseconds(10));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        REQUIRE(finished);
+        REQUIRE(finished_ok);
+        REQUIRE(in_order);
+        REQUIRE(received == expected);
+    }
+
+    // Stopping mid-file drops pending chunks
+    REQUIRE(reader->Start());
+    reader->Stop();
+    reader = nullptr;
+
+    event_loop->PostStopEvent();
+    thread.join();
+    std::remove(path.c_str());
+
+    REQUIRE_FALSE(MakeObject<FileStreamReader>(
+                      event_loop,FileStreamReader::Options(path))->Start());
+}
+
+// ============================================================= //
+
+#ifdef KS_ENV_LINUX
+TEST_CASE("FileWatcher","[misc]")
+{
+    std::string const dir_path = "ks_test_watch";
+    std::string const file_path = dir_path+"/config.txt";
+    std::string const temp_path = dir_path+"/config.tmp";
+    mkdir(dir_path.c_str(),0755);
+
+    shared_ptr<EventLoop> event_loop = make_shared<EventLoop>();
+    std::thread thread = EventLoop::LaunchInThread(event_loop);
+
+    shared_ptr<FileWatcher> watcher =
+            MakeObject<FileWatcher>(event_loop,Milliseconds(50));
+
+    std::mutex mutex;
+    std::map<std::string,uint> list_counts;
+    watcher->signal_changed.Connect(
+                [&](std::string const &path) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    list_counts[path]++;
+                });
+
+    auto get_counts = [&]() {
+        std::this_thread::sleep_for(Milliseconds(250));
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string,uint> list_result;
+        list_result.swap(list_counts);
+        return list_result;
+    };
+
+    // The file doesn't exist yet
+    REQUIRE(watcher->AddPath(file_path));
+    REQUIRE(watcher->AddPath(dir_path));
+    REQUIRE_FALSE(watcher->AddPath("ks_test_missing_dir/file.txt"));
+
+    // A burst of writes is one change
+    {
+        std::ofstream ofs(file_path.c_str());
+        for(uint i=0; i < 20; i++) {
+            ofs << "line " << i << std::endl;
+        }
+    }
+
+    auto list_result = get_counts();
+    REQUIRE(list_result[file_path] == 1);
+    REQUIRE(list_result[dir_path] == 1);
+
+    // Replacing the file by rename
+    {
+        std::ofstream ofs(temp_path.c_str());
+        ofs << "replaced";
+    }
+    get_counts();
+    std::rename(temp_path.c_str(),file_path.c_str());
+
+    list_result = get_counts();
+    REQUIRE(list_result[file_path] == 1);
+
+    // Nothing changes while idle
+    REQUIRE(get_counts().empty());
+
+    watcher->RemovePath(file_path);
+    {
+        std::ofstream ofs(file_path.c_str(),std::ios::app);
+        ofs << "more";
+    }
+    list_result = get_counts();
+    REQUIRE(list_result.count(file_path) == 0);
+    REQUIRE(list_result[dir_path] == 1);
+
+    // A directory added again right after being removed
+    // isn't dropped by the old watch's IN_IGNORED
+    watcher->RemovePath(dir_path);
+    REQUIRE(watcher->AddPath(dir_path));
+    {
+        std::ofstream ofs(file_path.c_str(),std::ios::app);
+        ofs << "again";
+    }
+    list_result = get_counts();
+    REQUIRE(list_result[dir_path] == 1);
+
+    {
+        std::ofstream ofs(file_path.c_str(),std::ios::app);
+        ofs << "and again";
+    }
+    list_result = get_counts();
+    REQUIRE(list_result[dir_path] == 1);
+
+    watcher = nullptr;
+    event_loop->PostStopEvent();
+    thread.join();
+
+    std::remove(file_path.c_str());
+    rmdir(dir_path.c_str());
+}
+#endif
+
+// ============================================================= //
+
+#ifdef KS_ENV_POSIX
+TEST_CASE("Mapped File Sink","[log]")
+{
+    using Options = Log::SinkToMappedFile::Options;
+
+    std::string const path = "ks_test_mapped_file_sink.log";
+    for(uint i=0; i < 4; i++) {
+        std::remove((i==0) ? path.c_str() : (path+"."+ToString(i)).c_str());
+    }
+
+    Options options(path);
+    options.segment_size = 64;
+    options.max_rotated_files = 2;
+
+    std::string contents;
+
+    SECTION("Append and rotate")
+    {
+        {
+            Log::SinkToMappedFile sink(options);
+            REQUIRE(sink.GetValid());
+
+            sink.log("0123456789");     // 11 bytes
+            REQUIRE(sink.GetSize() == 11);
+            REQUIRE(ReadFileIntoString(path,contents));
+            REQUIRE(contents.size() == 64); // preallocated
+
+            for(uint i=0; i < 6; i++) {
+                sink.log("abcdefghi");  // 10 bytes each
+            }
+            // 11+50 fits, the sixth line rotates
+            REQUIRE(sink.GetSize() == 10);
+        }
+
+        // Closing drops the preallocated tail
+        REQUIRE(ReadFileIntoString(path,contents));
+        REQUIRE(contents == "abcdefghi\n");
+
+        REQUIRE(ReadFileIntoString(path+".1",contents));
+        REQUIRE(contents.size() == 61);
+        REQUIRE(contents.compare(0,11,"0123456789\n") == 0);
+    }
+
+    SECTION("Recover tail")
+    {
+        // Simulate a crash: a preallocated file with
+        // a line that was cut short
+        {
+            std::string crashed("line one\nline tw");
+            crashed.resize(64,'\0');
+            std::ofstream ofs(path.c_str(),std::ios::binary);
+            ofs.write(crashed.data(),crashed.size());
+        }
+
+        {
+            Log::SinkToMappedFile sink(options);
+            REQUIRE(sink.GetSize() == 17);
+            sink.log("line three");
+        }
+
+        REQUIRE(ReadFileIntoString(path,contents));
+        REQUIRE(contents == "line one\nline tw\nline three\n");
+    }
+
+    SECTION("Compress rotated files")
+    {
+        options.compress_rotated = true;
+        options.segment_size = 4096;
+
+        std::string expected;
+        {
+            Log::SinkToMappedFile sink(options);
+            REQUIRE(sink.GetRotatedPath(1) == path+".1.ksz");
+
+            for(uint i=0; i < 100; i++) {
+                std::string const line = "line number "+ToString(i);
+                sink.log(line);
+                expected += line+"\n";
+            }
+            sink.Rotate();
+            sink.WaitForCompression();
+        }
+
+        // The uncompressed copy is removed once
+        // it has been compressed
+        REQUIRE_FALSE(ReadFileIntoString(path+".1",contents));
+        REQUIRE(ReadFileIntoString(path+".1.ksz",contents));
+        REQUIRE(contents.size() < expected.size()/2);
+
+        std::string decompressed;
+        FrameDecoder decoder;
+        REQUIRE(decoder.Feed(reinterpret_cast<u8 const*>(contents.data()),
+                             contents.size(),decompressed));
+        REQUIRE(decoder.GetPendingSize() == 0);
+        REQUIRE(decompressed == expected);
+
+        for(uint i=1; i < 4; i++) {
+            std::remove((path+"."+ToString(i)+".ksz").c_str());
+        }
+    }
+
+    for(uint i=0; i < 4; i++) {
+        std::remove((i==0) ? path.c_str() : (path+"."+ToString(i)).c_str());
+    }
+}
+#endif
+
+#ifdef KS_ENV_POSIX
+TEST_CASE("File Sink","[log]")
+{
+    std::string const path = "ks_test_file_sink.log";
+    std::remove(path.c_str());
+
+    {
+        Log::SinkToFile sink(path);
+        REQUIRE(sink.GetValid());
+
+        // More lines than fit in a single writev call
+        std::vector<std::string> list_lines;
+        for(uint i=0; i < 1500; i++) {
+            list_lines.push_back(ToString(i%10));
+        }
+        sink.log_batch(list_lines.data(),list_lines.size());
+        sink.log("end");
+        sink.log_buffer("x\ny",3);
+    }
+
+    std::string contents;
+    REQUIRE(ReadFileIntoString(path,contents));
+    REQUIRE(contents.size() == 1500*2+4+4);
+    REQUIRE(contents.compare(0,6,"0\n1\n2\n") == 0);
+    REQUIRE(contents.compare(contents.size()-8,8,"end\nx\ny\n") == 0);
+
+    std::remove(path.c_str());
+}
+#endif
+
+// ============================================================= //
+// ============================================================= //
@@ -0,0 +1,181 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ks/KsFormat.hpp>
+#include <ks/KsGlobal.hpp>
+#include <ks/KsMiscUtils.hpp>
+
+// usage: ks_format_bench [iterations]
+// * compares the number formatting and parsing in KsFormat
+//   against the std::stringstream conversions they replace
+// * prints the time per conversion for each
+
+namespace
+{
+    // Keeps results alive so the work isn't optimized out
+    volatile std::size_t g_sink = 0;
+
+    double TimeNsPerOp(std::size_t iterations,
+                       std::size_t ops_per_iteration,
+                       std::function<void()> const &fn)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        for(std::size_t i=0; i < iterations; i++) {
+            fn();
+        }
+        auto const end = std::chrono::steady_clock::now();
+
+        double const ns = std::chrono::duration_cast<
+                std::chrono::nanoseconds>(end-begin).count();
+
+        return ns/static_cast<double>(iterations*ops_per_iteration);
+    }
+
+    void Compare(char const * name,
+                 std::size_t iterations,
+                 std::size_t ops_per_iteration,
+                 std::function<void()> const &stream_fn,
+                 std::function<void()> const &ks_fn)
+    {
+        double const stream_ns = TimeNsPerOp(iterations,ops_per_iteration,stream_fn);
+        double const ks_ns = TimeNsPerOp(iterations,ops_per_iteration,ks_fn);
+
+        std::printf("%-22s stream: %8.1f ns   ks: %8.1f ns   (%.1fx)\n",
+                    name,stream_ns,ks_ns,stream_ns/ks_ns);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    std::size_t iterations = 20000;
+    if(argc > 1) {
+        bool ok = false;
+        iterations = ks::ConvStringToNumber<std::size_t>(argv[1],&ok);
+        if(!ok || iterations == 0) {
+            std::fprintf(stderr,"ks_format_bench: invalid iteration count %s\n",argv[1]);
+            return 1;
+        }
+    }
+
+    std::vector<ks::s64> list_ints;
+    std::vector<double> list_doubles;
+    for(ks::s64 i=0; i < 64; i++) {
+        list_ints.push_back((i*i*7919)-(i*104729)+(i << (i%40)));
+        list_doubles.push_back((static_cast<double>(i)-31.5)*1234.56789/(i+1));
+    }
+
+    std::vector<std::string> list_int_strs;
+    std::vector<std::string> list_double_strs;
+    for(std::size_t i=0; i < list_ints.size(); i++) {
+        list_int_strs.push_back(ks::ToString(list_ints[i]));
+
+        char buff[ks::k_format_max_size];
+        list_double_strs.push_back(
+                    std::string(buff,ks::FormatFloatRoundTrip(buff,list_doubles[i])));
+    }
+
+    std::size_t const count = list_ints.size();
+
+    Compare("format integer",iterations,count,
+            [&]() {
+                for(ks::s64 val : list_ints) {
+                    std::ostringstream oss;
+                    oss << val;
+                    g_sink += oss.str().size();
+                }
+            },
+            [&]() {
+                for(ks::s64 val : list_ints) {
+                    char buff[ks::k_format_max_size];
+                    g_sink += static_cast<std::size_t>(ks::FormatInteger(buff,val)-buff);
+                }
+            });
+
+    Compare("format double (%g)",iterations,count,
+            [&]() {
+                for(double val : list_doubles) {
+                    std::ostringstream oss;
+                    oss << val;
+                    g_sink += oss.str().size();
+                }
+            },
+            [&]() {
+                for(double val : list_doubles) {
+                    char buff[ks::k_format_max_size];
+                    g_sink += static_cast<std::size_t>(ks::FormatFloat(buff,val)-buff);
+                }
+            });
+
+    Compare("format double (exact)",iterations,count,
+            [&]() {
+                for(double val : list_doubles) {
+                    std::ostringstream oss;
+                    oss.precision(17);
+                    oss << val;
+                    g_sink += oss.str().size();
+                }
+            },
+            [&]() {
+                for(double val : list_doubles) {
+                    char buff[ks::k_format_max_size];
+                    g_sink += static_cast<std::size_t>(
+                                ks::FormatFloatRoundTrip(buff,val)-buff);
+                }
+            });
+
+    Compare("parse integer",iterations,count,
+            [&]() {
+                for(std::string const &str : list_int_strs) {
+                    ks::s64 val = 0;
+                    std::istringstream iss(str);
+                    iss >> val;
+                    g_sink += static_cast<std::size_t>(val);
+                }
+            },
+            [&]() {
+                for(std::string const &str : list_int_strs) {
+                    ks::s64 val = 0;
+                    ks::ParseInteger(str.data(),str.data()+str.size(),val);
+                    g_sink += static_cast<std::size_t>(val);
+                }
+            });
+
+    Compare("parse double",iterations,count,
+            [&]() {
+                for(std::string const &str : list_double_strs) {
+                    double val = 0;
+                    std::istringstream iss(str);
+                    iss >> val;
+                    g_sink += static_cast<std::size_t>(val != 0);
+                }
+            },
+            [&]() {
+                for(std::string const &str : list_double_strs) {
+                    double val = 0;
+                    ks::ParseFloat(str.data(),str.data()+str.size(),val);
+                    g_sink += static_cast<std::size_t>(val != 0);
+                }
+            });
+
+    return 0;
+}
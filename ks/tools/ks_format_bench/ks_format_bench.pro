@@ -0,0 +1,14 @@
+# ks_format_bench
+# * compares KsFormat number conversions against
+#   std::stringstream
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+TARGET = ks_format_bench
+
+include($${PWD}/../../../ks_core.pri)
+
+SOURCES += \
+    $${PWD}/KsFormatBench.cpp
@@ -0,0 +1,126 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdio>
+#include <cstring>
+
+#include <ks/KsCompress.hpp>
+#include <ks/KsLogBinary.hpp>
+
+// usage: ks_log_decode [binary log file]
+// * reads from stdin if no file is given
+// * writes the rendered lines to stdout
+// * compressed files (ie rotated by SinkToMappedFile with
+//   compress_rotated set) are decompressed first; text
+//   logs are written out as is
+
+int main(int argc, char * argv[])
+{
+    std::FILE * file = stdin;
+    if(argc > 1 && std::strcmp(argv[1],"-") != 0) {
+        file = std::fopen(argv[1],"rb");
+        if(file == nullptr) {
+            std::fprintf(stderr,"ks_log_decode: could not open %s\n",argv[1]);
+            return 1;
+        }
+    }
+
+    ks::Log::BinaryDecoder decoder(
+                ks::make_shared<ks::Log::SinkToStdOut>());
+
+    ks::FrameDecoder frame_decoder;
+    std::string decompressed;
+
+    // The stream type is detected from its first bytes
+    enum class Stream {
+        Unknown,
+        Binary,
+        Compressed,
+        CompressedBinary,
+        CompressedText
+    };
+
+    Stream stream = Stream::Unknown;
+
+    std::vector<ks::u8> buffer(64*1024);
+    bool ok = true;
+
+    while(ok) {
+        size_t const read_size =
+                std::fread(&(buffer[0]),1,buffer.size(),file);
+
+        if(read_size == 0) {
+            break;
+        }
+
+        if(stream == Stream::Unknown) {
+            stream = (read_size >= 4 &&
+                      std::memcmp(&(buffer[0]),ks::frame_detail::k_magic,4) == 0) ?
+                        Stream::Compressed : Stream::Binary;
+        }
+
+        if(stream == Stream::Binary) {
+            ok = decoder.Feed(&(buffer[0]),read_size);
+            continue;
+        }
+
+        ok = frame_decoder.Feed(&(buffer[0]),read_size,decompressed);
+
+        if(ok && stream == Stream::Compressed && decompressed.size() >= 4) {
+            stream = (decompressed.compare(0,4,ks::Log::binary_detail::k_magic) == 0) ?
+                        Stream::CompressedBinary : Stream::CompressedText;
+        }
+
+        if(ok && stream == Stream::CompressedBinary) {
+            ok = decoder.Feed(reinterpret_cast<ks::u8 const*>(decompressed.data()),
+                              decompressed.size());
+            decompressed.clear();
+        }
+        else if(ok && stream == Stream::CompressedText) {
+            std::fwrite(decompressed.data(),1,decompressed.size(),stdout);
+            decompressed.clear();
+        }
+    }
+
+    if(ok && stream == Stream::Compressed) {
+        // Less than four bytes of data
+        std::fwrite(decompressed.data(),1,decompressed.size(),stdout);
+    }
+
+    if(file != stdin) {
+        std::fclose(file);
+    }
+
+    if(!ok) {
+        std::fprintf(stderr,"ks_log_decode: malformed log stream\n");
+        return 1;
+    }
+
+    if(frame_decoder.GetPendingSize() > 0) {
+        // A partially written compressed file
+        std::fprintf(stderr,"ks_log_decode: ignored %zu trailing compressed bytes\n",
+                     frame_decoder.GetPendingSize());
+    }
+
+    if(decoder.GetPendingSize() > 0) {
+        // A truncated final record is expected if the
+        // writer didn't shut down cleanly
+        std::fprintf(stderr,"ks_log_decode: ignored %zu trailing bytes\n",
+                     decoder.GetPendingSize());
+    }
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+# ks_log_decode
+# * renders binary logs written by ks::Log::BinaryLogger as text
+# * decompresses rotated log files (.ksz)
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+TARGET = ks_log_decode
+
+include($${PWD}/../../../ks_core.pri)
+
+SOURCES += \
+    $${PWD}/KsLogDecode.cpp
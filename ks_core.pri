@@ -3,28 +3,70 @@ INCLUDEPATH += $${PWD}
 # ks
 PATH_KS_CORE = $${PWD}/ks
 
+# Uncomment to profile contention on ks's own
+# mutexes (see KsMutex.hpp)
+# DEFINES += KS_PROFILE_LOCKS
+
 # core
 HEADERS += \
     $${PATH_KS_CORE}/KsConfig.hpp \
     $${PATH_KS_CORE}/KsGlobal.hpp \
+    $${PATH_KS_CORE}/KsFormat.hpp \
+    $${PATH_KS_CORE}/KsFastClock.hpp \
+    $${PATH_KS_CORE}/KsCompress.hpp \
+    $${PATH_KS_CORE}/KsDelimitedText.hpp \
     $${PATH_KS_CORE}/KsLog.hpp \
+    $${PATH_KS_CORE}/KsLogBinary.hpp \
+    $${PATH_KS_CORE}/KsLogCategory.hpp \
+    $${PATH_KS_CORE}/KsLogFlightRecorder.hpp \
+    $${PATH_KS_CORE}/KsLogLimit.hpp \
+    $${PATH_KS_CORE}/KsLogFileSink.hpp \
     $${PATH_KS_CORE}/KsException.hpp \
+    $${PATH_KS_CORE}/KsMappedFile.hpp \
+    $${PATH_KS_CORE}/KsMemoryStats.hpp \
+    $${PATH_KS_CORE}/KsMetrics.hpp \
+    $${PATH_KS_CORE}/KsMetricsExporter.hpp \
     $${PATH_KS_CORE}/KsMiscUtils.hpp \
+    $${PATH_KS_CORE}/KsMutex.hpp \
     $${PATH_KS_CORE}/KsEvent.hpp \
     $${PATH_KS_CORE}/KsTask.hpp \
     $${PATH_KS_CORE}/KsEventLoop.hpp \
+    $${PATH_KS_CORE}/KsEventLoopWatchdog.hpp \
+    $${PATH_KS_CORE}/KsIntrospect.hpp \
     $${PATH_KS_CORE}/KsObject.hpp \
     $${PATH_KS_CORE}/KsSignal.hpp \
-    $${PATH_KS_CORE}/KsTimer.hpp
+    $${PATH_KS_CORE}/KsTimer.hpp \
+    $${PATH_KS_CORE}/KsTrace.hpp \
+    $${PATH_KS_CORE}/KsFileStreamReader.hpp \
+    $${PATH_KS_CORE}/KsFileWatcher.hpp
 
 SOURCES += \
+    $${PATH_KS_CORE}/KsFormat.cpp \
+    $${PATH_KS_CORE}/KsFastClock.cpp \
+    $${PATH_KS_CORE}/KsCompress.cpp \
+    $${PATH_KS_CORE}/KsDelimitedText.cpp \
     $${PATH_KS_CORE}/KsLog.cpp \
+    $${PATH_KS_CORE}/KsLogBinary.cpp \
+    $${PATH_KS_CORE}/KsLogCategory.cpp \
+    $${PATH_KS_CORE}/KsLogFlightRecorder.cpp \
+    $${PATH_KS_CORE}/KsLogLimit.cpp \
+    $${PATH_KS_CORE}/KsLogFileSink.cpp \
     $${PATH_KS_CORE}/KsException.cpp \
+    $${PATH_KS_CORE}/KsMappedFile.cpp \
+    $${PATH_KS_CORE}/KsMemoryStats.cpp \
+    $${PATH_KS_CORE}/KsMetrics.cpp \
+    $${PATH_KS_CORE}/KsMetricsExporter.cpp \
+    $${PATH_KS_CORE}/KsMutex.cpp \
     $${PATH_KS_CORE}/KsTask.cpp \
     $${PATH_KS_CORE}/KsEventLoop.cpp \
+    $${PATH_KS_CORE}/KsEventLoopWatchdog.cpp \
+    $${PATH_KS_CORE}/KsIntrospect.cpp \
     $${PATH_KS_CORE}/KsObject.cpp \
     $${PATH_KS_CORE}/KsSignal.cpp \
-    $${PATH_KS_CORE}/KsTimer.cpp
+    $${PATH_KS_CORE}/KsTimer.cpp \
+    $${PATH_KS_CORE}/KsTrace.cpp \
+    $${PATH_KS_CORE}/KsFileStreamReader.cpp \
+    $${PATH_KS_CORE}/KsFileWatcher.cpp
 
 # thirdparty
 include($${PATH_KS_CORE}/thirdparty/asio/asio.pri)
@@ -34,5 +76,10 @@ include($${PATH_KS_CORE}/thirdparty/asio/asio.pri)
     LIBS += -lpthread
 }
 
+# dladdr, used to symbolize exception stack traces
+linux:!android {
+    LIBS += -ldl
+}
+
 QMAKE_CXXFLAGS += -std=c++11
 